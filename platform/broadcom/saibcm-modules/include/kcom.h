@@ -51,10 +51,13 @@
 #define KCOM_M_NETIF_DESTROY    12 /* Destroy network interface */
 #define KCOM_M_NETIF_LIST       13 /* Get list of network interface IDs */
 #define KCOM_M_NETIF_GET        14 /* Get network interface info */
+#define KCOM_M_NETIF_CREATE_BATCH 15 /* Create network interfaces */
 #define KCOM_M_FILTER_CREATE    21 /* Create Rx filter */
 #define KCOM_M_FILTER_DESTROY   22 /* Destroy Rx filter */
 #define KCOM_M_FILTER_LIST      23 /* Get list of Rx filter IDs */
 #define KCOM_M_FILTER_GET       24 /* Get Rx filter info */
+#define KCOM_M_FILTER_CREATE_BATCH 25 /* Create Rx filters */
+#define KCOM_M_FILTER_DESTROY_BATCH 26 /* Destroy Rx filters */
 #define KCOM_M_DMA_INFO         31 /* Tx/Rx DMA info */
 #define KCOM_M_DBGPKT_SET       41 /* Enbale debug packet function */
 #define KCOM_M_DBGPKT_GET       42 /* Get debug packet function info */
@@ -503,6 +506,65 @@ typedef struct kcom_msg_filter_get_s {
     kcom_filter_t filter;
 } kcom_msg_filter_get_t;
 
+/*
+ * Batch messages
+ *
+ * Create or destroy several objects with a single message. Entries
+ * are applied in order and each entry returns its own status, the
+ * header status is only set if the message as a whole is invalid.
+ * The message length must cover <cnt> entries, use KCOM_MSG_BATCH_LEN
+ * to size it. A kernel module which does not support these opcodes
+ * returns a header with opcode KCOM_M_NONE if the message fits in
+ * kcom_msg_t, and fails the device IOCTL with -EINVAL if it does not.
+ * Either way objects should be created one message at a time.
+ *
+ * A message can be larger than kcom_msg_t when sent through the
+ * device IOCTL, but never larger than KCOM_MSG_BATCH_BYTES_MAX.
+ * Batch messages are not members of kcom_msg_t, so its size and
+ * thereby the message size of existing SDK builds is unchanged.
+ */
+#define KCOM_BATCH_MAX          256
+#define KCOM_MSG_BATCH_BYTES_MAX (64 * 1024)
+
+#define KCOM_MSG_BATCH_LEN(_m, _cnt) \
+    (sizeof(*(_m)) + ((_cnt) - 1) * sizeof((_m)->entry[0]))
+
+typedef struct kcom_netif_batch_entry_s {
+    uint8 status;
+    uint8 reserved[3];
+    kcom_netif_t netif;
+} kcom_netif_batch_entry_t;
+
+typedef struct kcom_msg_netif_create_batch_s {
+    kcom_msg_hdr_t hdr;
+    uint32 cnt;
+    kcom_netif_batch_entry_t entry[1];
+} kcom_msg_netif_create_batch_t;
+
+typedef struct kcom_filter_batch_entry_s {
+    uint8 status;
+    uint8 reserved[3];
+    kcom_filter_t filter;
+} kcom_filter_batch_entry_t;
+
+typedef struct kcom_msg_filter_create_batch_s {
+    kcom_msg_hdr_t hdr;
+    uint32 cnt;
+    kcom_filter_batch_entry_t entry[1];
+} kcom_msg_filter_create_batch_t;
+
+typedef struct kcom_filter_id_batch_entry_s {
+    uint16 id;
+    uint8 status;
+    uint8 reserved;
+} kcom_filter_id_batch_entry_t;
+
+typedef struct kcom_msg_filter_destroy_batch_s {
+    kcom_msg_hdr_t hdr;
+    uint32 cnt;
+    kcom_filter_id_batch_entry_t entry[1];
+} kcom_msg_filter_destroy_batch_t;
+
 /*
  * DMA info
  */
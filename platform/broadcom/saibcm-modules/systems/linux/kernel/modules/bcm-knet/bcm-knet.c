@@ -72,9 +72,13 @@
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/ethtool.h>
+#include <linux/rtnetlink.h>
 #include <linux/random.h>
 #include <linux/seq_file.h>
 #include <linux/if_vlan.h>
+#include <linux/jhash.h>
+#include <linux/rcupdate.h>
+#include <linux/hrtimer.h>
 
 
 MODULE_AUTHOR("Broadcom Corporation");
@@ -96,6 +100,16 @@ LKM_MOD_PARAM(rx_buffer_size, "i", int, 0);
 MODULE_PARM_DESC(rx_buffer_size,
 "Size of RX packet buffers (default 9216)");
 
+static int rx_page_pool = 0;
+LKM_MOD_PARAM(rx_page_pool, "i", int, 0);
+MODULE_PARM_DESC(rx_page_pool,
+"Recycle DMA-mapped RX packet buffers through a page pool, requires use_napi (default 0)");
+
+static int rx_latency = 0;
+LKM_MOD_PARAM(rx_latency, "i", int, 0);
+MODULE_PARM_DESC(rx_latency,
+"Record interrupt to Rx poll and netif latency histograms (default 0)");
+
 static int default_mtu = 1500;
 LKM_MOD_PARAM(default_mtu, "i", int, 0);
 MODULE_PARM_DESC(default_mtu,
@@ -161,6 +175,23 @@ LKM_MOD_PARAM_ARRAY(rx_burst, "1-4i", int, NULL, 0);
 MODULE_PARM_DESC(rx_burst,
 "Rx rate burst maximum in packets (default rx_rate/10)");
 
+/* Rx rate control timer runs in softirq context where supported */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,16,0)
+#define BKN_HRTIMER_MODE_ABS HRTIMER_MODE_ABS_SOFT
+#else
+#define BKN_HRTIMER_MODE_ABS HRTIMER_MODE_ABS
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,13,0)
+#define bkn_hrtimer_setup(_t, _f) \
+    hrtimer_setup(_t, _f, CLOCK_MONOTONIC, BKN_HRTIMER_MODE_ABS)
+#else
+#define bkn_hrtimer_setup(_t, _f) \
+    do { \
+        hrtimer_init(_t, CLOCK_MONOTONIC, BKN_HRTIMER_MODE_ABS); \
+        (_t)->function = _f; \
+    } while (0)
+#endif
+
 static int check_rcpu_signature = 0;
 LKM_MOD_PARAM(check_rcpu_signature, "i", int, 0);
 MODULE_PARM_DESC(check_rcpu_signature,
@@ -171,6 +202,11 @@ LKM_MOD_PARAM(basedev_suspend, "i", int, 0);
 MODULE_PARM_DESC(basedev_suspend,
 "Pause traffic till base device is up (enabled by default in NAPI mode)");
 
+static int rx_filter_hash = 1;
+LKM_MOD_PARAM(rx_filter_hash, "i", int, 0);
+MODULE_PARM_DESC(rx_filter_hash,
+"Look up Rx filters by hash of their match data (default 1)");
+
 /* Debug levels */
 #define DBG_LVL_VERB    0x1
 #define DBG_LVL_DCB     0x2
@@ -241,6 +277,16 @@ LKM_MOD_PARAM(napi_weight, "i", int, 0);
 MODULE_PARM_DESC(napi_weight,
 "Weight of NAPI interfaces (default 64)");
 
+static int use_napi_gro = 0;
+LKM_MOD_PARAM(use_napi_gro, "i", int, 0);
+MODULE_PARM_DESC(use_napi_gro,
+"Pass Rx packets to GRO in NAPI mode (default 0)");
+
+static int napi_per_chan = 0;
+LKM_MOD_PARAM(napi_per_chan, "i", int, 0);
+MODULE_PARM_DESC(napi_per_chan,
+"Use one NAPI instance per Rx DMA channel on CMICx devices (default 0)");
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,24)
 #define bkn_napi_enable(_dev, _napi) netif_poll_enable(_dev)
 #define bkn_napi_disable(_dev, _napi) netif_poll_disable(_dev)
@@ -248,6 +294,7 @@ MODULE_PARM_DESC(napi_weight,
 #define bkn_napi_schedule_prep(_dev, _napi) netif_rx_schedule_prep(_dev)
 #define __bkn_napi_schedule(_dev, _napi) __netif_rx_schedule(_dev)
 #define bkn_napi_complete(_dev, _napi) netif_rx_complete(_dev)
+#define bkn_napi_complete_done(_dev, _napi, _work) netif_rx_complete(_dev)
 #else
 #define bkn_napi_enable(_dev, _napi) napi_enable(_napi)
 #define bkn_napi_disable(_dev, _napi) napi_disable(_napi)
@@ -255,12 +302,29 @@ MODULE_PARM_DESC(napi_weight,
 #define bkn_napi_schedule_prep(_dev, _napi) napi_schedule_prep(_napi)
 #define __bkn_napi_schedule(_dev, _napi) __napi_schedule(_napi)
 #define bkn_napi_complete(_dev, _napi) napi_complete(_napi)
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,1,0)
+#define bkn_napi_complete_done(_dev, _napi, _work) napi_complete(_napi)
+#else
+#define bkn_napi_complete_done(_dev, _napi, _work) napi_complete_done(_napi, _work)
+#endif
+#endif
+
+/* GRO delivery is supported on kernels 3.0 and later */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,0,0)
+#define BKN_NAPI_GRO_SUPPORT 1
+#endif
+
+/* Per-channel NAPI instances require struct napi_struct */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,24)
+#define BKN_NAPI_PER_CHAN_SUPPORT 1
 #endif
 
 #else
 
 static int use_napi = 0;
 static int napi_weight = 0;
+static int use_napi_gro = 0;
+static int napi_per_chan = 0;
 
 #define bkn_napi_enable(_dev, _napi)
 #define bkn_napi_disable(_dev, _napi)
@@ -268,6 +332,7 @@ static int napi_weight = 0;
 #define bkn_napi_schedule_prep(_dev, _napi) (0)
 #define __bkn_napi_schedule(_dev, _napi)
 #define bkn_napi_complete(_dev, _napi)
+#define bkn_napi_complete_done(_dev, _napi, _work)
 
 #endif
 
@@ -323,6 +388,18 @@ struct napi_struct { int not_used; };
 } while(0)
 #endif
 
+#ifndef __rcu
+#define __rcu
+#endif
+
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0))
+#define bkn_netdev_xmit_more(_skb) netdev_xmit_more()
+#elif (LINUX_VERSION_CODE >= KERNEL_VERSION(3,18,0))
+#define bkn_netdev_xmit_more(_skb) ((_skb)->xmit_more)
+#else
+#define bkn_netdev_xmit_more(_skb) (0)
+#endif
+
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(2,6,18))
 #define SKB_PADTO(_skb,_len) (((_skb = skb_padto(_skb,_len)) == NULL) ? -1 : 0)
 #else
@@ -483,6 +560,62 @@ static inline void bkn_skb_tx_timestamp(struct sk_buff *skb)
 #define DMA_MAPPING_ERROR(d,a)          bkn_pci_dma_mapping_error(d,a)
 #endif
 
+/* Rx page pool needs a DMA device and SKB recycling (kernel 5.15) */
+#if defined(LINUX_BDE_DMA_DEVICE_SUPPORT) && \
+    (LINUX_VERSION_CODE >= KERNEL_VERSION(5,15,0))
+#define BKN_PAGE_POOL_SUPPORT 1
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,6,0)
+#include <net/page_pool/helpers.h>
+#else
+#include <net/page_pool.h>
+#endif
+#endif
+
+/* Per-CPU 64-bit netif counters (kernel 3.15) */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,15,0)
+#define BKN_PCPU_STATS_SUPPORT 1
+#include <linux/u64_stats_sync.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+#define bkn_u64_stats_fetch_begin(_s) u64_stats_fetch_begin(_s)
+#define bkn_u64_stats_fetch_retry(_s, _start) u64_stats_fetch_retry(_s, _start)
+#else
+#define bkn_u64_stats_fetch_begin(_s) u64_stats_fetch_begin_irq(_s)
+#define bkn_u64_stats_fetch_retry(_s, _start) u64_stats_fetch_retry_irq(_s, _start)
+#endif
+#endif
+
+/* Binary counter dump over generic netlink (kernel 4.10) */
+#if defined(BKN_PCPU_STATS_SUPPORT) && \
+    (LINUX_VERSION_CODE >= KERNEL_VERSION(4,10,0))
+#define BKN_GENL_STATS_SUPPORT 1
+#include <net/genetlink.h>
+#endif
+
+/* Rx/Tx tracepoints (kernel 3.10) */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
+#define BKN_TRACE_SUPPORT 1
+#define CREATE_TRACE_POINTS
+#include <trace/events/bcm_knet.h>
+#else
+#define trace_bkn_rx_desc(_u, _c, _i, _l)
+#define trace_bkn_rx_filter(_u, _c, _f, _dt, _di, _l)
+#define trace_bkn_rx_netif(_u, _c, _i, _l, _t)
+#define trace_bkn_tx_doorbell(_u, _i, _p)
+#endif
+
+/*
+ * Latency histogram, bucket 0 counts samples below 1 usec and
+ * bucket n samples from 2^(n-1) usec to 2^n usec. The last bucket
+ * also counts anything longer.
+ */
+#define BKN_LAT_BUCKETS         20
+
+typedef struct bkn_lat_hist_s {
+    uint32_t bucket[BKN_LAT_BUCKETS];
+    uint32_t samples;
+    uint32_t max_us;
+} bkn_lat_hist_t;
+
 /* RCPU operations */
 #define RCPU_OPCODE_RX          0x10
 #define RCPU_OPCODE_TX          0x20
@@ -498,6 +631,8 @@ static inline void bkn_skb_tx_timestamp(struct sk_buff *skb)
 #define RCPU_RX_ENCAP_SIZE      (RCPU_HDR_SIZE + RCPU_RX_META_SIZE)
 
 #define PKT_TX_HDR_SIZE         16
+/* Tx headroom asked of the stack: system headers (up to 27 bytes on DNX) or Tx header, plus a VLAN tag */
+#define BKN_TX_HEADROOM         32
 
 static volatile int module_initialized;
 
@@ -524,11 +659,21 @@ typedef struct bkn_dcb_chain_s {
 #define MAX_TX_DCBS 64
 #define MAX_RX_DCBS 64
 
+/* Largest DCB supported, Tx DCBs are prepared on the stack */
+#define BKN_DCB_WSIZE_MAX 32
+
 #define NUM_DMA_CHAN 8
 #define NUM_RX_CHAN 7
 #define NUM_CMICX_RX_CHAN 7
 #define NUM_CMICM_RX_CHAN 3
 
+/* Rx channel NAPI instance (napi_per_chan) */
+typedef struct bkn_rx_napi_s {
+    struct napi_struct napi;
+    struct bkn_switch_info_s *sinfo;
+    int chan;
+} bkn_rx_napi_t;
+
 #define FCS_SZ 4
 #define TAG_SZ 4
 
@@ -539,6 +684,7 @@ typedef struct bkn_switch_info_s {
     struct net_device **ndevs;  /* Indexed array of ndev_list */
     int ndev_max;               /* Size of indexed array */
     struct list_head rxpf_list; /* Associated Rx packet filters */
+    struct bkn_rxpf_cls_s __rcu *rxpf_cls; /* Rx packet filter classifier */
     volatile void *base_addr;   /* Base address for PCI register access */
     struct DMA_DEV *dma_dev;    /* Required for DMA memory control */
     struct pci_dev *pdev;       /* Required for DMA memory control */
@@ -547,11 +693,13 @@ typedef struct bkn_switch_info_s {
     struct timer_list timer;    /* Retry/resource timer */
     int timer_queued;           /* Flag indicating queued timer function */
     uint32_t timer_runs;        /* Timer function runs (debug only) */
-    struct timer_list rxtick;   /* Rx rate control timer */
-    uint32_t rxticks_per_sec;   /* Rx rate control update frequency */
-    uint32_t rxtick_jiffies;    /* Time between updates (in jiffies) */
+    struct hrtimer rxtick;      /* Rx rate control restart timer */
     uint32_t rxticks;           /* Rx rate control debug counter */
     uint32_t interrupts;        /* Total number of interrupts */
+    u64 isr_ns;                 /* Time of last interrupt (ns) */
+    int isr_poll_pending;       /* No Rx poll since last interrupt */
+    bkn_lat_hist_t lat_poll;    /* Interrupt to Rx poll latency */
+    bkn_lat_hist_t lat_netif;   /* Interrupt to netif delivery latency */
     spinlock_t lock;            /* Main lock for device */
     int dev_no;                 /* Device number (from BDE) */
     int cpu_no;                 /* Cpu number. 1 for iHost(AXI),0 for others */
@@ -571,6 +719,8 @@ typedef struct bkn_switch_info_s {
     uint32_t napi_poll_mode;    /* NAPI is in polling mode */
     uint32_t napi_not_done;     /* NAPI poll did not process all packets */
     uint32_t napi_poll_again;   /* Used if DCB chain is restarted */
+    int napi_per_chan;          /* Rx channels polled by own NAPI instances */
+    uint32_t irq_poll_mask;     /* IRQs disabled while NAPI instances poll */
     uint32_t tx_yield;          /* Tx schedule for Continuous DMA and Non-NAPI mode */
     void *dcb_mem;              /* Logical pointer to DCB memory */
     uint64_t dcb_dma;           /* Physical bus address for DCB memory */
@@ -593,6 +743,7 @@ typedef struct bkn_switch_info_s {
         int cur;                /* Index of current Tx DCB */
         int dirty;              /* Index of next Tx DCB to complete */
         int api_active;         /* BCM Tx API is in progress */
+        int goto_pending;       /* Continuous DMA halt location not moved yet */
         int suspends;           /* Calls to netif_stop_queue (debug only) */
         struct list_head api_dcb_list; /* Tx DCB chains from BCM Tx API */
         bkn_dcb_chain_t *api_dcb_chain; /* Current Tx DCB chain */
@@ -620,21 +771,32 @@ typedef struct bkn_switch_info_s {
         int sync_retry;         /* Total retry times for sync error (debug) */
         int sync_maxloop;       /* Max loop times once in recovering sync (debug) */
         int use_rx_skb;         /* Use SKBs for DMA */
+        bkn_rx_napi_t napi;     /* Channel NAPI instance (napi_per_chan) */
+        int napi_poll_again;    /* Channel NAPI used if DCB chain is restarted */
+#ifdef BKN_PAGE_POOL_SUPPORT
+        struct page_pool *page_pool; /* Recycled Rx buffers (rx_page_pool) */
+        struct page *pp_spare;  /* Page pool page left over by SKB build failure */
+        int pp_order;           /* Page pool page order */
+#endif
         uint32_t rate_max;      /* Rx rate in packets/sec */
         uint32_t burst_max;     /* Rx burst size in number of packets */
         uint32_t tokens;        /* Tokens for Rx rate control */
         uint32_t rate;          /* Current packet rate */
-        unsigned long tok_jif;  /* Jiffies at last token update */
+        u64 tok_ns;             /* Time of last token update (ns) */
         unsigned long rate_jif; /* Jiffies at last rate update */
         struct list_head api_dcb_list; /* Rx DCB chains from BCM Rx API */
         bkn_dcb_chain_t *api_dcb_chain; /* Current Rx DCB chain */
         bkn_dcb_chain_t *api_dcb_chain_end; /* Rx DCB chain end */
         uint32_t pkts;              /* Rx packet counter */
         uint32_t pkts_ref;          /* Rx packet count for rate calculation */
+        uint32_t pp_allocs;         /* Rx buffers taken from page pool */
+        uint32_t pp_fails;          /* Rx buffers the page pool could not provide */
         uint32_t pkts_f_api;        /* Rx packets filtered to API */
         uint32_t pkts_f_netif;      /* Rx packets filtered to net interface */
         uint32_t pkts_m_api;        /* Rx packets mirrored to API */
         uint32_t pkts_m_netif;      /* Rx packets mirrored to net interface */
+        uint32_t pkts_gro;          /* Rx packets passed to GRO */
+        uint32_t pkts_gro_merged;   /* Rx packets merged by GRO */
         uint32_t pkts_d_no_skb;     /* Rx drop - skb allocation failed */
         uint32_t pkts_d_no_match;   /* Rx drop - no matching filters */
         uint32_t pkts_d_unkn_netif; /* Rx drop - unknown net interface ID */
@@ -642,6 +804,7 @@ typedef struct bkn_switch_info_s {
         uint32_t pkts_d_callback;   /* Rx drop - consumed by call-back */
         uint32_t pkts_d_no_link;    /* Rx drop - software link down */
         uint32_t pkts_d_no_api_buf; /* Rx drop - no API buffers */
+        uint32_t pkts_d_rate;       /* Rx drop - netif rate exceeded */
     } rx[NUM_RX_CHAN];
 } bkn_switch_info_t;
 
@@ -870,9 +1033,58 @@ static u8 bkn_rcpu_smac[6];
 /* Driver Proc Entry root */
 static struct proc_dir_entry *bkn_proc_root = NULL;
 
+#ifdef BKN_PCPU_STATS_SUPPORT
+/*
+ * Netif counters, updated locklessly on the local CPU. Rx and Tx
+ * counters have separate sequence counters since Rx may interrupt Tx.
+ */
+typedef struct bkn_pcpu_stats_s {
+    u64 rx_packets;
+    u64 rx_bytes;
+    u64 rx_errors;
+    u64 rx_dropped;
+    struct u64_stats_sync rx_syncp;
+    u64 tx_packets;
+    u64 tx_bytes;
+    u64 tx_dropped;
+    struct u64_stats_sync tx_syncp;
+} bkn_pcpu_stats_t;
+
+#define BKN_NETIF_STATS_INC(_priv, _dir, _field)                        \
+    do {                                                                \
+        bkn_pcpu_stats_t *_ps = get_cpu_ptr((_priv)->pcpu_stats);       \
+        u64_stats_update_begin(&_ps->_dir##_syncp);                     \
+        _ps->_dir##_##_field++;                                         \
+        u64_stats_update_end(&_ps->_dir##_syncp);                       \
+        put_cpu_ptr((_priv)->pcpu_stats);                               \
+    } while (0)
+
+#define BKN_NETIF_STATS_PKT(_priv, _dir, _len)                          \
+    do {                                                                \
+        bkn_pcpu_stats_t *_ps = get_cpu_ptr((_priv)->pcpu_stats);       \
+        u64_stats_update_begin(&_ps->_dir##_syncp);                     \
+        _ps->_dir##_packets++;                                          \
+        _ps->_dir##_bytes += (_len);                                    \
+        u64_stats_update_end(&_ps->_dir##_syncp);                       \
+        put_cpu_ptr((_priv)->pcpu_stats);                               \
+    } while (0)
+#else
+#define BKN_NETIF_STATS_INC(_priv, _dir, _field)                        \
+    ((_priv)->stats._dir##_##_field++)
+
+#define BKN_NETIF_STATS_PKT(_priv, _dir, _len)                          \
+    do {                                                                \
+        (_priv)->stats._dir##_packets++;                                \
+        (_priv)->stats._dir##_bytes += (_len);                          \
+    } while (0)
+#endif
+
 typedef struct bkn_priv_s {
     struct list_head list;
     struct net_device_stats stats;
+#ifdef BKN_PCPU_STATS_SUPPORT
+    bkn_pcpu_stats_t __percpu *pcpu_stats;
+#endif
     struct net_device *dev;
     bkn_switch_info_t *sinfo;
     int id;
@@ -885,15 +1097,62 @@ typedef struct bkn_priv_s {
     uint32_t cb_user_data;
     uint8_t system_headers[27];
     uint32_t system_headers_size;
+    uint32_t rate_max;          /* Rx rate in packets/sec, 0 is unlimited */
+    uint32_t burst_max;         /* Rx burst size in number of packets */
+    uint32_t tokens;            /* Tokens for Rx rate control */
+    u64 tok_ns;                 /* Time of last token update (ns) */
 } bkn_priv_t;
 
 typedef struct bkn_filter_s {
     struct list_head list;
     int dev_no;
     unsigned long hits;
+    struct rcu_head rcu;
     kcom_filter_t kf;
 } bkn_filter_t;
 
+/*
+ * Rx packet filter classifier
+ *
+ * Filters with the same match shape (OOB and packet data offsets,
+ * sizes and mask) form a group, which is looked up by a hash of the
+ * masked match data. An Rx packet thus costs one lookup per group
+ * instead of one compare per filter. Filters of a group with equal
+ * match data are chained in rxpf_list order, and the candidates of
+ * all groups are tried in that order, so the first filter to match
+ * is the same as in a walk of rxpf_list.
+ *
+ * The classifier is rebuilt whenever a filter is created or destroyed
+ * and published with RCU, so lookups do not take any lock.
+ */
+#define BKN_RXPF_GROUPS_MAX 32
+
+typedef struct bkn_rxpf_node_s {
+    struct bkn_rxpf_node_s *next;   /* Next node in hash bucket */
+    struct bkn_rxpf_node_s *dup;    /* Next filter with same match data */
+    bkn_filter_t *filter;
+    int order;                      /* Position of filter in rxpf_list */
+} bkn_rxpf_node_t;
+
+typedef struct bkn_rxpf_group_s {
+    int oob_data_offset;
+    int oob_data_size;
+    int pkt_data_offset;
+    int pkt_data_size;
+    int wsize;                      /* Match data size in 32-bit words */
+    uint32_t mask[KCOM_FILTER_WORDS_MAX];
+    int num_filters;
+    uint32_t hash_mask;             /* Number of hash buckets minus one */
+    bkn_rxpf_node_t **buckets;
+} bkn_rxpf_group_t;
+
+typedef struct bkn_rxpf_cls_s {
+    struct rcu_head rcu;
+    int num_groups;
+    bkn_rxpf_group_t *groups[BKN_RXPF_GROUPS_MAX];
+    bkn_rxpf_node_t nodes[0];       /* One per classified filter */
+} bkn_rxpf_cls_t;
+
 #ifdef SAI_FIXUP    /* SDK-224448 */
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,29))
 #define BKN_NETDEV_TX_BUSY      NETDEV_TX_BUSY
@@ -1692,6 +1951,8 @@ xgsx_irq_mask_set(bkn_switch_info_t *sinfo, uint32_t mask)
     if (sinfo->napi_poll_mode) {
         mask = 0;
     }
+    /* Channels being polled by their own NAPI instance */
+    mask &= ~sinfo->irq_poll_mask;
 
     if (sinfo->cpu_no == 1) {
         lkbde_irq_mask_get(sinfo->dev_no, &irq_mask, &irq_fmask);
@@ -1707,23 +1968,22 @@ xgsx_irq_mask_set(bkn_switch_info_t *sinfo, uint32_t mask)
                        irq_mask_reg, mask, CMICX_TXRX_IRQ_MASK);
 }
 
-static inline void
-xgsx_irq_mask_enable(bkn_switch_info_t *sinfo, int chan, int update_hw)
+static inline uint32_t
+xgsx_irq_chan_mask(bkn_switch_info_t *sinfo, int chan)
 {
-    uint32_t mask;
-
     if (CDMA_CH(sinfo, chan)) {
-        mask = CMICX_DS_CMC_CTRLD_INT(chan);
-    } else {
-        if (chan == XGS_DMA_TX_CHAN) {
-            mask = CMICX_DS_CMC_CHAIN_DONE(chan);
-        } else {
-            mask = CMICX_DS_CMC_DESC_DONE(chan) |
-                   CMICX_DS_CMC_CHAIN_DONE(chan);
-        }
+        return CMICX_DS_CMC_CTRLD_INT(chan);
     }
+    if (chan == XGS_DMA_TX_CHAN) {
+        return CMICX_DS_CMC_CHAIN_DONE(chan);
+    }
+    return CMICX_DS_CMC_DESC_DONE(chan) | CMICX_DS_CMC_CHAIN_DONE(chan);
+}
 
-    sinfo->irq_mask |= mask;
+static inline void
+xgsx_irq_mask_enable(bkn_switch_info_t *sinfo, int chan, int update_hw)
+{
+    sinfo->irq_mask |= xgsx_irq_chan_mask(sinfo, chan);
 
     if (update_hw) {
         xgsx_irq_mask_set(sinfo, sinfo->irq_mask);
@@ -1733,20 +1993,7 @@ xgsx_irq_mask_enable(bkn_switch_info_t *sinfo, int chan, int update_hw)
 static inline void
 xgsx_irq_mask_disable(bkn_switch_info_t *sinfo, int chan, int update_hw)
 {
-    uint32_t mask;
-
-    if (CDMA_CH(sinfo, chan)) {
-        mask = CMICX_DS_CMC_CTRLD_INT(chan);
-    } else {
-        if (chan == XGS_DMA_TX_CHAN) {
-            mask = CMICX_DS_CMC_CHAIN_DONE(chan);
-        } else {
-            mask = CMICX_DS_CMC_DESC_DONE(chan) |
-                   CMICX_DS_CMC_CHAIN_DONE(chan);
-        }
-    }
-
-    sinfo->irq_mask &= ~mask;
+    sinfo->irq_mask &= ~xgsx_irq_chan_mask(sinfo, chan);
 
     if (update_hw) {
         xgsx_irq_mask_set(sinfo, sinfo->irq_mask);
@@ -1935,6 +2182,191 @@ bkn_clean_tx_dcbs(bkn_switch_info_t *sinfo)
                 sinfo->tx.cur, sinfo->tx.dirty));
 }
 
+#ifdef BKN_PAGE_POOL_SUPPORT
+
+/* Rx page pool buffer: headroom for RCPU encapsulation, then the DMA area */
+#define BKN_RX_PP_HEADROOM      (NET_SKB_PAD + RCPU_RX_ENCAP_SIZE)
+
+#define BKN_RX_PP_ACTIVE(_s, _c) ((_s)->rx[_c].page_pool != NULL)
+
+static void
+bkn_rx_pp_create(bkn_switch_info_t *sinfo)
+{
+    struct page_pool_params pp;
+    struct page_pool *pool;
+    uint32_t truesize;
+    int chan;
+
+    if (!rx_page_pool) {
+        return;
+    }
+    /*
+     * Buffers are refilled from the ISR without NAPI, which the page
+     * pool does not support.
+     */
+    if (!use_napi) {
+        gprintk("Rx page pool requires use_napi, rx_page_pool ignored\n");
+        return;
+    }
+
+    truesize = SKB_DATA_ALIGN(BKN_RX_PP_HEADROOM + rx_buffer_size +
+                              RCPU_RX_META_SIZE) +
+               SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+
+    for (chan = 0; chan < NUM_RX_CHAN; chan++) {
+        if (sinfo->rx[chan].use_rx_skb == 0 ||
+            sinfo->rx[chan].page_pool != NULL) {
+            continue;
+        }
+        memset(&pp, 0, sizeof(pp));
+        pp.order = get_order(truesize);
+        pp.flags = PP_FLAG_DMA_MAP | PP_FLAG_DMA_SYNC_DEV;
+        pp.pool_size = MAX_RX_DCBS * 2;
+        pp.nid = dev_to_node(sinfo->dma_dev);
+        pp.dev = sinfo->dma_dev;
+        pp.dma_dir = DMA_FROM_DEVICE;
+        pp.offset = BKN_RX_PP_HEADROOM;
+        pp.max_len = rx_buffer_size + RCPU_RX_META_SIZE;
+        /*
+         * pp.napi is not set, as buffers are also refilled from the Rx
+         * rate and DMA timers outside of the NAPI poll.
+         */
+        pool = page_pool_create(&pp);
+        if (IS_ERR(pool)) {
+            gprintk("Rx%d page pool creation failed (%ld), "
+                    "using regular SKBs\n", chan, PTR_ERR(pool));
+            continue;
+        }
+        sinfo->rx[chan].page_pool = pool;
+        sinfo->rx[chan].pp_order = pp.order;
+    }
+}
+
+static void
+bkn_rx_pp_destroy(bkn_switch_info_t *sinfo)
+{
+    int chan;
+
+    for (chan = 0; chan < NUM_RX_CHAN; chan++) {
+        if (sinfo->rx[chan].page_pool != NULL) {
+            if (sinfo->rx[chan].pp_spare != NULL) {
+                page_pool_put_full_page(sinfo->rx[chan].page_pool,
+                                        sinfo->rx[chan].pp_spare, false);
+                sinfo->rx[chan].pp_spare = NULL;
+            }
+            /* Pages still held by the stack are released when freed */
+            page_pool_destroy(sinfo->rx[chan].page_pool);
+            sinfo->rx[chan].page_pool = NULL;
+        }
+    }
+}
+
+/*
+ * Build an Rx SKB around a page pool buffer. The buffer stays DMA-mapped
+ * and goes back to the pool when the SKB is freed.
+ */
+static struct sk_buff *
+bkn_rx_pp_skb_alloc(bkn_switch_info_t *sinfo, int chan, uint64_t *dma)
+{
+    struct page_pool *pool = sinfo->rx[chan].page_pool;
+    struct sk_buff *skb;
+    struct page *page;
+
+    page = sinfo->rx[chan].pp_spare;
+    if (page != NULL) {
+        sinfo->rx[chan].pp_spare = NULL;
+    } else {
+        page = page_pool_dev_alloc_pages(pool);
+        if (page == NULL) {
+            sinfo->rx[chan].pp_fails++;
+            return NULL;
+        }
+        sinfo->rx[chan].pp_allocs++;
+    }
+
+    skb = build_skb(page_address(page), PAGE_SIZE << sinfo->rx[chan].pp_order);
+    if (skb == NULL) {
+        /*
+         * Keep the page for the next refill, returning it to the pool
+         * here would re-enable bottom halves under the device lock.
+         */
+        sinfo->rx[chan].pp_spare = page;
+        return NULL;
+    }
+    skb_mark_for_recycle(skb);
+    skb_reserve(skb, BKN_RX_PP_HEADROOM);
+    *dma = page_pool_get_dma_addr(page) + BKN_RX_PP_HEADROOM;
+
+    return skb;
+}
+
+static int
+bkn_rx_pp_refill(bkn_switch_info_t *sinfo, int chan, bkn_desc_info_t *desc,
+                 uint32_t dma_size)
+{
+    if (desc->skb == NULL) {
+        desc->skb = bkn_rx_pp_skb_alloc(sinfo, chan, &desc->skb_dma);
+        if (desc->skb == NULL) {
+            return -1;
+        }
+        desc->dma_size = dma_size;
+    } else {
+        /* Buffer was not passed up, give it back to the device */
+        dma_sync_single_for_device(sinfo->dma_dev,
+                                   desc->skb_dma, desc->dma_size,
+                                   DMA_FROM_DEVICE);
+    }
+    DBG_DCB_RX(("Refill Rx%d DCB %d from page pool (0x%08x).\n",
+                chan, sinfo->rx[chan].cur, (uint32_t)desc->skb_dma));
+
+    return 0;
+}
+
+#else
+
+#define BKN_RX_PP_ACTIVE(_s, _c) (0)
+
+static void
+bkn_rx_pp_create(bkn_switch_info_t *sinfo)
+{
+    if (rx_page_pool) {
+        gprintk("Rx page pool not supported, using regular SKBs\n");
+    }
+}
+
+static void
+bkn_rx_pp_destroy(bkn_switch_info_t *sinfo)
+{
+}
+
+static int
+bkn_rx_pp_refill(bkn_switch_info_t *sinfo, int chan, bkn_desc_info_t *desc,
+                 uint32_t dma_size)
+{
+    return -1;
+}
+
+#endif /* BKN_PAGE_POOL_SUPPORT */
+
+/* Hand a completed Rx buffer over to the CPU */
+static void
+bkn_rx_buf_unmap(bkn_switch_info_t *sinfo, int chan, bkn_desc_info_t *desc)
+{
+    if (BKN_RX_PP_ACTIVE(sinfo, chan)) {
+#ifdef BKN_PAGE_POOL_SUPPORT
+        /* Keep the mapping, the buffer may be reused for the same DCB */
+        dma_sync_single_for_cpu(sinfo->dma_dev,
+                                desc->skb_dma, desc->dma_size,
+                                DMA_FROM_DEVICE);
+#endif
+        return;
+    }
+    DMA_UNMAP_SINGLE(sinfo->dma_dev,
+                     desc->skb_dma, desc->dma_size,
+                     DMA_FROMDEV);
+    desc->skb_dma = 0;
+}
+
 static void
 bkn_clean_rx_dcbs(bkn_switch_info_t *sinfo, int chan)
 {
@@ -1947,10 +2379,7 @@ bkn_clean_rx_dcbs(bkn_switch_info_t *sinfo, int chan)
         if (desc->skb != NULL) {
             DBG_SKB(("Cleaning Rx%d SKB from DCB %d.\n",
                      chan, sinfo->rx[chan].dirty));
-            DMA_UNMAP_SINGLE(sinfo->dma_dev,
-                             desc->skb_dma, desc->dma_size,
-                             DMA_FROMDEV);
-            desc->skb_dma = 0;
+            bkn_rx_buf_unmap(sinfo, chan, desc);
             dev_kfree_skb_any(desc->skb);
             desc->skb = NULL;
         }
@@ -2061,26 +2490,21 @@ bkn_init_dcbs(bkn_switch_info_t *sinfo)
 }
 
 static void
-bkn_dump_dcb(char *prefix, uint32_t *dcb, int wsize, int txrx)
+bkn_dump_dcb(char *prefix, int idx, uint32_t *dcb, int wsize, int txrx)
 {
-    if (XGS_DMA_TX_CHAN == txrx) {
-        if (wsize > 4) {
-            DBG_DCB_TX(("%s: 0x%08x 0x%08x 0x%08x 0x%08x 0x%08x 0x%08x ... 0x%08x\n",
-                        prefix, dcb[0], dcb[1], dcb[2], dcb[3], dcb[4], dcb[5],
-                        dcb[wsize - 1]));
-        } else {
-            DBG_DCB_TX(("%s: 0x%08x 0x%08x 0x%08x 0x%08x\n",
-                        prefix, dcb[0], dcb[1], dcb[2], dcb[3]));
-        }
+    if (!(debug & DBG_LVL_DCB) &&
+        !(txrx == XGS_DMA_TX_CHAN && debug & DBG_LVL_DCB_TX) &&
+        !(txrx != XGS_DMA_TX_CHAN && debug & DBG_LVL_DCB_RX)) {
+        return;
+    }
+
+    if (wsize > 4) {
+        gprintk("%s (%d): 0x%08x 0x%08x 0x%08x 0x%08x 0x%08x 0x%08x ... 0x%08x\n",
+                prefix, idx, dcb[0], dcb[1], dcb[2], dcb[3], dcb[4], dcb[5],
+                dcb[wsize - 1]);
     } else {
-        if (wsize > 4) {
-            DBG_DCB_RX(("%s: 0x%08x 0x%08x 0x%08x 0x%08x 0x%08x 0x%08x ... 0x%08x\n",
-                        prefix, dcb[0], dcb[1], dcb[2], dcb[3], dcb[4], dcb[5],
-                        dcb[wsize - 1]));
-        } else {
-            DBG_DCB_RX(("%s: 0x%08x 0x%08x 0x%08x 0x%08x\n",
-                        prefix, dcb[0], dcb[1], dcb[2], dcb[3]));
-        }
+        gprintk("%s (%d): 0x%08x 0x%08x 0x%08x 0x%08x\n",
+                prefix, idx, dcb[0], dcb[1], dcb[2], dcb[3]);
     }
 }
 
@@ -2140,6 +2564,11 @@ bkn_cdma_goto(bkn_switch_info_t *sinfo, int chan, uint64_t dcb)
     /* Set the new halt location */
     sinfo->halt_addr[chan] = dcb;
     dev_cdma_halt_set(sinfo, chan);
+
+    if (chan == XGS_DMA_TX_CHAN) {
+        trace_bkn_tx_doorbell(sinfo->dev_no, sinfo->tx.cur,
+                              MAX_TX_DCBS - sinfo->tx.free);
+    }
 }
 
 static void
@@ -2288,6 +2717,110 @@ bkn_api_rx_copy_from_skb(bkn_switch_info_t *sinfo,
     return 0;
 }
 
+/*
+ * Rx rate control
+ *
+ * Tokens are earned lazily from the time elapsed since the last
+ * update, so rates are kept to the nanosecond without a periodic
+ * timer. The fraction of a token not yet earned is kept by advancing
+ * the update time only by the time paid out in whole tokens.
+ */
+#define BKN_RATE_NOW_NS() ktime_to_ns(ktime_get())
+
+static uint32_t
+bkn_tokens_earn(uint32_t tokens, uint32_t rate, uint32_t burst,
+                u64 *tok_ns, u64 now)
+{
+    u64 delta, fill_ns;
+    uint32_t add;
+
+    if (rate == 0 || tokens >= burst) {
+        *tok_ns = now;
+        return burst;
+    }
+    delta = now - *tok_ns;
+    fill_ns = div_u64((u64)(burst - tokens) * NSEC_PER_SEC, rate);
+    if (delta >= fill_ns) {
+        *tok_ns = now;
+        return burst;
+    }
+    add = (uint32_t)div_u64(delta * rate, NSEC_PER_SEC);
+    *tok_ns += div_u64((u64)add * NSEC_PER_SEC, rate);
+
+    return tokens + add;
+}
+
+static void
+bkn_rx_tokens_update(bkn_switch_info_t *sinfo, int chan)
+{
+    unsigned long cur_jif, ticks;
+    uint32_t pkt_diff;
+
+    sinfo->rx[chan].tokens = bkn_tokens_earn(sinfo->rx[chan].tokens,
+                                             sinfo->rx[chan].rate_max,
+                                             sinfo->rx[chan].burst_max,
+                                             &sinfo->rx[chan].tok_ns,
+                                             BKN_RATE_NOW_NS());
+
+    /* For debug purposes we maintain a rough actual packet rate */
+    cur_jif = jiffies;
+    ticks = cur_jif - sinfo->rx[chan].rate_jif;
+    if (ticks >= HZ) {
+        pkt_diff = sinfo->rx[chan].pkts - sinfo->rx[chan].pkts_ref;
+        sinfo->rx[chan].rate = (pkt_diff * HZ) / ticks;
+        sinfo->rx[chan].rate_jif = cur_jif;
+        sinfo->rx[chan].pkts_ref = sinfo->rx[chan].pkts;
+    }
+}
+
+/*
+ * Have the rate control timer restart a suppressed Rx channel once it
+ * has earned the tokens to refill its DCB ring.
+ */
+static void
+bkn_rxtick_arm(bkn_switch_info_t *sinfo, int chan)
+{
+    uint32_t need = MAX_RX_DCBS + 1;
+    ktime_t expires;
+    u64 due;
+
+    if (!module_initialized || sinfo->rx[chan].rate_max == 0) {
+        return;
+    }
+
+    due = sinfo->rx[chan].tok_ns;
+    if (sinfo->rx[chan].tokens < need) {
+        due += div_u64((u64)(need - sinfo->rx[chan].tokens) * NSEC_PER_SEC +
+                       sinfo->rx[chan].rate_max - 1,
+                       sinfo->rx[chan].rate_max);
+    }
+    expires = ns_to_ktime(due);
+    if (hrtimer_is_queued(&sinfo->rxtick) &&
+        ktime_compare(hrtimer_get_expires(&sinfo->rxtick), expires) <= 0) {
+        /* Timer is due earlier anyway */
+        return;
+    }
+    hrtimer_start(&sinfo->rxtick, expires, BKN_HRTIMER_MODE_ABS);
+}
+
+/* Returns 0 if an Rx packet exceeds the rate of its netif */
+static int
+bkn_netif_rate_ok(bkn_priv_t *priv)
+{
+    if (priv->rate_max == 0) {
+        return 1;
+    }
+    priv->tokens = bkn_tokens_earn(priv->tokens, priv->rate_max,
+                                   priv->burst_max, &priv->tok_ns,
+                                   BKN_RATE_NOW_NS());
+    if (priv->tokens == 0) {
+        return 0;
+    }
+    priv->tokens--;
+
+    return 1;
+}
+
 static void
 bkn_rx_refill(bkn_switch_info_t *sinfo, int chan)
 {
@@ -2303,51 +2836,61 @@ bkn_rx_refill(bkn_switch_info_t *sinfo, int chan)
         return;
     }
 
+    bkn_rx_tokens_update(sinfo, chan);
+
     if (!CDMA_CH(sinfo, XGS_DMA_RX_CHAN + chan) &&
         sinfo->rx[chan].tokens < MAX_RX_DCBS) {
         /* Pause DMA for now */
+        bkn_rxtick_arm(sinfo, chan);
         return;
     }
 
     while (sinfo->rx[chan].free < MAX_RX_DCBS) {
         desc = &sinfo->rx[chan].desc[sinfo->rx[chan].cur];
-        if (desc->skb == NULL) {
-            skb = dev_alloc_skb(rx_buffer_size + RCPU_RX_ENCAP_SIZE);
-            if (skb == NULL) {
+        if (BKN_RX_PP_ACTIVE(sinfo, chan)) {
+            if (bkn_rx_pp_refill(sinfo, chan, desc,
+                                 rx_buffer_size + meta_size) < 0) {
                 break;
             }
-            skb_reserve(skb, resv_size);
-            desc->skb = skb;
         } else {
-            DBG_DCB_RX(("Refill Rx%d SKB in DCB %d recycled.\n",
-                        chan, sinfo->rx[chan].cur));
-        }
-        skb = desc->skb;
-        desc->dma_size = rx_buffer_size + meta_size;
+            if (desc->skb == NULL) {
+                skb = dev_alloc_skb(rx_buffer_size + RCPU_RX_ENCAP_SIZE);
+                if (skb == NULL) {
+                    break;
+                }
+                skb_reserve(skb, resv_size);
+                desc->skb = skb;
+            } else {
+                DBG_DCB_RX(("Refill Rx%d SKB in DCB %d recycled.\n",
+                            chan, sinfo->rx[chan].cur));
+            }
+            skb = desc->skb;
+            desc->dma_size = rx_buffer_size + meta_size;
 #ifdef KNET_NO_AXI_DMA_INVAL
-        /*
-         * FIXME: Need to retain this code until iProc customers have been
-         * migrated to updated u-boot. Old u-boot versions are unable to load
-         * the kernel into non-ACP memory.
-         */
-        /*
-         * Cache invalidate may corrupt DMA memory on some iProc-based devices
-         * if the kernel is mapped to ACP memory.
-         */
-        if (sinfo->pdev == NULL) {
-            desc->dma_size = 0;
-        }
+            /*
+             * FIXME: Need to retain this code until iProc customers have been
+             * migrated to updated u-boot. Old u-boot versions are unable to load
+             * the kernel into non-ACP memory.
+             */
+            /*
+             * Cache invalidate may corrupt DMA memory on some iProc-based devices
+             * if the kernel is mapped to ACP memory.
+             */
+            if (sinfo->pdev == NULL) {
+                desc->dma_size = 0;
+            }
 #endif
-        desc->skb_dma = DMA_MAP_SINGLE(sinfo->dma_dev,
-                                       skb->data, desc->dma_size,
-                                       DMA_FROMDEV);
-        if (DMA_MAPPING_ERROR(sinfo->dma_dev, desc->skb_dma)) {
-            dev_kfree_skb_any(skb);
-            desc->skb = NULL;
-            break;
+            desc->skb_dma = DMA_MAP_SINGLE(sinfo->dma_dev,
+                                           skb->data, desc->dma_size,
+                                           DMA_FROMDEV);
+            if (DMA_MAPPING_ERROR(sinfo->dma_dev, desc->skb_dma)) {
+                dev_kfree_skb_any(skb);
+                desc->skb = NULL;
+                break;
+            }
+            DBG_DCB_RX(("Refill Rx%d DCB %d (0x%08x).\n",
+                        chan, sinfo->rx[chan].cur, (uint32_t)desc->skb_dma));
         }
-        DBG_DCB_RX(("Refill Rx%d DCB %d (0x%08x).\n",
-                    chan, sinfo->rx[chan].cur, (uint32_t)desc->skb_dma));
         dcb = desc->dcb_mem;
         dcb[0] = desc->skb_dma;
         if (CDMA_CH(sinfo, XGS_DMA_RX_CHAN + chan)) {
@@ -2385,6 +2928,12 @@ bkn_rx_refill(bkn_switch_info_t *sinfo, int chan)
         sinfo->rx[chan].free++;
         sinfo->rx[chan].tokens--;
     }
+
+    if (CDMA_CH(sinfo, XGS_DMA_RX_CHAN + chan) &&
+        sinfo->rx[chan].tokens <= MAX_RX_DCBS) {
+        /* DMA halt location not moved, restart when tokens are earned */
+        bkn_rxtick_arm(sinfo, chan);
+    }
 }
 
 static int
@@ -2416,6 +2965,8 @@ bkn_rx_restart(bkn_switch_info_t *sinfo, int chan)
     /* Request one extra poll if chain was restarted during poll */
     if (sinfo->napi_poll_mode) {
         sinfo->napi_poll_again = 1;
+    } else if (sinfo->napi_per_chan) {
+        sinfo->rx[chan].napi_poll_again = 1;
     }
 
     return 0;
@@ -2434,6 +2985,8 @@ bkn_tx_dma_start(bkn_switch_info_t *sinfo)
             dev_dma_chan_clear(sinfo, XGS_DMA_TX_CHAN);
             dev_irq_mask_enable(sinfo, XGS_DMA_TX_CHAN, 1);
             dev_dma_chan_start(sinfo, XGS_DMA_TX_CHAN, desc->dcb_dma);
+            trace_bkn_tx_doorbell(sinfo->dev_no, sinfo->tx.cur,
+                                  MAX_TX_DCBS - sinfo->tx.free);
         }
     }
 
@@ -2560,16 +3113,65 @@ device_is_sand(bkn_switch_info_t *sinfo)
     return is_sand;
 }
 
-static bkn_filter_t *
-bkn_match_rx_pkt(bkn_switch_info_t *sinfo, uint8_t *pkt, int pktlen,
-                 void *meta, int chan, bkn_filter_t *cbf)
+static int
+bkn_rxpf_prio_match(bkn_switch_info_t *sinfo, kcom_filter_t *kf, int chan)
 {
-    struct list_head *list;
-    bkn_filter_t *filter;
+    if (device_is_sand(sinfo)) {
+        /** priority 0 means no priority check */
+        if (kf->priority && (kf->priority < (num_rx_prio * sinfo->rx_chans))) {
+            if (kf->priority < (num_rx_prio * chan) ||
+                kf->priority >= (num_rx_prio * (chan + 1))) {
+                return 0;
+            }
+        }
+    }
+    else {
+        if (kf->priority < (num_rx_prio * sinfo->rx_chans)) {
+            if (kf->priority < (num_rx_prio * chan) ||
+                kf->priority >= (num_rx_prio * (chan + 1))) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static bkn_filter_t *
+bkn_rxpf_hit(bkn_switch_info_t *sinfo, bkn_filter_t *filter, uint8_t *pkt,
+             int pktlen, void *meta, int chan, bkn_filter_t *cbf)
+{
+    kcom_filter_t *kf = &filter->kf;
+
+    if (kf->dest_type == KCOM_DEST_T_CB) {
+        /* Check for custom filters */
+        if (knet_filter_cb != NULL && cbf != NULL) {
+            memset(cbf, 0, sizeof(*cbf));
+            memcpy(&cbf->kf, kf, sizeof(cbf->kf));
+            if (knet_filter_cb(pkt, pktlen, sinfo->dev_no,
+                               meta, chan, &cbf->kf)) {
+                filter->hits++;
+                return cbf;
+            }
+        } else {
+            DBG_FLTR(("Match, but not filter callback\n"));
+        }
+        return NULL;
+    }
+
+    filter->hits++;
+    return filter;
+}
+
+static bkn_filter_t *
+bkn_rxpf_list_match(bkn_switch_info_t *sinfo, uint8_t *pkt, int pktlen,
+                    void *meta, int chan, bkn_filter_t *cbf)
+{
+    struct list_head *list;
+    bkn_filter_t *filter, *match;
     kcom_filter_t scratch, *kf;
     uint8_t *oob = (uint8_t *)meta;
     int size, wsize;
-    int idx, match;
+    int idx;
 
     list_for_each(list, &sinfo->rxpf_list) {
         filter = (bkn_filter_t *)list;
@@ -2596,60 +3198,298 @@ bkn_match_rx_pkt(bkn_switch_info_t *sinfo, uint8_t *pkt, int pktlen,
             }
         }
 
-        match = 1;
-        if (match) {
-            if (device_is_sand(sinfo))
-            {
-                /** priority 0 means no priority check */
-                if (kf->priority && (kf->priority < (num_rx_prio * sinfo->rx_chans))) {
-                    if (kf->priority < (num_rx_prio * chan) ||
-                        kf->priority >= (num_rx_prio * (chan + 1))) {
-                        match = 0;
-                    }
-                }
-            }
-            else {
-                if (kf->priority < (num_rx_prio * sinfo->rx_chans)) {
-                    if (kf->priority < (num_rx_prio * chan) ||
-                        kf->priority >= (num_rx_prio * (chan + 1))) {
-                        match = 0;
-                    }
-                }
+        if (!bkn_rxpf_prio_match(sinfo, kf, chan)) {
+            continue;
+        }
+        for (idx = 0; idx < wsize; idx++) {
+            scratch.data.w[idx] &= kf->mask.w[idx];
+            if (scratch.data.w[idx] != kf->data.w[idx]) {
+                break;
             }
         }
+        if (idx < wsize) {
+            continue;
+        }
+        match = bkn_rxpf_hit(sinfo, filter, pkt, pktlen, meta, chan, cbf);
         if (match) {
-            for (idx = 0; idx < wsize; idx++) {
-                scratch.data.w[idx] &= kf->mask.w[idx];
-                if (scratch.data.w[idx] != kf->data.w[idx]) {
-                    match = 0;
-                    break;
-                }
+            return match;
+        }
+    }
+
+    return NULL;
+}
+
+static bkn_filter_t *
+bkn_rxpf_cls_match(bkn_switch_info_t *sinfo, bkn_rxpf_cls_t *cls, uint8_t *pkt,
+                   int pktlen, void *meta, int chan, bkn_filter_t *cbf)
+{
+    bkn_rxpf_node_t *cand[BKN_RXPF_GROUPS_MAX];
+    bkn_rxpf_group_t *group;
+    bkn_rxpf_node_t *node;
+    bkn_filter_t *match;
+    uint32_t key[KCOM_FILTER_WORDS_MAX];
+    uint8_t *oob = (uint8_t *)meta;
+    int grp, best, idx;
+
+    /* Find the first filter with matching data in every group */
+    for (grp = 0; grp < cls->num_groups; grp++) {
+        group = cls->groups[grp];
+        if (group->wsize > 0) {
+            /* Bytes past the match data are zero in the filter data */
+            key[group->wsize - 1] = 0;
+        }
+        memcpy(key, &oob[group->oob_data_offset], group->oob_data_size);
+        memcpy((uint8_t *)key + group->oob_data_size,
+               &pkt[group->pkt_data_offset], group->pkt_data_size);
+        for (idx = 0; idx < group->wsize; idx++) {
+            key[idx] &= group->mask[idx];
+        }
+
+        node = group->buckets[jhash2(key, group->wsize, 0) & group->hash_mask];
+        while (node != NULL &&
+               memcmp(node->filter->kf.data.w, key, group->wsize * sizeof(uint32_t)) != 0) {
+            node = node->next;
+        }
+        cand[grp] = node;
+    }
+
+    /* Try the candidates in rxpf_list order */
+    while (1) {
+        best = -1;
+        for (grp = 0; grp < cls->num_groups; grp++) {
+            if (cand[grp] != NULL &&
+                (best < 0 || cand[grp]->order < cand[best]->order)) {
+                best = grp;
             }
         }
-        if (match) {
-            if (kf->dest_type == KCOM_DEST_T_CB) {
-                /* Check for custom filters */
-                if (knet_filter_cb != NULL && cbf != NULL) {
-                    memset(cbf, 0, sizeof(*cbf));
-                    memcpy(&cbf->kf, kf, sizeof(cbf->kf));
-                    if (knet_filter_cb(pkt, pktlen, sinfo->dev_no,
-                                       meta, chan, &cbf->kf)) {
-                        filter->hits++;
-                        return cbf;
-                    }
-                } else {
-                    DBG_FLTR(("Match, but not filter callback\n"));
-                }
-            } else {
-                filter->hits++;
-                return filter;
+        if (best < 0) {
+            return NULL;
+        }
+
+        node = cand[best];
+        cand[best] = node->dup;
+        if (bkn_rxpf_prio_match(sinfo, &node->filter->kf, chan)) {
+            match = bkn_rxpf_hit(sinfo, node->filter, pkt, pktlen, meta, chan, cbf);
+            if (match) {
+                return match;
             }
         }
     }
+}
+
+static bkn_filter_t *
+bkn_match_rx_pkt(bkn_switch_info_t *sinfo, uint8_t *pkt, int pktlen,
+                 void *meta, int chan, bkn_filter_t *cbf)
+{
+    bkn_rxpf_cls_t *cls;
+    bkn_filter_t *match;
+
+    rcu_read_lock();
+    cls = rcu_dereference(sinfo->rxpf_cls);
+    if (cls != NULL) {
+        match = bkn_rxpf_cls_match(sinfo, cls, pkt, pktlen, meta, chan, cbf);
+    } else {
+        match = bkn_rxpf_list_match(sinfo, pkt, pktlen, meta, chan, cbf);
+    }
+    rcu_read_unlock();
+
+    if (match) {
+        trace_bkn_rx_filter(sinfo->dev_no, chan, match->kf.id,
+                            match->kf.dest_type, match->kf.dest_id, pktlen);
+    }
+
+    return match;
+}
+
+static int
+bkn_rxpf_classifiable(kcom_filter_t *kf)
+{
+    int size, idx;
 
+    size = kf->oob_data_size + kf->pkt_data_size;
+    if (size > KCOM_FILTER_BYTES_MAX) {
+        return 0;
+    }
+    /* Filter data outside of the mask never matches */
+    for (idx = 0; idx < BYTES2WORDS(size); idx++) {
+        if (kf->data.w[idx] & ~kf->mask.w[idx]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static bkn_rxpf_group_t *
+bkn_rxpf_group_find(bkn_rxpf_cls_t *cls, kcom_filter_t *kf)
+{
+    bkn_rxpf_group_t *group;
+    int grp;
+
+    for (grp = 0; grp < cls->num_groups; grp++) {
+        group = cls->groups[grp];
+        if (group->oob_data_offset == kf->oob_data_offset &&
+            group->oob_data_size == kf->oob_data_size &&
+            group->pkt_data_offset == kf->pkt_data_offset &&
+            group->pkt_data_size == kf->pkt_data_size &&
+            memcmp(group->mask, kf->mask.w, group->wsize * sizeof(uint32_t)) == 0) {
+            return group;
+        }
+    }
     return NULL;
 }
 
+static void
+bkn_rxpf_cls_free(bkn_rxpf_cls_t *cls)
+{
+    int grp;
+
+    for (grp = 0; grp < cls->num_groups; grp++) {
+        kfree(cls->groups[grp]->buckets);
+        kfree(cls->groups[grp]);
+    }
+    kfree(cls);
+}
+
+static void
+bkn_rxpf_cls_free_rcu(struct rcu_head *rcu)
+{
+    bkn_rxpf_cls_free(container_of(rcu, bkn_rxpf_cls_t, rcu));
+}
+
+static void
+bkn_filter_free_rcu(struct rcu_head *rcu)
+{
+    kfree(container_of(rcu, bkn_filter_t, rcu));
+}
+
+static int
+bkn_rxpf_cls_build(bkn_switch_info_t *sinfo, bkn_rxpf_cls_t *cls)
+{
+    struct list_head *list;
+    bkn_filter_t *filter;
+    kcom_filter_t *kf;
+    bkn_rxpf_group_t *group;
+    bkn_rxpf_node_t *node, **bucket;
+    int grp, order, num_nodes;
+    uint32_t num_buckets;
+
+    /* Group filters by match shape */
+    list_for_each(list, &sinfo->rxpf_list) {
+        kf = &((bkn_filter_t *)list)->kf;
+        if (!bkn_rxpf_classifiable(kf)) {
+            continue;
+        }
+        group = bkn_rxpf_group_find(cls, kf);
+        if (group == NULL) {
+            if (cls->num_groups >= BKN_RXPF_GROUPS_MAX) {
+                DBG_FLTR(("Too many Rx filter groups (max %d)\n",
+                          BKN_RXPF_GROUPS_MAX));
+                return -1;
+            }
+            group = kmalloc(sizeof(*group), GFP_ATOMIC);
+            if (group == NULL) {
+                return -1;
+            }
+            memset(group, 0, sizeof(*group));
+            group->oob_data_offset = kf->oob_data_offset;
+            group->oob_data_size = kf->oob_data_size;
+            group->pkt_data_offset = kf->pkt_data_offset;
+            group->pkt_data_size = kf->pkt_data_size;
+            group->wsize = BYTES2WORDS(kf->oob_data_size + kf->pkt_data_size);
+            memcpy(group->mask, kf->mask.w, group->wsize * sizeof(uint32_t));
+            cls->groups[cls->num_groups++] = group;
+        }
+        group->num_filters++;
+    }
+
+    /* Keep hash tables at most half full */
+    for (grp = 0; grp < cls->num_groups; grp++) {
+        group = cls->groups[grp];
+        num_buckets = 1;
+        while (num_buckets < 2 * group->num_filters) {
+            num_buckets <<= 1;
+        }
+        group->buckets = kmalloc(num_buckets * sizeof(*group->buckets), GFP_ATOMIC);
+        if (group->buckets == NULL) {
+            return -1;
+        }
+        memset(group->buckets, 0, num_buckets * sizeof(*group->buckets));
+        group->hash_mask = num_buckets - 1;
+    }
+
+    /* Hash filters in list order, so filters with same data stay in order */
+    order = 0;
+    num_nodes = 0;
+    list_for_each(list, &sinfo->rxpf_list) {
+        filter = (bkn_filter_t *)list;
+        kf = &filter->kf;
+        order++;
+        if (!bkn_rxpf_classifiable(kf)) {
+            continue;
+        }
+        group = bkn_rxpf_group_find(cls, kf);
+
+        node = &cls->nodes[num_nodes++];
+        node->next = NULL;
+        node->dup = NULL;
+        node->filter = filter;
+        node->order = order;
+
+        bucket = &group->buckets[jhash2(kf->data.w, group->wsize, 0) & group->hash_mask];
+        while (*bucket != NULL &&
+               memcmp((*bucket)->filter->kf.data.w, kf->data.w,
+                      group->wsize * sizeof(uint32_t)) != 0) {
+            bucket = &(*bucket)->next;
+        }
+        if (*bucket == NULL) {
+            *bucket = node;
+        } else {
+            for (node->next = *bucket; node->next->dup != NULL; ) {
+                node->next = node->next->dup;
+            }
+            node->next->dup = node;
+            node->next = NULL;
+        }
+    }
+
+    return 0;
+}
+
+/* Must be called with sinfo->lock held */
+static void
+bkn_rxpf_cls_update(bkn_switch_info_t *sinfo)
+{
+    struct list_head *list;
+    bkn_rxpf_cls_t *cls, *old_cls;
+    int num_filters;
+
+    num_filters = 0;
+    list_for_each(list, &sinfo->rxpf_list) {
+        num_filters++;
+    }
+
+    cls = NULL;
+    if (rx_filter_hash && num_filters > 0) {
+        cls = kmalloc(sizeof(*cls) + num_filters * sizeof(cls->nodes[0]),
+                      GFP_ATOMIC);
+        if (cls != NULL) {
+            memset(cls, 0, sizeof(*cls));
+            if (bkn_rxpf_cls_build(sinfo, cls) < 0) {
+                /* Fall back to walking rxpf_list */
+                DBG_WARN(("Rx filter classifier not built, using filter list\n"));
+                bkn_rxpf_cls_free(cls);
+                cls = NULL;
+            }
+        }
+    }
+
+    old_cls = sinfo->rxpf_cls;
+    rcu_assign_pointer(sinfo->rxpf_cls, cls);
+    if (old_cls != NULL) {
+        call_rcu(&old_cls->rcu, bkn_rxpf_cls_free_rcu);
+    }
+}
+
 static bkn_priv_t *
 bkn_netif_lookup(bkn_switch_info_t *sinfo, int id)
 {
@@ -3485,6 +4325,88 @@ bkn_dnx_packet_header_parse(bkn_switch_info_t *sinfo, uint8 *buf, uint32_t buf_l
     return 0;
 }
 
+static void
+bkn_lat_record(bkn_lat_hist_t *hist, u64 ns)
+{
+    u64 us = div_u64(ns, NSEC_PER_USEC);
+    int idx;
+
+    if (us > 0xffffffff) {
+        us = 0xffffffff;
+    }
+    idx = fls((uint32_t)us);
+    if (idx >= BKN_LAT_BUCKETS) {
+        idx = BKN_LAT_BUCKETS - 1;
+    }
+    hist->bucket[idx]++;
+    hist->samples++;
+    if ((uint32_t)us > hist->max_us) {
+        hist->max_us = (uint32_t)us;
+    }
+}
+
+/* Interrupt on device, stamp the start of the Rx latency */
+static inline void
+bkn_lat_isr(bkn_switch_info_t *sinfo)
+{
+    sinfo->isr_ns = ktime_to_ns(ktime_get());
+    sinfo->isr_poll_pending = 1;
+}
+
+/* Rx poll started */
+static inline void
+bkn_lat_poll(bkn_switch_info_t *sinfo)
+{
+    if (rx_latency && sinfo->isr_poll_pending) {
+        bkn_lat_record(&sinfo->lat_poll,
+                       ktime_to_ns(ktime_get()) - sinfo->isr_ns);
+    }
+    sinfo->isr_poll_pending = 0;
+}
+
+/* Rx processing started by the interrupt is done, later packets are not stamped */
+static inline void
+bkn_lat_done(bkn_switch_info_t *sinfo)
+{
+    sinfo->isr_ns = 0;
+}
+
+/* Must be called with sinfo->lock released */
+static void
+bkn_netif_rx_skb(bkn_switch_info_t *sinfo, int chan, struct sk_buff *skb)
+{
+    u64 isr_ns = sinfo->isr_ns;
+#ifdef BKN_NAPI_GRO_SUPPORT
+    struct napi_struct *napi;
+#endif
+
+    trace_bkn_rx_netif(sinfo->dev_no, chan, skb->dev->ifindex, skb->len, isr_ns);
+    if (rx_latency && isr_ns) {
+        bkn_lat_record(&sinfo->lat_netif, ktime_to_ns(ktime_get()) - isr_ns);
+    }
+
+    if (!use_napi) {
+        netif_rx(skb);
+        return;
+    }
+#ifdef BKN_NAPI_GRO_SUPPORT
+    if (use_napi_gro) {
+        /* Packets held by GRO are flushed when NAPI poll completes */
+        napi = sinfo->napi_per_chan ? &sinfo->rx[chan].napi.napi : &sinfo->napi;
+        sinfo->rx[chan].pkts_gro++;
+        switch (napi_gro_receive(napi, skb)) {
+        case GRO_MERGED:
+        case GRO_MERGED_FREE:
+            sinfo->rx[chan].pkts_gro_merged++;
+            break;
+        default:
+            break;
+        }
+        return;
+    }
+#endif
+    netif_receive_skb(skb);
+}
 
 static int
 bkn_do_api_rx(bkn_switch_info_t *sinfo, int chan, int budget)
@@ -3563,6 +4485,7 @@ bkn_do_api_rx(bkn_switch_info_t *sinfo, int chan, int budget)
             err_woff = sinfo->dcb_wsize - 1;
         }
         pktlen = dcb[sinfo->dcb_wsize-1] & SOC_DCB_KNET_COUNT_MASK;
+        trace_bkn_rx_desc(sinfo->dev_no, chan, dcb_chain->dcb_cur, pktlen);
         bkn_dump_pkt(pkt, pktlen, XGS_DMA_RX_CHAN);
 
         if (device_is_dpp(sinfo)) {
@@ -3653,6 +4576,11 @@ bkn_do_api_rx(bkn_switch_info_t *sinfo, int chan, int budget)
                         sinfo->rx[chan].pkts_d_no_link++;
                         break;
                     }
+                    if (!bkn_netif_rate_ok(priv)) {
+                        sinfo->rx[chan].pkts_d_rate++;
+                        BKN_NETIF_STATS_INC(priv, rx, dropped);
+                        break;
+                    }
 
                     if (sinfo->cmic_type == 'x') {
                         pkt += sinfo->pkt_hdr_size;
@@ -3709,8 +4637,7 @@ bkn_do_api_rx(bkn_switch_info_t *sinfo, int chan, int budget)
                     } else {
                         skb_put(skb, pktlen - 4); /* Strip CRC */
                     }
-                    priv->stats.rx_packets++;
-                    priv->stats.rx_bytes += skb->len;
+                    BKN_NETIF_STATS_PKT(priv, rx, skb->len);
 
                     /* Optional SKB updates */
                     if (knet_rx_cb != NULL) {
@@ -3746,11 +4673,7 @@ bkn_do_api_rx(bkn_switch_info_t *sinfo, int chan, int budget)
 
                     /* Unlock while calling up network stack */
                     spin_unlock(&sinfo->lock);
-                    if (use_napi) {
-                        netif_receive_skb(skb);
-                    } else {
-                        netif_rx(skb);
-                    }
+                    bkn_netif_rx_skb(sinfo, chan, skb);
                     spin_lock(&sinfo->lock);
 
                     if (filter->kf.mirror_type == KCOM_DEST_T_API ||
@@ -3811,11 +4734,10 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
     }
 
     while (dcbs_done < budget) {
-        char str[32];
-        sprintf(str, "Rx DCB (%d)", sinfo->rx[chan].dirty);
         desc = &sinfo->rx[chan].desc[sinfo->rx[chan].dirty];
         dcb = desc->dcb_mem;
-        bkn_dump_dcb(str, dcb, sinfo->dcb_wsize, XGS_DMA_RX_CHAN);
+        bkn_dump_dcb("Rx DCB", sinfo->rx[chan].dirty,
+                     dcb, sinfo->dcb_wsize, XGS_DMA_RX_CHAN);
         if ((dcb[sinfo->dcb_wsize-1] & (1 << 31)) == 0) {
             break;
         }
@@ -3825,6 +4747,8 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
             /* Request one extra poll to check for chain done interrupt */
             if (sinfo->napi_poll_mode) {
                 sinfo->napi_poll_again = 1;
+            } else if (sinfo->napi_per_chan) {
+                sinfo->rx[chan].napi_poll_again = 1;
             }
         }
         sinfo->rx[chan].pkts++;
@@ -3845,12 +4769,10 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
             err_woff = sinfo->dcb_wsize - 1;
         }
         pktlen = dcb[sinfo->dcb_wsize-1] & 0xffff;
+        trace_bkn_rx_desc(sinfo->dev_no, chan, sinfo->rx[chan].dirty, pktlen);
         priv = netdev_priv(sinfo->dev);
         DBG_DCB_RX(("Rx%d SKB DMA done (%d).\n", chan, sinfo->rx[chan].dirty));
-        DMA_UNMAP_SINGLE(sinfo->dma_dev,
-                         desc->skb_dma, desc->dma_size,
-                         DMA_FROMDEV);
-        desc->skb_dma = 0;
+        bkn_rx_buf_unmap(sinfo, chan, desc);
         bkn_dump_pkt(skb->data, pktlen, XGS_DMA_RX_CHAN);
 
         if (device_is_dpp(sinfo)) {
@@ -3922,7 +4844,7 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
         }
         if ((dcb[sinfo->dcb_wsize-1] & 0xf0000) != 0x30000) {
             /* Fragment or error */
-            priv->stats.rx_errors++;
+            BKN_NETIF_STATS_INC(priv, rx, errors);
             if (filter && filter->kf.mask.w[err_woff] == 0) {
                 /* Drop unless DCB status is part of filter */
                 filter = NULL;
@@ -3945,6 +4867,11 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
                         sinfo->rx[chan].pkts_d_no_link++;
                         break;
                     }
+                    if (!bkn_netif_rate_ok(priv)) {
+                        sinfo->rx[chan].pkts_d_rate++;
+                        BKN_NETIF_STATS_INC(priv, rx, dropped);
+                        break;
+                    }
                     DBG_FLTR(("Send to netif %d (%s)\n",
                               priv->id, priv->dev->name));
                     sinfo->rx[chan].pkts_f_netif++;
@@ -4018,8 +4945,7 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
                             }
                         }
                     }
-                    priv->stats.rx_packets++;
-                    priv->stats.rx_bytes += skb->len;
+                    BKN_NETIF_STATS_PKT(priv, rx, skb->len);
                     skb->dev = priv->dev;
 
                     /* Optional SKB updates */
@@ -4031,7 +4957,7 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
                         if (skb == NULL) {
                             /* Consumed by call-back */
                             sinfo->rx[chan].pkts_d_callback++;
-                            priv->stats.rx_dropped++;
+                            BKN_NETIF_STATS_INC(priv, rx, dropped);
                             desc->skb = NULL;
                             break;
                         }
@@ -4066,19 +4992,14 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
                                 sinfo->rx[chan].pkts_d_no_skb++;
                             } else {
                                 sinfo->rx[chan].pkts_m_netif++;
-                                mpriv->stats.rx_packets++;
-                                mpriv->stats.rx_bytes += mskb->len;
+                                BKN_NETIF_STATS_PKT(mpriv, rx, mskb->len);
                                 skb->dev = mpriv->dev;
                                 if (filter->kf.mirror_proto) {
                                     skb->protocol = filter->kf.mirror_proto;
                                 }
                                 /* Unlock while calling up network stack */
                                 spin_unlock(&sinfo->lock);
-                                if (use_napi) {
-                                    netif_receive_skb(mskb);
-                                } else {
-                                    netif_rx(mskb);
-                                }
+                                bkn_netif_rx_skb(sinfo, chan, mskb);
                                 spin_lock(&sinfo->lock);
                             }
                         }
@@ -4086,11 +5007,7 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
 
                     /* Unlock while calling up network stack */
                     spin_unlock(&sinfo->lock);
-                    if (use_napi) {
-                        netif_receive_skb(skb);
-                    } else {
-                        netif_rx(skb);
-                    }
+                    bkn_netif_rx_skb(sinfo, chan, skb);
                     spin_lock(&sinfo->lock);
 
                     /* Ensure that we reallocate SKB for this DCB */
@@ -4111,7 +5028,7 @@ bkn_do_skb_rx(bkn_switch_info_t *sinfo, int chan, int budget)
         } else {
             DBG_PKT(("Rx packet dropped.\n"));
             sinfo->rx[chan].pkts_d_no_match++;
-            priv->stats.rx_dropped++;
+            BKN_NETIF_STATS_INC(priv, rx, dropped);
         }
         dcb[sinfo->dcb_wsize-1] &= ~(1 << 31);
         if (++sinfo->rx[chan].dirty >= MAX_RX_DCBS) {
@@ -4289,13 +5206,12 @@ bkn_do_tx(bkn_switch_info_t *sinfo)
     }
 
     while (dcbs_done < MAX_TX_DCBS) {
-        char str[32];
         if (sinfo->tx.free == MAX_TX_DCBS) {
             break;
         }
-        sprintf(str, "Tx DCB (%d)", sinfo->tx.dirty);
         desc = &sinfo->tx.desc[sinfo->tx.dirty];
-        bkn_dump_dcb(str, desc->dcb_mem, sinfo->dcb_wsize, XGS_DMA_TX_CHAN);
+        bkn_dump_dcb("Tx DCB", sinfo->tx.dirty,
+                     desc->dcb_mem, sinfo->dcb_wsize, XGS_DMA_TX_CHAN);
         if ((desc->dcb_mem[sinfo->dcb_wsize-1] & (1 << 31)) == 0) {
             break;
         }
@@ -4463,7 +5379,7 @@ bkn_tx_cdma_chain_done(bkn_switch_info_t *sinfo, int done)
             sinfo->tx.api_dcb_chain = NULL;
             bkn_api_tx(sinfo);
             if ((++dcbs_done + done) >= MAX_TX_DCBS) {
-                if (sinfo->napi_poll_mode) {
+                if (sinfo->napi_poll_mode || sinfo->napi_per_chan) {
                     /* Request one extra poll to reschedule Tx */
                     sinfo->napi_poll_again = 1;
                 } else {
@@ -4583,17 +5499,81 @@ bkn_schedule_napi_poll(bkn_switch_info_t *sinfo)
 }
 
 static void
-bkn_napi_poll_complete(bkn_switch_info_t *sinfo)
+bkn_napi_poll_complete(bkn_switch_info_t *sinfo, int work_done)
 {
     /* Unlock while calling up network stack */
     spin_unlock(&sinfo->lock);
-    bkn_napi_complete(sinfo->dev, &sinfo->napi);
+    /* Flushes packets held by GRO */
+    bkn_napi_complete_done(sinfo->dev, &sinfo->napi, work_done);
     spin_lock(&sinfo->lock);
     /* Re-enable interrupts */
     sinfo->napi_poll_mode = 0;
+    if (sinfo->napi_per_chan) {
+        sinfo->irq_poll_mask &= ~xgsx_irq_chan_mask(sinfo, XGS_DMA_TX_CHAN);
+    }
+    if (sinfo->irq_poll_mask == 0) {
+        bkn_lat_done(sinfo);
+    }
     dev_irq_mask_set(sinfo, sinfo->irq_mask);
 }
 
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+static void
+xgsx_schedule_napi_chan_poll(bkn_switch_info_t *sinfo, uint32_t irq_stat)
+{
+    struct napi_struct *napi[NUM_RX_CHAN + 1];
+    uint32_t mask;
+    int chan, cnt = 0, idx;
+
+    irq_stat &= sinfo->irq_mask & ~sinfo->irq_poll_mask;
+
+    /* Disable channel interrupts until its poll job is complete */
+    for (chan = 0; chan < sinfo->rx_chans; chan++) {
+        mask = xgsx_irq_chan_mask(sinfo, XGS_DMA_RX_CHAN + chan);
+        if (irq_stat & mask) {
+            sinfo->irq_poll_mask |= mask;
+            napi[cnt++] = &sinfo->rx[chan].napi.napi;
+        }
+    }
+    /* Tx is done by the NAPI instance of the base device */
+    mask = xgsx_irq_chan_mask(sinfo, XGS_DMA_TX_CHAN);
+    if (irq_stat & mask) {
+        sinfo->irq_poll_mask |= mask;
+        napi[cnt++] = &sinfo->napi;
+    }
+    xgsx_irq_mask_set(sinfo, sinfo->irq_mask);
+
+    DBG_NAPI(("Schedule %d NAPI polls on %s.\n", cnt, sinfo->dev->name));
+    /* Unlock while calling up network stack */
+    spin_unlock(&sinfo->lock);
+    for (idx = 0; idx < cnt; idx++) {
+        if (bkn_napi_schedule_prep(sinfo->dev, napi[idx])) {
+            __bkn_napi_schedule(sinfo->dev, napi[idx]);
+        } else {
+            /* Most likely the base device is has not been opened */
+            gprintk("Warning: Unable to schedule NAPI - base device not up?\n");
+        }
+    }
+    spin_lock(&sinfo->lock);
+}
+
+static void
+bkn_napi_chan_poll_complete(bkn_switch_info_t *sinfo, int chan, int work_done)
+{
+    /* Unlock while calling up network stack */
+    spin_unlock(&sinfo->lock);
+    /* Flushes packets held by GRO */
+    bkn_napi_complete_done(sinfo->dev, &sinfo->rx[chan].napi.napi, work_done);
+    spin_lock(&sinfo->lock);
+    /* Re-enable channel interrupts */
+    sinfo->irq_poll_mask &= ~xgsx_irq_chan_mask(sinfo, XGS_DMA_RX_CHAN + chan);
+    if (sinfo->irq_poll_mask == 0) {
+        bkn_lat_done(sinfo);
+    }
+    xgsx_irq_mask_set(sinfo, sinfo->irq_mask);
+}
+#endif
+
 static int
 xgs_do_dma(bkn_switch_info_t *sinfo, int budget)
 {
@@ -4715,10 +5695,27 @@ xgsm_do_dma(bkn_switch_info_t *sinfo, int budget)
     return sinfo->poll_channels ? budget : rx_dcbs_done;
 }
 
+static void
+xgsx_do_tx_dma(bkn_switch_info_t *sinfo, uint32_t irq_stat, uint32_t tx_dma_stat)
+{
+    int tx_dcbs_done;
+
+    if ((irq_stat & CMICX_DS_CMC_CTRLD_INT(XGS_DMA_TX_CHAN)) ||
+        (tx_dma_stat & CMICX_DS_CMC_DMA_CHAIN_DONE)) {
+        if (CDMA_CH(sinfo, XGS_DMA_TX_CHAN)) {
+            xgsx_dma_desc_clear(sinfo, XGS_DMA_TX_CHAN);
+        } else {
+            xgsx_dma_chain_clear(sinfo, XGS_DMA_TX_CHAN);
+        }
+        tx_dcbs_done = bkn_do_tx(sinfo);
+        bkn_tx_chain_done(sinfo, tx_dcbs_done);
+    }
+}
+
 static int
 xgsx_do_dma(bkn_switch_info_t *sinfo, int budget)
 {
-    int rx_dcbs_done = 0, tx_dcbs_done = 0;
+    int rx_dcbs_done = 0;
     int chan_done, budget_chans = 0;
     uint32_t irq_stat, tx_dma_stat, rx_dma_stat[NUM_CMICX_RX_CHAN];
     int chan;
@@ -4770,20 +5767,54 @@ xgsx_do_dma(bkn_switch_info_t *sinfo, int budget)
         }
     }
 
-    if ((irq_stat & CMICX_DS_CMC_CTRLD_INT(XGS_DMA_TX_CHAN)) ||
-        (tx_dma_stat & CMICX_DS_CMC_DMA_CHAIN_DONE)) {
-        if (CDMA_CH(sinfo, XGS_DMA_TX_CHAN)) {
-            xgsx_dma_desc_clear(sinfo, XGS_DMA_TX_CHAN);
-        } else {
-            xgsx_dma_chain_clear(sinfo, XGS_DMA_TX_CHAN);
-        }
-        tx_dcbs_done = bkn_do_tx(sinfo);
-        bkn_tx_chain_done(sinfo, tx_dcbs_done);
-    }
+    xgsx_do_tx_dma(sinfo, irq_stat, tx_dma_stat);
 
     return sinfo->poll_channels ? budget : rx_dcbs_done;
 }
 
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+/* Rx DMA of a single channel for its own NAPI instance */
+static int
+xgsx_do_rx_chan_dma(bkn_switch_info_t *sinfo, int chan, int budget)
+{
+    int rx_dcbs_done;
+    uint32_t irq_stat, rx_dma_stat;
+
+    DEV_READ32(sinfo, CMICX_IRQ_STATr, &irq_stat);
+    DEV_READ32(sinfo,
+               CMICX_DMA_STATr + 0x80 * (XGS_DMA_RX_CHAN + chan),
+               &rx_dma_stat);
+
+    if ((irq_stat & CMICX_DS_CMC_CTRLD_INT(XGS_DMA_RX_CHAN + chan)) ||
+        (irq_stat & CMICX_DS_CMC_DESC_DONE(XGS_DMA_RX_CHAN + chan))) {
+        xgsx_dma_desc_clear(sinfo, XGS_DMA_RX_CHAN + chan);
+    }
+
+    rx_dcbs_done = bkn_do_rx(sinfo, chan, budget);
+    bkn_rx_desc_done(sinfo, chan);
+
+    if (!CDMA_CH(sinfo, XGS_DMA_RX_CHAN + chan) &&
+        (rx_dma_stat & CMICX_DS_CMC_DMA_CHAIN_DONE)) {
+        xgsx_dma_chain_clear(sinfo, XGS_DMA_RX_CHAN + chan);
+        bkn_rx_chain_done(sinfo, chan);
+    }
+
+    return rx_dcbs_done;
+}
+
+/* Tx DMA for the base device NAPI instance when Rx channels poll on their own */
+static void
+xgsx_do_tx_chan_dma(bkn_switch_info_t *sinfo)
+{
+    uint32_t irq_stat, tx_dma_stat;
+
+    DEV_READ32(sinfo, CMICX_IRQ_STATr, &irq_stat);
+    DEV_READ32(sinfo, CMICX_DMA_STATr + 0x80 * XGS_DMA_TX_CHAN, &tx_dma_stat);
+
+    xgsx_do_tx_dma(sinfo, irq_stat, tx_dma_stat);
+}
+#endif
+
 static int
 dev_do_dma(bkn_switch_info_t *sinfo, int budget)
 {
@@ -4808,6 +5839,7 @@ xgs_isr(bkn_switch_info_t *sinfo)
         return;
     }
     sinfo->interrupts++;
+    bkn_lat_isr(sinfo);
 
     DBG_IRQ(("Got interrupt on device %d (0x%08x)\n",
              sinfo->dev_no, irq_stat));
@@ -4819,6 +5851,7 @@ xgs_isr(bkn_switch_info_t *sinfo)
         do {
             rx_dcbs_done = xgs_do_dma(sinfo, MAX_RX_DCBS);
         } while (rx_dcbs_done);
+        bkn_lat_done(sinfo);
     }
 
     xgs_irq_mask_set(sinfo, sinfo->irq_mask);
@@ -4836,6 +5869,7 @@ xgsm_isr(bkn_switch_info_t *sinfo)
         return;
     }
     sinfo->interrupts++;
+    bkn_lat_isr(sinfo);
 
     DBG_IRQ(("Got interrupt on device %d (0x%08x)\n",
              sinfo->dev_no, irq_stat));
@@ -4853,6 +5887,7 @@ xgsm_isr(bkn_switch_info_t *sinfo)
                 }
             }
         } while (rx_dcbs_done);
+        bkn_lat_done(sinfo);
     }
 
     xgsm_irq_mask_set(sinfo, sinfo->irq_mask);
@@ -4865,15 +5900,22 @@ xgsx_isr(bkn_switch_info_t *sinfo)
     int rx_dcbs_done;
 
     DEV_READ32(sinfo, CMICX_IRQ_STATr, &irq_stat);
-    if ((irq_stat & sinfo->irq_mask) == 0) {
+    if ((irq_stat & sinfo->irq_mask & ~sinfo->irq_poll_mask) == 0) {
         /* Not ours */
         return;
     }
     sinfo->interrupts++;
+    bkn_lat_isr(sinfo);
 
     DBG_IRQ(("Got interrupt on device %d (0x%08x)\n",
              sinfo->dev_no, irq_stat));
 
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+    if (sinfo->napi_per_chan) {
+        xgsx_schedule_napi_chan_poll(sinfo, irq_stat);
+        return;
+    }
+#endif
     if (use_napi) {
         bkn_schedule_napi_poll(sinfo);
     } else {
@@ -4887,6 +5929,7 @@ xgsx_isr(bkn_switch_info_t *sinfo)
                 }
             }
         } while (rx_dcbs_done);
+        bkn_lat_done(sinfo);
     }
 
     xgsx_irq_mask_set(sinfo, sinfo->irq_mask);
@@ -4988,12 +6031,22 @@ bkn_open(struct net_device *dev)
     bkn_priv_t *priv = netdev_priv(dev);
     bkn_switch_info_t *sinfo = priv->sinfo;
     unsigned long flags;
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+    int chan;
+#endif
 
     /* Check if base device */
     if (priv->id <= 0) {
         /* NAPI used only on base device */
         if (use_napi) {
             bkn_napi_enable(dev, &sinfo->napi);
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+            if (napi_per_chan) {
+                for (chan = 0; chan < NUM_RX_CHAN; chan++) {
+                    bkn_napi_enable(dev, &sinfo->rx[chan].napi.napi);
+                }
+            }
+#endif
         }
 
         /* Start DMA when base device is started */
@@ -5120,6 +6173,7 @@ bkn_poll(struct net_device *dev, int *budget)
 
     DBG_NAPI(("NAPI poll on %s.\n", dev->name));
 
+    bkn_lat_poll(sinfo);
     sinfo->napi_poll_again = 0;
 
     if (cur_budget > dev->quota) {
@@ -5136,7 +6190,7 @@ bkn_poll(struct net_device *dev, int *budget)
         poll_again = 1;
         sinfo->napi_not_done++;
     } else {
-        bkn_napi_poll_complete(sinfo);
+        bkn_napi_poll_complete(sinfo, rx_dcbs_done);
     }
 
     spin_unlock_irqrestore(&sinfo->lock, flags);
@@ -5155,16 +6209,60 @@ bkn_poll(struct napi_struct *napi, int budget)
 
     DBG_NAPI(("NAPI poll on %s.\n", sinfo->dev->name));
 
+    bkn_lat_poll(sinfo);
     sinfo->napi_poll_again = 0;
 
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+    if (sinfo->napi_per_chan) {
+        /* Rx channels are polled by their own NAPI instances */
+        xgsx_do_tx_chan_dma(sinfo);
+        rx_dcbs_done = 0;
+    } else {
+        rx_dcbs_done = dev_do_dma(sinfo, budget);
+    }
+#else
     rx_dcbs_done = dev_do_dma(sinfo, budget);
+#endif
 
     if (sinfo->napi_poll_again || rx_dcbs_done >= budget) {
         /* Force poll again */
         rx_dcbs_done = budget;
         sinfo->napi_not_done++;
     } else {
-        bkn_napi_poll_complete(sinfo);
+        bkn_napi_poll_complete(sinfo, rx_dcbs_done);
+    }
+
+    spin_unlock_irqrestore(&sinfo->lock, flags);
+
+    return rx_dcbs_done;
+}
+#endif
+
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+static int
+bkn_poll_chan(struct napi_struct *napi, int budget)
+{
+    bkn_rx_napi_t *rx_napi = container_of(napi, bkn_rx_napi_t, napi);
+    bkn_switch_info_t *sinfo = rx_napi->sinfo;
+    int chan = rx_napi->chan;
+    int rx_dcbs_done;
+    unsigned long flags;
+
+    spin_lock_irqsave(&sinfo->lock, flags);
+
+    DBG_NAPI(("NAPI poll on %s Rx channel %d.\n", sinfo->dev->name, chan));
+
+    bkn_lat_poll(sinfo);
+    sinfo->rx[chan].napi_poll_again = 0;
+
+    rx_dcbs_done = xgsx_do_rx_chan_dma(sinfo, chan, budget);
+
+    if (sinfo->rx[chan].napi_poll_again || rx_dcbs_done >= budget) {
+        /* Force poll again */
+        rx_dcbs_done = budget;
+        sinfo->napi_not_done++;
+    } else {
+        bkn_napi_chan_poll_complete(sinfo, chan, rx_dcbs_done);
     }
 
     spin_unlock_irqrestore(&sinfo->lock, flags);
@@ -5179,6 +6277,9 @@ bkn_stop(struct net_device *dev)
     bkn_priv_t *priv = netdev_priv(dev);
     bkn_switch_info_t *sinfo = priv->sinfo;
     unsigned long flags;
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+    int chan;
+#endif
 
     netif_stop_queue(dev);
 
@@ -5187,6 +6288,13 @@ bkn_stop(struct net_device *dev)
         /* NAPI used only on base device */
         if (use_napi) {
             bkn_napi_disable(dev, &sinfo->napi);
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+            if (napi_per_chan) {
+                for (chan = 0; chan < NUM_RX_CHAN; chan++) {
+                    bkn_napi_disable(dev, &sinfo->rx[chan].napi.napi);
+                }
+            }
+#endif
         }
         /* Suspend all devices if base device is stopped */
         if (basedev_suspend) {
@@ -5200,6 +6308,62 @@ bkn_stop(struct net_device *dev)
     return 0;
 }
 
+#ifdef BKN_PCPU_STATS_SUPPORT
+/* Sum up the per-CPU counters of a netif */
+static void
+bkn_netif_stats_fold(bkn_priv_t *priv, struct rtnl_link_stats64 *stats)
+{
+    bkn_pcpu_stats_t *ps;
+    u64 rx_packets, rx_bytes, rx_errors, rx_dropped;
+    u64 tx_packets, tx_bytes, tx_dropped;
+    unsigned int start;
+    int cpu;
+
+    for_each_possible_cpu(cpu) {
+        ps = per_cpu_ptr(priv->pcpu_stats, cpu);
+        do {
+            start = bkn_u64_stats_fetch_begin(&ps->rx_syncp);
+            rx_packets = ps->rx_packets;
+            rx_bytes = ps->rx_bytes;
+            rx_errors = ps->rx_errors;
+            rx_dropped = ps->rx_dropped;
+        } while (bkn_u64_stats_fetch_retry(&ps->rx_syncp, start));
+        do {
+            start = bkn_u64_stats_fetch_begin(&ps->tx_syncp);
+            tx_packets = ps->tx_packets;
+            tx_bytes = ps->tx_bytes;
+            tx_dropped = ps->tx_dropped;
+        } while (bkn_u64_stats_fetch_retry(&ps->tx_syncp, start));
+
+        stats->rx_packets += rx_packets;
+        stats->rx_bytes += rx_bytes;
+        stats->rx_errors += rx_errors;
+        stats->rx_dropped += rx_dropped;
+        stats->tx_packets += tx_packets;
+        stats->tx_bytes += tx_bytes;
+        stats->tx_dropped += tx_dropped;
+    }
+}
+
+/*
+ * Network Device Statistics.
+ * Cleared at init time.
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,11,0)
+static void
+bkn_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
+{
+    bkn_netif_stats_fold(netdev_priv(dev), stats);
+}
+#else
+static struct rtnl_link_stats64 *
+bkn_get_stats64(struct net_device *dev, struct rtnl_link_stats64 *stats)
+{
+    bkn_netif_stats_fold(netdev_priv(dev), stats);
+    return stats;
+}
+#endif
+#else
 /*
  * Network Device Statistics.
  * Cleared at init time.
@@ -5211,6 +6375,7 @@ bkn_get_stats(struct net_device *dev)
 
     return &priv->stats;
 }
+#endif
 
 /* Fake multicast ability */
 static void
@@ -5257,11 +6422,14 @@ bkn_hw_tstamp_tx_config(bkn_switch_info_t *sinfo, struct sk_buff *skb, uint32_t
 }
 
 static int
-bkn_tx(struct sk_buff *skb, struct net_device *dev)
+bkn_tx_skb(struct sk_buff *skb, struct net_device *dev, int xmit_more)
 {
     bkn_priv_t *priv = netdev_priv(dev);
     bkn_switch_info_t *sinfo = priv->sinfo;
-    struct sk_buff *new_skb = NULL;
+    bkn_desc_info_t *desc;
+    uint32_t dcb_buf[BKN_DCB_WSIZE_MAX];
+    uint32_t *dcb, *meta;
+    uint64_t skb_dma;
     unsigned char *pktdata;
     int pktlen, hdrlen, taglen, rcpulen, metalen;
     int sop, idx;
@@ -5273,25 +6441,26 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
 
     if (priv->id <= 0) {
         /* Do not transmit on base device */
-        priv->stats.tx_dropped++;
+        BKN_NETIF_STATS_INC(priv, tx, dropped);
         dev_kfree_skb_any(skb);
         return 0;
     }
 
     if (!netif_carrier_ok(dev)) {
         DBG_WARN(("Tx drop: Netif link is down.\n"));
-        priv->stats.tx_dropped++;
+        BKN_NETIF_STATS_INC(priv, tx, dropped);
         sinfo->tx.pkts_d_no_link++;
         dev_kfree_skb_any(skb);
         return 0;
     }
 
-    spin_lock_irqsave(&sinfo->lock, flags);
-
+    /*
+     * The packet and its DCB are prepared without holding the lock,
+     * which is only taken to add the DCB to the Tx ring. Resources are
+     * checked up front, so that a packet that is requeued has not been
+     * modified yet.
+     */
     if (sinfo->tx.free > 1) {
-        bkn_desc_info_t *desc = &sinfo->tx.desc[sinfo->tx.cur];
-        uint32_t *dcb, *meta;
-
         pktdata = skb->data;
         pktlen = skb->len;
         hdrlen = (sinfo->cmic_type == 'x' ) ? ((device_is_dnx(sinfo)) ? priv->system_headers_size: PKT_TX_HDR_SIZE) : 0;
@@ -5302,19 +6471,17 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
             rcpulen = RCPU_HDR_SIZE;
             if (skb->len < (rcpulen + 14)) {
                 DBG_WARN(("Tx drop: Invalid RCPU encapsulation\n"));
-                priv->stats.tx_dropped++;
+                BKN_NETIF_STATS_INC(priv, tx, dropped);
                 sinfo->tx.pkts_d_rcpu_encap++;
                 dev_kfree_skb_any(skb);
-                spin_unlock_irqrestore(&sinfo->lock, flags);
                 return 0;
             }
             if (check_rcpu_signature &&
                 ((skb->data[18] << 8) | skb->data[19]) != sinfo->rcpu_sig) {
                 DBG_WARN(("Tx drop: Invalid RCPU signature\n"));
-                priv->stats.tx_dropped++;
+                BKN_NETIF_STATS_INC(priv, tx, dropped);
                 sinfo->tx.pkts_d_rcpu_sig++;
                 dev_kfree_skb_any(skb);
-                spin_unlock_irqrestore(&sinfo->lock, flags);
                 return 0;
             }
             if (skb->data[21] & RCPU_F_MODHDR) {
@@ -5327,10 +6494,9 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
                     break;
                 default:
                     DBG_WARN(("Tx drop: Invalid RCPU meta data\n"));
-                    priv->stats.tx_dropped++;
+                    BKN_NETIF_STATS_INC(priv, tx, dropped);
                     sinfo->tx.pkts_d_rcpu_meta++;
                     dev_kfree_skb_any(skb);
-                    spin_unlock_irqrestore(&sinfo->lock, flags);
                     return 0;
                 }
                 if (sinfo->cmic_type != 'x') {
@@ -5346,33 +6512,20 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
                 hdrlen = 0;
                 tpid = (pktdata[12] << 8) | pktdata[13];
                 if (tpid != 0x8100) {
-                    if (skb_header_cloned(skb)) {
-                        /* Current SKB cannot be modified */
-                        DBG_SKB(("Realloc Tx SKB\n"));
-                        new_skb = dev_alloc_skb(pktlen + TAG_SZ + FCS_SZ);
-                        if (new_skb == NULL) {
-                            DBG_WARN(("Tx drop: No SKB memory\n"));
-                            priv->stats.tx_dropped++;
-                            sinfo->tx.pkts_d_no_skb++;
-                            dev_kfree_skb_any(skb);
-                            spin_unlock_irqrestore(&sinfo->lock, flags);
-                            return 0;
-                        }
-                        memcpy(new_skb->data, pktdata, 12);
-                        memcpy(&new_skb->data[16], &pktdata[12], pktlen - 12);
-                        skb_put(new_skb, pktlen + TAG_SZ);
+                    /* Copies the header only if it is shared */
+                    if (skb_cow_head(skb, 0) < 0) {
+                        DBG_WARN(("Tx drop: No SKB memory\n"));
+                        BKN_NETIF_STATS_INC(priv, tx, dropped);
+                        sinfo->tx.pkts_d_no_skb++;
                         dev_kfree_skb_any(skb);
-                        skb = new_skb;
-                        pktdata = skb->data;
-                        rcpulen = 0;
-                    } else {
-                        /* Add tag to RCPU header space */
-                        DBG_SKB(("Expand into unused RCPU header\n"));
-                        rcpulen -= TAG_SZ;
-                        pktdata = &skb->data[rcpulen];
-                        for (idx = 0; idx < 12; idx++) {
-                            pktdata[idx] = pktdata[idx + TAG_SZ];
-                        }
+                        return 0;
+                    }
+                    /* Add tag to RCPU header space */
+                    DBG_SKB(("Expand into unused RCPU header\n"));
+                    rcpulen -= TAG_SZ;
+                    pktdata = &skb->data[rcpulen];
+                    for (idx = 0; idx < 12; idx++) {
+                        pktdata[idx] = pktdata[idx + TAG_SZ];
                     }
                     pktdata[12] = 0x81;
                     pktdata[13] = 0x00;
@@ -5383,30 +6536,19 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
             }
         } else {
             if (sinfo->cmic_type == 'x' && priv->port >= 0) {
-                if (skb_header_cloned(skb) || skb_headroom(skb) < hdrlen + 4) {
-                    /* Current SKB cannot be modified */
-                    DBG_SKB(("Realloc Tx SKB\n"));
-                    new_skb = dev_alloc_skb(pktlen + hdrlen + 4 + FCS_SZ);
-                    if (new_skb == NULL) {
-                        DBG_WARN(("Tx drop: No SKB memory\n"));
-                        priv->stats.tx_dropped++;
-                        sinfo->tx.pkts_d_no_skb++;
-                        dev_kfree_skb_any(skb);
-                        spin_unlock_irqrestore(&sinfo->lock, flags);
-                        return 0;
-                    }
-                    if (!device_is_dnx(sinfo))
-                    {
-                        skb_reserve(new_skb, 4);
-                    }
-                    memcpy(new_skb->data + hdrlen, skb->data, pktlen);
-                    skb_put(new_skb, pktlen + hdrlen);
+                /*
+                 * Netifs ask for enough headroom for the header and a
+                 * VLAN tag, so the SKB is only reallocated if shared
+                 */
+                if (skb_cow_head(skb, hdrlen + TAG_SZ) < 0) {
+                    DBG_WARN(("Tx drop: No SKB memory\n"));
+                    BKN_NETIF_STATS_INC(priv, tx, dropped);
+                    sinfo->tx.pkts_d_no_skb++;
                     dev_kfree_skb_any(skb);
-                    skb = new_skb;
-                } else {
-                    DBG_SKB(("Expand Tx SKB\n"));
-                    skb_push(skb, hdrlen);
+                    return 0;
                 }
+                DBG_SKB(("Expand Tx SKB\n"));
+                skb_push(skb, hdrlen);
                 memset(skb->data, 0, hdrlen);
                 pktdata = skb->data;
                 pktlen += hdrlen;
@@ -5419,31 +6561,18 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
                 /* Need to add VLAN tag if packet is untagged */
                 tpid = (skb->data[hdrlen + 12] << 8) | skb->data[hdrlen + 13];
                 if (tpid != 0x8100) {
-                    if (skb_header_cloned(skb) || skb_headroom(skb) < 4) {
-                        /* Current SKB cannot be modified */
-                        DBG_SKB(("Realloc Tx SKB\n"));
-                        new_skb = dev_alloc_skb(pktlen + TAG_SZ + FCS_SZ);
-                        if (new_skb == NULL) {
-                            DBG_WARN(("Tx drop: No SKB memory\n"));
-                            priv->stats.tx_dropped++;
-                            sinfo->tx.pkts_d_no_skb++;
-                            dev_kfree_skb_any(skb);
-                            spin_unlock_irqrestore(&sinfo->lock, flags);
-                            return 0;
-                        }
-                        memcpy(new_skb->data, skb->data, hdrlen + 12);
-                        memcpy(&new_skb->data[hdrlen + 16], &skb->data[hdrlen + 12],
-                               pktlen - hdrlen - 12);
-                        skb_put(new_skb, pktlen + TAG_SZ);
+                    if (skb_cow_head(skb, TAG_SZ) < 0) {
+                        DBG_WARN(("Tx drop: No SKB memory\n"));
+                        BKN_NETIF_STATS_INC(priv, tx, dropped);
+                        sinfo->tx.pkts_d_no_skb++;
                         dev_kfree_skb_any(skb);
-                        skb = new_skb;
-                    } else {
-                        /* Add tag to existing buffer */
-                        DBG_SKB(("Expand Tx SKB\n"));
-                        skb_push(skb, TAG_SZ);
-                        for (idx = 0; idx < hdrlen + 12; idx++) {
-                            skb->data[idx] = skb->data[idx + TAG_SZ];
-                        }
+                        return 0;
+                    }
+                    /* Add tag to existing buffer */
+                    DBG_SKB(("Expand Tx SKB\n"));
+                    skb_push(skb, TAG_SZ);
+                    for (idx = 0; idx < hdrlen + 12; idx++) {
+                        skb->data[idx] = skb->data[idx + TAG_SZ];
                     }
                     pktdata = skb->data;
                     pktdata[hdrlen + 12] = 0x81;
@@ -5465,10 +6594,9 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
             pktlen = (60 + taglen + hdrlen);
             if (SKB_PADTO(skb, pktlen) != 0) {
                 DBG_WARN(("Tx drop: skb_padto failed\n"));
-                priv->stats.tx_dropped++;
+                BKN_NETIF_STATS_INC(priv, tx, dropped);
                 sinfo->tx.pkts_d_pad_fail++;
                 dev_kfree_skb_any(skb);
-                spin_unlock_irqrestore(&sinfo->lock, flags);
                 return 0;
             }
             /* skb_padto may update the skb->data pointer */
@@ -5479,13 +6607,12 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
             DBG_WARN(("Tx drop: size of pkt (%d) is out of range(%d)\n",
                      (pktlen + FCS_SZ), SOC_DCB_KNET_COUNT_MASK));
             sinfo->tx.pkts_d_over_limit++;
-            priv->stats.tx_dropped++;
+            BKN_NETIF_STATS_INC(priv, tx, dropped);
             dev_kfree_skb_any(skb);
-            spin_unlock_irqrestore(&sinfo->lock, flags);
             return 0;
         }
 
-        dcb = desc->dcb_mem;
+        dcb = dcb_buf;
         meta = (sinfo->cmic_type == 'x') ? (uint32_t *)pktdata : dcb;
         memset(dcb, 0, sinfo->dcb_wsize * sizeof(uint32_t));
         if (priv->flags & KCOM_NETIF_F_RCPU_ENCAP) {
@@ -5535,27 +6662,15 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
                 {
                     if (priv->type == KCOM_NETIF_T_PORT) {
                         /* add PTCH ITMH header */
-                        if (skb_header_cloned(skb) || skb_headroom(skb) < 4) {
-                           /* Current SKB cannot be modified */
-                           DBG_SKB(("Realloc Tx SKB for DNX ITMH header\n"));
-                           new_skb = dev_alloc_skb(pktlen + 4 + 2 + FCS_SZ);
-                           if (new_skb == NULL) {
-                               DBG_WARN(("Tx drop: No SKB memory for DNX ITMH header\n"));
-                               priv->stats.tx_dropped++;
-                               sinfo->tx.pkts_d_no_skb++;
-                               dev_kfree_skb_any(skb);
-                               spin_unlock_irqrestore(&sinfo->lock, flags);
-                               return 0;
-                           }
-                           memcpy(&new_skb->data[6], skb->data, pktlen);
-                           skb_put(new_skb, pktlen + 6);
-                           dev_kfree_skb_any(skb);
-                           skb = new_skb;
-                        } else {
-                           /* Add tag to existing buffer */
-                           DBG_SKB(("Expand Tx SKB for DNX ITMH header\n"));
-                           skb_push(skb, 6);
+                        if (skb_cow_head(skb, 6) < 0) {
+                            DBG_WARN(("Tx drop: No SKB memory for DNX ITMH header\n"));
+                            BKN_NETIF_STATS_INC(priv, tx, dropped);
+                            sinfo->tx.pkts_d_no_skb++;
+                            dev_kfree_skb_any(skb);
+                            return 0;
                         }
+                        DBG_SKB(("Expand Tx SKB for DNX ITMH header\n"));
+                        skb_push(skb, 6);
                         pktdata = skb->data;
                         pktdata[0] = 0x50;
                         pktdata[1] = 0x00;
@@ -5564,27 +6679,15 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
                     }
                     else if (priv->type == KCOM_NETIF_T_VLAN) {
                         /* add PTCH header */
-                        if (skb_header_cloned(skb) || skb_headroom(skb) < 4) {
-                            /* Current SKB cannot be modified */
-                            DBG_SKB(("Realloc Tx SKB for DNX header\n"));
-                            new_skb = dev_alloc_skb(pktlen + 2 + FCS_SZ);
-                            if (new_skb == NULL) {
-                                DBG_WARN(("Tx drop: No SKB memory for DNX header\n"));
-                                priv->stats.tx_dropped++;
-                                sinfo->tx.pkts_d_no_skb++;
-                                dev_kfree_skb_any(skb);
-                                spin_unlock_irqrestore(&sinfo->lock, flags);
-                                return 0;
-                            }
-                            memcpy(&new_skb->data[2], skb->data, pktlen);
-                            skb_put(new_skb, pktlen + 2);
+                        if (skb_cow_head(skb, 2) < 0) {
+                            DBG_WARN(("Tx drop: No SKB memory for DNX header\n"));
+                            BKN_NETIF_STATS_INC(priv, tx, dropped);
+                            sinfo->tx.pkts_d_no_skb++;
                             dev_kfree_skb_any(skb);
-                            skb = new_skb;
-                        } else {
-                            /* Add tag to existing buffer */
-                            DBG_SKB(("Expand Tx SKB for DNX header\n"));
-                            skb_push(skb, 2);
+                            return 0;
                         }
+                        DBG_SKB(("Expand Tx SKB for DNX header\n"));
+                        skb_push(skb, 2);
                         pktdata = skb->data;
                         pktdata[0] = 0xd0;
                         pktdata[1] = priv->port;
@@ -5667,9 +6770,8 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
             if (skb == NULL) {
                 /* Consumed by call-back */
                 DBG_WARN(("Tx drop: Consumed by call-back\n"));
-                priv->stats.tx_dropped++;
+                BKN_NETIF_STATS_INC(priv, tx, dropped);
                 sinfo->tx.pkts_d_callback++;
-                spin_unlock_irqrestore(&sinfo->lock, flags);
                 return 0;
             }
             /* Restore (possibly) altered packet variables
@@ -5681,10 +6783,9 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
                     pktlen = (60 + taglen + hdrlen);
                     if (SKB_PADTO(skb, pktlen) != 0) {
                         DBG_WARN(("Tx drop: skb_padto failed\n"));
-                        priv->stats.tx_dropped++;
+                        BKN_NETIF_STATS_INC(priv, tx, dropped);
                         sinfo->tx.pkts_d_pad_fail++;
                         dev_kfree_skb_any(skb);
-                        spin_unlock_irqrestore(&sinfo->lock, flags);
                         return 0;
                     }
                     DBG_SKB(("Packet padded to %d bytes after tx callback\n", pktlen));
@@ -5697,10 +6798,9 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
                 DBG_WARN(("Tx drop: size of pkt (%d) is out of range(%d)\n",
                          (pktlen + FCS_SZ), SOC_DCB_KNET_COUNT_MASK));
                 sinfo->tx.pkts_d_over_limit++;
-                priv->stats.tx_dropped++;
+                BKN_NETIF_STATS_INC(priv, tx, dropped);
                 sinfo->tx.pkts_d_callback++;
                 dev_kfree_skb_any(skb);
-                spin_unlock_irqrestore(&sinfo->lock, flags);
                 return 0;
             }
         }
@@ -5716,22 +6816,19 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
         }
 
         /* Prepare for DMA */
-        desc->skb = skb;
         /* Add FCS bytes */
         pktlen = pktlen + FCS_SZ;
-        desc->dma_size = pktlen;
-        desc->skb_dma = DMA_MAP_SINGLE(sinfo->dma_dev,
-                                       pktdata, desc->dma_size,
-                                       DMA_TODEV);
-        if (DMA_MAPPING_ERROR(sinfo->dma_dev, desc->skb_dma)) {
-            priv->stats.tx_dropped++;
+        skb_dma = DMA_MAP_SINGLE(sinfo->dma_dev,
+                                 pktdata, pktlen,
+                                 DMA_TODEV);
+        if (DMA_MAPPING_ERROR(sinfo->dma_dev, skb_dma)) {
+            BKN_NETIF_STATS_INC(priv, tx, dropped);
             dev_kfree_skb_any(skb);
-            spin_unlock_irqrestore(&sinfo->lock, flags);
             return 0;
         }
-        dcb[0] = desc->skb_dma;
+        dcb[0] = skb_dma;
         if (sinfo->cmic_type == 'x') {
-            dcb[1] = DMA_TO_BUS_HI(desc->skb_dma >> 32);
+            dcb[1] = DMA_TO_BUS_HI(skb_dma >> 32);
             dcb[2] &= ~SOC_DCB_KNET_COUNT_MASK;
             dcb[2] |= pktlen;
         } else {
@@ -5739,19 +6836,42 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
             dcb[1] |= pktlen;
         }
 
-        bkn_dump_dcb("Tx RCPU", dcb, sinfo->dcb_wsize, XGS_DMA_TX_CHAN);
-        DBG_DCB_TX(("Add Tx DCB @ 0x%08x (%d) [%d free] (%d bytes).\n",
-                    (uint32_t)desc->dcb_dma, sinfo->tx.cur,
-                    sinfo->tx.free, pktlen));
-        bkn_dump_pkt(pktdata, pktlen, XGS_DMA_TX_CHAN);
-
         if (CDMA_CH(sinfo, XGS_DMA_TX_CHAN)) {
             if (sinfo->cmic_type == 'x') {
                 dcb[2] |= 1 << 24 | 1 << 16;
             } else {
                 dcb[1] |= 1 << 24 | 1 << 16;
             }
-        } else {
+        }
+
+        spin_lock_irqsave(&sinfo->lock, flags);
+
+        if (sinfo->tx.free <= 1) {
+            /* Another netif took the last DCBs */
+            DBG_VERB(("Tx drop: No DMA resources\n"));
+            sinfo->tx.pkts_d_dma_resrc++;
+            bkn_suspend_tx(sinfo);
+            spin_unlock_irqrestore(&sinfo->lock, flags);
+            DMA_UNMAP_SINGLE(sinfo->dma_dev, skb_dma, pktlen, DMA_TODEV);
+            BKN_NETIF_STATS_INC(priv, tx, dropped);
+            dev_kfree_skb_any(skb);
+            return 0;
+        }
+
+        desc = &sinfo->tx.desc[sinfo->tx.cur];
+        memcpy(desc->dcb_mem, dcb, sinfo->dcb_wsize * sizeof(uint32_t));
+        desc->skb = skb;
+        desc->skb_dma = skb_dma;
+        desc->dma_size = pktlen;
+
+        bkn_dump_dcb("Tx RCPU", sinfo->tx.cur,
+                     desc->dcb_mem, sinfo->dcb_wsize, XGS_DMA_TX_CHAN);
+        DBG_DCB_TX(("Add Tx DCB @ 0x%08x (%d) [%d free] (%d bytes).\n",
+                    (uint32_t)desc->dcb_dma, sinfo->tx.cur,
+                    sinfo->tx.free, pktlen));
+        bkn_dump_pkt(pktdata, pktlen, XGS_DMA_TX_CHAN);
+
+        if (!CDMA_CH(sinfo, XGS_DMA_TX_CHAN)) {
             bkn_tx_dma_start(sinfo);
         }
         if (++sinfo->tx.cur >= MAX_TX_DCBS) {
@@ -5760,15 +6880,21 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
         sinfo->tx.free--;
 
         if (CDMA_CH(sinfo, XGS_DMA_TX_CHAN) && !sinfo->tx.api_active) {
-            /* DMA run to the new halt location */
-            bkn_cdma_goto(sinfo, XGS_DMA_TX_CHAN,
-                          sinfo->tx.desc[sinfo->tx.cur].dcb_dma);
+            if (xmit_more && sinfo->tx.free > 1) {
+                /* More packets follow, move the halt location once for all */
+                sinfo->tx.goto_pending = 1;
+            } else {
+                /* DMA run to the new halt location */
+                sinfo->tx.goto_pending = 0;
+                bkn_cdma_goto(sinfo, XGS_DMA_TX_CHAN,
+                              sinfo->tx.desc[sinfo->tx.cur].dcb_dma);
+            }
         }
 
-        priv->stats.tx_packets++;
-        priv->stats.tx_bytes += pktlen;
+        BKN_NETIF_STATS_PKT(priv, tx, pktlen);
         sinfo->tx.pkts++;
     } else {
+        spin_lock_irqsave(&sinfo->lock, flags);
 #ifdef SAI_FIXUP    /* SDK-224448 */
         DBG_VERB(("Tx busy: No DMA resources\n"));
         sinfo->tx.pkts_d_dma_resrc++;
@@ -5787,6 +6913,31 @@ bkn_tx(struct sk_buff *skb, struct net_device *dev)
     return 0;
 }
 
+static int
+bkn_tx(struct sk_buff *skb, struct net_device *dev)
+{
+    bkn_priv_t *priv = netdev_priv(dev);
+    bkn_switch_info_t *sinfo = priv->sinfo;
+    int xmit_more = bkn_netdev_xmit_more(skb);
+    unsigned long flags;
+    int rv;
+
+    rv = bkn_tx_skb(skb, dev, xmit_more);
+
+    /* Move a halt location deferred by earlier packets, whatever became of this one */
+    if ((!xmit_more || rv != 0) && sinfo->tx.goto_pending) {
+        spin_lock_irqsave(&sinfo->lock, flags);
+        if (sinfo->tx.goto_pending && !sinfo->tx.api_active) {
+            bkn_cdma_goto(sinfo, XGS_DMA_TX_CHAN,
+                          sinfo->tx.desc[sinfo->tx.cur].dcb_dma);
+        }
+        sinfo->tx.goto_pending = 0;
+        spin_unlock_irqrestore(&sinfo->lock, flags);
+    }
+
+    return rv;
+}
+
 static void
 bkn_timer_func(bkn_switch_info_t *sinfo)
 {
@@ -5839,17 +6990,13 @@ bkn_timer(struct timer_list *t)
 static void
 bkn_rx_add_tokens(bkn_switch_info_t *sinfo, int chan)
 {
-    unsigned long cur_jif, ticks;
-    uint32_t tokens_per_tick;
     bkn_desc_info_t *desc;
 
-    tokens_per_tick = sinfo->rx[chan].rate_max / HZ;
-    cur_jif = jiffies;
-    ticks = cur_jif - sinfo->rx[chan].tok_jif;
-    sinfo->rx[chan].tokens += ticks * tokens_per_tick;
-    sinfo->rx[chan].tok_jif = cur_jif;
-    if (sinfo->rx[chan].tokens > sinfo->rx[chan].burst_max) {
-        sinfo->rx[chan].tokens = sinfo->rx[chan].burst_max;
+    bkn_rx_tokens_update(sinfo, chan);
+    if (sinfo->rx[chan].tokens <= MAX_RX_DCBS) {
+        /* Not there yet */
+        bkn_rxtick_arm(sinfo, chan);
+        return;
     }
 
     /* Restart channel if Rx is suppressed */
@@ -5868,107 +7015,52 @@ bkn_rx_add_tokens(bkn_switch_info_t *sinfo, int chan)
     }
 }
 
-static void
-bkn_rxtick_func(bkn_switch_info_t *sinfo)
+static enum hrtimer_restart
+bkn_rxtick(struct hrtimer *t)
 {
+    bkn_switch_info_t *sinfo = container_of(t, bkn_switch_info_t, rxtick);
     unsigned long flags;
-    unsigned long cur_jif, ticks;
-    uint32_t pkt_diff;
     int chan;
 
     spin_lock_irqsave(&sinfo->lock, flags);
 
-    sinfo->rxtick.expires = jiffies + sinfo->rxtick_jiffies;
-
-    /* For debug purposes we maintain a rough actual packet rate */
-    if (++sinfo->rxticks >= sinfo->rxticks_per_sec) {
-        for (chan = 0; chan < sinfo->rx_chans; chan++) {
-            pkt_diff = sinfo->rx[chan].pkts - sinfo->rx[chan].pkts_ref;
-            cur_jif = jiffies;
-            ticks = cur_jif - sinfo->rx[chan].rate_jif;
-            sinfo->rx[chan].rate = (pkt_diff * HZ) / ticks;
-            sinfo->rx[chan].rate_jif = cur_jif;
-            sinfo->rx[chan].pkts_ref = sinfo->rx[chan].pkts;
-        }
-        sinfo->rxticks = 0;
-    }
+    sinfo->rxticks++;
 
-    /* Update tokens for Rx rate control */
     for (chan = 0; chan < sinfo->rx_chans; chan++) {
-        if (sinfo->rx[chan].tokens < sinfo->rx[chan].burst_max) {
+        if (sinfo->rx[chan].use_rx_skb) {
             bkn_rx_add_tokens(sinfo, chan);
         }
     }
 
     spin_unlock_irqrestore(&sinfo->lock, flags);
 
-    add_timer(&sinfo->rxtick);
-}
-
-#if (LINUX_VERSION_CODE < KERNEL_VERSION(4,15,0))
-static void
-bkn_rxtick(unsigned long context)
-{
-    bkn_switch_info_t *sinfo = (bkn_switch_info_t *)context;
-    return bkn_rxtick_func(sinfo);
-}
-#else
-static void
-bkn_rxtick(struct timer_list *t)
-{
-    bkn_switch_info_t *sinfo = from_timer(sinfo, t, rxtick);
-    return bkn_rxtick_func(sinfo);
+    return HRTIMER_NORESTART;
 }
-#endif
 
 static void
 bkn_rx_rate_config(bkn_switch_info_t *sinfo)
 {
     unsigned long flags;
     int chan;
-    uint32_t rxticks_per_sec, rps;
-    uint32_t jiffies_per_rxtick;
-    uint32_t tokens_per_rxtick;
 
     spin_lock_irqsave(&sinfo->lock, flags);
 
-    /* Calculate the minimum update frequency across all channels */
-    rxticks_per_sec = 1;
     for (chan = 0; chan < NUM_RX_CHAN; chan++) {
         if (sinfo->rx[chan].burst_max == 0) {
             sinfo->rx[chan].burst_max = sinfo->rx[chan].rate_max / 10;
         }
-        rps = sinfo->rx[chan].rate_max / sinfo->rx[chan].burst_max;
-        if (rxticks_per_sec < rps) {
-            rxticks_per_sec = rps;
-        }
-    }
-
-    /* Convert update frequency to system ticks */
-    jiffies_per_rxtick = HZ / rxticks_per_sec;
-    if (jiffies_per_rxtick == 0) {
-        jiffies_per_rxtick = 1;
-    }
-    rxticks_per_sec = HZ / jiffies_per_rxtick;
-
-    for (chan = 0; chan < NUM_RX_CHAN; chan++) {
-        /* Ensure that burst size satifies overall rate */
-        tokens_per_rxtick = sinfo->rx[chan].rate_max / rxticks_per_sec;
-        if (sinfo->rx[chan].burst_max < tokens_per_rxtick) {
-            sinfo->rx[chan].burst_max = tokens_per_rxtick;
-        }
-        /* Ensure that rate has a sane value */
-        if (sinfo->rx[chan].rate_max != 0) {
-            if (sinfo->rx[chan].rate_max < rxticks_per_sec) {
-                sinfo->rx[chan].rate_max = rxticks_per_sec;
-            }
+        /* Suppressed Rx resumes once a full DCB ring can be refilled */
+        if (sinfo->rx[chan].burst_max <= MAX_RX_DCBS) {
+            sinfo->rx[chan].burst_max = MAX_RX_DCBS + 1;
         }
         sinfo->rx[chan].tokens = sinfo->rx[chan].burst_max;
+        sinfo->rx[chan].tok_ns = BKN_RATE_NOW_NS();
     }
 
-    /* Update timer controls */
-    sinfo->rxticks_per_sec = rxticks_per_sec;
-    sinfo->rxtick_jiffies = jiffies_per_rxtick;
+    /* Let suppressed channels pick up the new settings */
+    if (module_initialized) {
+        hrtimer_start(&sinfo->rxtick, ktime_get(), BKN_HRTIMER_MODE_ABS);
+    }
 
     spin_unlock_irqrestore(&sinfo->lock, flags);
 }
@@ -5978,6 +7070,7 @@ bkn_destroy_sinfo(bkn_switch_info_t *sinfo)
 {
     list_del(&sinfo->list);
     bkn_free_dcbs(sinfo);
+    bkn_rx_pp_destroy(sinfo);
     kfree(sinfo);
 }
 
@@ -6028,14 +7121,10 @@ bkn_create_sinfo(int dev_no)
         sinfo->rx[0].use_rx_skb = 0;
     }
 
-#if (LINUX_VERSION_CODE < KERNEL_VERSION(4,15,0))
-    init_timer(&sinfo->rxtick);
-    sinfo->rxtick.data = (unsigned long)sinfo;
-    sinfo->rxtick.function = bkn_rxtick;
-#else
-    timer_setup(&sinfo->rxtick, bkn_rxtick, 0);
-#endif
-    sinfo->rxtick.expires = jiffies + 1;
+    /* Channels without a page pool fall back to regular SKBs */
+    bkn_rx_pp_create(sinfo);
+
+    bkn_hrtimer_setup(&sinfo->rxtick, bkn_rxtick);
 
     for (chan = 0; chan < NUM_RX_CHAN; chan++) {
         sinfo->rx[chan].rate_max = rx_rate[chan];
@@ -6043,8 +7132,6 @@ bkn_create_sinfo(int dev_no)
     }
     bkn_rx_rate_config(sinfo);
 
-    add_timer(&sinfo->rxtick);
-
     list_add_tail(&sinfo->list, &_sinfo_list);
 
     return sinfo;
@@ -6055,7 +7142,11 @@ static const struct net_device_ops bkn_netdev_ops = {
     .ndo_open            = bkn_open,
     .ndo_stop            = bkn_stop,
     .ndo_start_xmit      = bkn_tx,
+#ifdef BKN_PCPU_STATS_SUPPORT
+    .ndo_get_stats64     = bkn_get_stats64,
+#else
     .ndo_get_stats       = bkn_get_stats,
+#endif
     .ndo_validate_addr   = eth_validate_addr,
     .ndo_set_rx_mode     = bkn_set_multicast_list,
     .ndo_set_mac_address = bkn_set_mac_address,
@@ -6123,10 +7214,27 @@ static const struct ethtool_ops bkn_ethtool_ops = {
 #endif
 };
 
+static void
+bkn_free_ndev(struct net_device *dev)
+{
+#ifdef BKN_PCPU_STATS_SUPPORT
+    bkn_priv_t *priv = netdev_priv(dev);
+
+    free_percpu(priv->pcpu_stats);
+#endif
+    free_netdev(dev);
+}
+
 static struct net_device *
-bkn_init_ndev(u8 *mac, char *name)
+bkn_init_ndev(u8 *mac, char *name, int rtnl_held)
 {
     struct net_device *dev;
+    int rv;
+#ifdef BKN_PCPU_STATS_SUPPORT
+    bkn_priv_t *priv;
+    bkn_pcpu_stats_t *ps;
+    int cpu;
+#endif
 
     /* Create Ethernet device */
     dev = alloc_etherdev(sizeof(bkn_priv_t));
@@ -6135,6 +7243,20 @@ bkn_init_ndev(u8 *mac, char *name)
         DBG_WARN(("Error allocating Ethernet device.\n"));
         return NULL;
     }
+#ifdef BKN_PCPU_STATS_SUPPORT
+    priv = netdev_priv(dev);
+    priv->pcpu_stats = alloc_percpu(bkn_pcpu_stats_t);
+    if (priv->pcpu_stats == NULL) {
+        DBG_WARN(("Error allocating Ethernet device statistics.\n"));
+        free_netdev(dev);
+        return NULL;
+    }
+    for_each_possible_cpu(cpu) {
+        ps = per_cpu_ptr(priv->pcpu_stats, cpu);
+        u64_stats_init(&ps->rx_syncp);
+        u64_stats_init(&ps->tx_syncp);
+    }
+#endif
 #ifdef SET_MODULE_OWNER
     SET_MODULE_OWNER(dev);
 #endif
@@ -6152,6 +7274,12 @@ bkn_init_ndev(u8 *mac, char *name)
         dev->mtu = rx_buffer_size;
     }
 
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,27))
+    /* Let the stack leave room to add headers and tags in place on Tx */
+    dev->needed_headroom = BKN_TX_HEADROOM;
+    dev->needed_tailroom = FCS_SZ;
+#endif
+
     /* Device vectors */
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,29))
     dev->netdev_ops = &bkn_netdev_ops;
@@ -6177,9 +7305,20 @@ bkn_init_ndev(u8 *mac, char *name)
 #endif
 
     /* Register the kernel Ethernet device */
-    if (register_netdev(dev)) {
+    if (rtnl_held) {
+        rv = 0;
+        if (strchr(dev->name, '%')) {
+            rv = dev_alloc_name(dev, dev->name);
+        }
+        if (rv >= 0) {
+            rv = register_netdevice(dev);
+        }
+    } else {
+        rv = register_netdev(dev);
+    }
+    if (rv) {
         DBG_WARN(("Error registering Ethernet device.\n"));
-        free_netdev(dev);
+        bkn_free_ndev(dev);
         return NULL;
     }
     DBG_VERB(("Created Ethernet device %s.\n", dev->name));
@@ -6187,6 +7326,203 @@ bkn_init_ndev(u8 *mac, char *name)
     return dev;
 }
 
+#ifdef BKN_GENL_STATS_SUPPORT
+/*
+ * Generic Netlink Counter Dump
+ *
+ * Counters are read without the device lock, DMA channel counters
+ * may thus be slightly out of step with each other.
+ */
+static struct genl_family bkn_genl_family;
+
+static int
+bkn_genl_unit_fill(struct sk_buff *msg, struct netlink_callback *cb,
+                   bkn_switch_info_t *sinfo)
+{
+    bkn_genl_tx_stats_t tx;
+    bkn_genl_rx_stats_t rx;
+    void *hdr;
+    int chan;
+
+    hdr = genlmsg_put(msg, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+                      &bkn_genl_family, NLM_F_MULTI, BKN_GENL_CMD_GET_STATS);
+    if (hdr == NULL) {
+        return -EMSGSIZE;
+    }
+    if (nla_put_u32(msg, BKN_GENL_ATTR_UNIT, sinfo->dev_no)) {
+        goto error;
+    }
+
+    memset(&tx, 0, sizeof(tx));
+    tx.pkts = sinfo->tx.pkts;
+    tx.pkts_d_no_skb = sinfo->tx.pkts_d_no_skb;
+    tx.pkts_d_rcpu_encap = sinfo->tx.pkts_d_rcpu_encap;
+    tx.pkts_d_rcpu_sig = sinfo->tx.pkts_d_rcpu_sig;
+    tx.pkts_d_rcpu_meta = sinfo->tx.pkts_d_rcpu_meta;
+    tx.pkts_d_pad_fail = sinfo->tx.pkts_d_pad_fail;
+    tx.pkts_d_dma_resrc = sinfo->tx.pkts_d_dma_resrc;
+    tx.pkts_d_callback = sinfo->tx.pkts_d_callback;
+    tx.pkts_d_no_link = sinfo->tx.pkts_d_no_link;
+    tx.pkts_d_over_limit = sinfo->tx.pkts_d_over_limit;
+    if (nla_put(msg, BKN_GENL_ATTR_TX_STATS, sizeof(tx), &tx)) {
+        goto error;
+    }
+
+    for (chan = 0; chan < sinfo->rx_chans; chan++) {
+        memset(&rx, 0, sizeof(rx));
+        rx.chan = chan;
+        rx.pkts = sinfo->rx[chan].pkts;
+        rx.pkts_f_api = sinfo->rx[chan].pkts_f_api;
+        rx.pkts_f_netif = sinfo->rx[chan].pkts_f_netif;
+        rx.pkts_m_api = sinfo->rx[chan].pkts_m_api;
+        rx.pkts_m_netif = sinfo->rx[chan].pkts_m_netif;
+        rx.pkts_gro = sinfo->rx[chan].pkts_gro;
+        rx.pkts_gro_merged = sinfo->rx[chan].pkts_gro_merged;
+        rx.pkts_d_no_skb = sinfo->rx[chan].pkts_d_no_skb;
+        rx.pkts_d_no_match = sinfo->rx[chan].pkts_d_no_match;
+        rx.pkts_d_unkn_netif = sinfo->rx[chan].pkts_d_unkn_netif;
+        rx.pkts_d_unkn_dest = sinfo->rx[chan].pkts_d_unkn_dest;
+        rx.pkts_d_callback = sinfo->rx[chan].pkts_d_callback;
+        rx.pkts_d_no_link = sinfo->rx[chan].pkts_d_no_link;
+        rx.pkts_d_no_api_buf = sinfo->rx[chan].pkts_d_no_api_buf;
+        rx.pkts_d_rate = sinfo->rx[chan].pkts_d_rate;
+        if (nla_put(msg, BKN_GENL_ATTR_RX_STATS, sizeof(rx), &rx)) {
+            goto error;
+        }
+    }
+
+    genlmsg_end(msg, hdr);
+    return 0;
+
+error:
+    genlmsg_cancel(msg, hdr);
+    return -EMSGSIZE;
+}
+
+static int
+bkn_genl_netif_fill(struct sk_buff *msg, struct netlink_callback *cb,
+                    struct net_device *dev)
+{
+    bkn_priv_t *priv = netdev_priv(dev);
+    struct rtnl_link_stats64 stats;
+    void *hdr;
+
+    hdr = genlmsg_put(msg, NETLINK_CB(cb->skb).portid, cb->nlh->nlmsg_seq,
+                      &bkn_genl_family, NLM_F_MULTI, BKN_GENL_CMD_GET_STATS);
+    if (hdr == NULL) {
+        return -EMSGSIZE;
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    bkn_netif_stats_fold(priv, &stats);
+
+    if (nla_put_u32(msg, BKN_GENL_ATTR_UNIT, priv->sinfo->dev_no) ||
+        nla_put_u32(msg, BKN_GENL_ATTR_NETIF_ID, priv->id) ||
+        nla_put_string(msg, BKN_GENL_ATTR_NETIF_NAME, dev->name) ||
+        nla_put_u32(msg, BKN_GENL_ATTR_IFINDEX, dev->ifindex) ||
+        nla_put_64bit(msg, BKN_GENL_ATTR_NETIF_STATS, sizeof(stats), &stats,
+                      BKN_GENL_ATTR_PAD)) {
+        genlmsg_cancel(msg, hdr);
+        return -EMSGSIZE;
+    }
+
+    genlmsg_end(msg, hdr);
+    return 0;
+}
+
+static int
+bkn_genl_stats_dumpit(struct sk_buff *msg, struct netlink_callback *cb)
+{
+    struct list_head *list;
+    bkn_switch_info_t *sinfo;
+    struct net_device *dev;
+    int start = cb->args[0];
+    int idx = 0;
+
+    /* Switch units first, the list only changes on module load/unload */
+    list_for_each(list, &_sinfo_list) {
+        sinfo = (bkn_switch_info_t *)list;
+        if (idx < start) {
+            idx++;
+            continue;
+        }
+        if (bkn_genl_unit_fill(msg, cb, sinfo) < 0) {
+            goto done;
+        }
+        idx++;
+    }
+
+    /* Then the netifs, whose per-CPU counters need no lock */
+    rcu_read_lock();
+    for_each_netdev_rcu(sock_net(msg->sk), dev) {
+        if (dev->netdev_ops != &bkn_netdev_ops) {
+            continue;
+        }
+        if (idx < start) {
+            idx++;
+            continue;
+        }
+        if (bkn_genl_netif_fill(msg, cb, dev) < 0) {
+            break;
+        }
+        idx++;
+    }
+    rcu_read_unlock();
+
+done:
+    cb->args[0] = idx;
+    return msg->len;
+}
+
+static const struct genl_ops bkn_genl_ops[] = {
+    {
+        .cmd = BKN_GENL_CMD_GET_STATS,
+        .dumpit = bkn_genl_stats_dumpit,
+        /* can be retrieved by unprivileged users */
+    }
+};
+
+static struct genl_family bkn_genl_family = {
+    .name       = BKN_GENL_NAME,
+    .version    = BKN_GENL_VERSION,
+    .netnsok    = true,
+    .module     = THIS_MODULE,
+    .ops        = bkn_genl_ops,
+    .n_ops      = ARRAY_SIZE(bkn_genl_ops),
+};
+
+static int bkn_genl_registered;
+
+static void
+bkn_genl_init(void)
+{
+    if (genl_register_family(&bkn_genl_family) < 0) {
+        gprintk("Generic netlink family %s not registered\n", BKN_GENL_NAME);
+        return;
+    }
+    bkn_genl_registered = 1;
+}
+
+static void
+bkn_genl_cleanup(void)
+{
+    if (bkn_genl_registered) {
+        genl_unregister_family(&bkn_genl_family);
+        bkn_genl_registered = 0;
+    }
+}
+#else
+static void
+bkn_genl_init(void)
+{
+}
+
+static void
+bkn_genl_cleanup(void)
+{
+}
+#endif /* BKN_GENL_STATS_SUPPORT */
+
 /*
  * Device Link Control Proc Read Entry
  */
@@ -6316,8 +7652,10 @@ static int
 bkn_proc_rate_show(struct seq_file *m, void *v)
 {
     int unit = 0;
-    struct list_head *list;
+    struct list_head *list, *dlist;
     bkn_switch_info_t *sinfo;
+    bkn_priv_t *priv;
+    unsigned long flags;
     int chan;
 
     list_for_each(list, &_sinfo_list) {
@@ -6334,6 +7672,17 @@ bkn_proc_rate_show(struct seq_file *m, void *v)
             seq_printf(m, "  Rx%d tokens    %8u\n",
                             chan, sinfo->rx[chan].tokens);
         }
+        spin_lock_irqsave(&sinfo->lock, flags);
+        list_for_each(dlist, &sinfo->ndev_list) {
+            priv = (bkn_priv_t *)dlist;
+            if (priv->dev == NULL || priv->rate_max == 0) {
+                continue;
+            }
+            seq_printf(m, "  %-14s max rate %8u burst %8u tokens %8u\n",
+                       priv->dev->name, priv->rate_max,
+                       priv->burst_max, priv->tokens);
+        }
+        spin_unlock_irqrestore(&sinfo->lock, flags);
 
         unit++;
     }
@@ -6351,23 +7700,31 @@ bkn_proc_rate_open(struct inode * inode, struct file * file)
  *
  *   Syntax:
  *   [<unit>:]rx_rate=<rate0>[,<rate1>[,<rate2]]
+ *   [<unit>:]netif_rate=<id>,<rate>[,<burst>]
  *
  *   Where <rate0> is packets/sec for the first Rx DMA channel,
  *   <rate1> is packets/sec for the second Rx DMA channel, etc.
+ *   A netif rate limits the packets delivered to a single virtual
+ *   network interface, packets in excess are dropped. A rate of
+ *   zero removes the limit.
  *
  *   Examples:
  *   rx_rate=5000
  *   0:rx_rate=10000,10000
  *   1:rx_rate=10000,5000
+ *   netif_rate=3,1000
  */
 static ssize_t
 bkn_proc_rate_write(struct file *file, const char *buf,
                     size_t count, loff_t *loff)
 {
     bkn_switch_info_t *sinfo;
+    bkn_priv_t *priv;
+    unsigned long flags;
     char rate_str[80];
     char *ptr;
-    int unit, chan;
+    int unit, chan, id;
+    uint32_t rate, burst;
 
     if (count > sizeof(rate_str)) {
         count = sizeof(rate_str) - 1;
@@ -6400,6 +7757,33 @@ bkn_proc_rate_write(struct file *file, const char *buf,
             sinfo->rx[chan].burst_max = simple_strtol(ptr, NULL, 10);
         } while ((ptr = strchr(ptr, ',')) != NULL && ++chan < sinfo->rx_chans);
         bkn_rx_rate_config(sinfo);
+    } else if ((ptr = strstr(rate_str, "netif_rate=")) != NULL) {
+        ptr += 11;
+        id = simple_strtol(ptr, NULL, 10);
+        if ((ptr = strchr(ptr, ',')) == NULL) {
+            gprintk("Warning: netif rate missing\n");
+            return count;
+        }
+        rate = simple_strtoul(++ptr, NULL, 10);
+        burst = rate / 10;
+        if ((ptr = strchr(ptr, ',')) != NULL) {
+            burst = simple_strtoul(++ptr, NULL, 10);
+        }
+        if (burst == 0) {
+            burst = 1;
+        }
+        spin_lock_irqsave(&sinfo->lock, flags);
+        priv = bkn_netif_lookup(sinfo, id);
+        if (priv != NULL) {
+            priv->rate_max = rate;
+            priv->burst_max = burst;
+            priv->tokens = burst;
+            priv->tok_ns = BKN_RATE_NOW_NS();
+        }
+        spin_unlock_irqrestore(&sinfo->lock, flags);
+        if (priv == NULL) {
+            gprintk("Warning: unknown netif: %d\n", id);
+        }
     } else {
         gprintk("Warning: unknown configuration setting\n");
     }
@@ -6745,6 +8129,8 @@ bkn_proc_debug_show(struct seq_file *m, void *v)
     seq_printf(m, "  rx_sync_retry:  %d\n", rx_sync_retry);
     seq_printf(m, "  use_napi:       %d\n", use_napi);
     seq_printf(m, "  napi_weight:    %d\n", napi_weight);
+    seq_printf(m, "  napi_per_chan:  %d\n", napi_per_chan);
+    seq_printf(m, "  rx_latency:     %d\n", rx_latency);
     seq_printf(m, "  basedev_susp:   %d\n", basedev_suspend);
     seq_printf(m, "Thread states:\n");
     seq_printf(m, "  Command thread: %d\n", bkn_cmd_ctrl.state);
@@ -6771,6 +8157,8 @@ bkn_proc_debug_show(struct seq_file *m, void *v)
         seq_printf(m, "  dcb_mem_size:   0x%x\n", sinfo->dcb_mem_size);
         seq_printf(m, "  rcpu_sig:       0x%x\n", sinfo->rcpu_sig);
         seq_printf(m, "  napi_poll_mode: %d\n", sinfo->napi_poll_mode);
+        seq_printf(m, "  napi_per_chan:  %d\n", sinfo->napi_per_chan);
+        seq_printf(m, "  irq_poll_mask:  0x%x\n", sinfo->irq_poll_mask);
         seq_printf(m, "  inst_id:        0x%x\n", sinfo->inst_id);
         seq_printf(m, "  evt_queue:      %d\n", sinfo->evt_idx);
 
@@ -6804,6 +8192,7 @@ bkn_proc_stats_show(struct seq_file *m, void *v)
     struct list_head *list, *flist;
     bkn_switch_info_t *sinfo;
     bkn_filter_t *filter;
+    bkn_rxpf_cls_t *cls;
     int chan;
 
 
@@ -6827,6 +8216,45 @@ bkn_proc_stats_show(struct seq_file *m, void *v)
         }
         seq_printf(m, "  Timer runs  %10u\n", sinfo->timer_runs);
         seq_printf(m, "  NAPI reruns %10u\n", sinfo->napi_not_done);
+#ifdef BKN_PAGE_POOL_SUPPORT
+        for (chan = 0; chan < sinfo->rx_chans; chan++) {
+            struct page_pool *pool = sinfo->rx[chan].page_pool;
+#ifdef CONFIG_PAGE_POOL_STATS
+            struct page_pool_stats pp_stats;
+            uint64_t fast, slow;
+#endif
+
+            if (pool == NULL) {
+                continue;
+            }
+            seq_printf(m, "  Rx%d pool allocs %6u\n",
+                       chan, sinfo->rx[chan].pp_allocs);
+            seq_printf(m, "  Rx%d pool fails  %6u\n",
+                       chan, sinfo->rx[chan].pp_fails);
+#ifdef CONFIG_PAGE_POOL_STATS
+            /* Pages not recycled were taken from the page allocator */
+            memset(&pp_stats, 0, sizeof(pp_stats));
+            if (!page_pool_get_stats(pool, &pp_stats)) {
+                continue;
+            }
+            fast = pp_stats.alloc_stats.fast;
+            slow = pp_stats.alloc_stats.slow +
+                   pp_stats.alloc_stats.slow_high_order;
+            if (fast + slow == 0) {
+                seq_printf(m, "  Rx%d pool hits           -\n", chan);
+            } else {
+                seq_printf(m, "  Rx%d pool hits   %5u%%\n", chan,
+                           (uint32_t)div64_u64(fast * 100, fast + slow));
+            }
+#endif
+        }
+#endif
+
+        rcu_read_lock();
+        cls = rcu_dereference(sinfo->rxpf_cls);
+        seq_printf(m, "  Filter groups %8d%s\n", cls ? cls->num_groups : 0,
+                   cls ? "" : " (list walk)");
+        rcu_read_unlock();
 
         list_for_each(flist, &sinfo->rxpf_list) {
             filter = (bkn_filter_t *)flist;
@@ -6967,6 +8395,10 @@ bkn_proc_dstats_show(struct seq_file *m, void *v)
                             chan, sinfo->rx[chan].pkts_m_api);
             seq_printf(m, "  Rx%d mirror to netif %10u\n",
                             chan, sinfo->rx[chan].pkts_m_netif);
+            seq_printf(m, "  Rx%d gro packets     %10u\n",
+                            chan, sinfo->rx[chan].pkts_gro);
+            seq_printf(m, "  Rx%d gro merged      %10u\n",
+                            chan, sinfo->rx[chan].pkts_gro_merged);
             seq_printf(m, "  Rx%d drop no skb     %10u\n",
                             chan, sinfo->rx[chan].pkts_d_no_skb);
             seq_printf(m, "  Rx%d drop no match   %10u\n",
@@ -6979,6 +8411,8 @@ bkn_proc_dstats_show(struct seq_file *m, void *v)
                             chan, sinfo->rx[chan].pkts_d_callback);
             seq_printf(m, "  Rx%d drop no link    %10u\n",
                             chan, sinfo->rx[chan].pkts_d_no_link);
+            seq_printf(m, "  Rx%d drop netif rate %10u\n",
+                            chan, sinfo->rx[chan].pkts_d_rate);
             seq_printf(m, "  Rx%d sync error      %10u\n",
                             chan, sinfo->rx[chan].sync_err);
             seq_printf(m, "  Rx%d sync retry      %10u\n",
@@ -7076,11 +8510,14 @@ bkn_proc_dstats_write(struct file *file, const char *buf,
             sinfo->rx[chan].pkts_f_netif = 0;
             sinfo->rx[chan].pkts_m_api = 0;
             sinfo->rx[chan].pkts_m_netif = 0;
+            sinfo->rx[chan].pkts_gro = 0;
+            sinfo->rx[chan].pkts_gro_merged = 0;
             sinfo->rx[chan].pkts_d_no_skb = 0;
             sinfo->rx[chan].pkts_d_no_match = 0;
             sinfo->rx[chan].pkts_d_unkn_netif = 0;
             sinfo->rx[chan].pkts_d_unkn_dest = 0;
             sinfo->rx[chan].pkts_d_no_api_buf = 0;
+            sinfo->rx[chan].pkts_d_rate = 0;
             sinfo->rx[chan].sync_err = 0;
             sinfo->rx[chan].sync_retry = 0;
             sinfo->rx[chan].sync_maxloop = 0;
@@ -7099,6 +8536,109 @@ struct file_operations bkn_proc_dstats_file_ops = {
     release:    single_release,
 };
 
+/*
+ * Rx Latency Proc Read Entry
+ *
+ * Latency is counted from the device interrupt to the start of the
+ * NAPI poll and to the hand-off of each packet to the network stack.
+ */
+static int
+bkn_proc_latency_show(struct seq_file *m, void *v)
+{
+    int unit = 0;
+    struct list_head *list;
+    bkn_switch_info_t *sinfo;
+    int idx;
+
+    seq_printf(m, "Rx latency recording: %s\n", rx_latency ? "on" : "off");
+
+    list_for_each(list, &_sinfo_list) {
+        sinfo = (bkn_switch_info_t *)list;
+
+        seq_printf(m, "Rx latency (unit %d):\n", unit);
+        seq_printf(m, "  usec            poll      netif\n");
+        for (idx = 0; idx < BKN_LAT_BUCKETS; idx++) {
+            if (idx == BKN_LAT_BUCKETS - 1) {
+                seq_printf(m, "  >= %-7u", 1U << (idx - 1));
+            } else {
+                seq_printf(m, "  < %-8u", 1U << idx);
+            }
+            seq_printf(m, " %10u %10u\n",
+                       sinfo->lat_poll.bucket[idx],
+                       sinfo->lat_netif.bucket[idx]);
+        }
+        seq_printf(m, "  samples    %10u %10u\n",
+                   sinfo->lat_poll.samples, sinfo->lat_netif.samples);
+        seq_printf(m, "  max        %10u %10u\n",
+                   sinfo->lat_poll.max_us, sinfo->lat_netif.max_us);
+
+        unit++;
+    }
+    return 0;
+}
+
+static int
+bkn_proc_latency_open(struct inode * inode, struct file * file)
+{
+    return single_open(file, bkn_proc_latency_show, NULL);
+}
+
+/*
+ * Rx Latency Proc Write Entry
+ *
+ *   Syntax:
+ *   rx_latency=0|1
+ *   [<unit>:]clear
+ *
+ *   Examples:
+ *   rx_latency=1
+ *   0:clear
+ */
+static ssize_t
+bkn_proc_latency_write(struct file *file, const char *buf,
+                       size_t count, loff_t *loff)
+{
+    bkn_switch_info_t *sinfo;
+    char lat_str[40];
+    char *ptr;
+    int unit;
+
+    if (count >= sizeof(lat_str)) {
+        count = sizeof(lat_str) - 1;
+    }
+    if (copy_from_user(lat_str, buf, count)) {
+        return -EFAULT;
+    }
+    lat_str[count] = '\0';
+
+    if ((ptr = strstr(lat_str, "rx_latency=")) != NULL) {
+        ptr += 11;
+        rx_latency = simple_strtol(ptr, NULL, 10);
+    } else if (strstr(lat_str, "clear") != NULL) {
+        unit = simple_strtol(lat_str, NULL, 10);
+        sinfo = bkn_sinfo_from_unit(unit);
+        if (sinfo == NULL) {
+            gprintk("Warning: unknown unit: %d\n", unit);
+            return count;
+        }
+        memset(&sinfo->lat_poll, 0, sizeof(sinfo->lat_poll));
+        memset(&sinfo->lat_netif, 0, sizeof(sinfo->lat_netif));
+    } else {
+        gprintk("Warning: unknown configuration setting\n");
+    }
+
+    return count;
+}
+
+struct file_operations bkn_proc_latency_file_ops = {
+    owner:      THIS_MODULE,
+    open:       bkn_proc_latency_open,
+    read:       seq_read,
+    llseek:     seq_lseek,
+    write:      bkn_proc_latency_write,
+    release:    single_release,
+};
+
 static int
 bkn_proc_init(void)
 {
@@ -7128,6 +8668,10 @@ bkn_proc_init(void)
     if (entry == NULL) {
         return -1;
     }
+    PROC_CREATE(entry, "latency", 0666, bkn_proc_root, &bkn_proc_latency_file_ops);
+    if (entry == NULL) {
+        return -1;
+    }
 
     return 0;
 }
@@ -7141,6 +8685,7 @@ bkn_proc_cleanup(void)
     remove_proc_entry("debug", bkn_proc_root);
     remove_proc_entry("stats", bkn_proc_root);
     remove_proc_entry("dstats", bkn_proc_root);
+    remove_proc_entry("latency", bkn_proc_root);
     return 0;
 }
 
@@ -7478,6 +9023,12 @@ bkn_knet_hw_init(kcom_msg_hw_init_t *kmsg, int len)
         return sizeof(kcom_msg_hdr_t);
     }
 
+    if (BYTES2WORDS(kmsg->dcb_size) > BKN_DCB_WSIZE_MAX) {
+        gprintk("DCB size %d not supported\n", kmsg->dcb_size);
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+
     spin_lock_irqsave(&sinfo->lock, flags);
 
     sinfo->cmic_type = kmsg->cmic_type;
@@ -7490,6 +9041,15 @@ bkn_knet_hw_init(kcom_msg_hw_init_t *kmsg, int len)
         sinfo->rx_chans = NUM_RX_CHAN;
     }
 
+    /* Per-channel NAPI relies on the per-channel interrupts of CMICx */
+    sinfo->napi_per_chan = 0;
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+    if (use_napi && napi_per_chan && sinfo->cmic_type == 'x') {
+        sinfo->napi_per_chan = 1;
+    }
+#endif
+    sinfo->irq_poll_mask = 0;
+
     DBG_DUNE(("CMIC:%c DCB:%d WSIZE:%d DMA HI: 0x%08x HDR size: %d\n",
         sinfo->cmic_type, sinfo->dcb_type, sinfo->dcb_wsize,
         sinfo->dma_hi, sinfo->pkt_hdr_size));
@@ -7589,72 +9149,65 @@ bkn_knet_reprobe(kcom_msg_reprobe_t *kmsg, int len)
     return sizeof(kcom_msg_reprobe_t);
 }
 
+/*
+ * Create and register the network interface described by <netif>.
+ * The interface is not used for Rx until it is added to the switch
+ * device with bkn_netif_add.
+ */
 static int
-bkn_knet_netif_create(kcom_msg_netif_create_t *kmsg, int len)
+bkn_netif_alloc(bkn_switch_info_t *sinfo, kcom_netif_t *netif,
+                int rtnl_held, bkn_priv_t **ppriv)
 {
-    bkn_switch_info_t *sinfo;
     struct net_device *dev;
-    struct list_head *list;
-    bkn_priv_t *priv, *lpriv;
-    unsigned long flags;
-    int found, id;
+    bkn_priv_t *priv;
     uint8 *ma;
 
-    kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
-
-    switch (kmsg->netif.type) {
+    switch (netif->type) {
     case KCOM_NETIF_T_VLAN:
     case KCOM_NETIF_T_PORT:
     case KCOM_NETIF_T_META:
         break;
     default:
-        kmsg->hdr.status = KCOM_E_PARAM;
-        return sizeof(kcom_msg_hdr_t);
+        return KCOM_E_PARAM;
     }
-    sinfo = bkn_sinfo_from_unit(kmsg->hdr.unit);
-    if (sinfo == NULL) {
-        kmsg->hdr.status = KCOM_E_PARAM;
-        return sizeof(kcom_msg_hdr_t);
-    }
-    ma = kmsg->netif.macaddr;
+    ma = netif->macaddr;
     if ((ma[0] | ma[1] | ma[2] | ma[3] | ma[4] | ma[5]) == 0) {
         bkn_dev_mac[5]++;
         ma = bkn_dev_mac;
     }
-    if ((dev = bkn_init_ndev(ma, kmsg->netif.name)) == NULL) {
-        kmsg->hdr.status = KCOM_E_RESOURCE;
-        return sizeof(kcom_msg_hdr_t);
+    if ((dev = bkn_init_ndev(ma, netif->name, rtnl_held)) == NULL) {
+        return KCOM_E_RESOURCE;
     }
     priv = netdev_priv(dev);
     priv->dev = dev;
     priv->sinfo = sinfo;
-    priv->type = kmsg->netif.type;
-    priv->vlan = kmsg->netif.vlan;
+    priv->type = netif->type;
+    priv->vlan = netif->vlan;
     if (priv->type == KCOM_NETIF_T_PORT) {
-        priv->port = kmsg->netif.port;
+        priv->port = netif->port;
         if (device_is_dpp(sinfo)) {
-            memcpy(priv->itmh, kmsg->netif.itmh, 4);
+            memcpy(priv->itmh, netif->itmh, 4);
         } else if (device_is_dnx(sinfo)) {
-            memcpy(priv->system_headers, kmsg->netif.system_headers, kmsg->netif.system_headers_size);
-            priv->system_headers_size = kmsg->netif.system_headers_size;
+            memcpy(priv->system_headers, netif->system_headers, netif->system_headers_size);
+            priv->system_headers_size = netif->system_headers_size;
         }
-        priv->qnum = kmsg->netif.qnum;
+        priv->qnum = netif->qnum;
     } else {
         if (device_is_sand(sinfo)) {
             if (device_is_dpp(sinfo)) {
-                priv->port = kmsg->netif.port;
-                priv->qnum = kmsg->netif.qnum;
+                priv->port = netif->port;
+                priv->qnum = netif->qnum;
             }else if (device_is_dnx(sinfo)) {
-                memcpy(priv->system_headers, kmsg->netif.system_headers, kmsg->netif.system_headers_size);
-                priv->system_headers_size = kmsg->netif.system_headers_size;
+                memcpy(priv->system_headers, netif->system_headers, netif->system_headers_size);
+                priv->system_headers_size = netif->system_headers_size;
             }
         }
         else {
             priv->port = -1;
         }
     }
-    priv->flags = kmsg->netif.flags;
-    priv->cb_user_data = kmsg->netif.cb_user_data;
+    priv->flags = netif->flags;
+    priv->cb_user_data = netif->cb_user_data;
 
     /* Force RCPU encapsulation if rcpu_mode */
     if (rcpu_mode) {
@@ -7662,11 +9215,33 @@ bkn_knet_netif_create(kcom_msg_netif_create_t *kmsg, int len)
         DBG_RCPU(("RCPU auto-enabled\n"));
     }
 
+    if (device_is_dnx(sinfo)) {
+        int idx = 0;
+        for (idx = 0; idx < priv->system_headers_size; idx++) {
+            DBG_DUNE(("System Header[%d]: 0x%02x\n", idx, priv->system_headers[idx]));
+        }
+    }
+
+    *ppriv = priv;
+    return KCOM_E_NONE;
+}
+
+/*
+ * Assign an ID to a new network interface and make it available to
+ * the Rx path. Caller must hold sinfo->lock.
+ */
+static void
+bkn_netif_add(bkn_switch_info_t *sinfo, int unit, kcom_netif_t *netif,
+              bkn_priv_t *priv)
+{
+    struct net_device *dev = priv->dev;
+    struct list_head *list;
+    bkn_priv_t *lpriv;
+    int found, id;
+
     /* Prevent (incorrect) compiler warning */
     lpriv = NULL;
 
-    spin_lock_irqsave(&sinfo->lock, flags);
-
     /*
      * We insert network interfaces sorted by ID.
      * In case an interface is destroyed, we reuse the ID
@@ -7715,27 +9290,95 @@ bkn_knet_netif_create(kcom_msg_netif_create_t *kmsg, int len)
     DBG_VERB(("Assigned ID %d to Ethernet device %s\n",
               priv->id, dev->name));
 
-    kmsg->netif.id = priv->id;
-    memcpy(kmsg->netif.macaddr, dev->dev_addr, 6);
-    memcpy(kmsg->netif.name, dev->name, KCOM_NETIF_NAME_MAX - 1);
+    netif->id = priv->id;
+    memcpy(netif->macaddr, dev->dev_addr, 6);
+    memcpy(netif->name, dev->name, KCOM_NETIF_NAME_MAX - 1);
 
     if (knet_netif_create_cb != NULL) {
-        int retv = knet_netif_create_cb(kmsg->hdr.unit, &(kmsg->netif), dev);
+        int retv = knet_netif_create_cb(unit, netif, dev);
         if (retv) { 
             gprintk("Warning: knet_netif_create_cb() returned %d for netif '%s'\n", retv, dev->name);
         }
     }
+}
+
+static int
+bkn_knet_netif_create(kcom_msg_netif_create_t *kmsg, int len)
+{
+    bkn_switch_info_t *sinfo;
+    bkn_priv_t *priv;
+    unsigned long flags;
+    int status;
+
+    kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
+
+    sinfo = bkn_sinfo_from_unit(kmsg->hdr.unit);
+    if (sinfo == NULL) {
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+    status = bkn_netif_alloc(sinfo, &kmsg->netif, 0, &priv);
+    if (status != KCOM_E_NONE) {
+        kmsg->hdr.status = status;
+        return sizeof(kcom_msg_hdr_t);
+    }
+
+    spin_lock_irqsave(&sinfo->lock, flags);
+
+    bkn_netif_add(sinfo, kmsg->hdr.unit, &kmsg->netif, priv);
 
     spin_unlock_irqrestore(&sinfo->lock, flags);
 
-    if (device_is_dnx(sinfo)) {
-        int idx = 0;
-        for (idx = 0; idx < priv->system_headers_size; idx++) {
-            DBG_DUNE(("System Header[%d]: 0x%02x\n", idx, priv->system_headers[idx]));
+    return sizeof(*kmsg);
+}
+
+static int
+bkn_knet_netif_create_batch(kcom_msg_netif_create_batch_t *kmsg, int len)
+{
+    bkn_switch_info_t *sinfo;
+    kcom_netif_batch_entry_t *entry;
+    bkn_priv_t **privs;
+    unsigned long flags;
+    int idx;
+
+    kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
+
+    sinfo = bkn_sinfo_from_unit(kmsg->hdr.unit);
+    if (sinfo == NULL || kmsg->cnt == 0 || kmsg->cnt > KCOM_BATCH_MAX ||
+        len < (int)KCOM_MSG_BATCH_LEN(kmsg, kmsg->cnt)) {
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+    privs = kmalloc(kmsg->cnt * sizeof(*privs), GFP_KERNEL);
+    if (privs == NULL) {
+        kmsg->hdr.status = KCOM_E_RESOURCE;
+        return sizeof(kcom_msg_hdr_t);
+    }
+
+    /* Register all interfaces within a single RTNL critical section */
+    rtnl_lock();
+    for (idx = 0; idx < kmsg->cnt; idx++) {
+        entry = &kmsg->entry[idx];
+        privs[idx] = NULL;
+        entry->status = bkn_netif_alloc(sinfo, &entry->netif, 1,
+                                        &privs[idx]);
+    }
+    rtnl_unlock();
+
+    spin_lock_irqsave(&sinfo->lock, flags);
+
+    for (idx = 0; idx < kmsg->cnt; idx++) {
+        if (privs[idx] != NULL) {
+            bkn_netif_add(sinfo, kmsg->hdr.unit, &kmsg->entry[idx].netif,
+                          privs[idx]);
         }
     }
 
-    return sizeof(*kmsg);
+    spin_unlock_irqrestore(&sinfo->lock, flags);
+
+    kfree(privs);
+
+    return KCOM_MSG_BATCH_LEN(kmsg, kmsg->cnt);
 }
 
 static int
@@ -7791,7 +9434,7 @@ bkn_knet_netif_destroy(kcom_msg_netif_destroy_t *kmsg, int len)
     DBG_VERB(("Removing virtual Ethernet device %s (%d).\n",
               dev->name, priv->id));
     unregister_netdev(dev);
-    free_netdev(dev);
+    bkn_free_ndev(dev);
 
     return sizeof(kcom_msg_hdr_t);
 }
@@ -7877,33 +9520,17 @@ bkn_knet_netif_get(kcom_msg_netif_get_t *kmsg, int len)
     return sizeof(*kmsg);
 }
 
+/*
+ * Assign an ID to a new filter and insert it according to priority.
+ * Caller must hold sinfo->lock and update the Rx classifier.
+ */
 static int
-bkn_knet_filter_create(kcom_msg_filter_create_t *kmsg, int len)
+bkn_filter_add(bkn_switch_info_t *sinfo, bkn_filter_t *filter)
 {
-    bkn_switch_info_t *sinfo;
     struct list_head *list;
-    bkn_filter_t *filter, *lfilter;
-    unsigned long flags;
+    bkn_filter_t *lfilter;
     int found, id;
 
-    kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
-
-    sinfo = bkn_sinfo_from_unit(kmsg->hdr.unit);
-    if (sinfo == NULL) {
-        kmsg->hdr.status = KCOM_E_PARAM;
-        return sizeof(kcom_msg_hdr_t);
-    }
-
-    switch (kmsg->filter.type) {
-    case KCOM_FILTER_T_RX_PKT:
-        break;
-    default:
-        kmsg->hdr.status = KCOM_E_PARAM;
-        return sizeof(kcom_msg_hdr_t);
-    }
-
-    spin_lock_irqsave(&sinfo->lock, flags);
-
     /*
      * Find available ID
      */
@@ -7921,28 +9548,17 @@ bkn_knet_filter_create(kcom_msg_filter_create_t *kmsg, int len)
     }
     if (found) {
         /* Too many filters */
-        spin_unlock_irqrestore(&sinfo->lock, flags);
-        kmsg->hdr.status = KCOM_E_RESOURCE;
-        return sizeof(kcom_msg_hdr_t);
+        return KCOM_E_RESOURCE;
     }
 
-    filter = kmalloc(sizeof(*filter), GFP_ATOMIC);
-    if (filter == NULL) {
-        spin_unlock_irqrestore(&sinfo->lock, flags);
-        kmsg->hdr.status = KCOM_E_PARAM;
-        return sizeof(kcom_msg_hdr_t);
-    }
-    memset(filter, 0, sizeof(*filter));
-    memcpy(&filter->kf, &kmsg->filter, sizeof(filter->kf));
-
     if (device_is_dnx(sinfo)) {
         /* Information to parser Dune system headers */
-        sinfo->ftmh_lb_key_ext_size = kmsg->filter.ftmh_lb_key_ext_size;
-        sinfo->ftmh_stacking_ext_size = kmsg->filter.ftmh_stacking_ext_size;
-        sinfo->pph_base_size = kmsg->filter.pph_base_size;
-        memcpy(sinfo->pph_lif_ext_size, kmsg->filter.pph_lif_ext_size, sizeof(sinfo->pph_lif_ext_size));
-        sinfo->udh_enable = kmsg->filter.udh_enable;
-        memcpy(sinfo->udh_length_type, kmsg->filter.udh_length_type, sizeof(sinfo->udh_length_type));
+        sinfo->ftmh_lb_key_ext_size = filter->kf.ftmh_lb_key_ext_size;
+        sinfo->ftmh_stacking_ext_size = filter->kf.ftmh_stacking_ext_size;
+        sinfo->pph_base_size = filter->kf.pph_base_size;
+        memcpy(sinfo->pph_lif_ext_size, filter->kf.pph_lif_ext_size, sizeof(sinfo->pph_lif_ext_size));
+        sinfo->udh_enable = filter->kf.udh_enable;
+        memcpy(sinfo->udh_length_type, filter->kf.udh_length_type, sizeof(sinfo->udh_length_type));
     }
 
     filter->kf.id = id;
@@ -7961,10 +9577,29 @@ bkn_knet_filter_create(kcom_msg_filter_create_t *kmsg, int len)
         list_add_tail(&filter->list, &sinfo->rxpf_list);
     }
 
-    kmsg->filter.id = filter->kf.id;
+    return KCOM_E_NONE;
+}
 
-    spin_unlock_irqrestore(&sinfo->lock, flags);
+/* Caller must hold sinfo->lock */
+static bkn_filter_t *
+bkn_filter_lookup(bkn_switch_info_t *sinfo, int id)
+{
+    struct list_head *list;
+    bkn_filter_t *filter;
 
+    list_for_each(list, &sinfo->rxpf_list) {
+        filter = (bkn_filter_t *)list;
+        if (id == filter->kf.id) {
+            return filter;
+        }
+    }
+
+    return NULL;
+}
+
+static void
+bkn_filter_dump_created(bkn_switch_info_t *sinfo, bkn_filter_t *filter)
+{
     DBG_VERB(("Created filter ID %d (%s).\n",
               filter->kf.id, filter->kf.desc));
 
@@ -7981,18 +9616,138 @@ bkn_knet_filter_create(kcom_msg_filter_create_t *kmsg, int len)
                   sinfo->pph_lif_ext_size[1],sinfo->pph_lif_ext_size[2], sinfo->pph_lif_ext_size[3],
                   sinfo->udh_enable, sinfo->udh_length_type[0], sinfo->udh_length_type[1], sinfo->udh_length_type[2], sinfo->udh_length_type[3]));
     }
+}
+
+static int
+bkn_knet_filter_create(kcom_msg_filter_create_t *kmsg, int len)
+{
+    bkn_switch_info_t *sinfo;
+    bkn_filter_t *filter;
+    unsigned long flags;
+    int status;
+
+    kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
+
+    sinfo = bkn_sinfo_from_unit(kmsg->hdr.unit);
+    if (sinfo == NULL) {
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+
+    switch (kmsg->filter.type) {
+    case KCOM_FILTER_T_RX_PKT:
+        break;
+    default:
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+
+    filter = kmalloc(sizeof(*filter), GFP_KERNEL);
+    if (filter == NULL) {
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+    memset(filter, 0, sizeof(*filter));
+    memcpy(&filter->kf, &kmsg->filter, sizeof(filter->kf));
+
+    spin_lock_irqsave(&sinfo->lock, flags);
+
+    status = bkn_filter_add(sinfo, filter);
+    if (status != KCOM_E_NONE) {
+        spin_unlock_irqrestore(&sinfo->lock, flags);
+        kfree(filter);
+        kmsg->hdr.status = status;
+        return sizeof(kcom_msg_hdr_t);
+    }
+    bkn_rxpf_cls_update(sinfo);
+
+    kmsg->filter.id = filter->kf.id;
+
+    spin_unlock_irqrestore(&sinfo->lock, flags);
+
+    bkn_filter_dump_created(sinfo, filter);
 
     return len;
 }
 
+static int
+bkn_knet_filter_create_batch(kcom_msg_filter_create_batch_t *kmsg, int len)
+{
+    bkn_switch_info_t *sinfo;
+    kcom_filter_batch_entry_t *entry;
+    bkn_filter_t **filters;
+    unsigned long flags;
+    int idx;
+
+    kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
+
+    sinfo = bkn_sinfo_from_unit(kmsg->hdr.unit);
+    if (sinfo == NULL || kmsg->cnt == 0 || kmsg->cnt > KCOM_BATCH_MAX ||
+        len < (int)KCOM_MSG_BATCH_LEN(kmsg, kmsg->cnt)) {
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+    filters = kmalloc(kmsg->cnt * sizeof(*filters), GFP_KERNEL);
+    if (filters == NULL) {
+        kmsg->hdr.status = KCOM_E_RESOURCE;
+        return sizeof(kcom_msg_hdr_t);
+    }
+
+    for (idx = 0; idx < kmsg->cnt; idx++) {
+        entry = &kmsg->entry[idx];
+        filters[idx] = NULL;
+        if (entry->filter.type != KCOM_FILTER_T_RX_PKT) {
+            entry->status = KCOM_E_PARAM;
+            continue;
+        }
+        filters[idx] = kmalloc(sizeof(bkn_filter_t), GFP_KERNEL);
+        if (filters[idx] == NULL) {
+            entry->status = KCOM_E_RESOURCE;
+            continue;
+        }
+        memset(filters[idx], 0, sizeof(bkn_filter_t));
+        memcpy(&filters[idx]->kf, &entry->filter, sizeof(entry->filter));
+    }
+
+    spin_lock_irqsave(&sinfo->lock, flags);
+
+    for (idx = 0; idx < kmsg->cnt; idx++) {
+        entry = &kmsg->entry[idx];
+        if (filters[idx] == NULL) {
+            continue;
+        }
+        entry->status = bkn_filter_add(sinfo, filters[idx]);
+        if (entry->status != KCOM_E_NONE) {
+            continue;
+        }
+        entry->filter.id = filters[idx]->kf.id;
+    }
+    /* Rebuild the Rx classifier once for the whole batch */
+    bkn_rxpf_cls_update(sinfo);
+
+    spin_unlock_irqrestore(&sinfo->lock, flags);
+
+    for (idx = 0; idx < kmsg->cnt; idx++) {
+        if (filters[idx] == NULL) {
+            continue;
+        }
+        if (kmsg->entry[idx].status != KCOM_E_NONE) {
+            kfree(filters[idx]);
+            continue;
+        }
+        bkn_filter_dump_created(sinfo, filters[idx]);
+    }
+    kfree(filters);
+
+    return KCOM_MSG_BATCH_LEN(kmsg, kmsg->cnt);
+}
+
 static int
 bkn_knet_filter_destroy(kcom_msg_filter_destroy_t *kmsg, int len)
 {
     bkn_switch_info_t *sinfo;
     bkn_filter_t *filter;
-    struct list_head *list;
     unsigned long flags;
-    int found;
 
     kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
 
@@ -8004,31 +9759,75 @@ bkn_knet_filter_destroy(kcom_msg_filter_destroy_t *kmsg, int len)
 
     spin_lock_irqsave(&sinfo->lock, flags);
 
-    found = 0;
-    list_for_each(list, &sinfo->rxpf_list) {
-        filter = (bkn_filter_t *)list;
-        if (kmsg->hdr.id == filter->kf.id) {
-            found = 1;
-            break;
-        }
-    }
+    filter = bkn_filter_lookup(sinfo, kmsg->hdr.id);
 
-    if (!found) {
+    if (filter == NULL) {
         spin_unlock_irqrestore(&sinfo->lock, flags);
         kmsg->hdr.status = KCOM_E_NOT_FOUND;
         return sizeof(kcom_msg_hdr_t);
     }
 
     list_del(&filter->list);
+    bkn_rxpf_cls_update(sinfo);
 
     spin_unlock_irqrestore(&sinfo->lock, flags);
 
     DBG_VERB(("Removing filter ID %d.\n", filter->kf.id));
-    kfree(filter);
+    /* Rx path may still hold it from the previous classifier */
+    call_rcu(&filter->rcu, bkn_filter_free_rcu);
 
     return sizeof(kcom_msg_hdr_t);
 }
 
+static int
+bkn_knet_filter_destroy_batch(kcom_msg_filter_destroy_batch_t *kmsg, int len)
+{
+    bkn_switch_info_t *sinfo;
+    kcom_filter_id_batch_entry_t *entry;
+    bkn_filter_t *filter;
+    struct list_head *list, *next;
+    LIST_HEAD(dead);
+    unsigned long flags;
+    int idx;
+
+    kmsg->hdr.type = KCOM_MSG_TYPE_RSP;
+
+    sinfo = bkn_sinfo_from_unit(kmsg->hdr.unit);
+    if (sinfo == NULL || kmsg->cnt == 0 || kmsg->cnt > KCOM_BATCH_MAX ||
+        len < (int)KCOM_MSG_BATCH_LEN(kmsg, kmsg->cnt)) {
+        kmsg->hdr.status = KCOM_E_PARAM;
+        return sizeof(kcom_msg_hdr_t);
+    }
+
+    spin_lock_irqsave(&sinfo->lock, flags);
+
+    for (idx = 0; idx < kmsg->cnt; idx++) {
+        entry = &kmsg->entry[idx];
+        filter = bkn_filter_lookup(sinfo, entry->id);
+        if (filter == NULL) {
+            entry->status = KCOM_E_NOT_FOUND;
+            continue;
+        }
+        entry->status = KCOM_E_NONE;
+        /* rxpf_list is only walked under the lock */
+        list_move_tail(&filter->list, &dead);
+    }
+    /* Rebuild the Rx classifier once for the whole batch */
+    bkn_rxpf_cls_update(sinfo);
+
+    spin_unlock_irqrestore(&sinfo->lock, flags);
+
+    list_for_each_safe(list, next, &dead) {
+        filter = (bkn_filter_t *)list;
+        list_del(&filter->list);
+        DBG_VERB(("Removing filter ID %d.\n", filter->kf.id));
+        /* Rx path may still hold it from the previous classifier */
+        call_rcu(&filter->rcu, bkn_filter_free_rcu);
+    }
+
+    return KCOM_MSG_BATCH_LEN(kmsg, kmsg->cnt);
+}
+
 static int
 bkn_knet_filter_list(kcom_msg_filter_list_t *kmsg, int len)
 {
@@ -8164,6 +9963,9 @@ bkn_knet_wb_cleanup(kcom_msg_wb_cleanup_t *kmsg, int len)
 static int
 bkn_handle_cmd_req(kcom_msg_t *kmsg, int len)
 {
+    /* Existing SDK builds size their messages as kcom_msg_t */
+    BUILD_BUG_ON(sizeof(kcom_msg_t) != sizeof(kcom_msg_filter_create_t));
+
     /* Silently drop events and unrecognized message types */
     if (kmsg->hdr.type != KCOM_MSG_TYPE_CMD) {
         if (kmsg->hdr.opcode == KCOM_M_STRING) {
@@ -8226,6 +10028,12 @@ bkn_handle_cmd_req(kcom_msg_t *kmsg, int len)
         /* Return network interface info */
         len = bkn_knet_netif_get(&kmsg->netif_get, len);
         break;
+    case KCOM_M_NETIF_CREATE_BATCH:
+        DBG_CMD(("KCOM_M_NETIF_CREATE_BATCH\n"));
+        /* Create network interfaces */
+        len = bkn_knet_netif_create_batch(
+                  (kcom_msg_netif_create_batch_t *)kmsg, len);
+        break;
     case KCOM_M_FILTER_CREATE:
         DBG_CMD(("KCOM_M_FILTER_CREATE\n"));
         /* Create packet filter */
@@ -8246,6 +10054,18 @@ bkn_handle_cmd_req(kcom_msg_t *kmsg, int len)
         /* Return packet filter info */
         len = bkn_knet_filter_get(&kmsg->filter_get, len);
         break;
+    case KCOM_M_FILTER_CREATE_BATCH:
+        DBG_CMD(("KCOM_M_FILTER_CREATE_BATCH\n"));
+        /* Create packet filters */
+        len = bkn_knet_filter_create_batch(
+                  (kcom_msg_filter_create_batch_t *)kmsg, len);
+        break;
+    case KCOM_M_FILTER_DESTROY_BATCH:
+        DBG_CMD(("KCOM_M_FILTER_DESTROY_BATCH\n"));
+        /* Destroy packet filters */
+        len = bkn_knet_filter_destroy_batch(
+                  (kcom_msg_filter_destroy_batch_t *)kmsg, len);
+        break;
     case KCOM_M_DBGPKT_SET:
         DBG_CMD(("KCOM_M_DBGPKT_SET\n"));
         /* Set debugging packet function */
@@ -8431,6 +10251,8 @@ _cleanup(void)
     /* Remove KCOM channel */
     PROXY_SERVICE_DESTROY(KCOM_CHAN_KNET);
 
+    bkn_genl_cleanup();
+
     bkn_proc_cleanup();
     remove_proc_entry("bcm/knet", NULL);
     remove_proc_entry("bcm", NULL);
@@ -8439,7 +10261,8 @@ _cleanup(void)
         sinfo = (bkn_switch_info_t *)list;
 
         del_timer_sync(&sinfo->timer);
-        del_timer_sync(&sinfo->rxtick);
+        /* No longer rearmed as module_initialized is cleared */
+        hrtimer_cancel(&sinfo->rxtick);
 
         spin_lock_irqsave(&sinfo->lock, flags);
         bkn_dma_abort(sinfo);
@@ -8461,11 +10284,18 @@ _cleanup(void)
         spin_unlock_irqrestore(&sinfo->lock, flags);
     }
 
+    /* Wait for filters and classifiers released with call_rcu() */
+    rcu_barrier();
+
     /* Destroy all switch devices */
     while (!list_empty(&_sinfo_list)) {
         sinfo = list_entry(_sinfo_list.next, bkn_switch_info_t, list);
 
         /* Destroy all associated Rx packet filters */
+        if (sinfo->rxpf_cls != NULL) {
+            bkn_rxpf_cls_free(sinfo->rxpf_cls);
+            sinfo->rxpf_cls = NULL;
+        }
         while (!list_empty(&sinfo->rxpf_list)) {
             filter = list_entry(sinfo->rxpf_list.next, bkn_filter_t, list);
             list_del(&filter->list);
@@ -8480,7 +10310,7 @@ _cleanup(void)
             dev = priv->dev;
             DBG_VERB(("Removing virtual Ethernet device %s.\n", dev->name));
             unregister_netdev(dev);
-            free_netdev(dev);
+            bkn_free_ndev(dev);
         }
         if (sinfo->ndevs != NULL) {
             kfree(sinfo->ndevs);
@@ -8490,7 +10320,7 @@ _cleanup(void)
         if (sinfo->dev) {
             DBG_VERB(("Removing Ethernet device %s.\n", sinfo->dev->name));
             unregister_netdev(sinfo->dev);
-            free_netdev(sinfo->dev);
+            bkn_free_ndev(sinfo->dev);
         }
 
         DBG_VERB(("Removing switch device.\n"));
@@ -8534,6 +10364,9 @@ bkn_knet_dev_init(int d)
     bkn_priv_t *priv;
     char *bdev_name;
     const ibde_dev_t *bde_dev;
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+    int chan;
+#endif
 
     DBG_VERB(("%s dev %d\n",__FUNCTION__, d));
     /* Base network device name */
@@ -8583,7 +10416,7 @@ bkn_knet_dev_init(int d)
 
     /* Create base virtual net device */
     bkn_dev_mac[5]++;
-    if ((dev = bkn_init_ndev(bkn_dev_mac, bdev_name)) == NULL) {
+    if ((dev = bkn_init_ndev(bkn_dev_mac, bdev_name, 0)) == NULL) {
         _cleanup();
         return -ENOMEM;
     } else {
@@ -8599,6 +10432,17 @@ bkn_knet_dev_init(int d)
 
     if (use_napi) {
         netif_napi_add(dev, &sinfo->napi, bkn_poll, napi_weight);
+#ifdef BKN_NAPI_PER_CHAN_SUPPORT
+        /* Used only if the device turns out to be CMICx */
+        if (napi_per_chan) {
+            for (chan = 0; chan < NUM_RX_CHAN; chan++) {
+                sinfo->rx[chan].napi.sinfo = sinfo;
+                sinfo->rx[chan].napi.chan = chan;
+                netif_napi_add(dev, &sinfo->rx[chan].napi.napi,
+                               bkn_poll_chan, napi_weight);
+            }
+        }
+#endif
     }
     return 0;
 }
@@ -8659,6 +10503,8 @@ _init(void)
 
     bkn_proc_init();
 
+    bkn_genl_init();
+
     /* Initialize event queue */
     for (idx = 0; idx < LINUX_BDE_MAX_DEVICES; idx++) {
         memset(&_bkn_evt[idx], 0, sizeof(bkn_evt_resource_t));
@@ -8686,6 +10532,8 @@ _ioctl(unsigned int cmd, unsigned long arg)
 {
     bkn_ioctl_t io;
     kcom_msg_t kmsg;
+    kcom_msg_t *msg;
+    int rv;
 
     if (!module_initialized) {
         return -EFAULT;
@@ -8695,7 +10543,12 @@ _ioctl(unsigned int cmd, unsigned long arg)
         return -EFAULT;
     }
 
-    if (io.len > sizeof(kmsg)) {
+    /*
+     * Only batch messages may exceed kcom_msg_t. Modules without batch
+     * support fail any such message with -EINVAL, which callers take
+     * as batches being unsupported.
+     */
+    if (io.len > sizeof(kmsg) && io.len > KCOM_MSG_BATCH_BYTES_MAX) {
         return -EINVAL;
     }
 
@@ -8703,6 +10556,30 @@ _ioctl(unsigned int cmd, unsigned long arg)
 
     switch(cmd) {
     case 0:
+        if (io.len > sizeof(kmsg)) {
+            /* Batch messages may exceed the generic message size */
+            msg = kmalloc(io.len, GFP_KERNEL);
+            if (msg == NULL) {
+                return -ENOMEM;
+            }
+            rv = 0;
+            if (copy_from_user(msg, (void *)(unsigned long)io.buf, io.len)) {
+                rv = -EFAULT;
+            } else {
+                ioctl_cmd++;
+                io.len = bkn_handle_cmd_req(msg, io.len);
+                ioctl_cmd--;
+                if (io.len > 0 &&
+                    copy_to_user((void *)(unsigned long)io.buf, msg, io.len)) {
+                    rv = -EFAULT;
+                }
+            }
+            kfree(msg);
+            if (rv < 0) {
+                return rv;
+            }
+            break;
+        }
         if (io.len > 0) {
             if (copy_from_user(&kmsg, (void *)(unsigned long)io.buf, io.len)) {
                 return -EFAULT;
@@ -33,6 +33,69 @@ typedef struct  {
     uint64_t buf;
 } bkn_ioctl_t;
 
+/*
+ * KNET counters over generic netlink.
+ *
+ * A dump of BKN_GENL_CMD_GET_STATS returns one message per switch unit
+ * with its DMA channel counters, followed by one message per KNET
+ * network interface in the network namespace of the requester.
+ */
+#define BKN_GENL_NAME           "bcm_knet"
+#define BKN_GENL_VERSION        1
+
+enum bkn_genl_cmd {
+    BKN_GENL_CMD_UNSPEC,
+    BKN_GENL_CMD_GET_STATS,
+    __BKN_GENL_CMD_MAX
+};
+#define BKN_GENL_CMD_MAX        (__BKN_GENL_CMD_MAX - 1)
+
+enum bkn_genl_attr {
+    BKN_GENL_ATTR_UNSPEC,
+    BKN_GENL_ATTR_PAD,
+    BKN_GENL_ATTR_UNIT,         /* u32, switch unit */
+    BKN_GENL_ATTR_TX_STATS,     /* bkn_genl_tx_stats_t */
+    BKN_GENL_ATTR_RX_STATS,     /* bkn_genl_rx_stats_t, one per Rx channel */
+    BKN_GENL_ATTR_NETIF_ID,     /* u32, KNET netif ID */
+    BKN_GENL_ATTR_NETIF_NAME,   /* string */
+    BKN_GENL_ATTR_IFINDEX,      /* u32 */
+    BKN_GENL_ATTR_NETIF_STATS,  /* struct rtnl_link_stats64 */
+    __BKN_GENL_ATTR_MAX
+};
+#define BKN_GENL_ATTR_MAX       (__BKN_GENL_ATTR_MAX - 1)
+
+typedef struct {
+    uint32_t pkts;
+    uint32_t pkts_d_no_skb;
+    uint32_t pkts_d_rcpu_encap;
+    uint32_t pkts_d_rcpu_sig;
+    uint32_t pkts_d_rcpu_meta;
+    uint32_t pkts_d_pad_fail;
+    uint32_t pkts_d_dma_resrc;
+    uint32_t pkts_d_callback;
+    uint32_t pkts_d_no_link;
+    uint32_t pkts_d_over_limit;
+} bkn_genl_tx_stats_t;
+
+typedef struct {
+    uint32_t chan;
+    uint32_t pkts;
+    uint32_t pkts_f_api;
+    uint32_t pkts_f_netif;
+    uint32_t pkts_m_api;
+    uint32_t pkts_m_netif;
+    uint32_t pkts_gro;
+    uint32_t pkts_gro_merged;
+    uint32_t pkts_d_no_skb;
+    uint32_t pkts_d_no_match;
+    uint32_t pkts_d_unkn_netif;
+    uint32_t pkts_d_unkn_dest;
+    uint32_t pkts_d_callback;
+    uint32_t pkts_d_no_link;
+    uint32_t pkts_d_no_api_buf;
+    uint32_t pkts_d_rate;
+} bkn_genl_rx_stats_t;
+
 #ifdef __KERNEL__
 
 /*
@@ -0,0 +1,143 @@
+/*
+ * Copyright 2017 Broadcom
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License, version 2, as
+ * published by the Free Software Foundation (the "GPL").
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License version 2 (GPLv2) for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 (GPLv2) along with this source code.
+ */
+/*
+ * KNET tracepoints
+ *
+ * Enable with e.g.
+ *   echo 1 > /sys/kernel/debug/tracing/events/bcm_knet/enable
+ *
+ * bkn_rx_netif reports the time since the interrupt which started
+ * the current Rx poll, 0 if the packet was not received by interrupt.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM bcm_knet
+
+#if !defined(_TRACE_BCM_KNET_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_BCM_KNET_H
+
+#include <linux/tracepoint.h>
+#include <linux/ktime.h>
+
+/* Rx DMA descriptor completed */
+TRACE_EVENT(bkn_rx_desc,
+
+    TP_PROTO(int unit, int chan, int idx, int len),
+
+    TP_ARGS(unit, chan, idx, len),
+
+    TP_STRUCT__entry(
+        __field(int, unit)
+        __field(int, chan)
+        __field(int, idx)
+        __field(int, len)
+    ),
+
+    TP_fast_assign(
+        __entry->unit = unit;
+        __entry->chan = chan;
+        __entry->idx = idx;
+        __entry->len = len;
+    ),
+
+    TP_printk("unit=%d chan=%d idx=%d len=%d",
+              __entry->unit, __entry->chan, __entry->idx, __entry->len)
+);
+
+/* Rx packet matched a filter */
+TRACE_EVENT(bkn_rx_filter,
+
+    TP_PROTO(int unit, int chan, int id, int dest_type, int dest_id, int len),
+
+    TP_ARGS(unit, chan, id, dest_type, dest_id, len),
+
+    TP_STRUCT__entry(
+        __field(int, unit)
+        __field(int, chan)
+        __field(int, id)
+        __field(int, dest_type)
+        __field(int, dest_id)
+        __field(int, len)
+    ),
+
+    TP_fast_assign(
+        __entry->unit = unit;
+        __entry->chan = chan;
+        __entry->id = id;
+        __entry->dest_type = dest_type;
+        __entry->dest_id = dest_id;
+        __entry->len = len;
+    ),
+
+    TP_printk("unit=%d chan=%d filter=%d dest_type=%d dest_id=%d len=%d",
+              __entry->unit, __entry->chan, __entry->id,
+              __entry->dest_type, __entry->dest_id, __entry->len)
+);
+
+/* Rx packet handed to the network stack */
+TRACE_EVENT(bkn_rx_netif,
+
+    TP_PROTO(int unit, int chan, int ifindex, int len, u64 isr_ns),
+
+    TP_ARGS(unit, chan, ifindex, len, isr_ns),
+
+    TP_STRUCT__entry(
+        __field(int, unit)
+        __field(int, chan)
+        __field(int, ifindex)
+        __field(int, len)
+        __field(u64, lat_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->unit = unit;
+        __entry->chan = chan;
+        __entry->ifindex = ifindex;
+        __entry->len = len;
+        __entry->lat_ns = isr_ns ? ktime_to_ns(ktime_get()) - isr_ns : 0;
+    ),
+
+    TP_printk("unit=%d chan=%d ifindex=%d len=%d lat_ns=%llu",
+              __entry->unit, __entry->chan, __entry->ifindex, __entry->len,
+              (unsigned long long)__entry->lat_ns)
+);
+
+/* Tx DMA started or moved to a new halt location */
+TRACE_EVENT(bkn_tx_doorbell,
+
+    TP_PROTO(int unit, int idx, int pending),
+
+    TP_ARGS(unit, idx, pending),
+
+    TP_STRUCT__entry(
+        __field(int, unit)
+        __field(int, idx)
+        __field(int, pending)
+    ),
+
+    TP_fast_assign(
+        __entry->unit = unit;
+        __entry->idx = idx;
+        __entry->pending = pending;
+    ),
+
+    TP_printk("unit=%d idx=%d pending=%d",
+              __entry->unit, __entry->idx, __entry->pending)
+);
+
+#endif /* _TRACE_BCM_KNET_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -42,6 +42,11 @@
 #include <linux/skbuff.h>
 #include <linux/sched.h>
 #include <linux/netdevice.h>
+#include <linux/rcupdate.h>
+#include <linux/log2.h>
+#include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/net_namespace.h>
 #include <net/psample.h>
 #include "psample-cb.h"
@@ -79,12 +84,33 @@ LKM_MOD_PARAM(psample_size, "i", int, 0);
 MODULE_PARM_DESC(psample_size,
 "psample pkt size (default 128 bytes)");
 
+static int psample_async = 0;
+LKM_MOD_PARAM(psample_async, "i", int, 0);
+MODULE_PARM_DESC(psample_async,
+"Queue samples to a per-CPU ring and send them from a work queue (default 0)");
+
+#define PSAMPLE_QLEN_DFLT 256
+static int psample_qlen = PSAMPLE_QLEN_DFLT;
+LKM_MOD_PARAM(psample_qlen, "i", int, 0);
+MODULE_PARM_DESC(psample_qlen,
+"Samples queued per CPU in async mode, rounded up to a power of 2 (default 256)");
+
+/* Max bytes of a sample queued in async mode */
+#define PSAMPLE_QDATA_MAX 256
+/* Samples sent per ring before moving on to the next CPU */
+#define PSAMPLE_QBATCH 64
+
 /* driver proc entry root */
 static struct proc_dir_entry *psample_proc_root = NULL;
 
+/* Port numbers are 8 bits in the netif and in the HiGig headers */
+#define PSAMPLE_PORT_MAX 256
+
 /* psample general info */
 typedef struct {
     struct list_head netif_list;
+    /* Lowest ID netif per port, for lockless lookup from the Rx path */
+    psample_netif_t __rcu *port_netif[PSAMPLE_PORT_MAX];
     knet_hw_info_t hw;
     struct net *netns;
     spinlock_t lock;
@@ -105,6 +131,9 @@ typedef struct psample_stats_s {
     unsigned long pkts_d_meta_srcport;
     unsigned long pkts_d_meta_dstport;
     unsigned long pkts_d_invalid_size;
+    unsigned long pkts_f_queued;
+    unsigned long pkts_d_queue_full;
+    unsigned long queue_batches;
 } psample_stats_t;
 static psample_stats_t g_psample_stats = {0};
 
@@ -115,25 +144,61 @@ typedef struct psample_meta_s {
     int sample_rate;
 } psample_meta_t;
 
+/* Sample queued by the Rx path in async mode */
+typedef struct psample_qentry_s {
+    int group_num;
+    int size;
+    psample_meta_t meta;
+    uint8_t data[PSAMPLE_QDATA_MAX];
+} psample_qentry_t;
+
+/*
+ * Per-CPU single producer/single consumer ring. The KNET Rx callback on
+ * the CPU advances head, the psample work advances tail.
+ */
+typedef struct psample_ring_s {
+    unsigned int head;
+    unsigned int tail;
+    psample_qentry_t *entry;
+} psample_ring_t;
+
+static DEFINE_PER_CPU(psample_ring_t, psample_ring);
+static unsigned int psample_qmask;
+static struct work_struct psample_qwork;
 
+
+/* Must be called under rcu_read_lock() */
 static psample_netif_t*
 psample_netif_lookup_by_port(int unit, int port)
+{
+    if (port < 0 || port >= PSAMPLE_PORT_MAX) {
+        return (NULL);
+    }
+    return rcu_dereference(g_psample_info.port_netif[port]);
+}
+
+/* Must be called with g_psample_info.lock held */
+static void
+psample_port_netif_update(int port)
 {
     struct list_head *list;
-    psample_netif_t *psample_netif = NULL;
-    unsigned long flags;
+    psample_netif_t *psample_netif;
 
-    /* look for port from list of available net_devices */
-    spin_lock_irqsave(&g_psample_info.lock, flags);
+    /* list is sorted by ID, the first netif on the port wins */
     list_for_each(list, &g_psample_info.netif_list) {
         psample_netif = (psample_netif_t*)list;
         if (psample_netif->port == port) {
-            spin_unlock_irqrestore(&g_psample_info.lock, flags);
-            return psample_netif;
+            rcu_assign_pointer(g_psample_info.port_netif[port], psample_netif);
+            return;
         }
     }
-    spin_unlock_irqrestore(&g_psample_info.lock, flags);
-    return (NULL);
+    RCU_INIT_POINTER(g_psample_info.port_netif[port], NULL);
+}
+
+static void
+psample_netif_free_rcu(struct rcu_head *rcu)
+{
+    kfree(container_of(rcu, psample_netif_t, rcu));
 }
         
 static int
@@ -309,6 +374,8 @@ psample_meta_get(int unit, uint8_t *pkt, void *pkt_meta, psample_meta_t *sflow_m
         return (-1);
     }
 
+    rcu_read_lock();
+
     /* find src port netif (no need to lookup CPU port) */
     if (srcport != 0) {
         if ((psample_netif = psample_netif_lookup_by_port(unit, srcport))) {
@@ -331,6 +398,8 @@ psample_meta_get(int unit, uint8_t *pkt, void *pkt_meta, psample_meta_t *sflow_m
         }
     }
 
+    rcu_read_unlock();
+
     PSAMPLE_CB_DBG_PRINT("%s: srcport %d, dstport %d, src_ifindex %d, dst_ifindex %d, trunc_size %d, sample_rate %d\n", 
             __func__, srcport, dstport, src_ifindex, dst_ifindex, sample_size, sample_rate);
 
@@ -342,6 +411,148 @@ psample_meta_get(int unit, uint8_t *pkt, void *pkt_meta, psample_meta_t *sflow_m
     return (0);
 }
 
+/* Copy sample to the ring of this CPU, returns -1 if the ring is full */
+static int
+psample_enqueue(int group_num, uint8_t *pkt, int size, psample_meta_t *meta)
+{
+    psample_ring_t *ring;
+    psample_qentry_t *qe;
+    unsigned int head;
+    unsigned long flags;
+    int rv = 0;
+
+    local_irq_save(flags);
+    ring = this_cpu_ptr(&psample_ring);
+    head = ring->head;
+    if (head - smp_load_acquire(&ring->tail) > psample_qmask) {
+        rv = -1;
+    } else {
+        qe = &ring->entry[head & psample_qmask];
+        qe->group_num = group_num;
+        qe->size = size;
+        qe->meta = *meta;
+        if (qe->meta.trunc_size > PSAMPLE_QDATA_MAX) {
+            qe->meta.trunc_size = PSAMPLE_QDATA_MAX;
+        }
+        if (qe->meta.trunc_size > 0) {
+            memcpy(qe->data, pkt, qe->meta.trunc_size);
+        }
+        /* Publish entry to the work */
+        smp_store_release(&ring->head, head + 1);
+    }
+    local_irq_restore(flags);
+
+    if (rv == 0) {
+        schedule_work(&psample_qwork);
+    }
+    return rv;
+}
+
+/* Send up to budget samples of a ring, returns number of samples sent */
+static int
+psample_ring_drain(psample_ring_t *ring, int budget)
+{
+    struct psample_group *group = NULL;
+    psample_qentry_t *qe;
+    struct sk_buff skb;
+    unsigned int head, tail;
+    int done = 0;
+
+    tail = ring->tail;
+    head = smp_load_acquire(&ring->head);
+    while (tail != head && done < budget) {
+        qe = &ring->entry[tail & psample_qmask];
+
+        /* consecutive samples mostly go to the same group */
+        if (!group || group->group_num != qe->group_num) {
+            group = psample_group_get(g_psample_info.netns, qe->group_num);
+        }
+        if (!group) {
+            g_psample_stats.pkts_d_no_group++;
+        } else {
+            /* only the truncated header is in the ring */
+            memset(&skb, 0, sizeof(struct sk_buff));
+            skb.len = qe->size;
+            skb.data = qe->data;
+
+            psample_sample_packet(group,
+                                  &skb,
+                                  qe->meta.trunc_size,
+                                  qe->meta.src_ifindex,
+                                  qe->meta.dst_ifindex,
+                                  qe->meta.sample_rate);
+
+            g_psample_stats.pkts_f_psample_mod++;
+        }
+
+        tail++;
+        done++;
+        /* Release entry to the Rx callback */
+        smp_store_release(&ring->tail, tail);
+    }
+    return done;
+}
+
+static void
+psample_qwork_func(struct work_struct *work)
+{
+    int cpu, done;
+
+    do {
+        done = 0;
+        for_each_possible_cpu(cpu) {
+            done += psample_ring_drain(per_cpu_ptr(&psample_ring, cpu),
+                                       PSAMPLE_QBATCH);
+        }
+        if (done) {
+            g_psample_stats.queue_batches++;
+            cond_resched();
+        }
+    } while (done);
+}
+
+static int
+psample_queue_init(void)
+{
+    psample_ring_t *ring;
+    unsigned int qlen;
+    int cpu;
+
+    qlen = psample_qlen > 0 ? roundup_pow_of_two(psample_qlen) : PSAMPLE_QLEN_DFLT;
+    psample_qmask = qlen - 1;
+    INIT_WORK(&psample_qwork, psample_qwork_func);
+
+    for_each_possible_cpu(cpu) {
+        ring = per_cpu_ptr(&psample_ring, cpu);
+        ring->head = 0;
+        ring->tail = 0;
+        ring->entry = vmalloc(qlen * sizeof(psample_qentry_t));
+        if (!ring->entry) {
+            gprintk("%s: failed to alloc %u queue entries for cpu %d\n",
+                    __func__, qlen, cpu);
+            return (-1);
+        }
+    }
+    return (0);
+}
+
+static void
+psample_queue_cleanup(void)
+{
+    psample_ring_t *ring;
+    int cpu;
+
+    cancel_work_sync(&psample_qwork);
+
+    for_each_possible_cpu(cpu) {
+        ring = per_cpu_ptr(&psample_ring, cpu);
+        if (ring->entry) {
+            vfree(ring->entry);
+            ring->entry = NULL;
+        }
+    }
+}
+
 int 
 psample_filter_cb(uint8_t * pkt, int size, int dev_no, void *pkt_meta,
                   int chan, kcom_filter_t *kf)
@@ -366,11 +577,16 @@ psample_filter_cb(uint8_t * pkt, int size, int dev_no, void *pkt_meta,
     g_psample_stats.pkts_f_psample_cb++;
 
     /* get psample group info. psample genetlink group ID passed in kf->dest_id */
-    group = psample_group_get(g_psample_info.netns, kf->dest_id);
-    if (!group) {
-        gprintk("%s: Could not find psample genetlink group %d\n", __func__, kf->cb_user_data);
-        g_psample_stats.pkts_d_no_group++;
-        goto PSAMPLE_FILTER_CB_PKT_HANDLED;
+    if (psample_async) {
+        /* looked up when the sample is sent */
+        group = NULL;
+    } else {
+        group = psample_group_get(g_psample_info.netns, kf->dest_id);
+        if (!group) {
+            gprintk("%s: Could not find psample genetlink group %d\n", __func__, kf->cb_user_data);
+            g_psample_stats.pkts_d_no_group++;
+            goto PSAMPLE_FILTER_CB_PKT_HANDLED;
+        }
     }
 
     /* get psample metadata */
@@ -395,10 +611,16 @@ psample_filter_cb(uint8_t * pkt, int size, int dev_no, void *pkt_meta,
     }
 
     PSAMPLE_CB_DBG_PRINT("%s: group 0x%x, trunc_size %d, src_ifdx %d, dst_ifdx %d, sample_rate %d\n",
-            __func__, group->group_num, meta.trunc_size, meta.src_ifindex, meta.dst_ifindex, meta.sample_rate);
+            __func__, kf->dest_id, meta.trunc_size, meta.src_ifindex, meta.dst_ifindex, meta.sample_rate);
 
     /* drop if configured sample rate is 0 */
-    if (meta.sample_rate > 0) {
+    if (meta.sample_rate > 0 && psample_async) {
+        if (psample_enqueue(kf->dest_id, pkt, size, &meta) < 0) {
+            g_psample_stats.pkts_d_queue_full++;
+        } else {
+            g_psample_stats.pkts_f_queued++;
+        }
+    } else if (meta.sample_rate > 0) {
         /* setup skb to point to pkt */
         memset(&skb, 0, sizeof(struct sk_buff));
         skb.len = size;
@@ -468,6 +690,7 @@ psample_netif_create_cb(int unit, kcom_netif_t *netif, struct net_device *dev)
         /* No holes - add to end of list */
         list_add_tail(&psample_netif->list, &g_psample_info.netif_list);
     }
+    psample_port_netif_update(psample_netif->port);
     
     spin_unlock_irqrestore(&g_psample_info.lock, flags);
 
@@ -478,7 +701,7 @@ psample_netif_create_cb(int unit, kcom_netif_t *netif, struct net_device *dev)
 int
 psample_netif_destroy_cb(int unit, kcom_netif_t *netif, struct net_device *dev)
 {
-    int found;
+    int found = 0;
     struct list_head *list;
     psample_netif_t *psample_netif;
     unsigned long flags; 
@@ -495,8 +718,10 @@ psample_netif_destroy_cb(int unit, kcom_netif_t *netif, struct net_device *dev)
         if (netif->id == psample_netif->id) {
             found = 1; 
             list_del(&psample_netif->list);
+            psample_port_netif_update(psample_netif->port);
             PSAMPLE_CB_DBG_PRINT("%s: removing psample netif '%s'\n", __func__, dev->name);
-            kfree(psample_netif);
+            /* Rx path may still be using it */
+            call_rcu(&psample_netif->rcu, psample_netif_free_rcu);
             break;
         }
     }
@@ -723,6 +948,8 @@ psample_proc_debug_show(struct seq_file *m, void *v)
     seq_printf(m, "  dcb_size:        %d\n",   g_psample_info.hw.dcb_size);
     seq_printf(m, "  pkt_hdr_size:    %d\n",   g_psample_info.hw.pkt_hdr_size);
     seq_printf(m, "  cdma_channels:   %d\n",   g_psample_info.hw.cdma_channels);
+    seq_printf(m, "  psample_async:   %d\n",   psample_async);
+    seq_printf(m, "  psample_qlen:    %u\n",   psample_qmask + 1);
 
     return 0;
 }
@@ -795,6 +1022,9 @@ psample_proc_stats_show(struct seq_file *m, void *v)
     seq_printf(m, "  pkts with invalid src port     %10lu\n", g_psample_stats.pkts_d_meta_srcport);
     seq_printf(m, "  pkts with invalid dst port     %10lu\n", g_psample_stats.pkts_d_meta_dstport);
     seq_printf(m, "  pkts with invalid orig pkt sz  %10lu\n", g_psample_stats.pkts_d_invalid_size);
+    seq_printf(m, "  pkts queued for psample module %10lu\n", g_psample_stats.pkts_f_queued);
+    seq_printf(m, "  pkts drop queue full           %10lu\n", g_psample_stats.pkts_d_queue_full);
+    seq_printf(m, "  queue batches sent             %10lu\n", g_psample_stats.queue_batches);
     return 0;
 }
 
@@ -819,6 +1049,11 @@ int psample_cleanup(void)
     remove_proc_entry("rate",  psample_proc_root);
     remove_proc_entry("size",  psample_proc_root);
     remove_proc_entry("debug", psample_proc_root);
+    if (psample_async) {
+        psample_queue_cleanup();
+    }
+    /* Wait for pending netif frees */
+    rcu_barrier();
     return 0;
 }
 
@@ -878,6 +1113,15 @@ int psample_init(void)
     }
     PSAMPLE_CB_DBG_PRINT("%s: current->pid %d, netns 0x%p, sample_size %d\n", __func__, 
             current->pid, g_psample_info.netns, psample_size);
+
+    /* setup sample queues for async mode */
+    if (psample_async) {
+        if (psample_queue_init() < 0) {
+            psample_queue_cleanup();
+            psample_async = 0;
+            gprintk("%s: falling back to synchronous psample mode\n", __func__);
+        }
+    }
    
     return 0;
 }
@@ -47,6 +47,7 @@ typedef struct {
     uint16 qnum;
     uint32 sample_rate;
     uint32 sample_size;
+    struct rcu_head rcu;
 } psample_netif_t;
 
 extern int
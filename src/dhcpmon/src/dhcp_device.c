@@ -4,6 +4,8 @@
  *  device (interface) module
  */
 
+#define _GNU_SOURCE                 /** recvmmsg() */
+
 #include <err.h>
 #include <errno.h>
 #include <string.h>
@@ -11,22 +13,30 @@
 #include <stdbool.h>
 #include <net/ethernet.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
 #include <netinet/udp.h>
 #include <netinet/ether.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <syslog.h>
+#include <ifaddrs.h>
 #include <libexplain/ioctl.h>
 #include <linux/filter.h>
-#include <netpacket/packet.h>
+#include <linux/if_packet.h>
 
 #include "dhcp_device.h"
+#include "dhcp_ebpf.h"
+#include "dhcp_xid.h"
 
 /** Counter print width */
 #define DHCP_COUNTER_WIDTH  9
 
+/** Prefix appended to Aggregation device */
+#define AGG_DEV_PREFIX  "Agg-"
+
 /** Start of Ether header of a captured frame */
 #define ETHER_START_OFFSET  0
 /** Start of IP header of a captured frame */
@@ -37,9 +47,44 @@
 #define DHCP_START_OFFSET (UDP_START_OFFSET + sizeof(struct udphdr))
 /** Start of DHCP Options segment of a captured frame */
 #define DHCP_OPTIONS_HEADER_SIZE 240
+/** Offset of DHCP XID */
+#define DHCP_XID_OFFSET 4
 /** Offset of DHCP GIADDR */
 #define DHCP_GIADDR_OFFSET 24
-
+/** Offset of DHCP CHADDR */
+#define DHCP_CHADDR_OFFSET 28
+
+/** Start of UDP header of a captured DHCPv6 frame */
+#define UDPV6_START_OFFSET (IP_START_OFFSET + sizeof(struct ip6_hdr))
+/** Start of DHCPv6 header of a captured frame */
+#define DHCPV6_START_OFFSET (UDPV6_START_OFFSET + sizeof(struct udphdr))
+/** DHCPv6 client UDP port */
+#define DHCPV6_CLIENT_PORT 546
+/** DHCPv6 server/relay agent UDP port */
+#define DHCPV6_SERVER_PORT 547
+/** Offset of DHCPv6 relay message link-address */
+#define DHCPV6_LINK_ADDR_OFFSET 2
+/** Size of DHCPv6 relay message header, options follow it */
+#define DHCPV6_RELAY_HEADER_SIZE 34
+/** DHCPv6 Relay Message option, it carries relayed message */
+#define DHCPV6_OPTION_RELAY_MSG 9
+
+/** Size of a TPACKET_V3 capture ring block */
+#define DHCP_RING_BLOCK_SIZE (1 << 16)
+/** Nominal size of a TPACKET_V3 capture ring frame, used only to size the ring */
+#define DHCP_RING_FRAME_SIZE (1 << 11)
+/** Time after which the kernel retires a partially filled capture ring block to user space */
+#define DHCP_RING_BLOCK_TIMEOUT_MSEC 64
+/** Nanoseconds per second */
+#define NSEC_PER_SEC 1000000000ULL
+/** Max number of frames read per recvmmsg() call */
+#define DHCP_RECV_BATCH_SIZE 32
+/** Max number of interfaces matched by the ifindex prefix of shared capture socket filter (jt is 8 bits wide) */
+#define DHCP_SHARED_FILTER_MAX_INTF 250
+/** Max number of shared capture sockets, default max number of members of a PACKET_FANOUT group */
+#define DHCP_SHARED_SOCK_MAX 256
+
+#define OP_LDWA     (BPF_LD  | BPF_W   | BPF_ABS)   /** bpf ld Abs */
 #define OP_LDHA     (BPF_LD  | BPF_H   | BPF_ABS)   /** bpf ldh Abs */
 #define OP_LDHI     (BPF_LD  | BPF_H   | BPF_IND)   /** bpf ldh Ind */
 #define OP_LDB      (BPF_LD  | BPF_B   | BPF_ABS)   /** bpf ldb Abs*/
@@ -49,6 +94,38 @@
 #define OP_JSET     (BPF_JMP | BPF_JSET | BPF_K)    /** bpf jset */
 #define OP_LDXB     (BPF_LDX | BPF_B    | BPF_MSH)  /** bpf ldxb */
 
+/** Berkeley Packet Filter program for "(ip and udp and (port 67 or port 68)) or
+ *  (ip6 and udp and (port 546 or port 547))", used when DHCPv6 relay is monitored as well.
+ * This program is derived from dhcp_bpf_code below, its IPv6 branch matches DHCPv6 ports
+ * and IPv6 frames of any other UDP port or protocol are dropped in the kernel.
+ */
+static struct sock_filter dhcp_dhcpv6_bpf_code[] = {
+    {.code = OP_LDHA, .jt = 0,  .jf = 0,  .k = 0x0000000c}, // (000) ldh      [12]
+    {.code = OP_JEQ,  .jt = 0,  .jf = 8,  .k = 0x000086dd}, // (001) jeq      #0x86dd          jt 2	jf 10
+    {.code = OP_LDB,  .jt = 0,  .jf = 0,  .k = 0x00000014}, // (002) ldb      [20]
+    {.code = OP_JEQ,  .jt = 0,  .jf = 19, .k = 0x00000011}, // (003) jeq      #0x11            jt 4	jf 23
+    {.code = OP_LDHA, .jt = 0,  .jf = 0,  .k = 0x00000036}, // (004) ldh      [54]
+    {.code = OP_JEQ,  .jt = 16, .jf = 0,  .k = 0x00000222}, // (005) jeq      #0x222           jt 22	jf 6
+    {.code = OP_JEQ,  .jt = 15, .jf = 0,  .k = 0x00000223}, // (006) jeq      #0x223           jt 22	jf 7
+    {.code = OP_LDHA, .jt = 0,  .jf = 0,  .k = 0x00000038}, // (007) ldh      [56]
+    {.code = OP_JEQ,  .jt = 13, .jf = 0,  .k = 0x00000222}, // (008) jeq      #0x222           jt 22	jf 9
+    {.code = OP_JEQ,  .jt = 12, .jf = 13, .k = 0x00000223}, // (009) jeq      #0x223           jt 22	jf 23
+    {.code = OP_JEQ,  .jt = 0,  .jf = 12, .k = 0x00000800}, // (010) jeq      #0x800           jt 11	jf 23
+    {.code = OP_LDB,  .jt = 0,  .jf = 0,  .k = 0x00000017}, // (011) ldb      [23]
+    {.code = OP_JEQ,  .jt = 0,  .jf = 10, .k = 0x00000011}, // (012) jeq      #0x11            jt 13	jf 23
+    {.code = OP_LDHA, .jt = 0,  .jf = 0,  .k = 0x00000014}, // (013) ldh      [20]
+    {.code = OP_JSET, .jt = 8,  .jf = 0,  .k = 0x00001fff}, // (014) jset     #0x1fff          jt 23	jf 15
+    {.code = OP_LDXB, .jt = 0,  .jf = 0,  .k = 0x0000000e}, // (015) ldxb     4*([14]&0xf)
+    {.code = OP_LDHI, .jt = 0,  .jf = 0,  .k = 0x0000000e}, // (016) ldh      [x + 14]
+    {.code = OP_JEQ,  .jt = 4,  .jf = 0,  .k = 0x00000043}, // (017) jeq      #0x43            jt 22	jf 18
+    {.code = OP_JEQ,  .jt = 3,  .jf = 0,  .k = 0x00000044}, // (018) jeq      #0x44            jt 22	jf 19
+    {.code = OP_LDHI, .jt = 0,  .jf = 0,  .k = 0x00000010}, // (019) ldh      [x + 16]
+    {.code = OP_JEQ,  .jt = 1,  .jf = 0,  .k = 0x00000043}, // (020) jeq      #0x43            jt 22	jf 21
+    {.code = OP_JEQ,  .jt = 0,  .jf = 1,  .k = 0x00000044}, // (021) jeq      #0x44            jt 22	jf 23
+    {.code = OP_RET,  .jt = 0,  .jf = 0,  .k = 0x00040000}, // (022) ret      #262144
+    {.code = OP_RET,  .jt = 0,  .jf = 0,  .k = 0x00000000}, // (023) ret      #0
+};
+
 /** Berkeley Packet Filter program for "udp and (port 67 or port 68)".
  * This program is obtained using the following command tcpdump:
  * `tcpdump -dd "udp and (port 67 or port 68)"`
@@ -84,42 +161,162 @@ static struct sock_fprog dhcp_sock_bfp = {
     .len = sizeof(dhcp_bpf_code) / sizeof(*dhcp_bpf_code), .filter = dhcp_bpf_code
 };
 
-/** Aggregate device of DHCP interfaces. It contains aggregate counters from
-    all interfaces
- */
-static dhcp_device_context_t aggregate_dev = {0};
+/** Filter program socket struct used when DHCPv6 relay is monitored as well */
+static struct sock_fprog dhcp_dhcpv6_sock_bfp = {
+    .len = sizeof(dhcp_dhcpv6_bpf_code) / sizeof(*dhcp_dhcpv6_bpf_code), .filter = dhcp_dhcpv6_bpf_code
+};
+
+/** Filter program attached to capture sockets */
+static struct sock_fprog *capture_bfp = &dhcp_sock_bfp;
+
+/** DHCPv6 relay is monitored, DHCPv6 counters are reported */
+static bool dhcpv6_capture = false;
+
+/** VLAN address entry of vlan_addrs hash table */
+typedef struct
+{
+    struct in6_addr addr;               /** VLAN address, IPv4 addresses are stored IPv4-mapped */
+    dhcp_device_context_t *agg_dev;     /** VLAN aggregate device, NULL for a free slot */
+} dhcp_vlan_addr_t;
+
+/** VLAN addresses, open addressed hash table keyed by VLAN IP/IPv6 address. Uplink packets are attributed to
+ *  their VLAN by looking up giaddr/destination IP or DHCPv6 link-address in this table */
+static dhcp_vlan_addr_t *vlan_addrs = NULL;
+/** Size of vlan_addrs hash table, power of 2 */
+static uint32_t vlan_addrs_sz = 0;
+/** Number of VLAN addresses */
+static uint32_t vlan_addrs_nr = 0;
+
+/** VLAN aggregate devices */
+static dhcp_device_context_t **vlan_devs = NULL;
+/** Number of VLAN aggregate devices */
+static uint32_t vlan_devs_nr = 0;
+
+/** Frames dropped by the kernel on all capture rings, reported along with VLAN aggregate device counters */
+static uint64_t ring_drops_total = 0;
 
-/** Monitored DHCP message type */
-static dhcp_message_type_t monitored_msgs[] = {
-    DHCP_MESSAGE_TYPE_DISCOVER,
-    DHCP_MESSAGE_TYPE_OFFER,
-    DHCP_MESSAGE_TYPE_REQUEST,
-    DHCP_MESSAGE_TYPE_ACK
+/** Number of monitored DHCP message type */
+#define DHCP_MONITORED_MSG_COUNT 4
+
+/** Monitored DHCP message type, per DHCP version */
+static const uint8_t monitored_msgs[DHCP_VERSION_COUNT][DHCP_MONITORED_MSG_COUNT] = {
+    [DHCP_VERSION_4] = {
+        DHCP_MESSAGE_TYPE_DISCOVER,
+        DHCP_MESSAGE_TYPE_OFFER,
+        DHCP_MESSAGE_TYPE_REQUEST,
+        DHCP_MESSAGE_TYPE_ACK
+    },
+    [DHCP_VERSION_6] = {
+        DHCPV6_MESSAGE_TYPE_SOLICIT,
+        DHCPV6_MESSAGE_TYPE_ADVERTISE,
+        DHCPV6_MESSAGE_TYPE_REQUEST,
+        DHCPV6_MESSAGE_TYPE_REPLY
+    }
 };
 
 /** Number of monitored DHCP message type */
-static uint8_t monitored_msg_sz = sizeof(monitored_msgs) / sizeof(*monitored_msgs);
+static uint8_t monitored_msg_sz = DHCP_MONITORED_MSG_COUNT;
+
+/** Capture ring is in use, ring drop counts are reported along with DHCP counters */
+static bool ring_capture = false;
+
+/** DHCP packets are counted by eBPF program attached to shared capture sockets */
+static bool ebpf_capture = false;
+
+/** Shared capture sockets, capturing on all interfaces */
+static dhcp_device_context_t *shared_socks = NULL;
+/** Number of shared capture sockets */
+static uint32_t shared_sock_nr = 0;
+
+/** Devices (interfaces) captured by shared capture sockets, indexed by ifindex */
+static dhcp_device_context_t **ifindex_devs = NULL;
+/** Size of ifindex_devs table */
+static int ifindex_devs_sz = 0;
+/** Number of devices in ifindex_devs table */
+static int ifindex_devs_nr = 0;
 
 /**
- * @code handle_dhcp_option_53(context, dhcp_option, dir, iphdr, dhcphdr);
+ * @code vlan_hash(addr);
  *
- * @brief handle the logic related to DHCP option 53
+ * @brief hashes VLAN address into vlan_addrs hash table
  *
- * @param context       Device (interface) context
- * @param dhcp_option   pointer to DHCP option buffer space
- * @param dir           packet direction
- * @param iphdr         pointer to packet IP header
- * @param dhcphdr       pointer to DHCP header
+ * @param addr          VLAN IPv6 or IPv4-mapped address
  *
- * @return none
+ * @return vlan_addrs hash table slot
+ */
+static inline uint32_t vlan_hash(const struct in6_addr *addr)
+{
+    uint32_t key = addr->s6_addr32[0] ^ addr->s6_addr32[1] ^ addr->s6_addr32[2] ^ addr->s6_addr32[3];
+
+    return (key * 2654435761u) & (vlan_addrs_sz - 1);
+}
+
+/**
+ * @code get_vlan6_context(addr);
+ *
+ * @brief finds VLAN aggregate device context of VLAN address
+ *
+ * @param addr          VLAN IPv6 or IPv4-mapped address
+ *
+ * @return VLAN aggregate device context, NULL if addr is not an address of a monitored VLAN
+ */
+static inline dhcp_device_context_t* get_vlan6_context(const struct in6_addr *addr)
+{
+    dhcp_device_context_t *agg_dev = NULL;
+
+    if (vlan_addrs_nr > 0) {
+        for (uint32_t i = vlan_hash(addr); vlan_addrs[i].agg_dev != NULL; i = (i + 1) & (vlan_addrs_sz - 1)) {
+            if (IN6_ARE_ADDR_EQUAL(&vlan_addrs[i].addr, addr)) {
+                agg_dev = vlan_addrs[i].agg_dev;
+                break;
+            }
+        }
+    }
+
+    return agg_dev;
+}
+
+/**
+ * @code get_vlan_context(ip);
+ *
+ * @brief finds VLAN aggregate device context of VLAN IP address
+ *
+ * @param ip            VLAN IP address
+ *
+ * @return VLAN aggregate device context, NULL if ip is not an IP of a monitored VLAN
+ */
+static inline dhcp_device_context_t* get_vlan_context(in_addr_t ip)
+{
+    struct in6_addr addr = {.s6_addr32 = {0, 0, htonl(0xffff), ip}};
+
+    return get_vlan6_context(&addr);
+}
+
+/**
+ * @code classify_dhcp_option_53(context, dhcp_option, dir, iphdr, dhcphdr, frame_class);
+ *
+ * @brief classify DHCP message by its option 53 message type
+ *
+ * @param context           Device (interface) context
+ * @param dhcp_option       pointer to DHCP option buffer space
+ * @param dir               packet direction
+ * @param iphdr             pointer to packet IP header
+ * @param dhcphdr           pointer to DHCP header
+ * @param frame_class(out)  DHCP message classification
+ *
+ * @return DHCP_FRAME_COUNTED if message is to be counted, otherwise DHCP_FRAME_IGNORED or DHCP_FRAME_UNKNOWN_TYPE
  */
-static void handle_dhcp_option_53(dhcp_device_context_t *context,
-                                  const u_char *dhcp_option,
-                                  dhcp_packet_direction_t dir,
-                                  struct ip *iphdr,
-                                  uint8_t *dhcphdr)
+static dhcp_frame_status_t classify_dhcp_option_53(const dhcp_device_context_t *context,
+                                                   const u_char *dhcp_option,
+                                                   dhcp_packet_direction_t dir,
+                                                   const struct ip *iphdr,
+                                                   const uint8_t *dhcphdr,
+                                                   dhcp_frame_class_t *frame_class)
 {
+    dhcp_frame_status_t status = DHCP_FRAME_IGNORED;
     in_addr_t giaddr;
+    dhcp_device_context_t *agg_dev = NULL;
+
     switch (dhcp_option[2])
     {
     // DHCP messages send by client
@@ -130,114 +327,438 @@ static void handle_dhcp_option_53(dhcp_device_context_t *context,
     case DHCP_MESSAGE_TYPE_INFORM:
         giaddr = ntohl(dhcphdr[DHCP_GIADDR_OFFSET] << 24 | dhcphdr[DHCP_GIADDR_OFFSET + 1] << 16 |
                        dhcphdr[DHCP_GIADDR_OFFSET + 2] << 8 | dhcphdr[DHCP_GIADDR_OFFSET + 3]);
-        if ((context->vlan_ip == giaddr && context->is_uplink && dir == DHCP_TX) ||
-            (!context->is_uplink && dir == DHCP_RX && iphdr->ip_dst.s_addr == INADDR_BROADCAST)) {
-            context->counters[DHCP_COUNTERS_CURRENT][dir][dhcp_option[2]]++;
-            aggregate_dev.counters[DHCP_COUNTERS_CURRENT][dir][dhcp_option[2]]++;
+        if (context->is_uplink && dir == DHCP_TX) {
+            agg_dev = get_vlan_context(giaddr);
+        } else if (!context->is_uplink && dir == DHCP_RX && iphdr->ip_dst.s_addr == INADDR_BROADCAST) {
+            agg_dev = context->agg_dev;
         }
         break;
     // DHCP messages send by server
     case DHCP_MESSAGE_TYPE_OFFER:
     case DHCP_MESSAGE_TYPE_ACK:
     case DHCP_MESSAGE_TYPE_NAK:
-        if ((context->vlan_ip == iphdr->ip_dst.s_addr && context->is_uplink && dir == DHCP_RX) ||
-            (!context->is_uplink && dir == DHCP_TX)) {
-            context->counters[DHCP_COUNTERS_CURRENT][dir][dhcp_option[2]]++;
-            aggregate_dev.counters[DHCP_COUNTERS_CURRENT][dir][dhcp_option[2]]++;
+        if (context->is_uplink && dir == DHCP_RX) {
+            agg_dev = get_vlan_context(iphdr->ip_dst.s_addr);
+        } else if (!context->is_uplink && dir == DHCP_TX) {
+            agg_dev = context->agg_dev;
+        }
+        break;
+    default:
+        status = DHCP_FRAME_UNKNOWN_TYPE;
+        break;
+    }
+
+    frame_class->version = DHCP_VERSION_4;
+    frame_class->dir = dir;
+    frame_class->msg_type = dhcp_option[2];
+    frame_class->agg_dev = agg_dev;
+    memcpy(&frame_class->xid, dhcphdr + DHCP_XID_OFFSET, sizeof(frame_class->xid));
+    frame_class->chaddr = dhcphdr + DHCP_CHADDR_OFFSET;
+    if (agg_dev != NULL) {
+        status = DHCP_FRAME_COUNTED;
+    }
+
+    return status;
+}
+
+/**
+ * @code classify_dhcp_frame(context, frame, frame_sz, frame_class);
+ *
+ * @brief parse captured frame and classify it by its DHCP option 53 message type
+ *
+ * @param context           Device (interface) context
+ * @param frame             pointer to start of captured Ethernet frame
+ * @param frame_sz          captured length of the frame
+ * @param frame_class(out)  DHCP message classification
+ *
+ * @return frame classification status
+ */
+static dhcp_frame_status_t classify_dhcp_frame(const dhcp_device_context_t *context,
+                                               const uint8_t *frame,
+                                               ssize_t frame_sz,
+                                               dhcp_frame_class_t *frame_class)
+{
+    dhcp_frame_status_t status = DHCP_FRAME_IGNORED;
+    const struct ether_header *ethhdr = (const struct ether_header*) frame;
+    const struct ip *iphdr = (const struct ip*) (frame + IP_START_OFFSET);
+    const struct udphdr *udp = (const struct udphdr*) (frame + UDP_START_OFFSET);
+    const uint8_t *dhcphdr = frame + DHCP_START_OFFSET;
+    int dhcp_option_offset = DHCP_START_OFFSET + DHCP_OPTIONS_HEADER_SIZE;
+
+    if ((frame_sz > UDP_START_OFFSET + sizeof(struct udphdr) + DHCP_OPTIONS_HEADER_SIZE) &&
+        (ntohs(udp->len) > DHCP_OPTIONS_HEADER_SIZE)) {
+        int dhcp_sz = ntohs(udp->len) < frame_sz - UDP_START_OFFSET - sizeof(struct udphdr) ?
+                      ntohs(udp->len) : frame_sz - UDP_START_OFFSET - sizeof(struct udphdr);
+        int dhcp_option_sz = dhcp_sz - DHCP_OPTIONS_HEADER_SIZE;
+        const u_char *dhcp_option = frame + dhcp_option_offset;
+        dhcp_packet_direction_t dir = (ethhdr->ether_shost[0] == context->mac[0] &&
+                                       ethhdr->ether_shost[1] == context->mac[1] &&
+                                       ethhdr->ether_shost[2] == context->mac[2] &&
+                                       ethhdr->ether_shost[3] == context->mac[3] &&
+                                       ethhdr->ether_shost[4] == context->mac[4] &&
+                                       ethhdr->ether_shost[5] == context->mac[5]) ?
+                                       DHCP_TX : DHCP_RX;
+        int offset = 0;
+        int stop_dhcp_processing = 0;
+        while ((offset < (dhcp_option_sz + 1)) && dhcp_option[offset] != 255) {
+            switch (dhcp_option[offset])
+            {
+            case 53:
+                if (offset < (dhcp_option_sz + 2)) {
+                    status = classify_dhcp_option_53(context, &dhcp_option[offset], dir, iphdr, dhcphdr,
+                                                     frame_class);
+                }
+                stop_dhcp_processing = 1; // break while loop since we are only interested in Option 53
+                break;
+            default:
+                break;
+            }
+
+            if (stop_dhcp_processing == 1) {
+                break;
+            }
+
+            if (dhcp_option[offset] == 0) { // DHCP Option Padding
+                offset++;
+            } else {
+                offset += dhcp_option[offset + 1] + 2;
+            }
+        }
+    } else {
+        status = DHCP_FRAME_TRUNCATED;
+    }
+
+    return status;
+}
+
+/**
+ * @code get_dhcpv6_relay_msg_type(relay_msg, relay_msg_sz);
+ *
+ * @brief finds type of the message carried in Relay Message option of DHCPv6 relay message
+ *
+ * @param relay_msg     pointer to DHCPv6 Relay-forward/Relay-reply message
+ * @param relay_msg_sz  captured size of DHCPv6 relay message
+ *
+ * @return relayed message type, type of relay message itself if Relay Message option was not captured
+ */
+static uint8_t get_dhcpv6_relay_msg_type(const uint8_t *relay_msg, int relay_msg_sz)
+{
+    uint8_t msg_type = relay_msg[0];
+    int offset = DHCPV6_RELAY_HEADER_SIZE;
+
+    while (offset + 4 < relay_msg_sz) {
+        uint16_t option_code = relay_msg[offset] << 8 | relay_msg[offset + 1];
+        uint16_t option_len = relay_msg[offset + 2] << 8 | relay_msg[offset + 3];
+
+        if (option_code == DHCPV6_OPTION_RELAY_MSG) {
+            if (option_len > 0) {
+                msg_type = relay_msg[offset + 4];
+            }
+            break;
+        }
+        offset += option_len + 4;
+    }
+
+    return msg_type;
+}
+
+/**
+ * @code classify_dhcpv6_frame(context, frame, frame_sz, frame_class);
+ *
+ * @brief parse captured DHCPv6 frame and classify it by its message type. Messages relayed on north interfaces are
+ *        classified by the type of the relayed message and attributed to the VLAN of their link-address
+ *
+ * @param context           Device (interface) context
+ * @param frame             pointer to start of captured Ethernet frame
+ * @param frame_sz          captured length of the frame
+ * @param frame_class(out)  DHCPv6 message classification
+ *
+ * @return frame classification status
+ */
+static dhcp_frame_status_t classify_dhcpv6_frame(const dhcp_device_context_t *context,
+                                                 const uint8_t *frame,
+                                                 ssize_t frame_sz,
+                                                 dhcp_frame_class_t *frame_class)
+{
+    dhcp_frame_status_t status = DHCP_FRAME_IGNORED;
+    const struct ether_header *ethhdr = (const struct ether_header*) frame;
+    const struct ip6_hdr *ip6hdr = (const struct ip6_hdr*) (frame + IP_START_OFFSET);
+    const struct udphdr *udp = (const struct udphdr*) (frame + UDPV6_START_OFFSET);
+    const uint8_t *dhcphdr = frame + DHCPV6_START_OFFSET;
+
+    if ((frame_sz > DHCPV6_START_OFFSET) && (ip6hdr->ip6_nxt == IPPROTO_UDP) &&
+        (ntohs(udp->len) > sizeof(struct udphdr)) &&
+        ((ntohs(udp->dest) == DHCPV6_CLIENT_PORT) || (ntohs(udp->dest) == DHCPV6_SERVER_PORT))) {
+        int dhcp_sz = ntohs(udp->len) - sizeof(struct udphdr) < frame_sz - DHCPV6_START_OFFSET ?
+                      ntohs(udp->len) - sizeof(struct udphdr) : frame_sz - DHCPV6_START_OFFSET;
+        dhcp_packet_direction_t dir = memcmp(ethhdr->ether_shost, context->mac, ETHER_ADDR_LEN) == 0 ?
+                                      DHCP_TX : DHCP_RX;
+        uint8_t msg_type = dhcphdr[0];
+        dhcp_device_context_t *agg_dev = NULL;
+
+        switch (msg_type)
+        {
+        // DHCPv6 messages send by client
+        case DHCPV6_MESSAGE_TYPE_SOLICIT:
+        case DHCPV6_MESSAGE_TYPE_REQUEST:
+        case DHCPV6_MESSAGE_TYPE_CONFIRM:
+        case DHCPV6_MESSAGE_TYPE_RENEW:
+        case DHCPV6_MESSAGE_TYPE_REBIND:
+        case DHCPV6_MESSAGE_TYPE_RELEASE:
+        case DHCPV6_MESSAGE_TYPE_DECLINE:
+        case DHCPV6_MESSAGE_TYPE_INFORMATION_REQUEST:
+            if (!context->is_uplink && dir == DHCP_RX && IN6_IS_ADDR_MULTICAST(&ip6hdr->ip6_dst)) {
+                agg_dev = context->agg_dev;
+            }
+            break;
+        // DHCPv6 messages send by server
+        case DHCPV6_MESSAGE_TYPE_ADVERTISE:
+        case DHCPV6_MESSAGE_TYPE_REPLY:
+        case DHCPV6_MESSAGE_TYPE_RECONFIGURE:
+            if (!context->is_uplink && dir == DHCP_TX) {
+                agg_dev = context->agg_dev;
+            }
+            break;
+        // DHCPv6 messages relayed to/from server
+        case DHCPV6_MESSAGE_TYPE_RELAY_FORW:
+        case DHCPV6_MESSAGE_TYPE_RELAY_REPL:
+            if (context->is_uplink && dhcp_sz >= DHCPV6_RELAY_HEADER_SIZE &&
+                dir == (msg_type == DHCPV6_MESSAGE_TYPE_RELAY_FORW ? DHCP_TX : DHCP_RX)) {
+                struct in6_addr link_addr;
+
+                memcpy(&link_addr, dhcphdr + DHCPV6_LINK_ADDR_OFFSET, sizeof(link_addr));
+                agg_dev = get_vlan6_context(&link_addr);
+                msg_type = get_dhcpv6_relay_msg_type(dhcphdr, dhcp_sz);
+            }
+            break;
+        default:
+            status = DHCP_FRAME_UNKNOWN_TYPE;
+            break;
+        }
+
+        frame_class->version = DHCP_VERSION_6;
+        frame_class->dir = dir;
+        frame_class->msg_type = msg_type;
+        frame_class->agg_dev = agg_dev;
+        frame_class->chaddr = NULL;
+        if ((agg_dev != NULL) && (msg_type < DHCPV6_MESSAGE_TYPE_COUNT)) {
+            status = DHCP_FRAME_COUNTED;
+        }
+    }
+
+    return status;
+}
+
+/**
+ * @code dhcp_device_classify_frame(context, frame, frame_sz, frame_class);
+ *
+ * @brief classifies captured frame by DHCP version, direction and message type
+ */
+dhcp_frame_status_t dhcp_device_classify_frame(const dhcp_device_context_t *context,
+                                               const uint8_t *frame,
+                                               ssize_t frame_sz,
+                                               dhcp_frame_class_t *frame_class)
+{
+    const struct ether_header *ethhdr = (const struct ether_header*) frame;
+
+    if ((frame_sz >= ETHER_HDR_LEN) && (ethhdr->ether_type == htons(ETHERTYPE_IPV6))) {
+        return classify_dhcpv6_frame(context, frame, frame_sz, frame_class);
+    }
+
+    return classify_dhcp_frame(context, frame, frame_sz, frame_class);
+}
+
+/**
+ * @code dhcp_device_handle_frame(context, frame, frame_sz, time_ns);
+ *
+ * @brief classifies captured frame, updates DHCP/DHCPv6 counters of device and of its VLAN and tracks its transaction
+ */
+void dhcp_device_handle_frame(dhcp_device_context_t *context, const uint8_t *frame, ssize_t frame_sz,
+                              uint64_t time_ns)
+{
+    dhcp_frame_class_t frame_class;
+
+    switch (dhcp_device_classify_frame(context, frame, frame_sz, &frame_class))
+    {
+    case DHCP_FRAME_COUNTED:
+        context->counters[frame_class.version][DHCP_COUNTERS_CURRENT][frame_class.dir][frame_class.msg_type]++;
+        frame_class.agg_dev->counters[frame_class.version][DHCP_COUNTERS_CURRENT][frame_class.dir]
+                                     [frame_class.msg_type]++;
+        dhcp_xid_track(context, &frame_class, time_ns);
+        break;
+    case DHCP_FRAME_TRUNCATED:
+        syslog(LOG_WARNING, "handle_dhcp_frame(%s): read length (%ld) is too small to capture DHCP options",
+               context->intf, frame_sz);
+        break;
+    case DHCP_FRAME_UNKNOWN_TYPE:
+        if (frame_class.version == DHCP_VERSION_6) {
+            syslog(LOG_WARNING, "handle_dhcpv6_frame(%s): Unknown DHCPv6 message type %d", context->intf,
+                   frame_class.msg_type);
+        } else {
+            syslog(LOG_WARNING, "handle_dhcp_option_53(%s): Unknown DHCP option 53 type %d", context->intf,
+                   frame_class.msg_type);
         }
         break;
     default:
-        syslog(LOG_WARNING, "handle_dhcp_option_53(%s): Unknown DHCP option 53 type %d", context->intf, dhcp_option[2]);
         break;
     }
 }
 
+/**
+ * @code get_frame_context(context, ifindex);
+ *
+ * @brief finds device (interface) context a captured frame belongs to
+ *
+ * @param context       context of the socket the frame was captured on
+ * @param ifindex       index of interface the frame was captured on
+ *
+ * @return device (interface) context, NULL if frame was captured on an unmonitored interface
+ */
+static inline dhcp_device_context_t* get_frame_context(dhcp_device_context_t *context, int ifindex)
+{
+    if (!context->is_shared) {
+        return context;
+    }
+
+    return (ifindex > 0 && ifindex < ifindex_devs_sz) ? ifindex_devs[ifindex] : NULL;
+}
+
 /**
  * @code read_callback(fd, event, arg);
  *
- * @brief callback for libevent which is called every time out in order to read queued packet capture
+ * @brief callback for libevent which is called every time out in order to read queued packet capture. Frames are
+ *        read in batches using recvmmsg() until the socket is drained or context budget is used up. Frames left
+ *        over are read on the next event loop iteration, after other pending events had their turn.
  *
  * @param fd            socket to read from
  * @param event         libevent triggered event
- * @param arg           user provided argument for callback (interface context)
+ * @param arg           user provided argument for callback (interface or shared socket context)
  *
  * @return none
  */
 static void read_callback(int fd, short event, void *arg)
 {
     dhcp_device_context_t *context = (dhcp_device_context_t*) arg;
-    ssize_t buffer_sz;
-
-    while ((event == EV_READ) &&
-           ((buffer_sz = recv(fd, context->buffer, context->snaplen, MSG_DONTWAIT)) > 0)) {
-        struct ether_header *ethhdr = (struct ether_header*) context->buffer;
-        struct ip *iphdr = (struct ip*) (context->buffer + IP_START_OFFSET);
-        struct udphdr *udp = (struct udphdr*) (context->buffer + UDP_START_OFFSET);
-        uint8_t *dhcphdr = context->buffer + DHCP_START_OFFSET;
-        int dhcp_option_offset = DHCP_START_OFFSET + DHCP_OPTIONS_HEADER_SIZE;
-
-        if ((buffer_sz > UDP_START_OFFSET + sizeof(struct udphdr) + DHCP_OPTIONS_HEADER_SIZE) &&
-            (ntohs(udp->len) > DHCP_OPTIONS_HEADER_SIZE)) {
-            int dhcp_sz = ntohs(udp->len) < buffer_sz - UDP_START_OFFSET - sizeof(struct udphdr) ?
-                          ntohs(udp->len) : buffer_sz - UDP_START_OFFSET - sizeof(struct udphdr);
-            int dhcp_option_sz = dhcp_sz - DHCP_OPTIONS_HEADER_SIZE;
-            const u_char *dhcp_option = context->buffer + dhcp_option_offset;
-            dhcp_packet_direction_t dir = (ethhdr->ether_shost[0] == context->mac[0] &&
-                                           ethhdr->ether_shost[1] == context->mac[1] &&
-                                           ethhdr->ether_shost[2] == context->mac[2] &&
-                                           ethhdr->ether_shost[3] == context->mac[3] &&
-                                           ethhdr->ether_shost[4] == context->mac[4] &&
-                                           ethhdr->ether_shost[5] == context->mac[5]) ?
-                                           DHCP_TX : DHCP_RX;
-            int offset = 0;
-            int stop_dhcp_processing = 0;
-            while ((offset < (dhcp_option_sz + 1)) && dhcp_option[offset] != 255) {
-                switch (dhcp_option[offset])
-                {
-                case 53:
-                    if (offset < (dhcp_option_sz + 2)) {
-                        handle_dhcp_option_53(context, &dhcp_option[offset], dir, iphdr, dhcphdr);
-                    }
-                    stop_dhcp_processing = 1; // break while loop since we are only interested in Option 53
-                    break;
-                default:
-                    break;
-                }
+    uint32_t frame_nr = 0;
+    struct timespec now;
 
-                if (stop_dhcp_processing == 1) {
-                    break;
-                }
+    while ((event == EV_READ) && (frame_nr < context->budget)) {
+        uint32_t vlen = context->budget - frame_nr < context->batch_sz ? context->budget - frame_nr : context->batch_sz;
+        int msg_nr = recvmmsg(fd, context->msgs, vlen, MSG_DONTWAIT, NULL);
 
-                if (dhcp_option[offset] == 0) { // DHCP Option Padding
-                    offset++;
-                } else {
-                    offset += dhcp_option[offset + 1] + 2;
-                }
+        if (msg_nr <= 0) {
+            break;
+        }
+
+        // a batch is timestamped as a whole, it is read well within the resolution of DHCP latencies. Monotonic
+        // time keeps transaction latencies and expiry unaffected by clock steps
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t time_ns = now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+        for (int i = 0; i < msg_nr; i++) {
+            dhcp_device_context_t *dev_context = get_frame_context(context, context->addrs[i].sll_ifindex);
+
+            if (dev_context != NULL) {
+                dhcp_device_handle_frame(dev_context, context->iovs[i].iov_base, context->msgs[i].msg_len,
+                                         time_ns);
             }
-        } else {
-            syslog(LOG_WARNING, "read_callback(%s): read length (%ld) is too small to capture DHCP options",
-                   context->intf, buffer_sz);
+            context->msgs[i].msg_hdr.msg_namelen = sizeof(*context->addrs);
+        }
+
+        frame_nr += msg_nr;
+        if ((uint32_t) msg_nr < vlen) {
+            break;
+        }
+    }
+}
+
+/**
+ * @code ring_read_callback(fd, event, arg);
+ *
+ * @brief callback for libevent which is called when capture ring blocks are handed over to user space. Frames are
+ *        processed in place and every consumed block is returned to the kernel. Blocks are processed as a whole
+ *        until context budget is used up.
+ *
+ * @param fd            socket owning the capture ring
+ * @param event         libevent triggered event
+ * @param arg           user provided argument for callback (interface or shared socket context)
+ *
+ * @return none
+ */
+static void ring_read_callback(int fd, short event, void *arg)
+{
+    dhcp_device_context_t *context = (dhcp_device_context_t*) arg;
+    uint32_t frame_nr = 0;
+    struct timespec now;
+
+    while ((event == EV_READ) && (frame_nr < context->budget)) {
+        struct tpacket_block_desc *block =
+            (struct tpacket_block_desc *) (context->ring + (size_t) context->ring_block_idx * DHCP_RING_BLOCK_SIZE);
+
+        if ((block->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+            break;
+        }
+        __sync_synchronize();
+
+        // frames are stamped when their block is read, as in read_callback(), ring timestamps are wall clock time
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t time_ns = now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+        struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) ((uint8_t *) block + block->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; i++) {
+            struct sockaddr_ll *addr = (struct sockaddr_ll *) ((uint8_t *) hdr + TPACKET_ALIGN(sizeof(*hdr)));
+            dhcp_device_context_t *dev_context = get_frame_context(context, addr->sll_ifindex);
+            ssize_t frame_sz = hdr->tp_snaplen < context->snaplen ? hdr->tp_snaplen : context->snaplen;
+
+            if (dev_context != NULL) {
+                dhcp_device_handle_frame(dev_context, (uint8_t *) hdr + hdr->tp_mac, frame_sz, time_ns);
+            }
+            hdr = (struct tpacket3_hdr *) ((uint8_t *) hdr + hdr->tp_next_offset);
         }
+
+        frame_nr += block->hdr.bh1.num_pkts;
+
+        __sync_synchronize();
+        block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        context->ring_block_idx = (context->ring_block_idx + 1) % context->ring_block_nr;
     }
 }
 
 /**
- * @code dhcp_device_is_dhcp_inactive(counters);
+ * @code dhcp_device_is_dhcp_inactive(version, counters);
  *
  * @brief Check if there were no DHCP activity
  *
+ * @param version   DHCP version of counters
  * @param counters  current/snapshot counter
  *
  * @return true if there were no DHCP activity, false otherwise
  */
-static bool dhcp_device_is_dhcp_inactive(uint64_t counters[][DHCP_DIR_COUNT][DHCP_MESSAGE_TYPE_COUNT])
+static bool dhcp_device_is_dhcp_inactive(dhcp_version_t version, uint64_t counters[][DHCP_DIR_COUNT][DHCP_MAX_MESSAGE_TYPE_COUNT])
 {
     uint64_t *rx_counters = counters[DHCP_COUNTERS_CURRENT][DHCP_RX];
     uint64_t *rx_counter_snapshot = counters[DHCP_COUNTERS_SNAPSHOT][DHCP_RX];
 
     bool rv = true;
     for (uint8_t i = 0; (i < monitored_msg_sz) && rv; i++) {
-        rv = rx_counters[monitored_msgs[i]] == rx_counter_snapshot[monitored_msgs[i]];
+        rv = rx_counters[monitored_msgs[version][i]] == rx_counter_snapshot[monitored_msgs[version][i]];
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_device_is_vlan_inactive(version);
+ *
+ * @brief Check if there were no DHCP activity on any VLAN
+ *
+ * @param version   DHCP version
+ *
+ * @return true if there were no DHCP activity, false otherwise
+ */
+static bool dhcp_device_is_vlan_inactive(dhcp_version_t version)
+{
+    bool rv = true;
+    for (uint32_t i = 0; (i < vlan_devs_nr) && rv; i++) {
+        rv = dhcp_device_is_dhcp_inactive(version, vlan_devs[i]->counters[version]);
     }
 
     return rv;
@@ -254,8 +775,8 @@ static bool dhcp_device_is_dhcp_inactive(uint64_t counters[][DHCP_DIR_COUNT][DHC
  *
  * @return true if DHCP message 'type' is transmitted,false otherwise
  */
-static bool dhcp_device_is_dhcp_msg_unhealthy(dhcp_message_type_t type,
-                                              uint64_t counters[][DHCP_DIR_COUNT][DHCP_MESSAGE_TYPE_COUNT])
+static bool dhcp_device_is_dhcp_msg_unhealthy(uint8_t type,
+                                              uint64_t counters[][DHCP_DIR_COUNT][DHCP_MAX_MESSAGE_TYPE_COUNT])
 {
     // check if DHCP message 'type' is being relayed
     return ((counters[DHCP_COUNTERS_CURRENT][DHCP_RX][type] >  counters[DHCP_COUNTERS_SNAPSHOT][DHCP_RX][type]) &&
@@ -263,22 +784,24 @@ static bool dhcp_device_is_dhcp_msg_unhealthy(dhcp_message_type_t type,
 }
 
 /**
- * @code dhcp_device_check_positive_health(counters, counters_snapshot);
+ * @code dhcp_device_check_positive_health(version, counters);
  *
- * @brief Check if DHCP relay is functioning properly for monitored messages (Discover, Offer, Request, ACK.)
+ * @brief Check if DHCP relay is functioning properly for monitored messages (Discover, Offer, Request, ACK,
+ *        or Solicit, Advertise, Request, Reply for DHCPv6.)
  *        For every rx of monitored messages, there should be increment of the same message type.
  *
+ * @param version   DHCP version of counters
  * @param counters  current/snapshot counter
  *
  * @return DHCP_MON_STATUS_HEALTHY, DHCP_MON_STATUS_UNHEALTHY, or DHCP_MON_STATUS_INDETERMINATE
  */
-static dhcp_mon_status_t dhcp_device_check_positive_health(uint64_t counters[][DHCP_DIR_COUNT][DHCP_MESSAGE_TYPE_COUNT])
+static dhcp_mon_status_t dhcp_device_check_positive_health(dhcp_version_t version, uint64_t counters[][DHCP_DIR_COUNT][DHCP_MAX_MESSAGE_TYPE_COUNT])
 {
     dhcp_mon_status_t rv = DHCP_MON_STATUS_HEALTHY;
 
     bool is_dhcp_unhealthy = false;
     for (uint8_t i = 0; (i < monitored_msg_sz) && !is_dhcp_unhealthy; i++) {
-        is_dhcp_unhealthy = dhcp_device_is_dhcp_msg_unhealthy(monitored_msgs[i], counters);
+        is_dhcp_unhealthy = dhcp_device_is_dhcp_msg_unhealthy(monitored_msgs[version][i], counters);
     }
 
     // if we have rx DORA then we should have corresponding tx DORA (DORA being relayed)
@@ -290,18 +813,19 @@ static dhcp_mon_status_t dhcp_device_check_positive_health(uint64_t counters[][D
 }
 
 /**
- * @code dhcp_device_check_negative_health(counters);
+ * @code dhcp_device_check_negative_health(version, counters);
  *
  * @brief Check that DHCP relayed messages are not being transmitted out of this interface/dev
  *        using its counters. The interface is negatively healthy if there are not DHCP message
  *        travelling through it.
  *
+ * @param version               DHCP version of counters
  * @param counters              recent interface counter
  * @param counters_snapshot     snapshot counters
  *
  * @return DHCP_MON_STATUS_HEALTHY, DHCP_MON_STATUS_UNHEALTHY, or DHCP_MON_STATUS_INDETERMINATE
  */
-static dhcp_mon_status_t dhcp_device_check_negative_health(uint64_t counters[][DHCP_DIR_COUNT][DHCP_MESSAGE_TYPE_COUNT])
+static dhcp_mon_status_t dhcp_device_check_negative_health(dhcp_version_t version, uint64_t counters[][DHCP_DIR_COUNT][DHCP_MAX_MESSAGE_TYPE_COUNT])
 {
     dhcp_mon_status_t rv = DHCP_MON_STATUS_HEALTHY;
 
@@ -310,7 +834,7 @@ static dhcp_mon_status_t dhcp_device_check_negative_health(uint64_t counters[][D
 
     bool is_dhcp_unhealthy = false;
     for (uint8_t i = 0; (i < monitored_msg_sz) && !is_dhcp_unhealthy; i++) {
-        is_dhcp_unhealthy = tx_counters[monitored_msgs[i]] > tx_counter_snapshot[monitored_msgs[i]];
+        is_dhcp_unhealthy = tx_counters[monitored_msgs[version][i]] > tx_counter_snapshot[monitored_msgs[version][i]];
     }
 
     // for negative validation, return unhealthy if DHCP packet are being
@@ -323,7 +847,7 @@ static dhcp_mon_status_t dhcp_device_check_negative_health(uint64_t counters[][D
 }
 
 /**
- * @code dhcp_device_check_health(check_type, counters, counters_snapshot);
+ * @code dhcp_device_check_health(check_type, version, context);
  *
  * @brief Check that DHCP relay is functioning properly given a check type. Positive check
  *        indicates for every rx of DHCP message of type 'type', there would increment of
@@ -332,74 +856,144 @@ static dhcp_mon_status_t dhcp_device_check_negative_health(uint64_t counters[][D
  *        considered unhealthy.
  *
  * @param check_type    type of health check
- * @param counters      current/snapshot counter
+ * @param version       DHCP version whose counters are checked
+ * @param context       Device (interface) context
  *
  * @return DHCP_MON_STATUS_HEALTHY, DHCP_MON_STATUS_UNHEALTHY, or DHCP_MON_STATUS_INDETERMINATE
  */
 static dhcp_mon_status_t dhcp_device_check_health(dhcp_mon_check_t check_type,
-                                                  uint64_t counters[][DHCP_DIR_COUNT][DHCP_MESSAGE_TYPE_COUNT])
+                                                  dhcp_version_t version,
+                                                  dhcp_device_context_t *context)
 {
     dhcp_mon_status_t rv = DHCP_MON_STATUS_HEALTHY;
+    bool is_inactive = context->is_aggregate ? dhcp_device_is_dhcp_inactive(version, context->counters[version]) :
+                                               dhcp_device_is_vlan_inactive(version);
 
-    if (dhcp_device_is_dhcp_inactive(aggregate_dev.counters)) {
+    if (is_inactive) {
         rv = DHCP_MON_STATUS_INDETERMINATE;
     } else if (check_type == DHCP_MON_CHECK_POSITIVE) {
-        rv = dhcp_device_check_positive_health(counters);
+        rv = dhcp_device_check_positive_health(version, context->counters[version]);
     } else if (check_type == DHCP_MON_CHECK_NEGATIVE) {
-        rv = dhcp_device_check_negative_health(counters);
+        rv = dhcp_device_check_negative_health(version, context->counters[version]);
     }
 
     return rv;
 }
 
 /**
- * @code dhcp_print_counters(vlan_intf, type, counters);
+ * @code dhcp_print_counters(vlan_intf, type, version, counters, ring_drops);
  *
  * @brief prints DHCP counters to sylsog.
  *
- * @param vlan_intf vlan interface name
- * @param type      counter type
- * @param counters  interface counter
+ * @param vlan_intf     vlan interface name
+ * @param type          counter type
+ * @param version       DHCP version of counters
+ * @param counters      interface counter
+ * @param ring_drops    frames dropped by capture ring, printed along DHCP counters in ring capture mode
  *
  * @return none
  */
 static void dhcp_print_counters(const char *vlan_intf,
                                 dhcp_counters_type_t type,
-                                uint64_t counters[][DHCP_MESSAGE_TYPE_COUNT])
+                                dhcp_version_t version,
+                                uint64_t counters[][DHCP_MAX_MESSAGE_TYPE_COUNT],
+                                uint64_t ring_drops)
 {
     static const char *counter_desc[DHCP_COUNTERS_COUNT] = {
         [DHCP_COUNTERS_CURRENT] = " Current",
         [DHCP_COUNTERS_SNAPSHOT] = "Snapshot"
     };
+    static const char *version_desc[DHCP_VERSION_COUNT] = {
+        [DHCP_VERSION_4] = "",
+        [DHCP_VERSION_6] = " DHCPv6"
+    };
+    static const char *msg_desc[DHCP_VERSION_COUNT][DHCP_MONITORED_MSG_COUNT] = {
+        [DHCP_VERSION_4] = {"Discover", "Offer", "Request", "ACK"},
+        [DHCP_VERSION_6] = {"Solicit", "Advertise", "Request", "Reply"}
+    };
+    const uint8_t *msgs = monitored_msgs[version];
+    char drops_desc[32] = "";
+
+    if (ring_capture && version == DHCP_VERSION_4) {
+        snprintf(drops_desc, sizeof(drops_desc), ", Ring Drops: %*lu", DHCP_COUNTER_WIDTH, ring_drops);
+    }
 
     syslog(
         LOG_NOTICE,
-        "[%*s-%*s rx/tx] Discover: %*lu/%*lu, Offer: %*lu/%*lu, Request: %*lu/%*lu, ACK: %*lu/%*lu\n",
+        "[%*s-%*s%s rx/tx] %s: %*lu/%*lu, %s: %*lu/%*lu, %s: %*lu/%*lu, %s: %*lu/%*lu%s\n",
         IF_NAMESIZE, vlan_intf,
         (int) strlen(counter_desc[type]), counter_desc[type],
-        DHCP_COUNTER_WIDTH, counters[DHCP_RX][DHCP_MESSAGE_TYPE_DISCOVER],
-        DHCP_COUNTER_WIDTH, counters[DHCP_TX][DHCP_MESSAGE_TYPE_DISCOVER],
-        DHCP_COUNTER_WIDTH, counters[DHCP_RX][DHCP_MESSAGE_TYPE_OFFER],
-        DHCP_COUNTER_WIDTH, counters[DHCP_TX][DHCP_MESSAGE_TYPE_OFFER],
-        DHCP_COUNTER_WIDTH, counters[DHCP_RX][DHCP_MESSAGE_TYPE_REQUEST],
-        DHCP_COUNTER_WIDTH, counters[DHCP_TX][DHCP_MESSAGE_TYPE_REQUEST],
-        DHCP_COUNTER_WIDTH, counters[DHCP_RX][DHCP_MESSAGE_TYPE_ACK],
-        DHCP_COUNTER_WIDTH, counters[DHCP_TX][DHCP_MESSAGE_TYPE_ACK]
+        version_desc[version],
+        msg_desc[version][0],
+        DHCP_COUNTER_WIDTH, counters[DHCP_RX][msgs[0]],
+        DHCP_COUNTER_WIDTH, counters[DHCP_TX][msgs[0]],
+        msg_desc[version][1],
+        DHCP_COUNTER_WIDTH, counters[DHCP_RX][msgs[1]],
+        DHCP_COUNTER_WIDTH, counters[DHCP_TX][msgs[1]],
+        msg_desc[version][2],
+        DHCP_COUNTER_WIDTH, counters[DHCP_RX][msgs[2]],
+        DHCP_COUNTER_WIDTH, counters[DHCP_TX][msgs[2]],
+        msg_desc[version][3],
+        DHCP_COUNTER_WIDTH, counters[DHCP_RX][msgs[3]],
+        DHCP_COUNTER_WIDTH, counters[DHCP_TX][msgs[3]],
+        drops_desc
     );
 }
 
 /**
- * @code init_socket(context, intf);
+ * @code dhcp_print_latency(vlan_intf, xid_stats);
  *
- * @brief initializes socket, bind it to interface and bpf program, and
- *        associate with libevent base
+ * @brief prints DHCP transaction latency percentiles to syslog.
  *
- * @param context           pointer to device (interface) context
- * @param intf              interface name
+ * @param vlan_intf     vlan interface name
+ * @param xid_stats     DHCP transaction statistics of the VLAN
+ *
+ * @return none
+ */
+static void dhcp_print_latency(const char *vlan_intf, const dhcp_xid_stats_t *xid_stats)
+{
+    static const char *phase_desc[DHCP_XID_PHASE_COUNT] = {
+        [DHCP_XID_PHASE_OFFER] = "Discover-Offer",
+        [DHCP_XID_PHASE_ACK] = "Request-ACK"
+    };
+    static const char *segment_desc[DHCP_LATENCY_SEGMENT_COUNT] = {
+        [DHCP_LATENCY_CLIENT] = "Client",
+        [DHCP_LATENCY_SERVER] = "Server"
+    };
+
+    for (int phase = 0; phase < DHCP_XID_PHASE_COUNT; phase++) {
+        for (int segment = 0; segment < DHCP_LATENCY_SEGMENT_COUNT; segment++) {
+            const dhcp_latency_hist_t *hist = &xid_stats->latency[phase][segment];
+
+            syslog(
+                LOG_NOTICE,
+                "[%*s-%s %s latency usec] Count: %*lu, p50: %*lu, p90: %*lu, p99: %*lu, max: %*lu, "
+                "Unanswered: %*lu\n",
+                IF_NAMESIZE, vlan_intf,
+                phase_desc[phase],
+                segment_desc[segment],
+                DHCP_COUNTER_WIDTH, hist->count,
+                DHCP_COUNTER_WIDTH, dhcp_xid_get_percentile(hist, 50),
+                DHCP_COUNTER_WIDTH, dhcp_xid_get_percentile(hist, 90),
+                DHCP_COUNTER_WIDTH, dhcp_xid_get_percentile(hist, 99),
+                DHCP_COUNTER_WIDTH, hist->max_usec,
+                DHCP_COUNTER_WIDTH, xid_stats->unanswered[phase]
+            );
+        }
+    }
+}
+
+/**
+ * @code init_socket(context);
+ *
+ * @brief initializes socket and bind it to context interface, shared capture sockets (ifindex 0) are bound to all
+ *        interfaces
+ *
+ * @param context           pointer to device (interface) or shared socket context
  *
  * @return 0 on success, otherwise for failure
  */
-static int init_socket(dhcp_device_context_t *context, const char *intf)
+static int init_socket(dhcp_device_context_t *context)
 {
     int rv = -1;
 
@@ -412,17 +1006,14 @@ static int init_socket(dhcp_device_context_t *context, const char *intf)
 
         struct sockaddr_ll addr;
         memset(&addr, 0, sizeof(addr));
-        addr.sll_ifindex = if_nametoindex(intf);
+        addr.sll_ifindex = context->ifindex;
         addr.sll_family = AF_PACKET;
         addr.sll_protocol = htons(ETH_P_ALL);
         if (bind(context->sock, (struct sockaddr *) &addr, sizeof(addr))) {
-            syslog(LOG_ALERT, "bind: failed to bind to interface '%s' with '%s'\n", intf, strerror(errno));
+            syslog(LOG_ALERT, "bind: failed to bind to interface '%s' with '%s'\n", context->intf, strerror(errno));
             break;
         }
 
-        strncpy(context->intf, intf, sizeof(context->intf) - 1);
-        context->intf[sizeof(context->intf) - 1] = '\0';
-
         rv = 0;
     } while (0);
 
@@ -430,45 +1021,204 @@ static int init_socket(dhcp_device_context_t *context, const char *intf)
 }
 
 /**
- * @code initialize_intf_mac_and_ip_addr(context);
+ * @code init_shared_filter(fprog);
  *
- * @brief initializes device (interface) mac/ip addresses
+ * @brief builds filter program of shared capture sockets. The DHCP filter is prefixed with a check of the ifindex
+ *        the frame was captured on so that frames of unmonitored interfaces are dropped in the kernel
+ *
+ * @param fprog(out)        filter program, fprog->filter is to be freed by caller
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int init_shared_filter(struct sock_fprog *fprog)
+{
+    int rv = -1;
+    int prefix_sz = 0;
+
+    if (ifindex_devs_nr <= DHCP_SHARED_FILTER_MAX_INTF) {
+        // ld ifindex; jeq #ifindex_0 ... jeq #ifindex_n-1; ret #0
+        prefix_sz = ifindex_devs_nr + 2;
+    }
+
+    fprog->len = prefix_sz + capture_bfp->len;
+    fprog->filter = (struct sock_filter *) calloc(fprog->len, sizeof(struct sock_filter));
+    if (fprog->filter != NULL) {
+        if (prefix_sz > 0) {
+            int i = 0;
+
+            fprog->filter[i++] = (struct sock_filter) {.code = OP_LDWA, .k = SKF_AD_OFF + SKF_AD_IFINDEX};
+            for (int ifindex = 0; ifindex < ifindex_devs_sz; ifindex++) {
+                if (ifindex_devs[ifindex] != NULL) {
+                    // on match, skip remaining ifindex checks and 'ret #0' to the DHCP filter
+                    fprog->filter[i] = (struct sock_filter) {
+                        .code = OP_JEQ, .jt = prefix_sz - 1 - i, .jf = 0, .k = ifindex
+                    };
+                    i++;
+                }
+            }
+            fprog->filter[i] = (struct sock_filter) {.code = OP_RET, .k = 0};
+        }
+        memcpy(fprog->filter + prefix_sz, capture_bfp->filter, capture_bfp->len * sizeof(struct sock_filter));
+
+        rv = 0;
+    } else {
+        syslog(LOG_ALERT, "calloc: failed to allocate memory for shared socket filter '%s'\n", strerror(errno));
+    }
+
+    return rv;
+}
+
+/**
+ * @code init_ring(context, ring_size);
+ *
+ * @brief switches device socket to TPACKET_V3 and maps a PACKET_RX_RING capture ring of ring_size bytes into memory
  *
  * @param context           pointer to device (interface) context
+ * @param ring_size         size of capture ring in bytes, rounded up to a whole number of ring blocks
  *
  * @return 0 on success, otherwise for failure
  */
-static int initialize_intf_mac_and_ip_addr(dhcp_device_context_t *context)
+static int init_ring(dhcp_device_context_t *context, size_t ring_size)
 {
     int rv = -1;
 
     do {
-        int fd;
-        struct ifreq ifr;
-        if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
-            syslog(LOG_ALERT, "socket: %s", strerror(errno));
+        int version = TPACKET_V3;
+        if (setsockopt(context->sock, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) != 0) {
+            syslog(LOG_ALERT, "setsockopt: failed to set TPACKET_V3 on '%s' with '%s'\n",
+                   context->intf, strerror(errno));
             break;
         }
 
-        ifr.ifr_addr.sa_family = AF_INET;
-        strncpy(ifr.ifr_name, context->intf, sizeof(ifr.ifr_name) - 1);
-        ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
-
-        // Get network address
-        if (ioctl(fd, SIOCGIFADDR, &ifr) == -1) {
-            syslog(LOG_ALERT, "ioctl: %s", explain_ioctl(fd, SIOCGIFADDR, &ifr));
+        struct tpacket_req3 req;
+        memset(&req, 0, sizeof(req));
+        req.tp_block_size = DHCP_RING_BLOCK_SIZE;
+        req.tp_block_nr = (ring_size + DHCP_RING_BLOCK_SIZE - 1) / DHCP_RING_BLOCK_SIZE;
+        req.tp_frame_size = DHCP_RING_FRAME_SIZE;
+        req.tp_frame_nr = req.tp_block_nr * (DHCP_RING_BLOCK_SIZE / DHCP_RING_FRAME_SIZE);
+        req.tp_retire_blk_tov = DHCP_RING_BLOCK_TIMEOUT_MSEC;
+        if (setsockopt(context->sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+            syslog(LOG_ALERT, "setsockopt: failed to set up capture ring of %u blocks on '%s' with '%s'\n",
+                   req.tp_block_nr, context->intf, strerror(errno));
             break;
         }
-        context->ip = ((struct sockaddr_in*) &ifr.ifr_addr)->sin_addr.s_addr;
 
-        // Get mac address
-        if (ioctl(fd, SIOCGIFHWADDR, &ifr) == -1) {
-            syslog(LOG_ALERT, "ioctl: %s", explain_ioctl(fd, SIOCGIFHWADDR, &ifr));
+        void *ring = mmap(NULL, (size_t) req.tp_block_nr * DHCP_RING_BLOCK_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_SHARED, context->sock, 0);
+        if (ring == MAP_FAILED) {
+            syslog(LOG_ALERT, "mmap: failed to map capture ring of '%s' with '%s'\n", context->intf, strerror(errno));
             break;
         }
-        memcpy(context->mac, ifr.ifr_hwaddr.sa_data, sizeof(context->mac));
 
-        close(fd);
+        context->ring = (uint8_t *) ring;
+        context->ring_block_nr = req.tp_block_nr;
+        context->ring_block_idx = 0;
+
+        rv = 0;
+    } while (0);
+
+    return rv;
+}
+
+/**
+ * @code init_recv_batch(context);
+ *
+ * @brief allocates buffers and recvmmsg() message headers used to read batches of context->batch_sz frames
+ *
+ * @param context           pointer to device (interface) or shared socket context
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int init_recv_batch(dhcp_device_context_t *context)
+{
+    int rv = -1;
+
+    context->buffer = (uint8_t *) malloc(context->batch_sz * context->snaplen);
+    context->msgs = (struct mmsghdr *) calloc(context->batch_sz, sizeof(*context->msgs));
+    context->iovs = (struct iovec *) calloc(context->batch_sz, sizeof(*context->iovs));
+    context->addrs = (struct sockaddr_ll *) calloc(context->batch_sz, sizeof(*context->addrs));
+
+    if ((context->buffer != NULL) && (context->msgs != NULL) && (context->iovs != NULL) && (context->addrs != NULL)) {
+        for (uint32_t i = 0; i < context->batch_sz; i++) {
+            context->iovs[i].iov_base = context->buffer + i * context->snaplen;
+            context->iovs[i].iov_len = context->snaplen;
+            context->msgs[i].msg_hdr.msg_iov = &context->iovs[i];
+            context->msgs[i].msg_hdr.msg_iovlen = 1;
+            context->msgs[i].msg_hdr.msg_name = &context->addrs[i];
+            context->msgs[i].msg_hdr.msg_namelen = sizeof(*context->addrs);
+        }
+
+        rv = 0;
+    } else {
+        syslog(LOG_ALERT, "malloc: failed to allocate memory for socket buffer '%s'\n", strerror(errno));
+    }
+
+    return rv;
+}
+
+/**
+ * @code collect_ring_stats(context);
+ *
+ * @brief collects capture ring drop count of context socket from the kernel and adds it to total drop count
+ *
+ * @param context           pointer to device (interface) or shared socket context
+ *
+ * @return none
+ */
+static void collect_ring_stats(dhcp_device_context_t *context)
+{
+    if (context->ring != NULL) {
+        struct tpacket_stats_v3 stats;
+        socklen_t len = sizeof(stats);
+
+        // kernel resets ring statistics every time they are read
+        if (getsockopt(context->sock, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0) {
+            context->ring_drops += stats.tp_drops;
+            ring_drops_total += stats.tp_drops;
+        }
+    }
+}
+
+/**
+ * @code initialize_intf_mac_and_ip_addr(context);
+ *
+ * @brief initializes device (interface) mac/ip addresses
+ *
+ * @param context           pointer to device (interface) context
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int initialize_intf_mac_and_ip_addr(dhcp_device_context_t *context)
+{
+    int rv = -1;
+
+    do {
+        int fd;
+        struct ifreq ifr;
+        if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) == -1) {
+            syslog(LOG_ALERT, "socket: %s", strerror(errno));
+            break;
+        }
+
+        ifr.ifr_addr.sa_family = AF_INET;
+        strncpy(ifr.ifr_name, context->intf, sizeof(ifr.ifr_name) - 1);
+        ifr.ifr_name[sizeof(ifr.ifr_name) - 1] = '\0';
+
+        // Get network address
+        if (ioctl(fd, SIOCGIFADDR, &ifr) == -1) {
+            syslog(LOG_ALERT, "ioctl: %s", explain_ioctl(fd, SIOCGIFADDR, &ifr));
+            break;
+        }
+        context->ip = ((struct sockaddr_in*) &ifr.ifr_addr)->sin_addr.s_addr;
+
+        // Get mac address
+        if (ioctl(fd, SIOCGIFHWADDR, &ifr) == -1) {
+            syslog(LOG_ALERT, "ioctl: %s", explain_ioctl(fd, SIOCGIFHWADDR, &ifr));
+            break;
+        }
+        memcpy(context->mac, ifr.ifr_hwaddr.sa_data, sizeof(context->mac));
+
+        close(fd);
 
         rv = 0;
     } while (0);
@@ -498,15 +1248,173 @@ int dhcp_device_get_ip(dhcp_device_context_t *context, in_addr_t *ip)
 }
 
 /**
- * @code dhcp_device_get_aggregate_context();
+ * @code add_vlan_addr(addr, agg_context);
  *
- * @brief Accessor method
+ * @brief inserts VLAN address into vlan_addrs hash table, growing the table to keep its load factor at most 1/2
+ *
+ * @param addr              VLAN IPv6 or IPv4-mapped address
+ * @param agg_context       pointer to VLAN aggregate device context
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int add_vlan_addr(const struct in6_addr *addr, dhcp_device_context_t *agg_context)
+{
+    int rv = -1;
+    char addr_str[INET6_ADDRSTRLEN];
+
+    do {
+        if (get_vlan6_context(addr) != NULL) {
+            syslog(LOG_ALERT, "VLAN address %s of '%s' is already monitored\n",
+                   inet_ntop(AF_INET6, addr, addr_str, sizeof(addr_str)), agg_context->intf);
+            break;
+        }
+
+        if (2 * (vlan_addrs_nr + 1) > vlan_addrs_sz) {
+            dhcp_vlan_addr_t *old_addrs = vlan_addrs;
+            uint32_t old_sz = vlan_addrs_sz;
+            uint32_t sz = vlan_addrs_sz ? 2 * vlan_addrs_sz : 8;
+
+            vlan_addrs = (dhcp_vlan_addr_t *) calloc(sz, sizeof(dhcp_vlan_addr_t));
+            if (vlan_addrs == NULL) {
+                syslog(LOG_ALERT, "calloc: failed to allocate memory for VLAN table '%s'\n", strerror(errno));
+                vlan_addrs = old_addrs;
+                break;
+            }
+            vlan_addrs_sz = sz;
+
+            for (uint32_t i = 0; i < old_sz; i++) {
+                if (old_addrs[i].agg_dev != NULL) {
+                    uint32_t j = vlan_hash(&old_addrs[i].addr);
+                    while (vlan_addrs[j].agg_dev != NULL) {
+                        j = (j + 1) & (vlan_addrs_sz - 1);
+                    }
+                    vlan_addrs[j] = old_addrs[i];
+                }
+            }
+            free(old_addrs);
+        }
+
+        uint32_t i = vlan_hash(addr);
+        while (vlan_addrs[i].agg_dev != NULL) {
+            i = (i + 1) & (vlan_addrs_sz - 1);
+        }
+        vlan_addrs[i].addr = *addr;
+        vlan_addrs[i].agg_dev = agg_context;
+        vlan_addrs_nr++;
+
+        rv = 0;
+    } while (0);
+
+    return rv;
+}
+
+/**
+ * @code add_vlan_dev(agg_context, intf);
+ *
+ * @brief adds VLAN aggregate device to VLAN device list and registers VLAN IP address and global IPv6 addresses
+ *        of VLAN interface in vlan_addrs hash table
+ *
+ * @param agg_context       pointer to VLAN aggregate device context
+ * @param intf              VLAN interface name
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int add_vlan_dev(dhcp_device_context_t *agg_context, const char *intf)
+{
+    int rv = -1;
+    struct ifaddrs *ifaddr = NULL;
+
+    do {
+        struct in6_addr addr = {.s6_addr32 = {0, 0, htonl(0xffff), agg_context->vlan_ip}};
+        if (add_vlan_addr(&addr, agg_context) != 0) {
+            break;
+        }
+
+        if (getifaddrs(&ifaddr) != 0) {
+            syslog(LOG_ALERT, "getifaddrs: failed to get IPv6 addresses of '%s' '%s'\n", intf, strerror(errno));
+            break;
+        }
+
+        struct ifaddrs *ifa;
+        for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
+            if ((ifa->ifa_addr != NULL) && (ifa->ifa_addr->sa_family == AF_INET6) &&
+                (strcmp(ifa->ifa_name, intf) == 0)) {
+                struct in6_addr *addr6 = &((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr;
+
+                // link-address of relay message is a global address, link-local one is not usable
+                if (!IN6_IS_ADDR_LINKLOCAL(addr6) && (add_vlan_addr(addr6, agg_context) != 0)) {
+                    break;
+                }
+            }
+        }
+        if (ifa != NULL) {
+            break;
+        }
+
+        dhcp_device_context_t **devs = (dhcp_device_context_t **) realloc(
+            vlan_devs, (vlan_devs_nr + 1) * sizeof(dhcp_device_context_t *)
+        );
+        if (devs == NULL) {
+            syslog(LOG_ALERT, "realloc: failed to allocate memory for VLAN list '%s'\n", strerror(errno));
+            break;
+        }
+        vlan_devs = devs;
+        vlan_devs[vlan_devs_nr++] = agg_context;
+
+        rv = 0;
+    } while (0);
+
+    if (ifaddr != NULL) {
+        freeifaddrs(ifaddr);
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_device_add_vlan(context, agg_context);
  *
- * @return pointer to aggregate device (interface) context
+ * @brief creates aggregate device of the VLAN whose south interface is context
  */
-dhcp_device_context_t* dhcp_device_get_aggregate_context()
+int dhcp_device_add_vlan(dhcp_device_context_t *context, dhcp_device_context_t **agg_context)
 {
-    return &aggregate_dev;
+    int rv = -1;
+    dhcp_device_context_t *agg_dev = NULL;
+
+    do {
+        agg_dev = (dhcp_device_context_t *) calloc(1, sizeof(dhcp_device_context_t));
+        if (agg_dev == NULL) {
+            syslog(LOG_ALERT, "calloc: failed to allocate aggregate device memory for '%s'", context->intf);
+            break;
+        }
+
+        agg_dev->sock = -1;
+        agg_dev->is_aggregate = 1;
+        agg_dev->vlan_ip = context->ip;
+        // VLAN name is cut to leave room for the prefix
+        snprintf(agg_dev->intf, sizeof(agg_dev->intf), AGG_DEV_PREFIX "%.*s",
+                 (int) (sizeof(agg_dev->intf) - sizeof(AGG_DEV_PREFIX)), context->intf);
+
+        agg_dev->xid_stats = (dhcp_xid_stats_t *) calloc(1, sizeof(dhcp_xid_stats_t));
+        if (agg_dev->xid_stats == NULL) {
+            syslog(LOG_ALERT, "calloc: failed to allocate transaction statistics memory for '%s'", context->intf);
+            free(agg_dev);
+            break;
+        }
+
+        if (add_vlan_dev(agg_dev, context->intf) != 0) {
+            free(agg_dev->xid_stats);
+            free(agg_dev);
+            break;
+        }
+
+        context->agg_dev = agg_dev;
+        *agg_context = agg_dev;
+
+        rv = 0;
+    } while (0);
+
+    return rv;
 }
 
 /**
@@ -523,8 +1431,15 @@ int dhcp_device_init(dhcp_device_context_t **context, const char *intf, uint8_t
 
         dev_context = (dhcp_device_context_t *) malloc(sizeof(dhcp_device_context_t));
         if (dev_context != NULL) {
-            if ((init_socket(dev_context, intf) == 0) &&
-                (initialize_intf_mac_and_ip_addr(dev_context) == 0)) {
+            memset(dev_context, 0, sizeof(*dev_context));
+
+            strncpy(dev_context->intf, intf, sizeof(dev_context->intf) - 1);
+            dev_context->intf[sizeof(dev_context->intf) - 1] = '\0';
+
+            dev_context->ifindex = if_nametoindex(intf);
+            if (dev_context->ifindex == 0) {
+                syslog(LOG_ALERT, "if_nametoindex: failed to find interface '%s' with '%s'\n", intf, strerror(errno));
+            } else if (initialize_intf_mac_and_ip_addr(dev_context) == 0) {
 
                 dev_context->is_uplink = is_uplink;
 
@@ -543,14 +1458,147 @@ int dhcp_device_init(dhcp_device_context_t **context, const char *intf, uint8_t
 }
 
 /**
- * @code dhcp_device_start_capture(context, snaplen, base, vlan_ip);
+ * @code start_socket_capture(context, fprog, config, base);
+ *
+ * @brief attaches filter program to context socket, sets up capture buffer or ring and associates the socket with
+ *        libevent base
+ *
+ * @param context           pointer to device (interface) or shared socket context
+ * @param fprog             filter program to attach, NULL if eBPF program is already attached
+ * @param config            packet capture configuration
+ * @param base              pointer to libevent base
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int start_socket_capture(dhcp_device_context_t *context,
+                                struct sock_fprog *fprog,
+                                const dhcp_capture_config_t *config,
+                                struct event_base *base)
+{
+    int rv = -1;
+
+    do {
+        context->snaplen = config->snaplen;
+        context->budget = config->budget;
+        context->batch_sz = config->budget < DHCP_RECV_BATCH_SIZE ? config->budget : DHCP_RECV_BATCH_SIZE;
+
+        if ((fprog != NULL) && (setsockopt(context->sock, SOL_SOCKET, SO_ATTACH_FILTER, fprog, sizeof(*fprog)) != 0)) {
+            syslog(LOG_ALERT, "setsockopt: failed to attach filter with '%s'\n", strerror(errno));
+            break;
+        }
+
+        event_callback_fn callback = read_callback;
+        if (config->ring_size > 0) {
+            if (init_ring(context, config->ring_size) != 0) {
+                break;
+            }
+            ring_capture = true;
+            callback = ring_read_callback;
+        } else if (init_recv_batch(context) != 0) {
+            break;
+        }
+
+        struct event *ev = event_new(base, context->sock, EV_READ | EV_PERSIST, callback, context);
+        if (ev == NULL) {
+            syslog(LOG_ALERT, "event_new: failed to allocate memory for libevent event '%s'\n", strerror(errno));
+            break;
+        }
+        event_add(ev, NULL);
+
+        rv = 0;
+    } while (0);
+
+    return rv;
+}
+
+/**
+ * @code add_ifindex_dev(context);
+ *
+ * @brief registers device (interface) with shared capture sockets, growing the ifindex lookup table as needed
+ *
+ * @param context           pointer to device (interface) context
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int add_ifindex_dev(dhcp_device_context_t *context)
+{
+    int rv = -1;
+
+    if (context->ifindex >= ifindex_devs_sz) {
+        int sz = context->ifindex + 1;
+        dhcp_device_context_t **devs =
+            (dhcp_device_context_t **) realloc(ifindex_devs, sz * sizeof(dhcp_device_context_t *));
+
+        if (devs != NULL) {
+            memset(devs + ifindex_devs_sz, 0, (sz - ifindex_devs_sz) * sizeof(dhcp_device_context_t *));
+            ifindex_devs = devs;
+            ifindex_devs_sz = sz;
+        } else {
+            syslog(LOG_ALERT, "realloc: failed to allocate memory for ifindex table '%s'\n", strerror(errno));
+        }
+    }
+
+    if (context->ifindex < ifindex_devs_sz) {
+        if (ifindex_devs[context->ifindex] == NULL) {
+            ifindex_devs[context->ifindex] = context;
+            ifindex_devs_nr++;
+            rv = 0;
+        } else {
+            syslog(LOG_ALERT, "interface '%s' is already captured by shared capture sockets as '%s'\n",
+                   context->intf, ifindex_devs[context->ifindex]->intf);
+        }
+    }
+
+    return rv;
+}
+
+/**
+ * @code init_ebpf_counting(config);
+ *
+ * @brief loads eBPF counting program and assigns eBPF counter slots, VLAN aggregate devices first followed by
+ *        devices registered in ifindex table
+ *
+ * @param config            packet capture configuration
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int init_ebpf_counting(const dhcp_capture_config_t *config)
+{
+    uint32_t slot = 0;
+    int rv = dhcp_ebpf_init(vlan_devs_nr + ifindex_devs_nr, config->dhcpv6);
+
+    for (uint32_t i = 0; (i < vlan_devs_nr) && (rv == 0); i++) {
+        vlan_devs[i]->ebpf_slot = slot++;
+        rv = dhcp_ebpf_add_vlan(vlan_devs[i]->vlan_ip, vlan_devs[i]->ebpf_slot);
+    }
+
+    for (int ifindex = 0; (ifindex < ifindex_devs_sz) && (rv == 0); ifindex++) {
+        dhcp_device_context_t *context = ifindex_devs[ifindex];
+
+        if (context != NULL) {
+            dhcp_device_context_t *agg_dev = context->agg_dev;
+
+            context->ebpf_slot = slot++;
+            rv = dhcp_ebpf_add_intf(ifindex, context->mac, context->ebpf_slot,
+                                    agg_dev != NULL ? agg_dev->ebpf_slot : DHCP_EBPF_NO_SLOT);
+        }
+    }
+
+    if (rv != 0) {
+        dhcp_ebpf_shutdown();
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_device_start_capture(context, config, base);
  *
  * @brief starts packet capture on this interface
  */
 int dhcp_device_start_capture(dhcp_device_context_t *context,
-                              size_t snaplen,
-                              struct event_base *base,
-                              in_addr_t vlan_ip)
+                              const dhcp_capture_config_t *config,
+                              struct event_base *base)
 {
     int rv = -1;
 
@@ -560,38 +1608,133 @@ int dhcp_device_start_capture(dhcp_device_context_t *context,
             break;
         }
 
-        if (snaplen < UDP_START_OFFSET + sizeof(struct udphdr) + DHCP_OPTIONS_HEADER_SIZE) {
+        if (config->snaplen < UDP_START_OFFSET + sizeof(struct udphdr) + DHCP_OPTIONS_HEADER_SIZE) {
             syslog(LOG_ALERT, "dhcp_device_start_capture(%s): snap length is too low to capture DHCP options", context->intf);
             break;
         }
 
-        context->vlan_ip = vlan_ip;
+        if (config->budget == 0) {
+            syslog(LOG_ALERT, "dhcp_device_start_capture(%s): read budget must be at least one frame", context->intf);
+            break;
+        }
+
+        context->snaplen = config->snaplen;
 
-        context->buffer = (uint8_t *) malloc(snaplen);
-        if (context->buffer == NULL) {
-            syslog(LOG_ALERT, "malloc: failed to allocate memory for socket buffer '%s'\n", strerror(errno));
+        if (config->dhcpv6) {
+            capture_bfp = &dhcp_dhcpv6_sock_bfp;
+            dhcpv6_capture = true;
+        }
+
+        if ((config->shared_sock_nr > 0) || config->ebpf) {
+            rv = add_ifindex_dev(context);
             break;
         }
-        context->snaplen = snaplen;
 
-        if (setsockopt(context->sock, SOL_SOCKET, SO_ATTACH_FILTER, &dhcp_sock_bfp, sizeof(dhcp_sock_bfp)) != 0) {
-            syslog(LOG_ALERT, "setsockopt: failed to attach filter with '%s'\n", strerror(errno));
+        if (init_socket(context) != 0) {
             break;
         }
 
-        struct event *ev = event_new(base, context->sock, EV_READ | EV_PERSIST, read_callback, context);
-        if (ev == NULL) {
-            syslog(LOG_ALERT, "event_new: failed to allocate memory for libevent event '%s'\n", strerror(errno));
+        rv = start_socket_capture(context, capture_bfp, config, base);
+    } while (0);
+
+    return rv;
+}
+
+/**
+ * @code dhcp_device_start_shared_capture(config, base);
+ *
+ * @brief opens shared capture sockets that capture on all registered interfaces
+ */
+int dhcp_device_start_shared_capture(const dhcp_capture_config_t *config, struct event_base *base)
+{
+    int rv = -1;
+    struct sock_fprog fprog = {.len = 0, .filter = NULL};
+    // DHCP packets counted in the kernel need a single socket unless more are configured
+    uint32_t sock_nr = config->shared_sock_nr > 0 ? config->shared_sock_nr : 1;
+
+    do {
+        if (sock_nr > DHCP_SHARED_SOCK_MAX) {
+            syslog(LOG_WARNING, "Number of shared capture sockets %u exceeds max of %u, using %u\n",
+                   sock_nr, DHCP_SHARED_SOCK_MAX, DHCP_SHARED_SOCK_MAX);
+            sock_nr = DHCP_SHARED_SOCK_MAX;
+        }
+
+        if (config->ebpf) {
+            ebpf_capture = init_ebpf_counting(config) == 0;
+            if (!ebpf_capture) {
+                syslog(LOG_WARNING, "eBPF DHCP counting is not available, falling back to classic BPF capture\n");
+            }
+        }
+
+        if (!ebpf_capture && (init_shared_filter(&fprog) != 0)) {
             break;
         }
-        event_add(ev, NULL);
 
-        rv = 0;
+        shared_socks = (dhcp_device_context_t *) calloc(sock_nr, sizeof(dhcp_device_context_t));
+        if (shared_socks == NULL) {
+            syslog(LOG_ALERT, "calloc: failed to allocate memory for shared capture sockets '%s'\n", strerror(errno));
+            break;
+        }
+
+        // fanout group id is only required to be unique among processes sharing the network namespace
+        int fanout_arg = (getpid() & 0xffff) | (PACKET_FANOUT_HASH << 16);
+        for (shared_sock_nr = 0; shared_sock_nr < sock_nr; shared_sock_nr++) {
+            dhcp_device_context_t *context = &shared_socks[shared_sock_nr];
+
+            context->is_shared = 1;
+            snprintf(context->intf, sizeof(context->intf), "shared-%hhu", (uint8_t) shared_sock_nr);
+
+            if (init_socket(context) != 0) {
+                break;
+            }
+
+            if ((sock_nr > 1) &&
+                (setsockopt(context->sock, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) != 0)) {
+                syslog(LOG_ALERT, "setsockopt: failed to join fanout group with '%s'\n", strerror(errno));
+                break;
+            }
+
+            if (ebpf_capture && (dhcp_ebpf_attach(context->sock) != 0)) {
+                break;
+            }
+
+            if (start_socket_capture(context, ebpf_capture ? NULL : &fprog, config, base) != 0) {
+                break;
+            }
+        }
+
+        if (shared_sock_nr == sock_nr) {
+            syslog(LOG_INFO, "%s DHCP packets of %d interfaces on %u shared sockets\n",
+                   ebpf_capture ? "Counting in the kernel" : "Capturing", ifindex_devs_nr, shared_sock_nr);
+            rv = 0;
+        }
     } while (0);
 
+    free(fprog.filter);
+
     return rv;
 }
 
+/**
+ * @code dhcp_device_is_ebpf_capture();
+ *
+ * @brief tells whether DHCP packets are counted in the kernel
+ */
+int dhcp_device_is_ebpf_capture()
+{
+    return ebpf_capture ? 1 : 0;
+}
+
+/**
+ * @code dhcp_device_start_replay(config);
+ *
+ * @brief prepares devices for replay of captured frames
+ */
+void dhcp_device_start_replay(const dhcp_capture_config_t *config)
+{
+    dhcpv6_capture = config->dhcpv6;
+}
+
 /**
  * @code dhcp_device_shutdown(context);
  *
@@ -599,26 +1742,104 @@ int dhcp_device_start_capture(dhcp_device_context_t *context,
  */
 void dhcp_device_shutdown(dhcp_device_context_t *context)
 {
+    if (context->agg_dev != NULL) {
+        free(((dhcp_device_context_t *) context->agg_dev)->samples);
+        free(((dhcp_device_context_t *) context->agg_dev)->xid_stats);
+    }
+    free(context->agg_dev);
+    free(context->samples);
+    if (context->ring != NULL) {
+        munmap(context->ring, (size_t) context->ring_block_nr * DHCP_RING_BLOCK_SIZE);
+    }
     free(context);
 }
 
 /**
- * @code dhcp_device_get_status(check_type, context);
+ * @code dhcp_device_get_status(check_type, version, context);
  *
- * @brief collects DHCP relay status info for a given interface. If context is null, it will report aggregate
- *        status
+ * @brief collects DHCP relay status info for a given interface
  */
-dhcp_mon_status_t dhcp_device_get_status(dhcp_mon_check_t check_type, dhcp_device_context_t *context)
+dhcp_mon_status_t dhcp_device_get_status(dhcp_mon_check_t check_type,
+                                         dhcp_version_t version,
+                                         dhcp_device_context_t *context)
 {
     dhcp_mon_status_t rv = DHCP_MON_STATUS_HEALTHY;
 
     if (context != NULL) {
-        rv = dhcp_device_check_health(check_type, context->counters);
+        rv = dhcp_device_check_health(check_type, version, context);
     }
 
     return rv;
 }
 
+/**
+ * @code dhcp_device_init_window(context, window_sec);
+ *
+ * @brief allocates ring of per-second counter samples
+ */
+int dhcp_device_init_window(dhcp_device_context_t *context, uint32_t window_sec)
+{
+    int rv = -1;
+
+    if ((context != NULL) && (window_sec > 0)) {
+        context->samples = (dhcp_counters_sample_t *) calloc(window_sec + 1, sizeof(dhcp_counters_sample_t));
+        if (context->samples != NULL) {
+            context->sample_sz = window_sec + 1;
+            context->sample_nr = 0;
+            context->sample_idx = context->sample_sz - 1;
+            dhcp_device_update_snapshot(context);
+            rv = 0;
+        } else {
+            syslog(LOG_ALERT, "calloc: failed to allocate counter samples of '%s'\n", context->intf);
+        }
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_device_get_last_sample(context, sample);
+ *
+ * @brief gets counter increments of the last second
+ */
+void dhcp_device_get_last_sample(dhcp_device_context_t *context, dhcp_counters_sample_t sample)
+{
+    memset(sample, 0, sizeof(dhcp_counters_sample_t));
+
+    if ((context != NULL) && (context->sample_nr >= 2)) {
+        uint64_t *newest = &context->samples[context->sample_idx][0][0][0];
+        uint64_t *previous = &context->samples[(context->sample_idx + context->sample_sz - 1) %
+                                               context->sample_sz][0][0][0];
+        uint64_t *delta = &sample[0][0][0];
+
+        for (size_t i = 0; i < sizeof(dhcp_counters_sample_t) / sizeof(uint64_t); i++) {
+            delta[i] = newest[i] - previous[i];
+        }
+    }
+}
+
+/**
+ * @code dhcp_device_get_ring_drops(context);
+ *
+ * @brief gets frames dropped by capture ring, aggregate devices get drops of all capture rings
+ */
+uint64_t dhcp_device_get_ring_drops(dhcp_device_context_t *context)
+{
+    return context->is_aggregate ? ring_drops_total : context->ring_drops;
+}
+
+/**
+ * @code dhcp_device_collect_counters(context);
+ *
+ * @brief Reads DHCP counters of device/interface from eBPF counters map
+ */
+void dhcp_device_collect_counters(dhcp_device_context_t *context)
+{
+    if ((context != NULL) && ebpf_capture) {
+        dhcp_ebpf_read_counters(context->ebpf_slot, context->counters[DHCP_VERSION_4][DHCP_COUNTERS_CURRENT]);
+    }
+}
+
 /**
  * @code dhcp_device_update_snapshot(context);
  *
@@ -627,9 +1848,36 @@ dhcp_mon_status_t dhcp_device_get_status(dhcp_mon_check_t check_type, dhcp_devic
 void dhcp_device_update_snapshot(dhcp_device_context_t *context)
 {
     if (context != NULL) {
-        memcpy(context->counters[DHCP_COUNTERS_SNAPSHOT],
-               context->counters[DHCP_COUNTERS_CURRENT],
-               sizeof(context->counters[DHCP_COUNTERS_SNAPSHOT]));
+        collect_ring_stats(context);
+
+        // shared capture sockets are not in the device list, their drops are only accounted for in total drop count
+        if (context->is_aggregate) {
+            for (uint32_t i = 0; i < shared_sock_nr; i++) {
+                collect_ring_stats(&shared_socks[i]);
+            }
+        }
+
+        if (context->samples != NULL) {
+            context->sample_idx = (context->sample_idx + 1) % context->sample_sz;
+            if (context->sample_nr < context->sample_sz) {
+                context->sample_nr++;
+            }
+            for (int version = 0; version < DHCP_VERSION_COUNT; version++) {
+                memcpy(context->samples[context->sample_idx][version],
+                       context->counters[version][DHCP_COUNTERS_CURRENT],
+                       sizeof(context->samples[context->sample_idx][version]));
+            }
+        }
+
+        // the oldest sample is the start of the sliding window, it is the first sample until the ring fills up
+        dhcp_counters_sample_t *window_start = context->samples == NULL ? NULL :
+            &context->samples[context->sample_nr < context->sample_sz ? 0 :
+                              (context->sample_idx + 1) % context->sample_sz];
+        for (int version = 0; version < DHCP_VERSION_COUNT; version++) {
+            memcpy(context->counters[version][DHCP_COUNTERS_SNAPSHOT],
+                   window_start ? (*window_start)[version] : context->counters[version][DHCP_COUNTERS_CURRENT],
+                   sizeof(context->counters[version][DHCP_COUNTERS_SNAPSHOT]));
+        }
     }
 }
 
@@ -641,6 +1889,14 @@ void dhcp_device_update_snapshot(dhcp_device_context_t *context)
 void dhcp_device_print_status(dhcp_device_context_t *context, dhcp_counters_type_t type)
 {
     if (context != NULL) {
-        dhcp_print_counters(context->intf, type, context->counters[type]);
+        dhcp_print_counters(context->intf, type, DHCP_VERSION_4, context->counters[DHCP_VERSION_4][type],
+                            dhcp_device_get_ring_drops(context));
+        if (dhcpv6_capture) {
+            dhcp_print_counters(context->intf, type, DHCP_VERSION_6, context->counters[DHCP_VERSION_6][type], 0);
+        }
+        // transactions are not tracked when DHCP packets are counted in the kernel
+        if ((type == DHCP_COUNTERS_CURRENT) && (context->xid_stats != NULL) && !ebpf_capture) {
+            dhcp_print_latency(context->intf, context->xid_stats);
+        }
     }
 }
@@ -8,6 +8,7 @@
 #define DHCP_DEVICE_H_
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <net/if.h>
 #include <netinet/in.h>
 #include <net/ethernet.h>
@@ -34,6 +35,40 @@ typedef enum
     DHCP_MESSAGE_TYPE_COUNT
 } dhcp_message_type_t;
 
+/**
+ * DHCPv6 message types
+ **/
+typedef enum
+{
+    DHCPV6_MESSAGE_TYPE_SOLICIT             = 1,
+    DHCPV6_MESSAGE_TYPE_ADVERTISE           = 2,
+    DHCPV6_MESSAGE_TYPE_REQUEST             = 3,
+    DHCPV6_MESSAGE_TYPE_CONFIRM             = 4,
+    DHCPV6_MESSAGE_TYPE_RENEW               = 5,
+    DHCPV6_MESSAGE_TYPE_REBIND              = 6,
+    DHCPV6_MESSAGE_TYPE_REPLY               = 7,
+    DHCPV6_MESSAGE_TYPE_RELEASE             = 8,
+    DHCPV6_MESSAGE_TYPE_DECLINE             = 9,
+    DHCPV6_MESSAGE_TYPE_RECONFIGURE         = 10,
+    DHCPV6_MESSAGE_TYPE_INFORMATION_REQUEST = 11,
+    DHCPV6_MESSAGE_TYPE_RELAY_FORW          = 12,
+    DHCPV6_MESSAGE_TYPE_RELAY_REPL          = 13,
+
+    DHCPV6_MESSAGE_TYPE_COUNT
+} dhcpv6_message_type_t;
+
+/** Size of message type dimension of counters, it fits both DHCP and DHCPv6 message types */
+#define DHCP_MAX_MESSAGE_TYPE_COUNT DHCPV6_MESSAGE_TYPE_COUNT
+
+/** DHCP protocol version */
+typedef enum
+{
+    DHCP_VERSION_4,     /** DHCP (IPv4) */
+    DHCP_VERSION_6,     /** DHCPv6 */
+
+    DHCP_VERSION_COUNT
+} dhcp_version_t;
+
 /** packet direction */
 typedef enum
 {
@@ -52,6 +87,52 @@ typedef enum
     DHCP_COUNTERS_COUNT
 } dhcp_counters_type_t;
 
+/** per-second sample of current DHCP and DHCPv6 counters */
+typedef uint64_t dhcp_counters_sample_t[DHCP_VERSION_COUNT][DHCP_DIR_COUNT][DHCP_MAX_MESSAGE_TYPE_COUNT];
+
+/** DHCP transaction phase whose latency is tracked */
+typedef enum
+{
+    DHCP_XID_PHASE_OFFER,       /** Discover answered by Offer */
+    DHCP_XID_PHASE_ACK,         /** Request answered by ACK or NAK */
+
+    DHCP_XID_PHASE_COUNT
+} dhcp_xid_phase_t;
+
+/** DHCP transaction segment latency is measured over */
+typedef enum
+{
+    DHCP_LATENCY_CLIENT,        /** client message received to answer sent on the south interface */
+    DHCP_LATENCY_SERVER,        /** client message relayed to answer received on north interfaces */
+
+    DHCP_LATENCY_SEGMENT_COUNT
+} dhcp_latency_segment_t;
+
+/** Number of linear sub-buckets per power of two of latency histogram, 2^3 keeps bucket error within 12.5% */
+#define DHCP_LATENCY_SUB_BUCKET_BITS 3
+/** Number of latency histogram buckets, they cover latencies up to 2^27 usec (134 sec) */
+#define DHCP_LATENCY_BUCKET_COUNT ((27 - DHCP_LATENCY_SUB_BUCKET_BITS + 1) << DHCP_LATENCY_SUB_BUCKET_BITS)
+
+/** HDR-style latency histogram, bucket width grows with latency so relative error is constant */
+typedef struct
+{
+    uint64_t count;                 /** number of recorded latencies */
+    uint64_t max_usec;              /** highest recorded latency in usec */
+    uint64_t buckets[DHCP_LATENCY_BUCKET_COUNT];
+                                    /** number of recorded latencies per bucket */
+} dhcp_latency_hist_t;
+
+/** DHCP transaction statistics of a VLAN */
+typedef struct
+{
+    dhcp_latency_hist_t latency[DHCP_XID_PHASE_COUNT][DHCP_LATENCY_SEGMENT_COUNT];
+                                    /** latency histograms of answered transactions */
+    uint64_t unanswered[DHCP_XID_PHASE_COUNT];
+                                    /** transactions expired unanswered */
+    uint64_t untracked[DHCP_XID_PHASE_COUNT];
+                                    /** transactions not tracked because transaction table was full */
+} dhcp_xid_stats_t;
+
 /** dhcp health status */
 typedef enum
 {
@@ -67,21 +148,76 @@ typedef enum
     DHCP_MON_CHECK_POSITIVE,    /** Validate that received DORA packets are relayed */
 } dhcp_mon_check_t;
 
+/** captured frame classification status */
+typedef enum
+{
+    DHCP_FRAME_COUNTED,         /** DHCP message is counted on the device and on the VLAN aggregate device */
+    DHCP_FRAME_IGNORED,         /** not a DHCP message or a DHCP message not counted on the device */
+    DHCP_FRAME_TRUNCATED,       /** frame is too short to capture DHCP options */
+    DHCP_FRAME_UNKNOWN_TYPE,    /** DHCP message of unknown message type */
+} dhcp_frame_status_t;
+
+/** packet capture configuration */
+typedef struct
+{
+    size_t snaplen;                 /** snap length of packet capture */
+    size_t ring_size;               /** size of TPACKET_V3 mmap capture ring in bytes, 0 to capture using recv() */
+    uint32_t shared_sock_nr;        /** number of sockets capturing on all interfaces in a PACKET_FANOUT group,
+                                        0 to open one socket per interface, at most 256 */
+    uint32_t budget;                /** max number of frames processed per socket read callback */
+    uint8_t dhcpv6;                 /** monitor DHCPv6 relay as well? */
+    uint8_t ebpf;                   /** count DHCP packets in the kernel with an eBPF program? falls back to
+                                        classic BPF capture if the program cannot be loaded */
+    uint32_t xid_capacity;          /** max number of DHCP transactions tracked at once, 0 disables latency
+                                        tracking */
+} dhcp_capture_config_t;
+
 /** DHCP device (interface) context */
 typedef struct
 {
     int sock;                       /** Raw socket associated with this device/interface */
+    int ifindex;                    /** interface index, 0 for shared capture sockets */
+    uint8_t is_shared;              /** shared capture socket that dispatches frames to devices by ifindex? */
     in_addr_t ip;                   /** network address of this device (interface) */
     uint8_t mac[ETHER_ADDR_LEN];    /** hardware address of this device (interface) */
-    in_addr_t vlan_ip;              /** Vlan IP address */
+    in_addr_t vlan_ip;              /** Vlan IP address of VLAN aggregate device */
     uint8_t is_uplink;              /** north interface? */
+    uint8_t is_aggregate;           /** VLAN aggregate device? */
+    void *agg_dev;                  /** VLAN aggregate device (dhcp_device_context_t) of south interface */
     char intf[IF_NAMESIZE];         /** device (interface) name */
-    uint8_t *buffer;                /** buffer used to read socket data */
+    uint8_t *buffer;                /** buffers used to read socket data, batch_sz buffers of snaplen bytes each */
     size_t snaplen;                 /** snap length or buffer size */
-    uint64_t counters[DHCP_COUNTERS_COUNT][DHCP_DIR_COUNT][DHCP_MESSAGE_TYPE_COUNT];
-                                    /** current/snapshot counters of DHCP packets */
+    struct mmsghdr *msgs;           /** recvmmsg() message headers, one per buffer */
+    struct iovec *iovs;             /** recvmmsg() io vectors, one per buffer */
+    struct sockaddr_ll *addrs;      /** recvmmsg() source addresses, one per buffer */
+    uint32_t batch_sz;              /** number of frames read per recvmmsg() call */
+    uint32_t budget;                /** max number of frames processed per socket read callback */
+    uint8_t *ring;                  /** TPACKET_V3 mmap capture ring, NULL when capturing with recv() */
+    uint32_t ring_block_nr;         /** number of blocks in capture ring */
+    uint32_t ring_block_idx;        /** index of next capture ring block to be processed */
+    uint64_t ring_drops;            /** frames dropped by the kernel because capture ring was full */
+    uint32_t ebpf_slot;             /** slot of DHCP counters of this device in eBPF counters map */
+    uint64_t counters[DHCP_VERSION_COUNT][DHCP_COUNTERS_COUNT][DHCP_DIR_COUNT][DHCP_MAX_MESSAGE_TYPE_COUNT];
+                                    /** current/snapshot counters of DHCP and DHCPv6 packets */
+    dhcp_counters_sample_t *samples;/** ring of per-second samples of current counters spanning the sliding health
+                                        check window, NULL if snapshot is taken once per window */
+    uint32_t sample_sz;             /** number of samples in ring, window length in seconds + 1 */
+    uint32_t sample_nr;             /** number of samples taken so far, up to sample_sz */
+    uint32_t sample_idx;            /** index of newest sample */
+    dhcp_xid_stats_t *xid_stats;    /** DHCP transaction statistics of VLAN aggregate device */
 } dhcp_device_context_t;
 
+/** captured frame classification */
+typedef struct
+{
+    dhcp_version_t version;         /** DHCP version of the message */
+    dhcp_packet_direction_t dir;    /** direction of the message on the device */
+    uint8_t msg_type;               /** message type, type of relayed message for DHCPv6 relay messages */
+    dhcp_device_context_t *agg_dev; /** VLAN aggregate device the message is attributed to, NULL if none */
+    uint32_t xid;                   /** DHCP transaction id, in network byte order */
+    const uint8_t *chaddr;          /** DHCP client hardware address, NULL for DHCPv6 */
+} dhcp_frame_class_t;
+
 /**
  * @code dhcp_device_get_ip(context, ip);
  *
@@ -95,13 +231,19 @@ typedef struct
 int dhcp_device_get_ip(dhcp_device_context_t *context, in_addr_t *ip);
 
 /**
- * @code dhcp_device_get_aggregate_context();
+ * @code dhcp_device_add_vlan(context, agg_context);
  *
- * @brief Accessor method
+ * @brief creates aggregate device of the VLAN whose south interface is context. The aggregate device collects
+ *        counters of DHCP packets relayed for this VLAN from the south interface and from all north interfaces,
+ *        where packets are attributed to the VLAN by its IP address (giaddr for client messages, destination IP
+ *        for server messages) or by one of its global IPv6 addresses (DHCPv6 relay message link-address)
+ *
+ * @param context           pointer to device (interface) context of VLAN south interface
+ * @param agg_context(out)  pointer to VLAN aggregate device context
  *
- * @return pointer to aggregate device (interface) context
+ * @return 0 on success, otherwise for failure
  */
-dhcp_device_context_t* dhcp_device_get_aggregate_context();
+int dhcp_device_add_vlan(dhcp_device_context_t *context, dhcp_device_context_t **agg_context);
 
 /**
  * @code dhcp_device_init(context, intf, is_uplink);
@@ -119,26 +261,98 @@ int dhcp_device_init(dhcp_device_context_t **context,
                      uint8_t is_uplink);
 
 /**
- * @code dhcp_device_start_capture(context, snaplen, base, vlan_ip);
+ * @code dhcp_device_start_capture(context, config, base);
  *
- * @brief starts packet capture on this interface
+ * @brief starts packet capture on this interface. When config requests shared capture sockets, the interface is only
+ *        registered with them and capture starts with dhcp_device_start_shared_capture()
  *
  * @param context           pointer to device (interface) context
- * @param snaplen           length of packet capture
+ * @param config            packet capture configuration
  * @param base              pointer to libevent base
- * @param vlan_ip           vlan IP address
  *
  * @return 0 on success, otherwise for failure
  */
 int dhcp_device_start_capture(dhcp_device_context_t *context,
-                              size_t snaplen,
-                              struct event_base *base,
-                              in_addr_t vlan_ip);
+                              const dhcp_capture_config_t *config,
+                              struct event_base *base);
+
+/**
+ * @code dhcp_device_start_shared_capture(config, base);
+ *
+ * @brief opens config->shared_sock_nr sockets that capture on all interfaces registered by
+ *        dhcp_device_start_capture() and dispatch frames to them by ifindex. With config->ebpf, DHCP packets are
+ *        counted by an eBPF program attached to these sockets and only DHCPv6 frames are read from them
+ *
+ * @param config            packet capture configuration
+ * @param base              pointer to libevent base
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_device_start_shared_capture(const dhcp_capture_config_t *config, struct event_base *base);
+
+/**
+ * @code dhcp_device_is_ebpf_capture();
+ *
+ * @brief tells whether DHCP packets are counted in the kernel. This is the capture mode actually set up by
+ *        dhcp_device_start_shared_capture(), which falls back to packet capture when eBPF is not available
+ *
+ * @return 1 if DHCP packets are counted by an eBPF program, 0 if they are read by dhcpmon
+ */
+int dhcp_device_is_ebpf_capture();
+
+/**
+ * @code dhcp_device_start_replay(config);
+ *
+ * @brief prepares devices for replay of captured frames with dhcp_device_handle_frame() instead of packet capture.
+ *        Only config->dhcpv6 applies to replay
+ *
+ * @param config            packet capture configuration
+ *
+ * @return none
+ */
+void dhcp_device_start_replay(const dhcp_capture_config_t *config);
+
+/**
+ * @code dhcp_device_classify_frame(context, frame, frame_sz, frame_class);
+ *
+ * @brief classifies captured frame by DHCP version, direction and message type and finds the VLAN it is attributed
+ *        to. It has no side effects and does not depend on how the frame was captured, so captured, replayed and
+ *        synthetic frames are classified alike
+ *
+ * @param context           Device (interface) context the frame was captured on
+ * @param frame             pointer to start of captured Ethernet frame
+ * @param frame_sz          captured length of the frame
+ * @param frame_class(out)  frame classification, valid for DHCP_FRAME_COUNTED and DHCP_FRAME_UNKNOWN_TYPE
+ *
+ * @return frame classification status
+ */
+dhcp_frame_status_t dhcp_device_classify_frame(const dhcp_device_context_t *context,
+                                               const uint8_t *frame,
+                                               ssize_t frame_sz,
+                                               dhcp_frame_class_t *frame_class);
+
+/**
+ * @code dhcp_device_handle_frame(context, frame, frame_sz, time_ns);
+ *
+ * @brief classifies captured frame, updates DHCP/DHCPv6 counters of device and of its VLAN aggregate device and
+ *        tracks the DHCP transaction of counted DHCP messages
+ *
+ * @param context           Device (interface) context the frame was captured on
+ * @param frame             pointer to start of captured Ethernet frame
+ * @param frame_sz          captured length of the frame
+ * @param time_ns           capture time of the frame in nanoseconds, CLOCK_MONOTONIC for live capture and
+ *                          the pcap timestamp for replay
+ *
+ * @return none
+ */
+void dhcp_device_handle_frame(dhcp_device_context_t *context, const uint8_t *frame, ssize_t frame_sz,
+                              uint64_t time_ns);
 
 /**
  * @code dhcp_device_shutdown(context);
  *
- * @brief shuts down device (interface). Also, stops packet capture on interface and cleans up any allocated memory
+ * @brief shuts down device (interface). Also, stops packet capture on interface and cleans up any allocated memory.
+ *        VLAN aggregate devices are shut down along with their south interface
  *
  * @param context   Device (interface) context
  *
@@ -147,31 +361,81 @@ int dhcp_device_start_capture(dhcp_device_context_t *context,
 void dhcp_device_shutdown(dhcp_device_context_t *context);
 
 /**
- * @code dhcp_device_get_status(check_type, context);
+ * @code dhcp_device_get_status(check_type, version, context);
  *
- * @brief collects DHCP relay status info for a given interface. If context is null, it will report aggregate
- *        status
+ * @brief collects DHCP relay status info for a given interface. Status is indeterminate while there is no DHCP
+ *        activity on the VLAN of an aggregate device, or on any VLAN for other devices
  *
  * @param check_type        Type of validation
+ * @param version           DHCP version whose counters are validated
  * @param context           Device (interface) context
  *
  * @return DHCP_MON_STATUS_HEALTHY, DHCP_MON_STATUS_UNHEALTHY, or DHCP_MON_STATUS_INDETERMINATE
  */
-dhcp_mon_status_t dhcp_device_get_status(dhcp_mon_check_t check_type, dhcp_device_context_t *context);
+dhcp_mon_status_t dhcp_device_get_status(dhcp_mon_check_t check_type,
+                                         dhcp_version_t version,
+                                         dhcp_device_context_t *context);
+
+/**
+ * @code dhcp_device_init_window(context, window_sec);
+ *
+ * @brief allocates ring of per-second counter samples, so that health is checked over a sliding window of
+ *        window_sec seconds. Snapshot counters then hold the counters of window_sec seconds ago
+ *
+ * @param context       Device (interface) context
+ * @param window_sec    length of sliding health check window in seconds
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_device_init_window(dhcp_device_context_t *context, uint32_t window_sec);
+
+/**
+ * @code dhcp_device_get_last_sample(context, sample);
+ *
+ * @brief gets counter increments of the last second
+ *
+ * @param context       Device (interface) context
+ * @param sample(out)   counter increments of the last second, zero until two samples are taken
+ *
+ * @return none
+ */
+void dhcp_device_get_last_sample(dhcp_device_context_t *context, dhcp_counters_sample_t sample);
+
+/**
+ * @code dhcp_device_get_ring_drops(context);
+ *
+ * @brief gets frames dropped by capture ring, aggregate devices get drops of all capture rings
+ *
+ * @param context       Device (interface) context
+ *
+ * @return number of dropped frames
+ */
+uint64_t dhcp_device_get_ring_drops(dhcp_device_context_t *context);
+
+/**
+ * @code dhcp_device_collect_counters(context);
+ *
+ * @param context   Device (interface) context
+ *
+ * @brief Reads DHCP counters of device/interface from eBPF counters map, if DHCP packets are counted in the kernel
+ */
+void dhcp_device_collect_counters(dhcp_device_context_t *context);
 
 /**
  * @code dhcp_device_update_snapshot(context);
  *
  * @param context   Device (interface) context
  *
- * @brief Update device/interface counters snapshot
+ * @brief Update device/interface counters snapshot. It also collects capture ring drop count from the kernel. With a
+ *        sliding window, it is called every second, it samples current counters and moves snapshot to the sample
+ *        taken window length seconds ago
  */
 void dhcp_device_update_snapshot(dhcp_device_context_t *context);
 
 /**
  * @code dhcp_device_print_status(context, type);
  *
- * @brief prints status counters to syslog. If context is null, it will print aggregate status
+ * @brief prints status counters to syslog
  *
  * @param context       Device (interface) context
  * @param counters_type Counter type to be printed
@@ -9,11 +9,13 @@
 #include <syslog.h>
 #include <sys/queue.h>
 #include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
 
 #include "dhcp_devman.h"
-
-/** Prefix appended to Aggregation device */
-#define AGG_DEV_PREFIX  "Agg-"
+#include "dhcp_export.h"
+#include "dhcp_pcap.h"
+#include "dhcp_xid.h"
 
 /** struct for interface information */
 struct intf
@@ -33,21 +35,33 @@ static uint32_t dhcp_num_north_intf = 0;
 /** dhcp_num_mgmt_intf number of mgmt interfaces */
 static uint32_t dhcp_num_mgmt_intf = 0;
 
-/** On Device  vlan interface IP address corresponding vlan downlink IP
- *  This IP is used to filter Offer/Ack packet coming from DHCP server */
-static in_addr_t vlan_ip = 0;
+/** VLAN aggregate devices, one per south interface */
+static dhcp_device_context_t **agg_devs = NULL;
 
 /** mgmt interface */
 static struct intf *mgmt_intf = NULL;
 
+/** first south interface, frames of pcap files that do not record interface index are replayed on it */
+static struct intf *replay_intf = NULL;
+
+/**
+ * @code dhcp_devman_get_agg_dev_nr();
+ *
+ * Accessor method
+ */
+uint32_t dhcp_devman_get_agg_dev_nr()
+{
+    return agg_devs ? dhcp_num_south_intf : 0;
+}
+
 /**
- * @code dhcp_devman_get_vlan_intf();
+ * @code dhcp_devman_get_agg_dev(index);
  *
  * Accessor method
  */
-dhcp_device_context_t* dhcp_devman_get_agg_dev()
+dhcp_device_context_t* dhcp_devman_get_agg_dev(uint32_t index)
 {
-    return dhcp_device_get_aggregate_context();
+    return index < dhcp_devman_get_agg_dev_nr() ? agg_devs[index] : NULL;
 }
 
 /**
@@ -63,8 +77,8 @@ dhcp_device_context_t* dhcp_devman_get_mgmt_dev()
 /**
  * @code dhcp_devman_init();
  *
- * initializes device (interface) manager that keeps track of interfaces and assert that there is one south
- * interface and as many north interfaces
+ * initializes device (interface) manager that keeps track of interfaces. There could be as many south (VLAN)
+ * interfaces and as many north interfaces
  */
 void dhcp_devman_init()
 {
@@ -94,6 +108,11 @@ void dhcp_devman_shutdown()
         LIST_REMOVE(prev_intf, entry);
         free(prev_intf);
     }
+
+    free(agg_devs);
+
+    dhcp_xid_shutdown();
+    dhcp_export_shutdown();
 }
 
 /**
@@ -116,8 +135,6 @@ int dhcp_devman_add_intf(const char *name, char intf_type)
             dhcp_num_north_intf++;
             break;
         case 'd':
-            dhcp_num_south_intf++;
-            assert(dhcp_num_south_intf <= 1);
             break;
         case 'm':
             dhcp_num_mgmt_intf++;
@@ -130,13 +147,21 @@ int dhcp_devman_add_intf(const char *name, char intf_type)
 
         rv = dhcp_device_init(&dev->dev_context, dev->name, dev->is_uplink);
         if (rv == 0 && intf_type == 'd') {
-            rv = dhcp_device_get_ip(dev->dev_context, &vlan_ip);
+            dhcp_device_context_t **devs = realloc(agg_devs, (dhcp_num_south_intf + 1) * sizeof(*agg_devs));
 
-            dhcp_device_context_t *agg_dev = dhcp_device_get_aggregate_context();
-
-            strncpy(agg_dev->intf, AGG_DEV_PREFIX, sizeof(AGG_DEV_PREFIX));
-            strncpy(agg_dev->intf + sizeof(AGG_DEV_PREFIX) - 1, name, sizeof(agg_dev->intf) - sizeof(AGG_DEV_PREFIX));
-            agg_dev->intf[sizeof(agg_dev->intf) - 1] = '\0';
+            if (devs != NULL) {
+                agg_devs = devs;
+                rv = dhcp_device_add_vlan(dev->dev_context, &agg_devs[dhcp_num_south_intf]);
+                if (rv == 0) {
+                    if (dhcp_num_south_intf == 0) {
+                        replay_intf = dev;
+                    }
+                    dhcp_num_south_intf++;
+                }
+            } else {
+                syslog(LOG_ALERT, "realloc: failed to allocate memory for vlan '%s'\n", name);
+                rv = -1;
+            }
         }
 
         LIST_INSERT_HEAD(&intfs, dev, entry);
@@ -149,18 +174,18 @@ int dhcp_devman_add_intf(const char *name, char intf_type)
 }
 
 /**
- * @code dhcp_devman_start_capture(snaplen, base);
+ * @code dhcp_devman_start_capture(config, base);
  *
  * @brief start packet capture on the devman interface list
  */
-int dhcp_devman_start_capture(size_t snaplen, struct event_base *base)
+int dhcp_devman_start_capture(const dhcp_capture_config_t *config, struct event_base *base)
 {
     int rv = -1;
     struct intf *int_ptr;
 
-    if ((dhcp_num_south_intf == 1) && (dhcp_num_north_intf >= 1)) {
+    if ((dhcp_num_south_intf >= 1) && (dhcp_num_north_intf >= 1)) {
         LIST_FOREACH(int_ptr, &intfs, entry) {
-            rv = dhcp_device_start_capture(int_ptr->dev_context, snaplen, base, vlan_ip);
+            rv = dhcp_device_start_capture(int_ptr->dev_context, config, base);
             if (rv == 0) {
                 syslog(LOG_INFO,
                        "Capturing DHCP packets on interface %s, ip: 0x%08x, mac [%02x:%02x:%02x:%02x:%02x:%02x] \n",
@@ -172,6 +197,16 @@ int dhcp_devman_start_capture(size_t snaplen, struct event_base *base)
                 break;
             }
         }
+
+        if ((rv == 0) && ((config->shared_sock_nr > 0) || config->ebpf)) {
+            rv = dhcp_device_start_shared_capture(config, base);
+        }
+
+        // frames counted in the kernel never reach user space, so their transactions cannot be tracked. eBPF may have
+        // been requested and not set up, in which case frames are captured and tracked as usual
+        if ((rv == 0) && !dhcp_device_is_ebpf_capture() && (config->xid_capacity > 0)) {
+            rv = dhcp_xid_init(config->xid_capacity);
+        }
     }
     else {
         syslog(LOG_ERR, "Invalid number of interfaces, downlink/south %d, uplink/north %d\n",
@@ -182,13 +217,239 @@ int dhcp_devman_start_capture(size_t snaplen, struct event_base *base)
 }
 
 /**
- * @code dhcp_devman_get_status(check_type, context);
+ * @code get_replay_context(frame);
+ *
+ * @brief finds device (interface) context a frame loaded from pcap file is replayed on
+ *
+ * @param frame             frame loaded from pcap file
+ *
+ * @return device (interface) context, NULL if frame was captured on an unmonitored interface
+ */
+static dhcp_device_context_t* get_replay_context(const dhcp_pcap_frame_t *frame)
+{
+    struct intf *int_ptr;
+
+    if (frame->ifindex == 0) {
+        return replay_intf ? replay_intf->dev_context : NULL;
+    }
+
+    LIST_FOREACH(int_ptr, &intfs, entry) {
+        if (int_ptr->dev_context->ifindex == frame->ifindex) {
+            return int_ptr->dev_context;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @code dhcp_devman_replay(path, replay_nr, config);
+ *
+ * @brief replays frames of a pcap file on the devman interface list
+ */
+int dhcp_devman_replay(const char *path, uint32_t replay_nr, const dhcp_capture_config_t *config)
+{
+    int rv = -1;
+    dhcp_pcap_t pcap;
+    dhcp_device_context_t **contexts = NULL;
+
+    do {
+        if (dhcp_num_south_intf < 1) {
+            syslog(LOG_ERR, "Invalid number of interfaces, downlink/south %d\n", dhcp_num_south_intf);
+            break;
+        }
+
+        if (dhcp_pcap_load(path, &pcap) != 0) {
+            break;
+        }
+
+        contexts = (dhcp_device_context_t **) calloc(pcap.frame_nr ? pcap.frame_nr : 1, sizeof(*contexts));
+        if (contexts == NULL) {
+            syslog(LOG_ALERT, "calloc: failed to allocate memory for frames of '%s'\n", path);
+            dhcp_pcap_free(&pcap);
+            break;
+        }
+
+        // resolve interfaces up front, so only frame classification and counting are timed
+        uint32_t skipped_nr = 0;
+        for (uint32_t i = 0; i < pcap.frame_nr; i++) {
+            const struct ether_header *ethhdr = (const struct ether_header *) pcap.frames[i].data;
+
+            if ((pcap.frames[i].len < ETHER_HDR_LEN) ||
+                (!config->dhcpv6 && (ethhdr->ether_type == htons(ETHERTYPE_IPV6)))) {
+                skipped_nr++;
+            } else if ((contexts[i] = get_replay_context(&pcap.frames[i])) == NULL) {
+                skipped_nr++;
+            }
+        }
+        if (skipped_nr > 0) {
+            syslog(LOG_INFO, "Skipping %u frames of '%s' not captured on monitored interfaces or filtered out\n",
+                   skipped_nr, path);
+        }
+
+        dhcp_device_start_replay(config);
+        if ((config->xid_capacity > 0) && (dhcp_xid_init(config->xid_capacity) != 0)) {
+            free(contexts);
+            dhcp_pcap_free(&pcap);
+            break;
+        }
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t n = 0; n < replay_nr; n++) {
+            for (uint32_t i = 0; i < pcap.frame_nr; i++) {
+                if (contexts[i] != NULL) {
+                    dhcp_device_handle_frame(contexts[i], pcap.frames[i].data, pcap.frames[i].len,
+                                             pcap.frames[i].time_ns);
+                }
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        uint64_t frame_nr = (uint64_t) (pcap.frame_nr - skipped_nr) * replay_nr;
+        uint64_t elapsed_ns = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+        syslog(LOG_INFO, "Replayed %lu frames of '%s' in %.3f sec, %.0f frames/sec, %.1f ns/frame\n",
+               frame_nr, path, elapsed_ns / 1e9, elapsed_ns ? frame_nr * 1e9 / elapsed_ns : 0.0,
+               frame_nr ? (double) elapsed_ns / frame_nr : 0.0);
+
+        free(contexts);
+        dhcp_pcap_free(&pcap);
+
+        rv = 0;
+    } while (0);
+
+    return rv;
+}
+
+/**
+ * @code dhcp_devman_get_status(check_type, version, context);
  *
  * @brief collects DHCP relay status info.
  */
-dhcp_mon_status_t dhcp_devman_get_status(dhcp_mon_check_t check_type, dhcp_device_context_t *context)
+dhcp_mon_status_t dhcp_devman_get_status(dhcp_mon_check_t check_type,
+                                         dhcp_version_t version,
+                                         dhcp_device_context_t *context)
 {
-    return dhcp_device_get_status(check_type, context);
+    return dhcp_device_get_status(check_type, version, context);
+}
+
+/**
+ * @code dhcp_devman_collect_counters();
+ *
+ * @brief Reads DHCP counters counted in the kernel for all interfaces
+ */
+void dhcp_devman_collect_counters()
+{
+    struct intf *int_ptr;
+
+    LIST_FOREACH(int_ptr, &intfs, entry) {
+        dhcp_device_collect_counters(int_ptr->dev_context);
+    }
+
+    for (uint32_t i = 0; i < dhcp_devman_get_agg_dev_nr(); i++) {
+        dhcp_device_collect_counters(dhcp_devman_get_agg_dev(i));
+    }
+}
+
+/**
+ * @code dhcp_devman_expire_transactions();
+ *
+ * @brief expires DHCP transactions left unanswered
+ */
+void dhcp_devman_expire_transactions()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    dhcp_xid_expire(now.tv_sec * 1000000000ULL + now.tv_nsec);
+}
+
+/**
+ * @code dhcp_devman_init_window(window_sec);
+ *
+ * @brief allocates per-second counter samples of all interfaces and VLAN aggregate devices
+ */
+int dhcp_devman_init_window(uint32_t window_sec)
+{
+    int rv = 0;
+    struct intf *int_ptr;
+
+    LIST_FOREACH(int_ptr, &intfs, entry) {
+        if ((rv = dhcp_device_init_window(int_ptr->dev_context, window_sec)) != 0) {
+            break;
+        }
+    }
+
+    for (uint32_t i = 0; (i < dhcp_devman_get_agg_dev_nr()) && (rv == 0); i++) {
+        rv = dhcp_device_init_window(dhcp_devman_get_agg_dev(i), window_sec);
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_devman_export_init(path);
+ *
+ * @brief creates counter export file for all interfaces and VLAN aggregate devices
+ */
+int dhcp_devman_export_init(const char *path)
+{
+    uint32_t dev_nr = dhcp_devman_get_agg_dev_nr();
+    struct intf *int_ptr;
+
+    LIST_FOREACH(int_ptr, &intfs, entry) {
+        dev_nr++;
+    }
+
+    return dhcp_export_init(path, dev_nr);
+}
+
+/**
+ * @code dhcp_devman_export_counters();
+ *
+ * @brief exports counters of all interfaces followed by VLAN aggregate devices
+ */
+void dhcp_devman_export_counters()
+{
+    struct intf *int_ptr;
+    uint32_t index = 0;
+    dhcp_counters_sample_t last_sample;
+    dhcp_export_latency_t latency[DHCP_XID_PHASE_COUNT][DHCP_LATENCY_SEGMENT_COUNT];
+
+    dhcp_export_begin();
+
+    LIST_FOREACH(int_ptr, &intfs, entry) {
+        dhcp_device_context_t *context = int_ptr->dev_context;
+        dhcp_export_dev_type_t type = int_ptr == mgmt_intf ? DHCP_EXPORT_DEV_MGMT :
+                                      int_ptr->is_uplink ? DHCP_EXPORT_DEV_NORTH : DHCP_EXPORT_DEV_SOUTH;
+
+        dhcp_device_get_last_sample(context, last_sample);
+        dhcp_export_device(index++, context->intf, type, dhcp_device_get_ring_drops(context), context->counters,
+                           last_sample, NULL, NULL);
+    }
+
+    for (uint32_t i = 0; i < dhcp_devman_get_agg_dev_nr(); i++) {
+        dhcp_device_context_t *context = dhcp_devman_get_agg_dev(i);
+        const dhcp_xid_stats_t *xid_stats = context->xid_stats;
+
+        for (int phase = 0; phase < DHCP_XID_PHASE_COUNT; phase++) {
+            for (int segment = 0; segment < DHCP_LATENCY_SEGMENT_COUNT; segment++) {
+                const dhcp_latency_hist_t *hist = &xid_stats->latency[phase][segment];
+
+                latency[phase][segment].count = hist->count;
+                latency[phase][segment].p50 = dhcp_xid_get_percentile(hist, 50);
+                latency[phase][segment].p90 = dhcp_xid_get_percentile(hist, 90);
+                latency[phase][segment].p99 = dhcp_xid_get_percentile(hist, 99);
+                latency[phase][segment].max = hist->max_usec;
+            }
+        }
+
+        dhcp_device_get_last_sample(context, last_sample);
+        dhcp_export_device(index++, context->intf, DHCP_EXPORT_DEV_AGGREGATE, dhcp_device_get_ring_drops(context),
+                           context->counters, last_sample, latency, xid_stats->unanswered);
+    }
+
+    dhcp_export_end();
 }
 
 /**
@@ -205,7 +466,9 @@ void dhcp_devman_update_snapshot(dhcp_device_context_t *context)
             dhcp_device_update_snapshot(int_ptr->dev_context);
         }
 
-        dhcp_device_update_snapshot(dhcp_devman_get_agg_dev());
+        for (uint32_t i = 0; i < dhcp_devman_get_agg_dev_nr(); i++) {
+            dhcp_device_update_snapshot(dhcp_devman_get_agg_dev(i));
+        }
     } else {
         dhcp_device_update_snapshot(context);
     }
@@ -225,7 +488,9 @@ void dhcp_devman_print_status(dhcp_device_context_t *context, dhcp_counters_type
             dhcp_device_print_status(int_ptr->dev_context, type);
         }
 
-        dhcp_device_print_status(dhcp_devman_get_agg_dev(), type);
+        for (uint32_t i = 0; i < dhcp_devman_get_agg_dev_nr(); i++) {
+            dhcp_device_print_status(dhcp_devman_get_agg_dev(i), type);
+        }
     } else {
         dhcp_device_print_status(context, type);
     }
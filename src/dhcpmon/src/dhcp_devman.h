@@ -14,8 +14,8 @@
 /**
  * @code dhcp_devman_init();
  *
- * @brief initializes device (interface) manager that keeps track of interfaces and assert that there is one south
- *        interface and as many north interfaces
+ * @brief initializes device (interface) manager that keeps track of interfaces. There could be as many south
+ *        (VLAN) interfaces and as many north interfaces
  *
  * @return none
  */
@@ -32,13 +32,24 @@ void dhcp_devman_init();
 void dhcp_devman_shutdown();
 
 /**
- * @code dhcp_devman_get_vlan_intf();
+ * @code dhcp_devman_get_agg_dev_nr();
  *
  * @brief Accessor method
  *
- * @return pointer to aggregate device (interface) context
+ * @return number of VLAN aggregate devices, one per south interface
  */
-dhcp_device_context_t* dhcp_devman_get_agg_dev();
+uint32_t dhcp_devman_get_agg_dev_nr();
+
+/**
+ * @code dhcp_devman_get_agg_dev(index);
+ *
+ * @brief Accessor method
+ *
+ * @param index             index of VLAN aggregate device, less than dhcp_devman_get_agg_dev_nr()
+ *
+ * @return pointer to VLAN aggregate device (interface) context, NULL if index is out of range
+ */
+dhcp_device_context_t* dhcp_devman_get_agg_dev(uint32_t index);
 
 /**
  * @code dhcp_devman_get_mgmt_intf_context();
@@ -64,28 +75,96 @@ dhcp_device_context_t* dhcp_devman_get_mgmt_dev();
 int dhcp_devman_add_intf(const char *name, char intf_type);
 
 /**
- * @code dhcp_devman_start_capture(snaplen, base);
+ * @code dhcp_devman_start_capture(config, base);
  *
  * @brief start packet capture on the devman interface list
  *
- * @param snaplen packet    packet capture snap length
+ * @param config            packet capture configuration
  * @param base              libevent base
  *
  * @return 0 on success, nonzero otherwise
  */
-int dhcp_devman_start_capture(size_t snaplen, struct event_base *base);
+int dhcp_devman_start_capture(const dhcp_capture_config_t *config, struct event_base *base);
+
+/**
+ * @code dhcp_devman_replay(path, replay_nr, config);
+ *
+ * @brief replays frames of a pcap file on the devman interface list instead of capturing packets and logs replay
+ *        throughput. Frames of Linux cooked capture files (tcpdump -i any) are replayed on the interface they were
+ *        captured on, frames of Ethernet capture files on the first south interface
+ *
+ * @param path              pcap file path
+ * @param replay_nr         number of times frames of the file are replayed
+ * @param config            packet capture configuration
+ *
+ * @return 0 on success, nonzero otherwise
+ */
+int dhcp_devman_replay(const char *path, uint32_t replay_nr, const dhcp_capture_config_t *config);
 
 /**
- * @code dhcp_devman_get_status(check_type, context);
+ * @code dhcp_devman_get_status(check_type, version, context);
  *
  * @brief collects DHCP relay status info.
  *
  * @param check_type        Type of validation
+ * @param version           DHCP version whose counters are validated
  * @param context           pointer to device (interface) context
  *
  * @return DHCP_MON_STATUS_HEALTHY, DHCP_MON_STATUS_UNHEALTHY, or DHCP_MON_STATUS_INDETERMINATE
  */
-dhcp_mon_status_t dhcp_devman_get_status(dhcp_mon_check_t check_type, dhcp_device_context_t *context);
+dhcp_mon_status_t dhcp_devman_get_status(dhcp_mon_check_t check_type,
+                                         dhcp_version_t version,
+                                         dhcp_device_context_t *context);
+
+/**
+ * @code dhcp_devman_collect_counters();
+ *
+ * @brief Reads DHCP counters of all interfaces from the kernel when DHCP packets are counted by eBPF program
+ *
+ * @return none
+ */
+void dhcp_devman_collect_counters();
+
+/**
+ * @code dhcp_devman_expire_transactions();
+ *
+ * @brief expires DHCP transactions left unanswered and counts them as unanswered on their VLAN
+ *
+ * @return none
+ */
+void dhcp_devman_expire_transactions();
+
+/**
+ * @code dhcp_devman_init_window(window_sec);
+ *
+ * @brief allocates per-second counter samples of all interfaces and VLAN aggregate devices, so that health is
+ *        checked over a sliding window of window_sec seconds
+ *
+ * @param window_sec        length of sliding health check window in seconds
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_devman_init_window(uint32_t window_sec);
+
+/**
+ * @code dhcp_devman_export_init(path);
+ *
+ * @brief creates counter export file for all interfaces and VLAN aggregate devices, see dhcp_export.h
+ *
+ * @param path              counter export file path
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_devman_export_init(const char *path);
+
+/**
+ * @code dhcp_devman_export_counters();
+ *
+ * @brief exports current/snapshot counters of all interfaces and VLAN aggregate devices to counter export file
+ *
+ * @return none
+ */
+void dhcp_devman_export_counters();
 
 /**
  * @code dhcp_devman_update_snapshot(context);
@@ -0,0 +1,762 @@
+/**
+ * @file dhcp_ebpf.c
+ *
+ *  in-kernel DHCP counting (eBPF) module
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <net/ethernet.h>
+#include <netinet/ip.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+
+#include "dhcp_ebpf.h"
+
+/** Offset of Ether type of a captured frame */
+#define EBPF_ETHER_TYPE_OFFSET 12
+/** Offset of source MAC of a captured frame */
+#define EBPF_ETHER_SHOST_OFFSET 6
+/** Offset of IPv4 version/header length of a captured frame */
+#define EBPF_IP_VHL_OFFSET 14
+/** Offset of IPv4 fragment offset of a captured frame */
+#define EBPF_IP_FRAG_OFFSET 20
+/** Offset of IPv4 protocol of a captured frame */
+#define EBPF_IP_PROTO_OFFSET 23
+/** Offset of IPv4 destination address of a captured frame */
+#define EBPF_IP_DST_OFFSET 30
+/** Offset of UDP source port of a captured frame, IPv4 header has no options */
+#define EBPF_UDP_SPORT_OFFSET 34
+/** Offset of UDP destination port of a captured frame, IPv4 header has no options */
+#define EBPF_UDP_DPORT_OFFSET 36
+/** Offset of DHCP GIADDR of a captured frame */
+#define EBPF_DHCP_GIADDR_OFFSET 66
+/** Offset of DHCP options of a captured frame */
+#define EBPF_DHCP_OPTIONS_OFFSET 282
+/** Offset of IPv6 next header of a captured frame */
+#define EBPF_IP6_NXT_OFFSET 20
+/** Offset of UDP source port of a captured IPv6 frame */
+#define EBPF_UDP6_SPORT_OFFSET 54
+/** Offset of UDP destination port of a captured IPv6 frame */
+#define EBPF_UDP6_DPORT_OFFSET 56
+
+/** Max number of DHCP options scanned for option 53. Every option takes at least one byte, so all options of a max
+ *  size untagged Ethernet frame are scanned, as they are by the packet capture path with the default snap length.
+ *  The scan is a bounded loop, which kernels before 5.3 do not verify, they fall back to packet capture */
+#define EBPF_OPTION_SCAN_MAX (ETHER_MAX_LEN - EBPF_DHCP_OPTIONS_OFFSET)
+/** Max number of instructions of the program */
+#define EBPF_MAX_INSNS 512
+/** Max number of jump labels of the program */
+#define EBPF_MAX_LABELS 32
+/** Size of verifier log printed if program fails to load, it holds the start of the verification of the program */
+#define EBPF_LOG_SIZE (1 << 16)
+
+/** Bit mask of DHCP message types sent by client */
+#define EBPF_CLIENT_MSG_MASK ((1 << DHCP_MESSAGE_TYPE_DISCOVER) | (1 << DHCP_MESSAGE_TYPE_REQUEST) |   \
+                              (1 << DHCP_MESSAGE_TYPE_DECLINE) | (1 << DHCP_MESSAGE_TYPE_RELEASE) |    \
+                              (1 << DHCP_MESSAGE_TYPE_INFORM))
+/** Bit mask of DHCP message types sent by server */
+#define EBPF_SERVER_MSG_MASK ((1 << DHCP_MESSAGE_TYPE_OFFER) | (1 << DHCP_MESSAGE_TYPE_ACK) |          \
+                              (1 << DHCP_MESSAGE_TYPE_NAK))
+
+/** eBPF instruction encoding, these follow the kernel's include/linux/filter.h */
+#define EBPF_ALU64_IMM(OP, DST, IMM)                                                                    \
+    ((struct bpf_insn) {.code = BPF_ALU64 | BPF_OP(OP) | BPF_K, .dst_reg = DST, .imm = IMM})
+#define EBPF_ALU64_REG(OP, DST, SRC)                                                                    \
+    ((struct bpf_insn) {.code = BPF_ALU64 | BPF_OP(OP) | BPF_X, .dst_reg = DST, .src_reg = SRC})
+#define EBPF_MOV64_IMM(DST, IMM)        EBPF_ALU64_IMM(BPF_MOV, DST, IMM)
+#define EBPF_MOV64_REG(DST, SRC)        EBPF_ALU64_REG(BPF_MOV, DST, SRC)
+#define EBPF_MOV32_IMM(DST, IMM)                                                                        \
+    ((struct bpf_insn) {.code = BPF_ALU | BPF_MOV | BPF_K, .dst_reg = DST, .imm = IMM})
+#define EBPF_LDX_MEM(SIZE, DST, SRC, OFF)                                                               \
+    ((struct bpf_insn) {.code = BPF_LDX | BPF_SIZE(SIZE) | BPF_MEM, .dst_reg = DST, .src_reg = SRC, .off = OFF})
+#define EBPF_STX_MEM(SIZE, DST, SRC, OFF)                                                               \
+    ((struct bpf_insn) {.code = BPF_STX | BPF_SIZE(SIZE) | BPF_MEM, .dst_reg = DST, .src_reg = SRC, .off = OFF})
+#define EBPF_STX_XADD(SIZE, DST, SRC, OFF)                                                              \
+    ((struct bpf_insn) {.code = BPF_STX | BPF_SIZE(SIZE) | BPF_XADD, .dst_reg = DST, .src_reg = SRC, .off = OFF})
+#define EBPF_LD_ABS(SIZE, IMM)                                                                          \
+    ((struct bpf_insn) {.code = BPF_LD | BPF_SIZE(SIZE) | BPF_ABS, .imm = IMM})
+#define EBPF_LD_IND(SIZE, SRC, IMM)                                                                     \
+    ((struct bpf_insn) {.code = BPF_LD | BPF_SIZE(SIZE) | BPF_IND, .src_reg = SRC, .imm = IMM})
+#define EBPF_LD_MAP_FD(DST, FD)                                                                         \
+    ((struct bpf_insn) {.code = BPF_LD | BPF_DW | BPF_IMM, .dst_reg = DST, .src_reg = BPF_PSEUDO_MAP_FD,  \
+                        .imm = FD}),                                                                    \
+    ((struct bpf_insn) {.code = 0})
+#define EBPF_CALL(FUNC)                                                                                 \
+    ((struct bpf_insn) {.code = BPF_JMP | BPF_CALL, .imm = FUNC})
+#define EBPF_EXIT()                                                                                     \
+    ((struct bpf_insn) {.code = BPF_JMP | BPF_EXIT})
+
+/** eBPF interface map value */
+typedef struct
+{
+    uint32_t slot;                  /** counter slot of the interface */
+    uint32_t agg_slot;              /** counter slot of VLAN of south interface, DHCP_EBPF_NO_SLOT otherwise */
+    uint32_t mac_hi;                /** first 4 bytes of interface MAC in host order */
+    uint32_t mac_lo;                /** last 2 bytes of interface MAC in host order */
+} dhcp_ebpf_intf_t;
+
+/** eBPF program being assembled */
+typedef struct
+{
+    struct bpf_insn insns[EBPF_MAX_INSNS];      /** program instructions */
+    int len;                                    /** number of instructions */
+    int labels[EBPF_MAX_LABELS];                /** instruction index of label, -1 until label is placed */
+    int label_nr;                               /** number of labels */
+    int jumps[EBPF_MAX_INSNS];                  /** label of jump instruction, -1 for other instructions */
+} ebpf_prog_t;
+
+/** eBPF socket filter program */
+static int prog_fd = -1;
+/** eBPF interface map, ifindex to dhcp_ebpf_intf_t */
+static int intf_map_fd = -1;
+/** eBPF VLAN map, VLAN IP address in host order to VLAN counter slot */
+static int vlan_map_fd = -1;
+/** eBPF per-CPU counters map, indexed by (slot, direction, message type) */
+static int counters_map_fd = -1;
+/** number of counter slots */
+static uint32_t counters_slot_nr = 0;
+/** number of possible CPUs, per-CPU map values are reported for each of them */
+static int cpu_nr = 0;
+/** per-CPU values of a counter */
+static uint64_t *cpu_values = NULL;
+
+/**
+ * @code sys_bpf(cmd, attr);
+ *
+ * @brief bpf() system call, it has no glibc wrapper
+ *
+ * @param cmd           bpf command
+ * @param attr          command attributes
+ *
+ * @return command result, -1 for failure
+ */
+static inline int sys_bpf(enum bpf_cmd cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * @code get_possible_cpu_nr();
+ *
+ * @brief counts possible CPUs listed in /sys/devices/system/cpu/possible (e.g. "0-3,6")
+ *
+ * @return number of possible CPUs, -1 for failure
+ */
+static int get_possible_cpu_nr()
+{
+    int nr = -1;
+    char buf[128];
+    FILE *fp = fopen("/sys/devices/system/cpu/possible", "r");
+
+    if (fp != NULL) {
+        if (fgets(buf, sizeof(buf), fp) != NULL) {
+            char *p = buf;
+            nr = 0;
+            while (*p != '\0' && *p != '\n') {
+                int first, last, n;
+                if (sscanf(p, "%d-%d%n", &first, &last, &n) == 2) {
+                    nr += last - first + 1;
+                } else if (sscanf(p, "%d%n", &first, &n) == 1) {
+                    nr++;
+                } else {
+                    nr = -1;
+                    break;
+                }
+                p += n;
+                if (*p == ',') {
+                    p++;
+                }
+            }
+        }
+        fclose(fp);
+    }
+
+    if (nr <= 0) {
+        syslog(LOG_ALERT, "get_possible_cpu_nr: failed to read number of possible CPUs\n");
+        nr = -1;
+    }
+
+    return nr;
+}
+
+/**
+ * @code create_map(map_type, key_size, value_size, max_entries);
+ *
+ * @brief creates eBPF map
+ *
+ * @return map file descriptor, -1 for failure
+ */
+static int create_map(enum bpf_map_type map_type, uint32_t key_size, uint32_t value_size, uint32_t max_entries)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = map_type;
+    attr.key_size = key_size;
+    attr.value_size = value_size;
+    attr.max_entries = max_entries;
+
+    int fd = sys_bpf(BPF_MAP_CREATE, &attr);
+    if (fd < 0) {
+        syslog(LOG_ALERT, "bpf: failed to create map of type %d with '%s'\n", map_type, strerror(errno));
+    }
+
+    return fd;
+}
+
+/**
+ * @code update_map(fd, key, value);
+ *
+ * @brief adds or updates eBPF map element
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int update_map(int fd, const void *key, const void *value)
+{
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = fd;
+    attr.key = (uint64_t) (uintptr_t) key;
+    attr.value = (uint64_t) (uintptr_t) value;
+    attr.flags = BPF_ANY;
+
+    int rv = sys_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+    if (rv != 0) {
+        syslog(LOG_ALERT, "bpf: failed to update map element with '%s'\n", strerror(errno));
+    }
+
+    return rv;
+}
+
+/**
+ * @code emit(prog, insn);
+ *
+ * @brief appends instruction to eBPF program, instructions beyond EBPF_MAX_INSNS are counted but not stored and
+ *        fail program assembly
+ *
+ * @return none
+ */
+static void emit(ebpf_prog_t *prog, struct bpf_insn insn)
+{
+    if (prog->len < EBPF_MAX_INSNS) {
+        prog->insns[prog->len] = insn;
+        prog->jumps[prog->len] = -1;
+    }
+    prog->len++;
+}
+
+/**
+ * @code emit_ld_map_fd(prog, reg, fd);
+ *
+ * @brief appends wide instruction that loads map pointer into register
+ *
+ * @return none
+ */
+static void emit_ld_map_fd(ebpf_prog_t *prog, int reg, int fd)
+{
+    struct bpf_insn insns[] = {EBPF_LD_MAP_FD(reg, fd)};
+
+    emit(prog, insns[0]);
+    emit(prog, insns[1]);
+}
+
+/**
+ * @code new_label(prog);
+ *
+ * @brief allocates jump label of eBPF program
+ *
+ * @return label
+ */
+static int new_label(ebpf_prog_t *prog)
+{
+    assert(prog->label_nr < EBPF_MAX_LABELS);
+    prog->labels[prog->label_nr] = -1;
+
+    return prog->label_nr++;
+}
+
+/**
+ * @code place_label(prog, label);
+ *
+ * @brief places jump label at the next instruction of eBPF program
+ *
+ * @return none
+ */
+static void place_label(ebpf_prog_t *prog, int label)
+{
+    prog->labels[label] = prog->len;
+}
+
+/**
+ * @code emit_jmp(prog, op, reg, src_reg, imm, label);
+ *
+ * @brief appends conditional jump to label, comparing reg to src_reg if src_reg >= 0, otherwise to imm. BPF_JA op
+ *        is an unconditional jump
+ *
+ * @return none
+ */
+static void emit_jmp(ebpf_prog_t *prog, int op, int reg, int src_reg, int32_t imm, int label)
+{
+    struct bpf_insn insn = {
+        .code = BPF_JMP | op | (src_reg >= 0 ? BPF_X : BPF_K),
+        .dst_reg = reg,
+        .src_reg = src_reg >= 0 ? src_reg : 0,
+        .imm = src_reg >= 0 ? 0 : imm
+    };
+
+    emit(prog, insn);
+    if (prog->len <= EBPF_MAX_INSNS) {
+        prog->jumps[prog->len - 1] = label;
+    }
+}
+
+/**
+ * @code resolve_jumps(prog);
+ *
+ * @brief sets jump offsets of eBPF program once all labels are placed
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int resolve_jumps(ebpf_prog_t *prog)
+{
+    int rv = 0;
+
+    if (prog->len > EBPF_MAX_INSNS) {
+        syslog(LOG_ALERT, "resolve_jumps: eBPF program is too long (%d instructions)\n", prog->len);
+        rv = -1;
+    }
+
+    for (int i = 0; (i < prog->len) && (rv == 0); i++) {
+        if (prog->jumps[i] >= 0) {
+            prog->insns[i].off = prog->labels[prog->jumps[i]] - (i + 1);
+        }
+    }
+
+    return rv;
+}
+
+/**
+ * @code emit_count(prog, slot_reg);
+ *
+ * @brief appends instructions that increment per-CPU counter of (slot, direction, message type). Direction is kept
+ *        in R9 and message type at R10 - 8
+ *
+ * @param prog          eBPF program
+ * @param slot_reg      register holding counter slot
+ * @param drop          label of drop exit
+ *
+ * @return none
+ */
+static void emit_count(ebpf_prog_t *prog, int slot_reg, int drop)
+{
+    emit(prog, EBPF_MOV64_REG(BPF_REG_1, slot_reg));
+    emit(prog, EBPF_ALU64_IMM(BPF_MUL, BPF_REG_1, DHCP_DIR_COUNT));
+    emit(prog, EBPF_ALU64_REG(BPF_ADD, BPF_REG_1, BPF_REG_9));
+    emit(prog, EBPF_ALU64_IMM(BPF_MUL, BPF_REG_1, DHCP_MESSAGE_TYPE_COUNT));
+    emit(prog, EBPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_10, -8));
+    emit(prog, EBPF_ALU64_REG(BPF_ADD, BPF_REG_1, BPF_REG_2));
+    emit(prog, EBPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, -16));
+    emit_ld_map_fd(prog, BPF_REG_1, counters_map_fd);
+    emit(prog, EBPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+    emit(prog, EBPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -16));
+    emit(prog, EBPF_CALL(BPF_FUNC_map_lookup_elem));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 0, drop);
+    emit(prog, EBPF_MOV64_IMM(BPF_REG_1, 1));
+    emit(prog, EBPF_STX_XADD(BPF_DW, BPF_REG_0, BPF_REG_1, 0));
+}
+
+/**
+ * @code build_prog(prog, dhcpv6);
+ *
+ * @brief assembles eBPF socket filter program. It mirrors classify_dhcp_frame()/classify_dhcp_option_53() of device
+ *        module: option 53 of DHCP frames with IPv4 header of 20 bytes is counted on the interface slot and on the
+ *        slot of the VLAN the frame is relayed for. Registers: R6 context, R7 option offset then VLAN slot, R8
+ *        interface map value, R9 direction
+ *
+ * @param prog          eBPF program
+ * @param dhcpv6        pass DHCPv6 frames to the socket
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int build_prog(ebpf_prog_t *prog, uint8_t dhcpv6)
+{
+    int drop = new_label(prog);
+    int not_ipv4 = new_label(prog);
+    int ports_ok = new_label(prog);
+    int dir_done = new_label(prog);
+    int scan = new_label(prog);
+    int found = new_label(prog);
+    int client = new_label(prog);
+    int client_uplink = new_label(prog);
+    int server = new_label(prog);
+    int server_uplink = new_label(prog);
+    int vlan_lookup = new_label(prog);
+    int count = new_label(prog);
+    int pass = new_label(prog);
+
+    // interface of the frame
+    emit(prog, EBPF_MOV64_REG(BPF_REG_6, BPF_REG_1));
+    emit(prog, EBPF_LDX_MEM(BPF_W, BPF_REG_0, BPF_REG_6, offsetof(struct __sk_buff, ifindex)));
+    emit(prog, EBPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, -4));
+    emit_ld_map_fd(prog, BPF_REG_1, intf_map_fd);
+    emit(prog, EBPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+    emit(prog, EBPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4));
+    emit(prog, EBPF_CALL(BPF_FUNC_map_lookup_elem));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 0, drop);
+    emit(prog, EBPF_MOV64_REG(BPF_REG_8, BPF_REG_0));
+
+    // udp and (port 67 or port 68), not fragmented
+    emit(prog, EBPF_LD_ABS(BPF_H, EBPF_ETHER_TYPE_OFFSET));
+    emit_jmp(prog, BPF_JNE, BPF_REG_0, -1, ETHERTYPE_IP, not_ipv4);
+    emit(prog, EBPF_LD_ABS(BPF_B, EBPF_IP_VHL_OFFSET));
+    emit_jmp(prog, BPF_JNE, BPF_REG_0, -1, 0x45, drop);
+    emit(prog, EBPF_LD_ABS(BPF_B, EBPF_IP_PROTO_OFFSET));
+    emit_jmp(prog, BPF_JNE, BPF_REG_0, -1, IPPROTO_UDP, drop);
+    emit(prog, EBPF_LD_ABS(BPF_H, EBPF_IP_FRAG_OFFSET));
+    emit_jmp(prog, BPF_JSET, BPF_REG_0, -1, 0x1fff, drop);
+    emit(prog, EBPF_LD_ABS(BPF_H, EBPF_UDP_SPORT_OFFSET));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 67, ports_ok);
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 68, ports_ok);
+    emit(prog, EBPF_LD_ABS(BPF_H, EBPF_UDP_DPORT_OFFSET));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 67, ports_ok);
+    emit_jmp(prog, BPF_JNE, BPF_REG_0, -1, 68, drop);
+    place_label(prog, ports_ok);
+
+    // frames sent from interface MAC are transmitted
+    emit(prog, EBPF_MOV64_IMM(BPF_REG_9, DHCP_RX));
+    emit(prog, EBPF_LD_ABS(BPF_W, EBPF_ETHER_SHOST_OFFSET));
+    emit(prog, EBPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_8, offsetof(dhcp_ebpf_intf_t, mac_hi)));
+    emit_jmp(prog, BPF_JNE, BPF_REG_0, BPF_REG_1, 0, dir_done);
+    emit(prog, EBPF_LD_ABS(BPF_H, EBPF_ETHER_SHOST_OFFSET + 4));
+    emit(prog, EBPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_8, offsetof(dhcp_ebpf_intf_t, mac_lo)));
+    emit_jmp(prog, BPF_JNE, BPF_REG_0, BPF_REG_1, 0, dir_done);
+    emit(prog, EBPF_MOV64_IMM(BPF_REG_9, DHCP_TX));
+    place_label(prog, dir_done);
+
+    // scan DHCP options for option 53, loads beyond the frame end the program with 0 (drop). The option length is
+    // added without a branch for DHCP Option Padding, so the verifier follows a single path through the loop instead
+    // of twice as many per option. Loads clobber R1-R5, the padding flag and the loop counter are kept on the stack
+    emit(prog, EBPF_MOV64_IMM(BPF_REG_7, 0));
+    emit(prog, EBPF_MOV64_IMM(BPF_REG_0, 0));
+    emit(prog, EBPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -32));
+    place_label(prog, scan);
+    emit(prog, EBPF_LD_IND(BPF_B, BPF_REG_7, EBPF_DHCP_OPTIONS_OFFSET));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 53, found);
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 255, drop);
+    emit(prog, EBPF_ALU64_IMM(BPF_ADD, BPF_REG_0, 255));
+    emit(prog, EBPF_ALU64_IMM(BPF_RSH, BPF_REG_0, 8)); // 0 for DHCP Option Padding, 1 otherwise
+    emit(prog, EBPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -24));
+    emit(prog, EBPF_ALU64_IMM(BPF_ADD, BPF_REG_7, 1));
+    emit(prog, EBPF_LD_IND(BPF_B, BPF_REG_7, EBPF_DHCP_OPTIONS_OFFSET));
+    emit(prog, EBPF_ALU64_IMM(BPF_ADD, BPF_REG_0, 1));
+    emit(prog, EBPF_LDX_MEM(BPF_DW, BPF_REG_1, BPF_REG_10, -24));
+    emit(prog, EBPF_ALU64_REG(BPF_MUL, BPF_REG_0, BPF_REG_1));
+    emit(prog, EBPF_ALU64_REG(BPF_ADD, BPF_REG_7, BPF_REG_0));
+    emit(prog, EBPF_LDX_MEM(BPF_DW, BPF_REG_0, BPF_REG_10, -32));
+    emit(prog, EBPF_ALU64_IMM(BPF_ADD, BPF_REG_0, 1));
+    emit(prog, EBPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_0, -32));
+    emit_jmp(prog, BPF_JLT, BPF_REG_0, -1, EBPF_OPTION_SCAN_MAX, scan);
+    emit_jmp(prog, BPF_JA, 0, -1, 0, drop);
+
+    place_label(prog, found);
+    emit(prog, EBPF_LD_IND(BPF_B, BPF_REG_7, EBPF_DHCP_OPTIONS_OFFSET + 2));
+    emit_jmp(prog, BPF_JGE, BPF_REG_0, -1, DHCP_MESSAGE_TYPE_COUNT, drop);
+    emit(prog, EBPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, -8));
+    emit(prog, EBPF_MOV64_IMM(BPF_REG_1, 1));
+    emit(prog, EBPF_ALU64_REG(BPF_LSH, BPF_REG_1, BPF_REG_0));
+    emit(prog, EBPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_8, offsetof(dhcp_ebpf_intf_t, agg_slot)));
+    emit_jmp(prog, BPF_JSET, BPF_REG_1, -1, EBPF_CLIENT_MSG_MASK, client);
+    emit_jmp(prog, BPF_JSET, BPF_REG_1, -1, EBPF_SERVER_MSG_MASK, server);
+    emit_jmp(prog, BPF_JA, 0, -1, 0, drop);
+
+    // DHCP messages send by client: broadcast on south interface, relayed with giaddr on north interface
+    place_label(prog, client);
+    emit(prog, EBPF_MOV32_IMM(BPF_REG_2, DHCP_EBPF_NO_SLOT));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_7, BPF_REG_2, 0, client_uplink);
+    emit_jmp(prog, BPF_JNE, BPF_REG_9, -1, DHCP_RX, drop);
+    emit(prog, EBPF_LD_ABS(BPF_W, EBPF_IP_DST_OFFSET));
+    emit(prog, EBPF_MOV32_IMM(BPF_REG_2, INADDR_BROADCAST));
+    emit_jmp(prog, BPF_JNE, BPF_REG_0, BPF_REG_2, 0, drop);
+    emit_jmp(prog, BPF_JA, 0, -1, 0, count);
+    place_label(prog, client_uplink);
+    emit_jmp(prog, BPF_JNE, BPF_REG_9, -1, DHCP_TX, drop);
+    emit(prog, EBPF_LD_ABS(BPF_W, EBPF_DHCP_GIADDR_OFFSET));
+    emit_jmp(prog, BPF_JA, 0, -1, 0, vlan_lookup);
+
+    // DHCP messages send by server: sent to VLAN IP on north interface, relayed on south interface
+    place_label(prog, server);
+    emit(prog, EBPF_MOV32_IMM(BPF_REG_2, DHCP_EBPF_NO_SLOT));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_7, BPF_REG_2, 0, server_uplink);
+    emit_jmp(prog, BPF_JNE, BPF_REG_9, -1, DHCP_TX, drop);
+    emit_jmp(prog, BPF_JA, 0, -1, 0, count);
+    place_label(prog, server_uplink);
+    emit_jmp(prog, BPF_JNE, BPF_REG_9, -1, DHCP_RX, drop);
+    emit(prog, EBPF_LD_ABS(BPF_W, EBPF_IP_DST_OFFSET));
+
+    place_label(prog, vlan_lookup);
+    emit(prog, EBPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_0, -12));
+    emit_ld_map_fd(prog, BPF_REG_1, vlan_map_fd);
+    emit(prog, EBPF_MOV64_REG(BPF_REG_2, BPF_REG_10));
+    emit(prog, EBPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -12));
+    emit(prog, EBPF_CALL(BPF_FUNC_map_lookup_elem));
+    emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 0, drop);
+    emit(prog, EBPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_0, 0));
+
+    place_label(prog, count);
+    emit(prog, EBPF_LDX_MEM(BPF_W, BPF_REG_1, BPF_REG_8, offsetof(dhcp_ebpf_intf_t, slot)));
+    emit_count(prog, BPF_REG_1, drop);
+    emit_count(prog, BPF_REG_7, drop);
+
+    place_label(prog, drop);
+    if (!dhcpv6) {
+        place_label(prog, not_ipv4);
+    }
+    emit(prog, EBPF_MOV64_IMM(BPF_REG_0, 0));
+    emit(prog, EBPF_EXIT());
+
+    // ip6 and udp and (port 546 or port 547) is passed to the socket
+    if (dhcpv6) {
+        place_label(prog, not_ipv4);
+        emit_jmp(prog, BPF_JNE, BPF_REG_0, -1, ETHERTYPE_IPV6, drop);
+        emit(prog, EBPF_LD_ABS(BPF_B, EBPF_IP6_NXT_OFFSET));
+        emit_jmp(prog, BPF_JNE, BPF_REG_0, -1, IPPROTO_UDP, drop);
+        emit(prog, EBPF_LD_ABS(BPF_H, EBPF_UDP6_SPORT_OFFSET));
+        emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 546, pass);
+        emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 547, pass);
+        emit(prog, EBPF_LD_ABS(BPF_H, EBPF_UDP6_DPORT_OFFSET));
+        emit_jmp(prog, BPF_JEQ, BPF_REG_0, -1, 546, pass);
+        emit_jmp(prog, BPF_JNE, BPF_REG_0, -1, 547, drop);
+        place_label(prog, pass);
+        emit(prog, EBPF_MOV64_IMM(BPF_REG_0, 0x40000));
+        emit(prog, EBPF_EXIT());
+    }
+
+    return resolve_jumps(prog);
+}
+
+/**
+ * @code load_prog(dhcpv6);
+ *
+ * @brief assembles and loads eBPF socket filter program, verifier log is written to syslog on failure
+ *
+ * @param dhcpv6        pass DHCPv6 frames to the socket
+ *
+ * @return program file descriptor, -1 for failure
+ */
+static int load_prog(uint8_t dhcpv6)
+{
+    int fd = -1;
+    ebpf_prog_t *prog = (ebpf_prog_t *) calloc(1, sizeof(ebpf_prog_t));
+    char *log = (char *) calloc(1, EBPF_LOG_SIZE);
+
+    do {
+        if ((prog == NULL) || (log == NULL)) {
+            syslog(LOG_ALERT, "calloc: failed to allocate memory for eBPF program '%s'\n", strerror(errno));
+            break;
+        }
+
+        if (build_prog(prog, dhcpv6) != 0) {
+            break;
+        }
+
+        union bpf_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+        attr.insns = (uint64_t) (uintptr_t) prog->insns;
+        attr.insn_cnt = prog->len;
+        attr.license = (uint64_t) (uintptr_t) "Apache-2.0";
+
+        // verifier log of the whole program does not fit the log buffer, which fails the load, so it is only
+        // requested to report a failure
+        fd = sys_bpf(BPF_PROG_LOAD, &attr);
+        if (fd < 0) {
+            syslog(LOG_ALERT, "bpf: failed to load program with '%s'\n", strerror(errno));
+            attr.log_buf = (uint64_t) (uintptr_t) log;
+            attr.log_size = EBPF_LOG_SIZE;
+            attr.log_level = 1;
+            int log_fd = sys_bpf(BPF_PROG_LOAD, &attr);
+            if (log_fd >= 0) {
+                close(log_fd);
+            }
+            syslog(LOG_ERR, "%s", log);
+        }
+    } while (0);
+
+    free(log);
+    free(prog);
+
+    return fd;
+}
+
+/**
+ * @code dhcp_ebpf_init(slot_nr, dhcpv6);
+ *
+ * @brief creates eBPF maps and loads eBPF socket filter program
+ */
+int dhcp_ebpf_init(uint32_t slot_nr, uint8_t dhcpv6)
+{
+    int rv = -1;
+    struct rlimit rlim = {.rlim_cur = RLIM_INFINITY, .rlim_max = RLIM_INFINITY};
+
+    do {
+        // kernels before 5.11 charge maps to locked memory limit, later kernels charge them to memory cgroup and
+        // failure to lift the limit is harmless there
+        setrlimit(RLIMIT_MEMLOCK, &rlim);
+
+        cpu_nr = get_possible_cpu_nr();
+        if (cpu_nr < 0) {
+            break;
+        }
+
+        cpu_values = (uint64_t *) calloc(cpu_nr, sizeof(uint64_t));
+        if (cpu_values == NULL) {
+            syslog(LOG_ALERT, "calloc: failed to allocate memory for per-CPU counters '%s'\n", strerror(errno));
+            break;
+        }
+
+        counters_slot_nr = slot_nr;
+        counters_map_fd = create_map(BPF_MAP_TYPE_PERCPU_ARRAY, sizeof(uint32_t), sizeof(uint64_t),
+                                     slot_nr * DHCP_DIR_COUNT * DHCP_MESSAGE_TYPE_COUNT);
+        if (counters_map_fd < 0) {
+            break;
+        }
+
+        intf_map_fd = create_map(BPF_MAP_TYPE_HASH, sizeof(uint32_t), sizeof(dhcp_ebpf_intf_t), slot_nr);
+        if (intf_map_fd < 0) {
+            break;
+        }
+
+        vlan_map_fd = create_map(BPF_MAP_TYPE_HASH, sizeof(uint32_t), sizeof(uint32_t), slot_nr);
+        if (vlan_map_fd < 0) {
+            break;
+        }
+
+        prog_fd = load_prog(dhcpv6);
+        if (prog_fd < 0) {
+            break;
+        }
+
+        rv = 0;
+    } while (0);
+
+    if (rv != 0) {
+        dhcp_ebpf_shutdown();
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_ebpf_add_intf(ifindex, mac, slot, agg_slot);
+ *
+ * @brief adds interface to eBPF interface map
+ */
+int dhcp_ebpf_add_intf(int ifindex, const uint8_t *mac, uint32_t slot, uint32_t agg_slot)
+{
+    uint32_t key = ifindex;
+    dhcp_ebpf_intf_t intf = {
+        .slot = slot,
+        .agg_slot = agg_slot,
+        .mac_hi = (uint32_t) mac[0] << 24 | mac[1] << 16 | mac[2] << 8 | mac[3],
+        .mac_lo = mac[4] << 8 | mac[5]
+    };
+
+    return update_map(intf_map_fd, &key, &intf);
+}
+
+/**
+ * @code dhcp_ebpf_add_vlan(ip, agg_slot);
+ *
+ * @brief adds VLAN IP address to eBPF VLAN map
+ */
+int dhcp_ebpf_add_vlan(in_addr_t ip, uint32_t agg_slot)
+{
+    // packet loads of eBPF program convert to host order
+    uint32_t key = ntohl(ip);
+
+    return update_map(vlan_map_fd, &key, &agg_slot);
+}
+
+/**
+ * @code dhcp_ebpf_attach(sock);
+ *
+ * @brief attaches eBPF program to capture socket
+ */
+int dhcp_ebpf_attach(int sock)
+{
+    int rv = setsockopt(sock, SOL_SOCKET, SO_ATTACH_BPF, &prog_fd, sizeof(prog_fd));
+
+    if (rv != 0) {
+        syslog(LOG_ALERT, "setsockopt: failed to attach eBPF program with '%s'\n", strerror(errno));
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_ebpf_read_counters(slot, counters);
+ *
+ * @brief sums per-CPU DHCP counters of a slot
+ */
+int dhcp_ebpf_read_counters(uint32_t slot, uint64_t counters[][DHCP_MAX_MESSAGE_TYPE_COUNT])
+{
+    int rv = 0;
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = counters_map_fd;
+    attr.value = (uint64_t) (uintptr_t) cpu_values;
+
+    for (int dir = 0; (dir < DHCP_DIR_COUNT) && (rv == 0) && (slot < counters_slot_nr); dir++) {
+        for (int type = 0; type < DHCP_MESSAGE_TYPE_COUNT; type++) {
+            uint32_t key = (slot * DHCP_DIR_COUNT + dir) * DHCP_MESSAGE_TYPE_COUNT + type;
+
+            attr.key = (uint64_t) (uintptr_t) &key;
+            rv = sys_bpf(BPF_MAP_LOOKUP_ELEM, &attr);
+            if (rv != 0) {
+                syslog(LOG_ALERT, "bpf: failed to read DHCP counters with '%s'\n", strerror(errno));
+                break;
+            }
+
+            counters[dir][type] = 0;
+            for (int cpu = 0; cpu < cpu_nr; cpu++) {
+                counters[dir][type] += cpu_values[cpu];
+            }
+        }
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_ebpf_shutdown();
+ *
+ * @brief closes eBPF program and maps
+ */
+void dhcp_ebpf_shutdown()
+{
+    int *fds[] = {&prog_fd, &intf_map_fd, &vlan_map_fd, &counters_map_fd};
+
+    for (size_t i = 0; i < sizeof(fds) / sizeof(*fds); i++) {
+        if (*fds[i] >= 0) {
+            close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+
+    free(cpu_values);
+    cpu_values = NULL;
+    counters_slot_nr = 0;
+}
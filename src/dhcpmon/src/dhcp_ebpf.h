@@ -0,0 +1,90 @@
+/**
+ * @file dhcp_ebpf.h
+ *
+ *  in-kernel DHCP counting (eBPF) module
+ */
+
+#ifndef DHCP_EBPF_H_
+#define DHCP_EBPF_H_
+
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "dhcp_device.h"
+
+/** Counter slot of a north interface, its packets are attributed to VLAN slots by DHCP giaddr/destination IP */
+#define DHCP_EBPF_NO_SLOT UINT32_MAX
+
+/**
+ * @code dhcp_ebpf_init(slot_nr, dhcpv6);
+ *
+ * @brief creates eBPF maps and loads eBPF socket filter program that parses DHCP option 53 in the kernel and
+ *        increments per-CPU DHCP counters of (slot, direction, message type). Every interface and every VLAN has
+ *        its own slot. DHCP frames are counted and dropped by the program, they are never queued to the socket
+ *
+ * @param slot_nr           number of counter slots
+ * @param dhcpv6            pass DHCPv6 frames to the socket, they are parsed in user space
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_ebpf_init(uint32_t slot_nr, uint8_t dhcpv6);
+
+/**
+ * @code dhcp_ebpf_add_intf(ifindex, mac, slot, agg_slot);
+ *
+ * @brief adds interface to eBPF interface map, DHCP frames of interfaces not in the map are dropped uncounted
+ *
+ * @param ifindex           interface index
+ * @param mac               interface MAC address, frames sent from it are counted as transmitted
+ * @param slot              counter slot of the interface
+ * @param agg_slot          counter slot of the VLAN of a south interface, DHCP_EBPF_NO_SLOT for north interfaces
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_ebpf_add_intf(int ifindex, const uint8_t *mac, uint32_t slot, uint32_t agg_slot);
+
+/**
+ * @code dhcp_ebpf_add_vlan(ip, agg_slot);
+ *
+ * @brief adds VLAN IP address to eBPF VLAN map, north interface packets are attributed to the VLAN by it
+ *
+ * @param ip                VLAN IP address
+ * @param agg_slot          counter slot of the VLAN
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_ebpf_add_vlan(in_addr_t ip, uint32_t agg_slot);
+
+/**
+ * @code dhcp_ebpf_attach(sock);
+ *
+ * @brief attaches eBPF program to capture socket
+ *
+ * @param sock              packet socket
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_ebpf_attach(int sock);
+
+/**
+ * @code dhcp_ebpf_read_counters(slot, counters);
+ *
+ * @brief sums per-CPU DHCP counters of a slot
+ *
+ * @param slot              counter slot
+ * @param counters(out)     rx/tx counters of DHCP message types
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_ebpf_read_counters(uint32_t slot, uint64_t counters[][DHCP_MAX_MESSAGE_TYPE_COUNT]);
+
+/**
+ * @code dhcp_ebpf_shutdown();
+ *
+ * @brief closes eBPF program and maps
+ *
+ * @return none
+ */
+void dhcp_ebpf_shutdown();
+
+#endif /* DHCP_EBPF_H_ */
@@ -0,0 +1,189 @@
+/**
+ * @file dhcp_export.c
+ *
+ *  shared memory counter export module
+ */
+
+#define _GNU_SOURCE                 /** asprintf() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "dhcp_export.h"
+#include "dhcp_device.h"
+
+_Static_assert(DHCP_EXPORT_VERSION_COUNT == DHCP_VERSION_COUNT &&
+               DHCP_EXPORT_COUNTERS_COUNT == DHCP_COUNTERS_COUNT &&
+               DHCP_EXPORT_DIR_COUNT == DHCP_DIR_COUNT &&
+               DHCP_EXPORT_MESSAGE_TYPE_COUNT == DHCP_MAX_MESSAGE_TYPE_COUNT,
+               "exported counter matrix does not match device counters");
+_Static_assert(DHCP_EXPORT_PHASE_COUNT == DHCP_XID_PHASE_COUNT &&
+               DHCP_EXPORT_SEGMENT_COUNT == DHCP_LATENCY_SEGMENT_COUNT,
+               "exported latency summaries do not match transaction statistics");
+
+/** mapped counter export file, NULL if counters are not exported */
+static dhcp_export_header_t *export_hdr = NULL;
+/** exported devices, they follow the header */
+static dhcp_export_dev_t *export_devs = NULL;
+/** size of mapped counter export file */
+static size_t export_sz = 0;
+/** path of counter export file */
+static char *export_path = NULL;
+
+/**
+ * @code dhcp_export_init(path, dev_nr);
+ *
+ * @brief creates counter export file and maps it into memory
+ */
+int dhcp_export_init(const char *path, uint32_t dev_nr)
+{
+    int rv = -1;
+    int fd = -1;
+    char *tmp_path = NULL;
+
+    do {
+        export_sz = sizeof(dhcp_export_header_t) + dev_nr * sizeof(dhcp_export_dev_t);
+        export_path = strdup(path);
+        if ((export_path == NULL) || (asprintf(&tmp_path, "%s.tmp", path) < 0)) {
+            syslog(LOG_ALERT, "dhcp_export_init: failed to allocate memory for '%s'\n", path);
+            tmp_path = NULL;
+            break;
+        }
+
+        fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            syslog(LOG_ALERT, "open: failed to create counter export file '%s' with '%s'\n", tmp_path, strerror(errno));
+            break;
+        }
+
+        if (ftruncate(fd, export_sz) != 0) {
+            syslog(LOG_ALERT, "ftruncate: failed to size counter export file with '%s'\n", strerror(errno));
+            break;
+        }
+
+        void *addr = mmap(NULL, export_sz, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            syslog(LOG_ALERT, "mmap: failed to map counter export file with '%s'\n", strerror(errno));
+            break;
+        }
+        export_hdr = (dhcp_export_header_t *) addr;
+        export_devs = (dhcp_export_dev_t *) (export_hdr + 1);
+
+        export_hdr->version = DHCP_EXPORT_VERSION;
+        export_hdr->dev_nr = dev_nr;
+        export_hdr->dev_size = sizeof(dhcp_export_dev_t);
+        export_hdr->pid = getpid();
+        // readers validate magic last
+        __atomic_store_n(&export_hdr->magic, DHCP_EXPORT_MAGIC, __ATOMIC_RELEASE);
+
+        if (rename(tmp_path, path) != 0) {
+            syslog(LOG_ALERT, "rename: failed to rename counter export file to '%s' with '%s'\n",
+                   path, strerror(errno));
+            break;
+        }
+
+        rv = 0;
+    } while (0);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (rv != 0) {
+        if (tmp_path != NULL) {
+            unlink(tmp_path);
+        }
+        if (export_hdr != NULL) {
+            munmap(export_hdr, export_sz);
+            export_hdr = NULL;
+            export_devs = NULL;
+        }
+        free(export_path);
+        export_path = NULL;
+    }
+    free(tmp_path);
+
+    return rv;
+}
+
+/**
+ * @code dhcp_export_begin();
+ *
+ * @brief starts counter export file update
+ */
+void dhcp_export_begin()
+{
+    if (export_hdr != NULL) {
+        __atomic_store_n(&export_hdr->seq, export_hdr->seq + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @code dhcp_export_device(index, name, type, ring_drops, counters, last_sample, latency, unanswered);
+ *
+ * @brief updates exported device
+ */
+void dhcp_export_device(uint32_t index,
+                        const char *name,
+                        dhcp_export_dev_type_t type,
+                        uint64_t ring_drops,
+                        uint64_t counters[][DHCP_EXPORT_COUNTERS_COUNT][DHCP_EXPORT_DIR_COUNT]
+                                         [DHCP_EXPORT_MESSAGE_TYPE_COUNT],
+                        uint64_t last_sample[][DHCP_EXPORT_DIR_COUNT][DHCP_EXPORT_MESSAGE_TYPE_COUNT],
+                        const dhcp_export_latency_t latency[][DHCP_EXPORT_SEGMENT_COUNT],
+                        const uint64_t *unanswered)
+{
+    if ((export_hdr != NULL) && (index < export_hdr->dev_nr)) {
+        dhcp_export_dev_t *dev = &export_devs[index];
+
+        strncpy(dev->name, name, sizeof(dev->name) - 1);
+        dev->type = type;
+        dev->ring_drops = ring_drops;
+        memcpy(dev->counters, counters, sizeof(dev->counters));
+        memcpy(dev->last_sample, last_sample, sizeof(dev->last_sample));
+        if (latency != NULL) {
+            memcpy(dev->latency, latency, sizeof(dev->latency));
+        }
+        if (unanswered != NULL) {
+            memcpy(dev->unanswered, unanswered, sizeof(dev->unanswered));
+        }
+    }
+}
+
+/**
+ * @code dhcp_export_end();
+ *
+ * @brief completes counter export file update
+ */
+void dhcp_export_end()
+{
+    if (export_hdr != NULL) {
+        export_hdr->update_time = time(NULL);
+        __atomic_store_n(&export_hdr->seq, export_hdr->seq + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @code dhcp_export_shutdown();
+ *
+ * @brief unmaps and removes counter export file
+ */
+void dhcp_export_shutdown()
+{
+    if (export_hdr != NULL) {
+        munmap(export_hdr, export_sz);
+        export_hdr = NULL;
+        export_devs = NULL;
+        unlink(export_path);
+    }
+
+    free(export_path);
+    export_path = NULL;
+}
@@ -0,0 +1,150 @@
+/**
+ * @file dhcp_export.h
+ *
+ *  shared memory counter export module. The file layout defined here is shared by dhcpmon and its readers
+ */
+
+#ifndef DHCP_EXPORT_H_
+#define DHCP_EXPORT_H_
+
+#include <stdint.h>
+#include <net/if.h>
+
+/** Conventional path of counter export file */
+#define DHCP_EXPORT_DEFAULT_PATH "/run/dhcpmon.counters"
+
+/** Counter export file magic number, "DHCP" */
+#define DHCP_EXPORT_MAGIC 0x44484350
+/** Counter export file layout version, bumped on any incompatible layout change */
+#define DHCP_EXPORT_VERSION 3
+
+/** Dimensions of exported counter matrix, they match dhcp_device_context_t counters */
+#define DHCP_EXPORT_VERSION_COUNT 2
+#define DHCP_EXPORT_COUNTERS_COUNT 2
+#define DHCP_EXPORT_DIR_COUNT 2
+#define DHCP_EXPORT_MESSAGE_TYPE_COUNT 14
+/** Dimensions of exported latency summaries, they match dhcp_xid_stats_t */
+#define DHCP_EXPORT_PHASE_COUNT 2
+#define DHCP_EXPORT_SEGMENT_COUNT 2
+
+/** exported device type */
+typedef enum
+{
+    DHCP_EXPORT_DEV_SOUTH,          /** south (VLAN) interface */
+    DHCP_EXPORT_DEV_NORTH,          /** north interface */
+    DHCP_EXPORT_DEV_MGMT,           /** mgmt interface */
+    DHCP_EXPORT_DEV_AGGREGATE,      /** VLAN aggregate device */
+
+    DHCP_EXPORT_DEV_TYPE_COUNT
+} dhcp_export_dev_type_t;
+
+/** exported DHCP transaction latency summary, in usec */
+typedef struct
+{
+    uint64_t count;                 /** number of answered transactions */
+    uint64_t p50;                   /** median latency */
+    uint64_t p90;                   /** 90th percentile latency */
+    uint64_t p99;                   /** 99th percentile latency */
+    uint64_t max;                   /** highest latency */
+} dhcp_export_latency_t;
+
+/** exported device counters */
+typedef struct
+{
+    char name[IF_NAMESIZE];         /** device (interface) name */
+    uint32_t type;                  /** dhcp_export_dev_type_t */
+    uint32_t reserved;
+    uint64_t ring_drops;            /** frames dropped by the kernel because capture ring was full */
+    uint64_t counters[DHCP_EXPORT_VERSION_COUNT][DHCP_EXPORT_COUNTERS_COUNT][DHCP_EXPORT_DIR_COUNT]
+                     [DHCP_EXPORT_MESSAGE_TYPE_COUNT];
+                                    /** current/snapshot counters of DHCP and DHCPv6 packets */
+    uint64_t last_sample[DHCP_EXPORT_VERSION_COUNT][DHCP_EXPORT_DIR_COUNT][DHCP_EXPORT_MESSAGE_TYPE_COUNT];
+                                    /** DHCP and DHCPv6 packets counted in the last second */
+    dhcp_export_latency_t latency[DHCP_EXPORT_PHASE_COUNT][DHCP_EXPORT_SEGMENT_COUNT];
+                                    /** Discover-Offer and Request-ACK latency of client and server segments, zero
+                                        unless device is a VLAN aggregate device */
+    uint64_t unanswered[DHCP_EXPORT_PHASE_COUNT];
+                                    /** Discover and Request transactions expired unanswered */
+} dhcp_export_dev_t;
+
+/** counter export file header, it is followed by dev_nr dhcp_export_dev_t of dev_size bytes each */
+typedef struct
+{
+    uint32_t magic;                 /** DHCP_EXPORT_MAGIC */
+    uint32_t version;               /** DHCP_EXPORT_VERSION */
+    uint32_t dev_nr;                /** number of exported devices */
+    uint32_t dev_size;              /** size of exported device */
+    uint64_t seq;                   /** seqlock sequence, it is odd while dhcpmon updates the devices. Readers copy
+                                        the devices and retry unless seq was even and unchanged across the copy */
+    uint64_t update_time;           /** time of last update in seconds since the Epoch */
+    uint32_t pid;                   /** process id of dhcpmon */
+    uint32_t reserved;
+} dhcp_export_header_t;
+
+/**
+ * @code dhcp_export_init(path, dev_nr);
+ *
+ * @brief creates counter export file and maps it into memory. The file is created under a temporary name and
+ *        renamed to path, so readers never map a partially initialized file
+ *
+ * @param path              counter export file path
+ * @param dev_nr            number of exported devices
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_export_init(const char *path, uint32_t dev_nr);
+
+/**
+ * @code dhcp_export_begin();
+ *
+ * @brief starts counter export file update, readers retry until dhcp_export_end() is called
+ *
+ * @return none
+ */
+void dhcp_export_begin();
+
+/**
+ * @code dhcp_export_device(index, name, type, ring_drops, counters, last_sample, latency, unanswered);
+ *
+ * @brief updates exported device, it is to be called between dhcp_export_begin() and dhcp_export_end()
+ *
+ * @param index             index of exported device, less than dev_nr
+ * @param name              device (interface) name
+ * @param type              device type
+ * @param ring_drops        frames dropped by the kernel because capture ring was full
+ * @param counters          current/snapshot counters of DHCP and DHCPv6 packets
+ * @param last_sample       DHCP and DHCPv6 packets counted in the last second
+ * @param latency           DHCP transaction latency summaries, NULL if device does not track transactions
+ * @param unanswered        DHCP transactions expired unanswered, NULL if device does not track transactions
+ *
+ * @return none
+ */
+void dhcp_export_device(uint32_t index,
+                        const char *name,
+                        dhcp_export_dev_type_t type,
+                        uint64_t ring_drops,
+                        uint64_t counters[][DHCP_EXPORT_COUNTERS_COUNT][DHCP_EXPORT_DIR_COUNT]
+                                         [DHCP_EXPORT_MESSAGE_TYPE_COUNT],
+                        uint64_t last_sample[][DHCP_EXPORT_DIR_COUNT][DHCP_EXPORT_MESSAGE_TYPE_COUNT],
+                        const dhcp_export_latency_t latency[][DHCP_EXPORT_SEGMENT_COUNT],
+                        const uint64_t *unanswered);
+
+/**
+ * @code dhcp_export_end();
+ *
+ * @brief completes counter export file update
+ *
+ * @return none
+ */
+void dhcp_export_end();
+
+/**
+ * @code dhcp_export_shutdown();
+ *
+ * @brief unmaps and removes counter export file
+ *
+ * @return none
+ */
+void dhcp_export_shutdown();
+
+#endif /* DHCP_EXPORT_H_ */
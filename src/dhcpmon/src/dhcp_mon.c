@@ -20,18 +20,25 @@
 typedef struct
 {
     dhcp_mon_check_t check_type;                /** check type */
-    dhcp_device_context_t* (*get_context)();    /** functor to a device context accessor function */
+    dhcp_version_t version;                     /** DHCP version whose counters are checked */
+    dhcp_device_context_t *context;             /** device context the check is run against */
     int count;                                  /** count in the number of unhealthy checks */
     const char *msg;                            /** message to be printed if unhealthy state is determined */
 } dhcp_mon_state_t;
 
-/** window_interval_sec monitoring window for dhcp relay health checks */
+/** window_interval_sec monitoring window for dhcp relay health checks, it slides every second */
 static int window_interval_sec = 18;
+/** check_interval_sec interval of dhcp relay health checks over the sliding window */
+static int check_interval_sec = 1;
+/** sample_interval_sec interval of counter samples the sliding window is made of */
+static const int sample_interval_sec = 1;
+/** sample_count number of counter samples taken */
+static uint64_t sample_count = 0;
 /** dhcp_unhealthy_max_count max count of consecutive unhealthy statuses before reporting to syslog */
 static int dhcp_unhealthy_max_count = 10;
 /** libevent base struct */
 static struct event_base *base;
-/** libevent timeout event struct */
+/** libevent counter sample timer event struct */
 static struct event *ev_timeout = NULL;
 /** libevent SIGINT signal event struct */
 static struct event *ev_sigint;
@@ -39,23 +46,31 @@ static struct event *ev_sigint;
 static struct event *ev_sigterm;
 /** libevent SIGUSR1 signal event struct */
 static struct event *ev_sigusr1;
-
-/** DHCP monitor state data for aggregate device for mgmt device */
-static dhcp_mon_state_t state_data[] = {
-    [0] = {
-        .check_type = DHCP_MON_CHECK_POSITIVE,
-        .get_context = dhcp_devman_get_agg_dev,
-        .count = 0,
-        .msg = "dhcpmon detected disparity in DHCP Relay behavior. Duration: %d (sec) for vlan: '%s'\n"
-    },
-    [1] = {
-        .check_type = DHCP_MON_CHECK_NEGATIVE,
-        .get_context = dhcp_devman_get_mgmt_dev,
-        .count = 0,
-        .msg = "dhcpmon detected DHCP packets traveling through mgmt interface (please check BGP routes.)"
-               " Duration: %d (sec) for intf: '%s'\n"
-    }
-};
+/** libevent counter export timer event struct, NULL if counters are not exported */
+static struct event *ev_export = NULL;
+/** export_interval_sec interval of counter export */
+static const int export_interval_sec = 1;
+
+/** DHCP monitor state data, one for every VLAN aggregate device followed by one for mgmt device, per monitored
+ *  DHCP version */
+static dhcp_mon_state_t *state_data = NULL;
+/** number of DHCP monitor state data entries */
+static uint32_t state_data_nr = 0;
+
+/** message printed when DHCP relay of a VLAN is unhealthy */
+static const char *positive_check_msg =
+    "dhcpmon detected disparity in DHCP Relay behavior. Duration: %d (sec) for vlan: '%s'\n";
+/** message printed when DHCPv6 relay of a VLAN is unhealthy */
+static const char *positive_check_v6_msg =
+    "dhcpmon detected disparity in DHCPv6 Relay behavior. Duration: %d (sec) for vlan: '%s'\n";
+/** message printed when DHCP packets travel through mgmt interface */
+static const char *negative_check_msg =
+    "dhcpmon detected DHCP packets traveling through mgmt interface (please check BGP routes.)"
+    " Duration: %d (sec) for intf: '%s'\n";
+/** message printed when DHCPv6 packets travel through mgmt interface */
+static const char *negative_check_v6_msg =
+    "dhcpmon detected DHCPv6 packets traveling through mgmt interface (please check BGP routes.)"
+    " Duration: %d (sec) for intf: '%s'\n";
 
 /**
  * @code signal_callback(fd, event, arg);
@@ -71,6 +86,7 @@ static dhcp_mon_state_t state_data[] = {
 static void signal_callback(evutil_socket_t fd, short event, void *arg)
 {
     syslog(LOG_ALERT, "Received signal: '%s'\n", strsignal(fd));
+    dhcp_devman_collect_counters();
     dhcp_devman_print_status(NULL, DHCP_COUNTERS_CURRENT);
     if ((fd == SIGTERM) || (fd == SIGINT)) {
         dhcp_mon_stop();
@@ -88,14 +104,15 @@ static void signal_callback(evutil_socket_t fd, short event, void *arg)
  */
 static void check_dhcp_relay_health(dhcp_mon_state_t *state_data)
 {
-    dhcp_device_context_t *context = state_data->get_context();
-    dhcp_mon_status_t dhcp_mon_status = dhcp_devman_get_status(state_data->check_type, context);
+    dhcp_device_context_t *context = state_data->context;
+    dhcp_mon_status_t dhcp_mon_status = dhcp_devman_get_status(state_data->check_type, state_data->version, context);
 
     switch (dhcp_mon_status)
     {
     case DHCP_MON_STATUS_UNHEALTHY:
         if (++state_data->count > dhcp_unhealthy_max_count) {
-            syslog(LOG_ALERT, state_data->msg, state_data->count * window_interval_sec, context->intf);
+            syslog(LOG_ALERT, state_data->msg, window_interval_sec + (state_data->count - 1) * check_interval_sec,
+                   context->intf);
             dhcp_devman_print_status(context, DHCP_COUNTERS_SNAPSHOT);
             dhcp_devman_print_status(context, DHCP_COUNTERS_CURRENT);
         }
@@ -117,7 +134,9 @@ static void check_dhcp_relay_health(dhcp_mon_state_t *state_data)
 /**
  * @code timeout_callback(fd, event, arg);
  *
- * @brief periodic timer call back
+ * @brief periodic counter sample timer call back. Every second, counters are sampled, the window slides by one
+ *        second and unanswered DHCP transactions expire, every check_interval_sec seconds health is checked over the
+ *        window
  *
  * @param fd        libevent socket
  * @param event     event triggered
@@ -127,26 +146,102 @@ static void check_dhcp_relay_health(dhcp_mon_state_t *state_data)
  */
 static void timeout_callback(evutil_socket_t fd, short event, void *arg)
 {
-    for (uint8_t i = 0; i < sizeof(state_data) / sizeof(*state_data); i++) {
-        check_dhcp_relay_health(&state_data[i]);
+    dhcp_devman_collect_counters();
+    dhcp_devman_update_snapshot(NULL);
+    dhcp_devman_expire_transactions();
+
+    if (++sample_count % (check_interval_sec / sample_interval_sec) == 0) {
+        for (uint32_t i = 0; i < state_data_nr; i++) {
+            check_dhcp_relay_health(&state_data[i]);
+        }
     }
+}
 
-    dhcp_devman_update_snapshot(NULL);
+/**
+ * @code export_callback(fd, event, arg);
+ *
+ * @brief periodic counter export timer call back
+ *
+ * @param fd        libevent socket
+ * @param event     event triggered
+ * @param arg       pointer user provided context (libevent base)
+ *
+ * @return none
+ */
+static void export_callback(evutil_socket_t fd, short event, void *arg)
+{
+    dhcp_devman_collect_counters();
+    dhcp_devman_export_counters();
 }
 
 /**
- * @code dhcp_mon_init(window_sec, max_count);
+ * @code init_state_data(config);
+ *
+ * @brief allocates DHCP monitor state data, a positive check for every VLAN aggregate device and a negative check
+ *        for mgmt device, for DHCP and, if enabled, for DHCPv6
  *
- * initializes event base and periodic timer event that continuously collects dhcp relay health status every window_sec
- * seconds. It also writes to syslog when dhcp relay has been unhealthy for consecutive max_count checks.
+ * @param config    capture configuration
  *
+ * @return 0 on success, otherwise for failure
  */
-int dhcp_mon_init(int window_sec, int max_count)
+static int init_state_data(const dhcp_capture_config_t *config)
 {
     int rv = -1;
+    uint32_t agg_dev_nr = dhcp_devman_get_agg_dev_nr();
+    uint32_t version_nr = config->dhcpv6 ? DHCP_VERSION_COUNT : 1;
+    static const char **positive_msgs[DHCP_VERSION_COUNT] = {&positive_check_msg, &positive_check_v6_msg};
+    static const char **negative_msgs[DHCP_VERSION_COUNT] = {&negative_check_msg, &negative_check_v6_msg};
 
     do {
+        state_data = (dhcp_mon_state_t *) calloc((agg_dev_nr + 1) * version_nr, sizeof(dhcp_mon_state_t));
+        if (state_data == NULL) {
+            syslog(LOG_ERR, "Could not allocate DHCP monitor state data!\n");
+            break;
+        }
+
+        for (uint32_t version = 0; version < version_nr; version++) {
+            for (uint32_t i = 0; i < agg_dev_nr; i++) {
+                state_data[state_data_nr].check_type = DHCP_MON_CHECK_POSITIVE;
+                state_data[state_data_nr].version = version;
+                state_data[state_data_nr].context = dhcp_devman_get_agg_dev(i);
+                state_data[state_data_nr].msg = *positive_msgs[version];
+                state_data_nr++;
+            }
+        }
+        for (uint32_t version = 0; version < version_nr; version++) {
+            state_data[state_data_nr].check_type = DHCP_MON_CHECK_NEGATIVE;
+            state_data[state_data_nr].version = version;
+            state_data[state_data_nr].context = dhcp_devman_get_mgmt_dev();
+            state_data[state_data_nr].msg = *negative_msgs[version];
+            state_data_nr++;
+        }
+
+        rv = 0;
+    } while (0);
+
+    return rv;
+}
+
+/**
+ * @code dhcp_mon_init(window_sec, check_sec, max_count, export_path);
+ *
+ * initializes event base and periodic timer event that continuously collects dhcp relay health status over a sliding
+ * window of window_sec seconds every check_sec seconds. It also writes to syslog when dhcp relay has been unhealthy
+ * for consecutive max_count checks.
+ *
+ */
+int dhcp_mon_init(int window_sec, int check_sec, int max_count, const char *export_path)
+{
+    int rv = -1;
+
+    do {
+        if ((window_sec < sample_interval_sec) || (check_sec < sample_interval_sec)) {
+            syslog(LOG_ERR, "Health check window and interval must be at least %d sec!\n", sample_interval_sec);
+            break;
+        }
+
         window_interval_sec = window_sec;
+        check_interval_sec = check_sec;
         dhcp_unhealthy_max_count = max_count;
 
         base = event_base_new();
@@ -179,6 +274,19 @@ int dhcp_mon_init(int window_sec, int max_count)
             break;
         }
 
+        if (export_path != NULL) {
+            if (dhcp_devman_export_init(export_path) != 0) {
+                syslog(LOG_ERR, "Could not create counter export file!\n");
+                break;
+            }
+
+            ev_export = event_new(base, -1, EV_PERSIST, export_callback, base);
+            if (ev_export == NULL) {
+                syslog(LOG_ERR, "Could not create libevent counter export timer!\n");
+                break;
+            }
+        }
+
         rv = 0;
     } while (0);
 
@@ -202,21 +310,39 @@ void dhcp_mon_shutdown()
     event_free(ev_sigterm);
     event_free(ev_sigusr1);
 
+    if (ev_export != NULL) {
+        event_del(ev_export);
+        event_free(ev_export);
+        ev_export = NULL;
+    }
+
     event_base_free(base);
+
+    free(state_data);
+    state_data = NULL;
+    state_data_nr = 0;
 }
 
 /**
- * @code dhcp_mon_start(snaplen);
+ * @code dhcp_mon_start(config);
  *
  * @brief start monitoring DHCP Relay
  */
-int dhcp_mon_start(size_t snaplen)
+int dhcp_mon_start(const dhcp_capture_config_t *config)
 {
     int rv = -1;
 
     do
     {
-        if (dhcp_devman_start_capture(snaplen, base) != 0) {
+        if (init_state_data(config) != 0) {
+            break;
+        }
+
+        if (dhcp_devman_init_window(window_interval_sec / sample_interval_sec) != 0) {
+            break;
+        }
+
+        if (dhcp_devman_start_capture(config, base) != 0) {
             break;
         }
 
@@ -235,12 +361,18 @@ int dhcp_mon_start(size_t snaplen)
             break;
         }
 
-        struct timeval event_time = {.tv_sec = window_interval_sec, .tv_usec = 0};
+        struct timeval event_time = {.tv_sec = sample_interval_sec, .tv_usec = 0};
         if (evtimer_add(ev_timeout, &event_time) != 0) {
             syslog(LOG_ERR, "Could not add event timer to libevent!\n");
             break;
         }
 
+        struct timeval export_time = {.tv_sec = export_interval_sec, .tv_usec = 0};
+        if ((ev_export != NULL) && (evtimer_add(ev_export, &export_time) != 0)) {
+            syslog(LOG_ERR, "Could not add counter export timer to libevent!\n");
+            break;
+        }
+
         if (event_base_dispatch(base) != 0) {
             syslog(LOG_ERR, "Could not start libevent dispatching loop!\n");
             break;
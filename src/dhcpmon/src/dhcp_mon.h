@@ -8,19 +8,23 @@
 #ifndef DHCP_MON_H_
 #define DHCP_MON_H_
 
+#include "dhcp_device.h"
+
 /**
- * @code dhcp_mon_init(window_ssec, max_count);
+ * @code dhcp_mon_init(window_sec, check_sec, max_count, export_path);
  *
- * @brief initializes event base and periodic timer event that continuously collects dhcp relay health status every
- *        window_sec seconds. It also writes to syslog when dhcp relay has been unhealthy for consecutive max_count
- *        checks.
+ * @brief initializes event base and periodic timer event that samples counters every second and checks dhcp relay
+ *        health over the last window_sec seconds every check_sec seconds. It also writes to syslog when dhcp relay has
+ *        been unhealthy for consecutive max_count checks.
  *
- * @param window_sec time interval between health checks
+ * @param window_sec length of sliding window health is checked over
+ * @param check_sec time interval between health checks, window_sec checks consecutive non-overlapping windows
  * @param max_count max count of consecutive unhealthy statuses before reporting to syslog
+ * @param export_path file counters are exported to every second, NULL to not export counters
  *
  * @return 0 upon success, otherwise upon failure
  */
-int dhcp_mon_init(int window_sec, int max_count);
+int dhcp_mon_init(int window_sec, int check_sec, int max_count, const char *export_path);
 
 /**
  * @code dhcp_mon_shutdown();
@@ -32,15 +36,15 @@ int dhcp_mon_init(int window_sec, int max_count);
 void dhcp_mon_shutdown();
 
 /**
- * @code dhcp_mon_start(snaplen);
+ * @code dhcp_mon_start(config);
  *
  * @brief start monitoring DHCP Relay
  *
- * @param snaplen       packet capture length
+ * @param config        packet capture configuration
  *
  * @return 0 upon success, otherwise upon failure
  */
-int dhcp_mon_start(size_t snaplen);
+int dhcp_mon_start(const dhcp_capture_config_t *config);
 
 /**
  * @code dhcp_mon_stop();
@@ -0,0 +1,290 @@
+/**
+ * @file dhcp_pcap.c
+ *
+ *  pcap capture file module
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <byteswap.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <sys/stat.h>
+
+#include "dhcp_pcap.h"
+
+/** pcap file magic number of files with microsecond timestamps */
+#define PCAP_MAGIC_USEC 0xa1b2c3d4
+/** pcap file magic number of files with nanosecond timestamps */
+#define PCAP_MAGIC_NSEC 0xa1b23c4d
+/** Nanoseconds per microsecond */
+#define NSEC_PER_USEC 1000ULL
+/** Nanoseconds per second */
+#define NSEC_PER_SEC 1000000000ULL
+/** pcap file format version written */
+#define PCAP_VERSION_MAJOR 2
+#define PCAP_VERSION_MINOR 4
+
+/** Size of Linux cooked capture v2 header */
+#define SLL2_HDR_LEN 20
+/** Offset of protocol (ether type) in Linux cooked capture v2 header */
+#define SLL2_PROTOCOL_OFFSET 0
+/** Offset of interface index in Linux cooked capture v2 header */
+#define SLL2_IFINDEX_OFFSET 4
+/** Offset of link-layer address in Linux cooked capture v2 header */
+#define SLL2_ADDR_OFFSET 12
+
+/** pcap file header */
+typedef struct
+{
+    uint32_t magic;                 /** PCAP_MAGIC_USEC or PCAP_MAGIC_NSEC, byte swapped if written on a host of
+                                        other endianness */
+    uint16_t version_major;         /** PCAP_VERSION_MAJOR */
+    uint16_t version_minor;         /** PCAP_VERSION_MINOR */
+    int32_t thiszone;               /** unused, 0 */
+    uint32_t sigfigs;               /** unused, 0 */
+    uint32_t snaplen;               /** max captured length of frames */
+    uint32_t linktype;              /** link type of frames */
+} pcap_file_hdr_t;
+
+/** pcap frame record header */
+typedef struct
+{
+    uint32_t ts_sec;                /** timestamp seconds */
+    uint32_t ts_frac;               /** timestamp microseconds or nanoseconds */
+    uint32_t incl_len;              /** captured length of frame */
+    uint32_t orig_len;              /** length of frame on the wire */
+} pcap_rec_hdr_t;
+
+/**
+ * @code read_file(path, size);
+ *
+ * @brief reads a whole file into memory
+ *
+ * @param path              file path
+ * @param size(out)         file size
+ *
+ * @return buffer holding the file, NULL on failure
+ */
+static uint8_t* read_file(const char *path, size_t *size)
+{
+    uint8_t *buffer = NULL;
+    int fd = -1;
+    struct stat st;
+
+    do {
+        fd = open(path, O_RDONLY);
+        if ((fd < 0) || (fstat(fd, &st) != 0)) {
+            syslog(LOG_ALERT, "open: failed to open pcap file '%s' with '%s'\n", path, strerror(errno));
+            break;
+        }
+
+        buffer = (uint8_t *) malloc(st.st_size > 0 ? st.st_size : 1);
+        if (buffer == NULL) {
+            syslog(LOG_ALERT, "malloc: failed to allocate memory for pcap file '%s'\n", path);
+            break;
+        }
+
+        size_t offset = 0;
+        while (offset < (size_t) st.st_size) {
+            ssize_t sz = read(fd, buffer + offset, st.st_size - offset);
+            if (sz <= 0) {
+                break;
+            }
+            offset += sz;
+        }
+        if (offset < (size_t) st.st_size) {
+            syslog(LOG_ALERT, "read: failed to read pcap file '%s' with '%s'\n", path, strerror(errno));
+            free(buffer);
+            buffer = NULL;
+            break;
+        }
+
+        *size = st.st_size;
+    } while (0);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return buffer;
+}
+
+/**
+ * @code sll2_to_ether(frame, ifindex);
+ *
+ * @brief rewrites Linux cooked capture v2 header in place into an Ethernet header whose source address is the
+ *        link-layer address of the frame. Destination address is not recorded and is left zero
+ *
+ * @param frame             Linux cooked capture v2 frame
+ * @param ifindex(out)      index of interface the frame was captured on
+ *
+ * @return Ethernet frame, it starts SLL2_HDR_LEN - ETHER_HDR_LEN bytes into frame
+ */
+static uint8_t* sll2_to_ether(uint8_t *frame, int *ifindex)
+{
+    uint8_t *ether_frame = frame + SLL2_HDR_LEN - ETHER_HDR_LEN;
+    uint32_t sll_ifindex;
+    uint16_t protocol;
+    uint8_t addr[ETHER_ADDR_LEN];
+    struct ether_header ethhdr;
+
+    memcpy(&protocol, frame + SLL2_PROTOCOL_OFFSET, sizeof(protocol));
+    memcpy(&sll_ifindex, frame + SLL2_IFINDEX_OFFSET, sizeof(sll_ifindex));
+    memcpy(addr, frame + SLL2_ADDR_OFFSET, sizeof(addr));
+
+    memset(ethhdr.ether_dhost, 0, sizeof(ethhdr.ether_dhost));
+    memcpy(ethhdr.ether_shost, addr, sizeof(ethhdr.ether_shost));
+    ethhdr.ether_type = protocol;
+    memcpy(ether_frame, &ethhdr, sizeof(ethhdr));
+
+    *ifindex = ntohl(sll_ifindex);
+
+    return ether_frame;
+}
+
+/**
+ * @code dhcp_pcap_load(path, pcap);
+ *
+ * @brief loads all frames of a pcap file into memory
+ */
+int dhcp_pcap_load(const char *path, dhcp_pcap_t *pcap)
+{
+    int rv = -1;
+    size_t size = 0;
+    uint32_t frames_sz = 0;
+
+    memset(pcap, 0, sizeof(*pcap));
+
+    do {
+        pcap->buffer = read_file(path, &size);
+        if (pcap->buffer == NULL) {
+            break;
+        }
+
+        pcap_file_hdr_t hdr;
+        if (size < sizeof(hdr)) {
+            syslog(LOG_ALERT, "dhcp_pcap_load: '%s' is not a pcap file\n", path);
+            break;
+        }
+        memcpy(&hdr, pcap->buffer, sizeof(hdr));
+
+        int swapped = (hdr.magic == bswap_32(PCAP_MAGIC_USEC)) || (hdr.magic == bswap_32(PCAP_MAGIC_NSEC));
+        int nsec = (hdr.magic == PCAP_MAGIC_NSEC) || (hdr.magic == bswap_32(PCAP_MAGIC_NSEC));
+        if (!swapped && (hdr.magic != PCAP_MAGIC_USEC) && (hdr.magic != PCAP_MAGIC_NSEC)) {
+            syslog(LOG_ALERT, "dhcp_pcap_load: '%s' is not a pcap file, pcapng files are to be converted first\n",
+                   path);
+            break;
+        }
+
+        pcap->linktype = swapped ? bswap_32(hdr.linktype) : hdr.linktype;
+        if ((pcap->linktype != DHCP_PCAP_LINKTYPE_ETHERNET) && (pcap->linktype != DHCP_PCAP_LINKTYPE_LINUX_SLL2)) {
+            syslog(LOG_ALERT, "dhcp_pcap_load: unsupported link type %u of '%s'\n", pcap->linktype, path);
+            break;
+        }
+
+        size_t offset = sizeof(hdr);
+        rv = 0;
+        while ((rv == 0) && (offset + sizeof(pcap_rec_hdr_t) <= size)) {
+            pcap_rec_hdr_t rec;
+            memcpy(&rec, pcap->buffer + offset, sizeof(rec));
+            offset += sizeof(rec);
+
+            uint32_t len = swapped ? bswap_32(rec.incl_len) : rec.incl_len;
+            if (len > size - offset) {
+                syslog(LOG_WARNING, "dhcp_pcap_load: last frame of '%s' is truncated\n", path);
+                break;
+            }
+
+            uint8_t *frame = pcap->buffer + offset;
+            int ifindex = 0;
+            offset += len;
+
+            if (pcap->linktype == DHCP_PCAP_LINKTYPE_LINUX_SLL2) {
+                if (len < SLL2_HDR_LEN) {
+                    continue;
+                }
+                frame = sll2_to_ether(frame, &ifindex);
+                len -= SLL2_HDR_LEN - ETHER_HDR_LEN;
+            }
+
+            if (pcap->frame_nr == frames_sz) {
+                uint32_t sz = frames_sz ? 2 * frames_sz : 1024;
+                dhcp_pcap_frame_t *frames = (dhcp_pcap_frame_t *) realloc(pcap->frames, sz * sizeof(*frames));
+
+                if (frames == NULL) {
+                    syslog(LOG_ALERT, "realloc: failed to allocate memory for frames of '%s'\n", path);
+                    rv = -1;
+                    continue;
+                }
+                pcap->frames = frames;
+                frames_sz = sz;
+            }
+
+            pcap->frames[pcap->frame_nr].data = frame;
+            pcap->frames[pcap->frame_nr].len = len;
+            pcap->frames[pcap->frame_nr].ifindex = ifindex;
+            uint64_t ts_sec = swapped ? bswap_32(rec.ts_sec) : rec.ts_sec;
+            uint64_t ts_frac = swapped ? bswap_32(rec.ts_frac) : rec.ts_frac;
+            pcap->frames[pcap->frame_nr].time_ns = ts_sec * NSEC_PER_SEC + (nsec ? ts_frac : ts_frac * NSEC_PER_USEC);
+            pcap->frame_nr++;
+        }
+    } while (0);
+
+    if (rv != 0) {
+        dhcp_pcap_free(pcap);
+    }
+
+    return rv;
+}
+
+/**
+ * @code dhcp_pcap_free(pcap);
+ *
+ * @brief releases frames loaded by dhcp_pcap_load()
+ */
+void dhcp_pcap_free(dhcp_pcap_t *pcap)
+{
+    free(pcap->frames);
+    free(pcap->buffer);
+    memset(pcap, 0, sizeof(*pcap));
+}
+
+/**
+ * @code dhcp_pcap_write_header(file, snaplen);
+ *
+ * @brief writes header of a pcap file of Ethernet frames
+ */
+int dhcp_pcap_write_header(FILE *file, uint32_t snaplen)
+{
+    pcap_file_hdr_t hdr = {
+        .magic = PCAP_MAGIC_USEC,
+        .version_major = PCAP_VERSION_MAJOR,
+        .version_minor = PCAP_VERSION_MINOR,
+        .snaplen = snaplen,
+        .linktype = DHCP_PCAP_LINKTYPE_ETHERNET
+    };
+
+    return fwrite(&hdr, sizeof(hdr), 1, file) == 1 ? 0 : -1;
+}
+
+/**
+ * @code dhcp_pcap_write_frame(file, frame, frame_sz, time_ns);
+ *
+ * @brief appends Ethernet frame to a pcap file
+ */
+int dhcp_pcap_write_frame(FILE *file, const uint8_t *frame, uint32_t frame_sz, uint64_t time_ns)
+{
+    pcap_rec_hdr_t rec = {
+        .ts_sec = time_ns / NSEC_PER_SEC,
+        .ts_frac = (time_ns % NSEC_PER_SEC) / NSEC_PER_USEC,
+        .incl_len = frame_sz,
+        .orig_len = frame_sz
+    };
+
+    return (fwrite(&rec, sizeof(rec), 1, file) == 1) && (fwrite(frame, frame_sz, 1, file) == 1) ? 0 : -1;
+}
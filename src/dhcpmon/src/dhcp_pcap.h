@@ -0,0 +1,88 @@
+/**
+ * @file dhcp_pcap.h
+ *
+ *  pcap capture file module
+ */
+
+#ifndef DHCP_PCAP_H_
+#define DHCP_PCAP_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/** pcap link type of Ethernet frames */
+#define DHCP_PCAP_LINKTYPE_ETHERNET 1
+/** pcap link type of Linux "cooked" capture v2 frames, written by tcpdump -i any */
+#define DHCP_PCAP_LINKTYPE_LINUX_SLL2 276
+
+/** frame loaded from a pcap file */
+typedef struct
+{
+    const uint8_t *data;            /** Ethernet frame */
+    uint32_t len;                   /** captured length of Ethernet frame */
+    int ifindex;                    /** index of interface the frame was captured on, 0 if the file does not
+                                        record it */
+    uint64_t time_ns;               /** capture time of the frame in nanoseconds */
+} dhcp_pcap_frame_t;
+
+/** frames loaded from a pcap file */
+typedef struct
+{
+    dhcp_pcap_frame_t *frames;      /** loaded frames */
+    uint32_t frame_nr;              /** number of loaded frames */
+    uint32_t linktype;              /** pcap link type of the file */
+    uint8_t *buffer;                /** buffer holding frame data */
+} dhcp_pcap_t;
+
+/**
+ * @code dhcp_pcap_load(path, pcap);
+ *
+ * @brief loads all frames of a pcap file into memory. Ethernet frames are loaded as they are, Linux cooked capture
+ *        v2 frames are loaded with an Ethernet header rebuilt from their source link-layer address and protocol, and
+ *        carry the index of the interface they were captured on
+ *
+ * @param path              pcap file path
+ * @param pcap(out)         loaded frames, to be released with dhcp_pcap_free()
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_pcap_load(const char *path, dhcp_pcap_t *pcap);
+
+/**
+ * @code dhcp_pcap_free(pcap);
+ *
+ * @brief releases frames loaded by dhcp_pcap_load()
+ *
+ * @param pcap              loaded frames
+ *
+ * @return none
+ */
+void dhcp_pcap_free(dhcp_pcap_t *pcap);
+
+/**
+ * @code dhcp_pcap_write_header(file, snaplen);
+ *
+ * @brief writes header of a pcap file of Ethernet frames
+ *
+ * @param file              pcap file
+ * @param snaplen           max captured length of frames in the file
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_pcap_write_header(FILE *file, uint32_t snaplen);
+
+/**
+ * @code dhcp_pcap_write_frame(file, frame, frame_sz, time_ns);
+ *
+ * @brief appends Ethernet frame to a pcap file
+ *
+ * @param file              pcap file
+ * @param frame             Ethernet frame
+ * @param frame_sz          length of Ethernet frame
+ * @param time_ns           capture time of the frame in nanoseconds, written with microsecond precision
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_pcap_write_frame(FILE *file, const uint8_t *frame, uint32_t frame_sz, uint64_t time_ns);
+
+#endif /* DHCP_PCAP_H_ */
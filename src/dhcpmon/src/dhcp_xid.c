@@ -0,0 +1,458 @@
+/**
+ * @file dhcp_xid.c
+ *
+ *  DHCP transaction (xid) latency tracking module
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "dhcp_xid.h"
+
+/** Nil index of transaction pool and index table */
+#define XID_NIL UINT32_MAX
+/** Number of timer wheel slots, one per second. It exceeds transaction timeout so a slot only holds transactions
+ *  expiring the second it is drained */
+#define XID_WHEEL_SLOTS 16
+/** Nanoseconds per second */
+#define NSEC_PER_SEC 1000000000ULL
+/** Nanoseconds per microsecond */
+#define NSEC_PER_USEC 1000ULL
+
+_Static_assert(DHCP_XID_TIMEOUT_SEC < XID_WHEEL_SLOTS, "transaction timeout must be shorter than timer wheel");
+
+/** transaction events that are timestamped */
+typedef enum
+{
+    XID_EVENT_CLIENT_RX,        /** client message received on south interface */
+    XID_EVENT_RELAY_TX,         /** client message relayed on north interface */
+    XID_EVENT_SERVER_RX,        /** answer received on north interface */
+
+    XID_EVENT_COUNT
+} xid_event_t;
+
+/** tracked DHCP transaction */
+typedef struct
+{
+    uint32_t xid;                       /** DHCP transaction id */
+    uint8_t chaddr[ETHER_ADDR_LEN];     /** DHCP client hardware address */
+    uint8_t phase;                      /** dhcp_xid_phase_t */
+    uint8_t seen;                       /** bitmap of timestamped xid_event_t */
+    dhcp_device_context_t *agg_dev;     /** VLAN aggregate device of transaction */
+    uint64_t time_ns[XID_EVENT_COUNT];  /** event timestamps */
+    uint64_t expire_sec;                /** time the transaction expires at */
+    uint32_t prev;                      /** previous transaction in timer wheel slot, or free list */
+    uint32_t next;                      /** next transaction in timer wheel slot, or free list */
+} xid_entry_t;
+
+/** transaction pool, its entries never move, so timer wheel links stay valid */
+static xid_entry_t *xid_pool = NULL;
+/** number of entries in transaction pool */
+static uint32_t xid_capacity = 0;
+/** head of free transaction list */
+static uint32_t xid_free = XID_NIL;
+/** open-addressed index of transactions by (xid, chaddr), twice the pool size so load factor stays at most 1/2 */
+static uint32_t *xid_index = NULL;
+/** mask of xid_index size, a power of two */
+static uint32_t xid_index_mask = 0;
+/** timer wheel slots, heads of doubly linked transaction lists */
+static uint32_t xid_wheel[XID_WHEEL_SLOTS];
+/** time in seconds timer wheel was last advanced to */
+static uint64_t xid_wheel_sec = 0;
+
+/**
+ * @code xid_hash(xid, chaddr);
+ *
+ * @brief hashes DHCP transaction key
+ *
+ * @param xid       DHCP transaction id
+ * @param chaddr    DHCP client hardware address
+ *
+ * @return hash of transaction key
+ */
+static inline uint32_t xid_hash(uint32_t xid, const uint8_t *chaddr)
+{
+    uint64_t key = (uint64_t) xid << 32 ^
+                   ((uint64_t) chaddr[0] << 40 | (uint64_t) chaddr[1] << 32 | (uint64_t) chaddr[2] << 24 |
+                    chaddr[3] << 16 | chaddr[4] << 8 | chaddr[5]);
+
+    return (key * 0x9e3779b97f4a7c15ULL) >> 32;
+}
+
+/**
+ * @code xid_lookup(xid, chaddr);
+ *
+ * @brief finds index slot of a DHCP transaction, or the empty slot it would be inserted at
+ *
+ * @param xid       DHCP transaction id
+ * @param chaddr    DHCP client hardware address
+ *
+ * @return index slot
+ */
+static inline uint32_t xid_lookup(uint32_t xid, const uint8_t *chaddr)
+{
+    uint32_t i = xid_hash(xid, chaddr) & xid_index_mask;
+
+    while (xid_index[i] != XID_NIL) {
+        xid_entry_t *entry = &xid_pool[xid_index[i]];
+
+        if ((entry->xid == xid) && (memcmp(entry->chaddr, chaddr, ETHER_ADDR_LEN) == 0)) {
+            break;
+        }
+        i = (i + 1) & xid_index_mask;
+    }
+
+    return i;
+}
+
+/**
+ * @code xid_remove(slot);
+ *
+ * @brief removes DHCP transaction from index, timer wheel and returns it to free list. Entries following it in its
+ *        probe sequence are shifted back, so lookups never need tombstones
+ *
+ * @param slot      index slot of transaction
+ *
+ * @return none
+ */
+static void xid_remove(uint32_t slot)
+{
+    uint32_t n = xid_index[slot];
+    xid_entry_t *entry = &xid_pool[n];
+
+    if (entry->prev != XID_NIL) {
+        xid_pool[entry->prev].next = entry->next;
+    } else {
+        xid_wheel[entry->expire_sec % XID_WHEEL_SLOTS] = entry->next;
+    }
+    if (entry->next != XID_NIL) {
+        xid_pool[entry->next].prev = entry->prev;
+    }
+    entry->next = xid_free;
+    xid_free = n;
+
+    uint32_t i = slot;
+    uint32_t j = slot;
+    while (true) {
+        j = (j + 1) & xid_index_mask;
+        if (xid_index[j] == XID_NIL) {
+            break;
+        }
+
+        xid_entry_t *moved = &xid_pool[xid_index[j]];
+        uint32_t k = xid_hash(moved->xid, moved->chaddr) & xid_index_mask;
+        // entry at j may move to i unless its home slot k lies cyclically in (i, j]
+        if ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j))) {
+            continue;
+        }
+        xid_index[i] = xid_index[j];
+        i = j;
+    }
+    xid_index[i] = XID_NIL;
+}
+
+/**
+ * @code xid_advance(now_sec);
+ *
+ * @brief advances timer wheel to now_sec and expires transactions of the slots passed
+ *
+ * @param now_sec   current time in seconds
+ *
+ * @return none
+ */
+static void xid_advance(uint64_t now_sec)
+{
+    uint64_t sec = xid_wheel_sec;
+
+    if (now_sec <= sec) {
+        return;
+    }
+
+    if (now_sec - sec > XID_WHEEL_SLOTS) {
+        sec = now_sec - XID_WHEEL_SLOTS;
+    }
+
+    while (sec < now_sec) {
+        sec++;
+
+        uint32_t n = xid_wheel[sec % XID_WHEEL_SLOTS];
+        while (n != XID_NIL) {
+            xid_entry_t *entry = &xid_pool[n];
+            uint32_t next = entry->next;
+
+            if (entry->expire_sec <= now_sec) {
+                entry->agg_dev->xid_stats->unanswered[entry->phase]++;
+                xid_remove(xid_lookup(entry->xid, entry->chaddr));
+            }
+            n = next;
+        }
+    }
+
+    xid_wheel_sec = now_sec;
+}
+
+/**
+ * @code xid_insert(slot, frame_class, phase);
+ *
+ * @brief starts tracking DHCP transaction and schedules its expiry
+ *
+ * @param slot          empty index slot found by xid_lookup()
+ * @param frame_class   classification of client message starting the transaction
+ * @param phase         transaction phase
+ *
+ * @return transaction, NULL if transaction table is full
+ */
+static xid_entry_t* xid_insert(uint32_t slot, const dhcp_frame_class_t *frame_class, dhcp_xid_phase_t phase)
+{
+    uint32_t n = xid_free;
+
+    if (n == XID_NIL) {
+        return NULL;
+    }
+
+    xid_entry_t *entry = &xid_pool[n];
+    xid_free = entry->next;
+
+    entry->xid = frame_class->xid;
+    memcpy(entry->chaddr, frame_class->chaddr, ETHER_ADDR_LEN);
+    entry->phase = phase;
+    entry->seen = 0;
+    entry->agg_dev = frame_class->agg_dev;
+    entry->expire_sec = xid_wheel_sec + DHCP_XID_TIMEOUT_SEC;
+
+    uint32_t *head = &xid_wheel[entry->expire_sec % XID_WHEEL_SLOTS];
+    entry->prev = XID_NIL;
+    entry->next = *head;
+    if (*head != XID_NIL) {
+        xid_pool[*head].prev = n;
+    }
+    *head = n;
+
+    xid_index[slot] = n;
+
+    return entry;
+}
+
+/**
+ * @code record_latency(hist, latency_ns);
+ *
+ * @brief records latency in histogram
+ *
+ * @param hist          latency histogram
+ * @param latency_ns    latency in nanoseconds
+ *
+ * @return none
+ */
+static void record_latency(dhcp_latency_hist_t *hist, uint64_t latency_ns)
+{
+    uint64_t usec = latency_ns / NSEC_PER_USEC;
+    uint32_t bucket = usec;
+
+    if (usec >= (1 << DHCP_LATENCY_SUB_BUCKET_BITS)) {
+        int msb = 63 - __builtin_clzll(usec);
+        int shift = msb - DHCP_LATENCY_SUB_BUCKET_BITS;
+
+        bucket = ((shift + 1) << DHCP_LATENCY_SUB_BUCKET_BITS) +
+                 ((usec >> shift) & ((1 << DHCP_LATENCY_SUB_BUCKET_BITS) - 1));
+        if (bucket >= DHCP_LATENCY_BUCKET_COUNT) {
+            bucket = DHCP_LATENCY_BUCKET_COUNT - 1;
+        }
+    }
+
+    hist->buckets[bucket]++;
+    hist->count++;
+    if (usec > hist->max_usec) {
+        hist->max_usec = usec;
+    }
+}
+
+/**
+ * @code dhcp_xid_init(capacity);
+ *
+ * @brief allocates DHCP transaction table
+ */
+int dhcp_xid_init(uint32_t capacity)
+{
+    int rv = -1;
+    uint32_t index_sz = 2;
+
+    while (index_sz < 2 * capacity) {
+        index_sz <<= 1;
+    }
+
+    do {
+        xid_pool = (xid_entry_t *) calloc(capacity, sizeof(xid_entry_t));
+        xid_index = (uint32_t *) malloc(index_sz * sizeof(uint32_t));
+        if ((xid_pool == NULL) || (xid_index == NULL)) {
+            syslog(LOG_ALERT, "dhcp_xid_init: failed to allocate transaction table '%s'\n", strerror(errno));
+            dhcp_xid_shutdown();
+            break;
+        }
+
+        xid_capacity = capacity;
+        xid_index_mask = index_sz - 1;
+        memset(xid_index, 0xff, index_sz * sizeof(uint32_t));
+        for (int i = 0; i < XID_WHEEL_SLOTS; i++) {
+            xid_wheel[i] = XID_NIL;
+        }
+
+        xid_free = XID_NIL;
+        for (uint32_t n = capacity; n > 0; n--) {
+            xid_pool[n - 1].next = xid_free;
+            xid_free = n - 1;
+        }
+
+        rv = 0;
+    } while (0);
+
+    return rv;
+}
+
+/**
+ * @code dhcp_xid_track(context, frame_class, time_ns);
+ *
+ * @brief tracks DHCP transaction of a counted DHCP message
+ */
+void dhcp_xid_track(dhcp_device_context_t *context, const dhcp_frame_class_t *frame_class, uint64_t time_ns)
+{
+    dhcp_xid_phase_t phase;
+    bool is_client_msg;
+
+    if ((xid_pool == NULL) || (frame_class->chaddr == NULL) || (frame_class->agg_dev->xid_stats == NULL)) {
+        return;
+    }
+
+    switch (frame_class->msg_type)
+    {
+    case DHCP_MESSAGE_TYPE_DISCOVER:
+        phase = DHCP_XID_PHASE_OFFER;
+        is_client_msg = true;
+        break;
+    case DHCP_MESSAGE_TYPE_OFFER:
+        phase = DHCP_XID_PHASE_OFFER;
+        is_client_msg = false;
+        break;
+    case DHCP_MESSAGE_TYPE_REQUEST:
+        phase = DHCP_XID_PHASE_ACK;
+        is_client_msg = true;
+        break;
+    case DHCP_MESSAGE_TYPE_ACK:
+    case DHCP_MESSAGE_TYPE_NAK:
+        phase = DHCP_XID_PHASE_ACK;
+        is_client_msg = false;
+        break;
+    default:
+        return;
+    }
+
+    xid_advance(time_ns / NSEC_PER_SEC);
+
+    uint32_t slot = xid_lookup(frame_class->xid, frame_class->chaddr);
+    xid_entry_t *entry = xid_index[slot] != XID_NIL ? &xid_pool[xid_index[slot]] : NULL;
+
+    if (is_client_msg) {
+        if (!context->is_uplink) {
+            // a client moving on to the next phase abandons the previous one
+            if ((entry != NULL) && (entry->phase != phase)) {
+                entry->agg_dev->xid_stats->unanswered[entry->phase]++;
+                xid_remove(slot);
+                slot = xid_lookup(frame_class->xid, frame_class->chaddr);
+                entry = NULL;
+            }
+            if ((entry == NULL) && ((entry = xid_insert(slot, frame_class, phase)) == NULL)) {
+                frame_class->agg_dev->xid_stats->untracked[phase]++;
+                return;
+            }
+            // retransmissions keep the time of the first message, the latency seen by the client
+            if ((entry->seen & (1 << XID_EVENT_CLIENT_RX)) == 0) {
+                entry->time_ns[XID_EVENT_CLIENT_RX] = time_ns;
+                entry->seen |= 1 << XID_EVENT_CLIENT_RX;
+            }
+        } else if ((entry != NULL) && (entry->phase == phase) && ((entry->seen & (1 << XID_EVENT_RELAY_TX)) == 0)) {
+            entry->time_ns[XID_EVENT_RELAY_TX] = time_ns;
+            entry->seen |= 1 << XID_EVENT_RELAY_TX;
+        }
+    } else if ((entry != NULL) && (entry->phase == phase)) {
+        if (context->is_uplink) {
+            if ((entry->seen & (1 << XID_EVENT_SERVER_RX)) == 0) {
+                entry->time_ns[XID_EVENT_SERVER_RX] = time_ns;
+                entry->seen |= 1 << XID_EVENT_SERVER_RX;
+            }
+        } else {
+            dhcp_xid_stats_t *stats = entry->agg_dev->xid_stats;
+
+            if (time_ns >= entry->time_ns[XID_EVENT_CLIENT_RX]) {
+                record_latency(&stats->latency[phase][DHCP_LATENCY_CLIENT],
+                               time_ns - entry->time_ns[XID_EVENT_CLIENT_RX]);
+            }
+            if ((entry->seen & (1 << XID_EVENT_RELAY_TX)) && (entry->seen & (1 << XID_EVENT_SERVER_RX)) &&
+                (entry->time_ns[XID_EVENT_SERVER_RX] >= entry->time_ns[XID_EVENT_RELAY_TX])) {
+                record_latency(&stats->latency[phase][DHCP_LATENCY_SERVER],
+                               entry->time_ns[XID_EVENT_SERVER_RX] - entry->time_ns[XID_EVENT_RELAY_TX]);
+            }
+            xid_remove(slot);
+        }
+    }
+}
+
+/**
+ * @code dhcp_xid_expire(time_ns);
+ *
+ * @brief expires DHCP transactions unanswered for DHCP_XID_TIMEOUT_SEC
+ */
+void dhcp_xid_expire(uint64_t time_ns)
+{
+    if (xid_pool != NULL) {
+        xid_advance(time_ns / NSEC_PER_SEC);
+    }
+}
+
+/**
+ * @code dhcp_xid_get_percentile(hist, percentile);
+ *
+ * @brief estimates latency percentile from histogram
+ */
+uint64_t dhcp_xid_get_percentile(const dhcp_latency_hist_t *hist, double percentile)
+{
+    uint64_t rank = (uint64_t) (hist->count * percentile / 100.0 + 0.5);
+    uint64_t count = 0;
+    uint64_t usec = 0;
+
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    for (uint32_t bucket = 0; (bucket < DHCP_LATENCY_BUCKET_COUNT) && (count < rank); bucket++) {
+        count += hist->buckets[bucket];
+        if (count >= rank) {
+            if (bucket < (1 << DHCP_LATENCY_SUB_BUCKET_BITS)) {
+                usec = bucket;
+            } else {
+                int shift = (bucket >> DHCP_LATENCY_SUB_BUCKET_BITS) - 1;
+                uint64_t sub = bucket & ((1 << DHCP_LATENCY_SUB_BUCKET_BITS) - 1);
+
+                usec = (((1 << DHCP_LATENCY_SUB_BUCKET_BITS) + sub + 1) << shift) - 1;
+            }
+        }
+    }
+
+    return usec < hist->max_usec ? usec : hist->max_usec;
+}
+
+/**
+ * @code dhcp_xid_shutdown();
+ *
+ * @brief releases DHCP transaction table
+ */
+void dhcp_xid_shutdown()
+{
+    free(xid_pool);
+    free(xid_index);
+    xid_pool = NULL;
+    xid_index = NULL;
+    xid_capacity = 0;
+    xid_free = XID_NIL;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file dhcp_xid.h
+ *
+ *  DHCP transaction (xid) latency tracking module
+ */
+
+#ifndef DHCP_XID_H_
+#define DHCP_XID_H_
+
+#include <stdint.h>
+
+#include "dhcp_device.h"
+
+/** Time after which an unanswered DHCP transaction expires, clients retransmit after about 4 seconds */
+#define DHCP_XID_TIMEOUT_SEC 10
+
+/**
+ * @code dhcp_xid_init(capacity);
+ *
+ * @brief allocates DHCP transaction table. Its memory is fixed, transactions beyond capacity are not tracked
+ *
+ * @param capacity          max number of DHCP transactions tracked at once
+ *
+ * @return 0 on success, otherwise for failure
+ */
+int dhcp_xid_init(uint32_t capacity);
+
+/**
+ * @code dhcp_xid_track(context, frame_class, time_ns);
+ *
+ * @brief tracks DHCP transaction of a counted DHCP message. A transaction starts when Discover or Request is
+ *        received on a south interface, it is timestamped when relayed on and answered on north interfaces and
+ *        completes when Offer or ACK/NAK is sent on the south interface. Its latency is then recorded in the
+ *        histograms of its VLAN aggregate device
+ *
+ * @param context           Device (interface) context the message was captured on
+ * @param frame_class       classification of counted DHCP message
+ * @param time_ns           capture time of the message in nanoseconds
+ *
+ * @return none
+ */
+void dhcp_xid_track(dhcp_device_context_t *context, const dhcp_frame_class_t *frame_class, uint64_t time_ns);
+
+/**
+ * @code dhcp_xid_expire(time_ns);
+ *
+ * @brief expires DHCP transactions unanswered for DHCP_XID_TIMEOUT_SEC and counts them as unanswered on their VLAN
+ *
+ * @param time_ns           current time in nanoseconds
+ *
+ * @return none
+ */
+void dhcp_xid_expire(uint64_t time_ns);
+
+/**
+ * @code dhcp_xid_get_percentile(hist, percentile);
+ *
+ * @brief estimates latency percentile from histogram
+ *
+ * @param hist              latency histogram
+ * @param percentile        percentile, 0 to 100
+ *
+ * @return highest latency in usec of the histogram bucket the percentile falls into, 0 if histogram is empty
+ */
+uint64_t dhcp_xid_get_percentile(const dhcp_latency_hist_t *hist, double percentile);
+
+/**
+ * @code dhcp_xid_shutdown();
+ *
+ * @brief releases DHCP transaction table
+ *
+ * @return none
+ */
+void dhcp_xid_shutdown();
+
+#endif /* DHCP_XID_H_ */
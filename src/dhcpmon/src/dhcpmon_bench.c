@@ -0,0 +1,284 @@
+/**
+ * @file dhcpmon_bench.c
+ *
+ *  @brief: synthetic DHCP DORA pcap file generator, its files are replayed by dhcpmon -f to measure packet cost.
+ *
+ */
+
+#include <errno.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include "dhcp_pcap.h"
+
+/** default number of synthetic DORA exchanges */
+#define BENCH_DEFAULT_DORA_COUNT 16384
+/** size of BOOTP header, DHCP magic cookie and options follow it */
+#define BOOTP_HDR_LEN 236
+/** size of DHCP message, padded to the minimum BOOTP message size */
+#define DHCP_MSG_LEN 300
+/** Offset of BOOTP transaction id */
+#define BOOTP_XID_OFFSET 4
+/** Offset of BOOTP flags */
+#define BOOTP_FLAGS_OFFSET 10
+/** Offset of BOOTP client hardware address */
+#define BOOTP_CHADDR_OFFSET 28
+/** DHCP magic cookie */
+#define DHCP_MAGIC_COOKIE 0x63825363
+/** DHCP client UDP port */
+#define DHCP_CLIENT_PORT 68
+/** DHCP server UDP port */
+#define DHCP_SERVER_PORT 67
+/** Time between synthetic frames, the relay answers a client message after one gap */
+#define BENCH_FRAME_GAP_NS 250000ULL
+/** Size of synthetic DHCP frame */
+#define BENCH_FRAME_LEN (ETHER_HDR_LEN + sizeof(struct ip) + sizeof(struct udphdr) + DHCP_MSG_LEN)
+
+/**
+ * @code usage(prog);
+ *
+ * @brief prints help message about how to use dhcpmon-bench utility
+ *
+ * @param prog program name
+ *
+ * @return none
+ */
+static void usage(const char *prog)
+{
+    printf("Usage: %s -i <south interface> -o <pcap file> [-n <DORA count>]\n", prog);
+    printf("where\n");
+    printf("\tsouth interface: interface the frames are replayed on, server messages are sent from its MAC,\n");
+    printf("\tpcap file: Ethernet pcap file to write, replay it with dhcpmon -id <south interface> -f <pcap file>,\n");
+    printf("\tDORA count: number of synthetic DORA exchanges, four frames each (default %d).\n",
+           BENCH_DEFAULT_DORA_COUNT);
+
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @code get_intf_addr(intf, mac, ip);
+ *
+ * @brief reads MAC and IP address of an interface
+ *
+ * @param intf              interface name
+ * @param mac(out)          interface MAC address
+ * @param ip(out)           interface IP address
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int get_intf_addr(const char *intf, uint8_t *mac, in_addr_t *ip)
+{
+    int rv = -1;
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct ifreq ifr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, intf, sizeof(ifr.ifr_name) - 1);
+
+    if ((fd >= 0) && (ioctl(fd, SIOCGIFHWADDR, &ifr) == 0)) {
+        memcpy(mac, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+
+        ifr.ifr_addr.sa_family = AF_INET;
+        if (ioctl(fd, SIOCGIFADDR, &ifr) == 0) {
+            *ip = ((struct sockaddr_in *) &ifr.ifr_addr)->sin_addr.s_addr;
+            rv = 0;
+        }
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return rv;
+}
+
+/**
+ * @code ip_checksum(iphdr);
+ *
+ * @brief computes IPv4 header checksum
+ *
+ * @param iphdr             IPv4 header without options
+ *
+ * @return IPv4 header checksum
+ */
+static uint16_t ip_checksum(const struct ip *iphdr)
+{
+    const uint16_t *words = (const uint16_t *) iphdr;
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i < sizeof(*iphdr) / sizeof(*words); i++) {
+        sum += words[i];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+
+    return ~sum;
+}
+
+/**
+ * @code build_frame(frame, msg_type, client, intf_mac, intf_ip);
+ *
+ * @brief builds broadcast DHCP frame of a client message received on, or of a server message sent from the south
+ *        interface
+ *
+ * @param frame(out)        BENCH_FRAME_LEN bytes frame buffer
+ * @param msg_type          DHCP message type
+ * @param client            client number, it makes client MAC address and transaction id
+ * @param intf_mac          south interface MAC address
+ * @param intf_ip           south interface IP address
+ *
+ * @return none
+ */
+static void build_frame(uint8_t *frame, uint8_t msg_type, uint32_t client, const uint8_t *intf_mac, in_addr_t intf_ip)
+{
+    uint8_t client_mac[ETHER_ADDR_LEN] = {0x02, 0x00, client >> 24, client >> 16, client >> 8, client};
+    int is_client = msg_type == 1 || msg_type == 3;
+    struct ether_header *ethhdr = (struct ether_header *) frame;
+    struct ip *iphdr = (struct ip *) (frame + ETHER_HDR_LEN);
+    struct udphdr *udp = (struct udphdr *) (iphdr + 1);
+    uint8_t *dhcp = (uint8_t *) (udp + 1);
+    uint8_t *option = dhcp + BOOTP_HDR_LEN;
+    uint32_t xid = htonl(client);
+    uint32_t cookie = htonl(DHCP_MAGIC_COOKIE);
+
+    memset(frame, 0, BENCH_FRAME_LEN);
+
+    memset(ethhdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    memcpy(ethhdr->ether_shost, is_client ? client_mac : intf_mac, ETHER_ADDR_LEN);
+    ethhdr->ether_type = htons(ETHERTYPE_IP);
+
+    iphdr->ip_v = 4;
+    iphdr->ip_hl = sizeof(*iphdr) >> 2;
+    iphdr->ip_len = htons(sizeof(*iphdr) + sizeof(*udp) + DHCP_MSG_LEN);
+    iphdr->ip_ttl = 64;
+    iphdr->ip_p = IPPROTO_UDP;
+    iphdr->ip_src.s_addr = is_client ? INADDR_ANY : intf_ip;
+    iphdr->ip_dst.s_addr = INADDR_BROADCAST;
+    iphdr->ip_sum = ip_checksum(iphdr);
+
+    udp->source = htons(is_client ? DHCP_CLIENT_PORT : DHCP_SERVER_PORT);
+    udp->dest = htons(is_client ? DHCP_SERVER_PORT : DHCP_CLIENT_PORT);
+    udp->len = htons(sizeof(*udp) + DHCP_MSG_LEN);
+
+    dhcp[0] = is_client ? 1 : 2;        // op: BOOTREQUEST/BOOTREPLY
+    dhcp[1] = 1;                        // htype: Ethernet
+    dhcp[2] = ETHER_ADDR_LEN;           // hlen
+    memcpy(dhcp + BOOTP_XID_OFFSET, &xid, sizeof(xid));
+    dhcp[BOOTP_FLAGS_OFFSET] = 0x80;    // broadcast flag
+    memcpy(dhcp + BOOTP_CHADDR_OFFSET, client_mac, ETHER_ADDR_LEN);
+
+    memcpy(option, &cookie, sizeof(cookie));
+    option += sizeof(cookie);
+    *option++ = 53;                     // DHCP message type
+    *option++ = 1;
+    *option++ = msg_type;
+    *option++ = 61;                     // client identifier
+    *option++ = 1 + ETHER_ADDR_LEN;
+    *option++ = 1;
+    memcpy(option, client_mac, ETHER_ADDR_LEN);
+    option += ETHER_ADDR_LEN;
+    if (is_client) {
+        static const uint8_t params[] = {1, 3, 6, 12, 15, 28, 42, 119};
+
+        *option++ = 55;                 // parameter request list
+        *option++ = sizeof(params);
+        memcpy(option, params, sizeof(params));
+        option += sizeof(params);
+    } else {
+        *option++ = 54;                 // server identifier
+        *option++ = sizeof(intf_ip);
+        memcpy(option, &intf_ip, sizeof(intf_ip));
+        option += sizeof(intf_ip);
+    }
+    *option = 255;                      // end
+}
+
+/**
+ * @code main(argc, argv);
+ *
+ * @brief main entry point of dhcpmon-bench utility
+ *
+ * @return int 0 on success, otherwise on failure
+ */
+int main(int argc, char **argv)
+{
+    int rv = EXIT_FAILURE;
+    const char *intf = NULL;
+    const char *path = NULL;
+    uint32_t dora_nr = BENCH_DEFAULT_DORA_COUNT;
+    uint8_t intf_mac[ETHER_ADDR_LEN];
+    in_addr_t intf_ip;
+    uint8_t frame[BENCH_FRAME_LEN];
+    FILE *file = NULL;
+
+    for (int i = 1; i < argc; i += 2) {
+        if ((strcmp(argv[i], "-i") == 0) && (i + 1 < argc)) {
+            intf = argv[i + 1];
+        } else if ((strcmp(argv[i], "-o") == 0) && (i + 1 < argc)) {
+            path = argv[i + 1];
+        } else if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+            dora_nr = atoi(argv[i + 1]);
+        } else {
+            usage(basename(argv[0]));
+        }
+    }
+    if ((intf == NULL) || (path == NULL)) {
+        usage(basename(argv[0]));
+    }
+
+    do {
+        if (get_intf_addr(intf, intf_mac, &intf_ip) != 0) {
+            fprintf(stderr, "%s: failed to get addresses of '%s': %s\n", basename(argv[0]), intf, strerror(errno));
+            break;
+        }
+
+        file = fopen(path, "w");
+        if ((file == NULL) || (dhcp_pcap_write_header(file, BENCH_FRAME_LEN) != 0)) {
+            fprintf(stderr, "%s: failed to create '%s': %s\n", basename(argv[0]), path, strerror(errno));
+            break;
+        }
+
+        uint32_t client;
+        for (client = 0; client < dora_nr; client++) {
+            static const uint8_t dora[] = {1, 2, 3, 5};     // Discover, Offer, Request, ACK
+            size_t i;
+
+            for (i = 0; i < sizeof(dora); i++) {
+                build_frame(frame, dora[i], client, intf_mac, intf_ip);
+                uint64_t time_ns = ((uint64_t) client * sizeof(dora) + i) * BENCH_FRAME_GAP_NS;
+                if (dhcp_pcap_write_frame(file, frame, sizeof(frame), time_ns) != 0) {
+                    break;
+                }
+            }
+            if (i < sizeof(dora)) {
+                break;
+            }
+        }
+        int close_rv = fclose(file);
+        file = NULL;
+        if ((client < dora_nr) || (close_rv != 0)) {
+            fprintf(stderr, "%s: failed to write '%s': %s\n", basename(argv[0]), path, strerror(errno));
+            break;
+        }
+
+        printf("Wrote %u DORA exchanges, %u frames, to '%s'\n", dora_nr, 4 * dora_nr, path);
+        rv = EXIT_SUCCESS;
+    } while (0);
+
+    if (file != NULL) {
+        fclose(file);
+    }
+
+    return rv;
+}
@@ -0,0 +1,265 @@
+/**
+ * @file dhcpmon_counters.c
+ *
+ *  @brief: dhcpmon counter export reader, it dumps a consistent snapshot of exported counters as JSON.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dhcp_export.h"
+
+/** max number of attempts to copy a consistent snapshot while dhcpmon keeps updating it */
+#define READ_RETRY_MAX 1000
+
+/** DHCP message type names indexed by option 53 value */
+static const char *dhcp_msg_names[] = {
+    NULL, "Discover", "Offer", "Request", "Decline", "ACK", "NAK", "Release", "Inform"
+};
+
+/** DHCPv6 message type names indexed by msg-type */
+static const char *dhcpv6_msg_names[] = {
+    NULL, "Solicit", "Advertise", "Request", "Confirm", "Renew", "Rebind", "Reply", "Release", "Decline",
+    "Reconfigure", "Information-request", "Relay-forward", "Relay-reply"
+};
+
+/** message type names and count per DHCP version */
+static const struct
+{
+    const char *name;
+    const char **msg_names;
+    int msg_count;
+} versions[DHCP_EXPORT_VERSION_COUNT] = {
+    {"dhcp", dhcp_msg_names, sizeof(dhcp_msg_names) / sizeof(*dhcp_msg_names)},
+    {"dhcpv6", dhcpv6_msg_names, sizeof(dhcpv6_msg_names) / sizeof(*dhcpv6_msg_names)}
+};
+
+/** exported device type names */
+static const char *dev_type_names[DHCP_EXPORT_DEV_TYPE_COUNT] = {
+    [DHCP_EXPORT_DEV_SOUTH] = "south",
+    [DHCP_EXPORT_DEV_NORTH] = "north",
+    [DHCP_EXPORT_DEV_MGMT] = "mgmt",
+    [DHCP_EXPORT_DEV_AGGREGATE] = "aggregate"
+};
+
+/**
+ * @code usage(prog);
+ *
+ * @brief prints help message about how to use dhcpmon-counters utility
+ *
+ * @param prog program name
+ *
+ * @return none
+ */
+static void usage(const char *prog)
+{
+    printf("Usage: %s [-f <export file>]\n", prog);
+    printf("where\n");
+    printf("\texport file: counter export file of dhcpmon (default %s).\n", DHCP_EXPORT_DEFAULT_PATH);
+
+    exit(EXIT_SUCCESS);
+}
+
+/**
+ * @code read_snapshot(hdr, devs, seq, update_time);
+ *
+ * @brief copies exported devices, retrying while dhcpmon updates them
+ *
+ * @param hdr               mapped counter export file
+ * @param devs(out)         copy of exported devices
+ * @param seq(out)          sequence of copied snapshot
+ * @param update_time(out)  update time of copied snapshot
+ *
+ * @return 0 on success, otherwise for failure
+ */
+static int read_snapshot(const dhcp_export_header_t *hdr, dhcp_export_dev_t *devs, uint64_t *seq,
+                         uint64_t *update_time)
+{
+    int rv = -1;
+    const dhcp_export_dev_t *export_devs = (const dhcp_export_dev_t *) (hdr + 1);
+
+    for (int i = 0; (i < READ_RETRY_MAX) && (rv != 0); i++) {
+        uint64_t begin = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+
+        if ((begin & 1) == 0) {
+            memcpy(devs, export_devs, hdr->dev_nr * sizeof(dhcp_export_dev_t));
+            *update_time = hdr->update_time;
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) == begin) {
+                *seq = begin;
+                rv = 0;
+            }
+        }
+
+        if (rv != 0) {
+            sched_yield();
+        }
+    }
+
+    return rv;
+}
+
+/**
+ * @code print_counters(counters, version);
+ *
+ * @brief prints counters of a direction as JSON object keyed by message type name
+ *
+ * @return none
+ */
+static void print_counters(const uint64_t *counters, int version)
+{
+    printf("{");
+    for (int type = 1; type < versions[version].msg_count; type++) {
+        printf("%s\"%s\": %lu", type > 1 ? ", " : "", versions[version].msg_names[type], counters[type]);
+    }
+    printf("}");
+}
+
+/**
+ * @code print_json(hdr, devs, seq, update_time);
+ *
+ * @brief prints counter snapshot as JSON
+ *
+ * @return none
+ */
+static void print_json(const dhcp_export_header_t *hdr, const dhcp_export_dev_t *devs, uint64_t seq,
+                       uint64_t update_time)
+{
+    static const char *counter_names[DHCP_EXPORT_COUNTERS_COUNT] = {"current", "snapshot"};
+    static const char *dir_names[DHCP_EXPORT_DIR_COUNT] = {"rx", "tx"};
+    static const char *phase_names[DHCP_EXPORT_PHASE_COUNT] = {"discover_offer", "request_ack"};
+    static const char *segment_names[DHCP_EXPORT_SEGMENT_COUNT] = {"client", "server"};
+
+    printf("{\n  \"version\": %u,\n  \"pid\": %u,\n  \"seq\": %lu,\n  \"update_time\": %lu,\n  \"devices\": [",
+           hdr->version, hdr->pid, seq, update_time);
+
+    for (uint32_t i = 0; i < hdr->dev_nr; i++) {
+        const dhcp_export_dev_t *dev = &devs[i];
+
+        printf("%s\n    {\n      \"name\": \"%.*s\",\n      \"type\": \"%s\",\n      \"ring_drops\": %lu",
+               i > 0 ? "," : "", (int) sizeof(dev->name), dev->name,
+               dev->type < DHCP_EXPORT_DEV_TYPE_COUNT ? dev_type_names[dev->type] : "unknown", dev->ring_drops);
+        for (int version = 0; version < DHCP_EXPORT_VERSION_COUNT; version++) {
+            printf(",\n      \"%s\": {", versions[version].name);
+            for (int counter = 0; counter < DHCP_EXPORT_COUNTERS_COUNT; counter++) {
+                printf("%s\n        \"%s\": {", counter > 0 ? "," : "", counter_names[counter]);
+                for (int dir = 0; dir < DHCP_EXPORT_DIR_COUNT; dir++) {
+                    printf("%s\"%s\": ", dir > 0 ? ", " : "", dir_names[dir]);
+                    print_counters(dev->counters[version][counter][dir], version);
+                }
+                printf("}");
+            }
+            printf(",\n        \"last_second\": {");
+            for (int dir = 0; dir < DHCP_EXPORT_DIR_COUNT; dir++) {
+                printf("%s\"%s\": ", dir > 0 ? ", " : "", dir_names[dir]);
+                print_counters(dev->last_sample[version][dir], version);
+            }
+            printf("}\n      }");
+        }
+        if (dev->type == DHCP_EXPORT_DEV_AGGREGATE) {
+            printf(",\n      \"latency_usec\": {");
+            for (int phase = 0; phase < DHCP_EXPORT_PHASE_COUNT; phase++) {
+                printf("%s\n        \"%s\": {", phase > 0 ? "," : "", phase_names[phase]);
+                for (int segment = 0; segment < DHCP_EXPORT_SEGMENT_COUNT; segment++) {
+                    const dhcp_export_latency_t *latency = &dev->latency[phase][segment];
+
+                    printf("\"%s\": {\"count\": %lu, \"p50\": %lu, \"p90\": %lu, \"p99\": %lu, \"max\": %lu}, ",
+                           segment_names[segment], latency->count, latency->p50, latency->p90, latency->p99,
+                           latency->max);
+                }
+                printf("\"unanswered\": %lu}", dev->unanswered[phase]);
+            }
+            printf("\n      }");
+        }
+        printf("\n    }");
+    }
+
+    printf("\n  ]\n}\n");
+}
+
+/**
+ * @code main(argc, argv);
+ *
+ * @brief main entry point of dhcpmon-counters utility
+ *
+ * @return int 0 on success, otherwise on failure
+ */
+int main(int argc, char **argv)
+{
+    int rv = EXIT_FAILURE;
+    const char *path = DHCP_EXPORT_DEFAULT_PATH;
+    int fd = -1;
+    void *addr = MAP_FAILED;
+    struct stat st;
+    dhcp_export_dev_t *devs = NULL;
+
+    for (int i = 1; i < argc; i += 2) {
+        if ((strcmp(argv[i], "-f") == 0) && (i + 1 < argc)) {
+            path = argv[i + 1];
+        } else {
+            usage(basename(argv[0]));
+        }
+    }
+
+    do {
+        fd = open(path, O_RDONLY);
+        if ((fd < 0) || (fstat(fd, &st) != 0)) {
+            fprintf(stderr, "%s: failed to open '%s': %s\n", basename(argv[0]), path, strerror(errno));
+            break;
+        }
+
+        if (st.st_size < sizeof(dhcp_export_header_t)) {
+            fprintf(stderr, "%s: '%s' is not a dhcpmon counter export file\n", basename(argv[0]), path);
+            break;
+        }
+
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            fprintf(stderr, "%s: failed to map '%s': %s\n", basename(argv[0]), path, strerror(errno));
+            break;
+        }
+
+        const dhcp_export_header_t *hdr = (const dhcp_export_header_t *) addr;
+        if ((__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != DHCP_EXPORT_MAGIC) ||
+            (hdr->version != DHCP_EXPORT_VERSION) || (hdr->dev_size != sizeof(dhcp_export_dev_t)) ||
+            (st.st_size < sizeof(dhcp_export_header_t) + (size_t) hdr->dev_nr * sizeof(dhcp_export_dev_t))) {
+            fprintf(stderr, "%s: '%s' is not a version %d dhcpmon counter export file\n",
+                    basename(argv[0]), path, DHCP_EXPORT_VERSION);
+            break;
+        }
+
+        devs = (dhcp_export_dev_t *) calloc(hdr->dev_nr, sizeof(dhcp_export_dev_t));
+        if ((devs == NULL) && (hdr->dev_nr > 0)) {
+            fprintf(stderr, "%s: failed to allocate memory: %s\n", basename(argv[0]), strerror(errno));
+            break;
+        }
+
+        uint64_t seq, update_time;
+        if (read_snapshot(hdr, devs, &seq, &update_time) != 0) {
+            fprintf(stderr, "%s: failed to read consistent snapshot of '%s'\n", basename(argv[0]), path);
+            break;
+        }
+
+        print_json(hdr, devs, seq, update_time);
+        rv = EXIT_SUCCESS;
+    } while (0);
+
+    free(devs);
+    if (addr != MAP_FAILED) {
+        munmap(addr, st.st_size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    return rv;
+}
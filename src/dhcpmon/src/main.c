@@ -19,15 +19,30 @@
 
 #include "dhcp_mon.h"
 #include "dhcp_devman.h"
+#include "dhcp_export.h"
 
-/** dhcpmon_default_snaplen: default snap length of packet being captured */
-static const size_t dhcpmon_default_snaplen = 65535;
+/** dhcpmon_default_snaplen: default snap length of packet being captured. DHCP message type (option 53) is found
+ *  well within a max size untagged Ethernet frame */
+static const size_t dhcpmon_default_snaplen = 1518;
 /** dhcpmon_default_health_check_window: default value for a time window, during which DHCP DORA packet counts are being
  *  collected */
 static const uint32_t dhcpmon_default_health_check_window = 18;
+/** dhcpmon_default_health_check_interval: default interval between DHCP relay health checks, each one is done over
+ *  the last health check window */
+static const uint32_t dhcpmon_default_health_check_interval = 1;
 /** dhcpmon_default_unhealthy_max_count: default max consecutive unhealthy status reported before reporting an issue
  *  with DHCP relay */
 static const uint32_t dhcpmon_default_unhealthy_max_count = 10;
+/** dhcpmon_default_ring_size: default size of TPACKET_V3 capture ring, 0 captures packets using recv() */
+static const size_t dhcpmon_default_ring_size = 0;
+/** dhcpmon_default_shared_sock_nr: default number of shared capture sockets, 0 opens one socket per interface */
+static const uint32_t dhcpmon_default_shared_sock_nr = 0;
+/** dhcpmon_default_budget: default max number of frames processed per socket wakeup */
+static const uint32_t dhcpmon_default_budget = 256;
+/** dhcpmon_default_xid_capacity: default max number of DHCP transactions whose latency is tracked at once */
+static const uint32_t dhcpmon_default_xid_capacity = 16384;
+/** dhcpmon_default_replay_count: default number of times frames of a pcap file are replayed */
+static const uint32_t dhcpmon_default_replay_count = 1;
 
 /**
  * @code usage(prog);
@@ -40,17 +55,37 @@ static const uint32_t dhcpmon_default_unhealthy_max_count = 10;
  */
 static void usage(const char *prog)
 {
-    printf("Usage: %s -id <south interface> {-iu <north interface>}+ -im <mgmt interface> [-w <snapshot window in sec>]"
-            "[-c <unhealthy status count>] [-s <snap length>] [-d]\n", prog);
+    printf("Usage: %s {-id <south interface>}+ {-iu <north interface>}+ -im <mgmt interface> [-w <snapshot window in sec>]"
+            "[-p <check interval in sec>] [-c <unhealthy status count>] [-s <snap length>] [-r <ring size>] [-S <shared sockets>] [-b <read budget>] [-t <transaction table size>] [-x <export file>] [-f <pcap file> [-n <replay count>]] [-6] [-e] [-d]\n", prog);
     printf("where\n");
-    printf("\tsouth interface: is a vlan interface,\n");
+    printf("\tsouth interface: is a vlan interface, every vlan is monitored separately,\n");
     printf("\tnorth interface: is a TOR-T1 interface,\n");
-    printf("\tsnapshot window: during which DHCP counters are gathered and DHCP status is validated (default %d),\n",
-            dhcpmon_default_health_check_window);
+    printf("\tsnapshot window: sliding window over which DHCP counters are gathered and DHCP status is validated "
+           "(default %d),\n", dhcpmon_default_health_check_window);
+    printf("\tcheck interval: interval between DHCP status validations, the window slides by one second at a time, "
+           "set it to snapshot window to validate consecutive windows (default %d),\n",
+           dhcpmon_default_health_check_interval);
     printf("\tunhealthy status count: count of consecutive unhealthy status before writing an alert to syslog "
            "(default %d),\n",
            dhcpmon_default_unhealthy_max_count);
     printf("\tsnap length: snap length of packet capture (default %ld),\n", dhcpmon_default_snaplen);
+    printf("\tring size: size in bytes of per interface TPACKET_V3 mmap capture ring, 0 captures packets using "
+           "recv() (default %ld),\n", dhcpmon_default_ring_size);
+    printf("\tshared sockets: number of sockets capturing on all interfaces in a PACKET_FANOUT group, 0 opens one "
+           "socket per interface (default %d),\n", dhcpmon_default_shared_sock_nr);
+    printf("\tread budget: max number of frames processed per socket wakeup before other events are served "
+           "(default %d),\n", dhcpmon_default_budget);
+    printf("\ttransaction table size: max number of DHCP transactions whose Discover-Offer and Request-ACK latency "
+           "is tracked at once, 0 disables latency tracking (default %d),\n", dhcpmon_default_xid_capacity);
+    printf("\texport file: file under /run counters are exported to every second, e.g. %s, read it with "
+           "dhcpmon-counters (default none),\n", DHCP_EXPORT_DEFAULT_PATH);
+    printf("\tpcap file: replay frames of the file instead of capturing packets, print counters and replay "
+           "throughput and exit. Frames of Ethernet captures are replayed on the first south interface,\n");
+    printf("\treplay count: number of times frames of the pcap file are replayed (default %d),\n",
+           dhcpmon_default_replay_count);
+    printf("\t-6: monitor DHCPv6 relay as well (default off),\n");
+    printf("\t-e: count DHCP packets in the kernel with an eBPF program, falls back to packet capture if it cannot be "
+           "loaded (default off),\n");
     printf("\t-d: daemonize %s.\n", prog);
 
     exit(EXIT_SUCCESS);
@@ -108,9 +143,19 @@ int main(int argc, char **argv)
     int rv = EXIT_FAILURE;
     int i;
     int window_interval = dhcpmon_default_health_check_window;
+    int check_interval = dhcpmon_default_health_check_interval;
     int max_unhealthy_count = dhcpmon_default_unhealthy_max_count;
-    size_t snaplen = dhcpmon_default_snaplen;
+    dhcp_capture_config_t capture_config = {
+        .snaplen = dhcpmon_default_snaplen,
+        .ring_size = dhcpmon_default_ring_size,
+        .shared_sock_nr = dhcpmon_default_shared_sock_nr,
+        .budget = dhcpmon_default_budget,
+        .xid_capacity = dhcpmon_default_xid_capacity
+    };
     int make_daemon = 0;
+    const char *export_path = NULL;
+    const char *replay_path = NULL;
+    uint32_t replay_count = dhcpmon_default_replay_count;
 
     setlogmask(LOG_UPTO(LOG_INFO));
     openlog(basename(argv[0]), LOG_CONS | LOG_PID | LOG_NDELAY, LOG_DAEMON);
@@ -136,14 +181,54 @@ int main(int argc, char **argv)
             make_daemon = 1;
             i++;
             break;
+        case '6':
+            capture_config.dhcpv6 = 1;
+            i++;
+            break;
+        case 'e':
+            capture_config.ebpf = 1;
+            i++;
+            break;
+        case 'x':
+            export_path = argv[i + 1];
+            i += 2;
+            break;
+        case 'f':
+            replay_path = argv[i + 1];
+            i += 2;
+            break;
+        case 'n':
+            replay_count = atoi(argv[i + 1]);
+            i += 2;
+            break;
         case 's':
-            snaplen = atoi(argv[i + 1]);
+            capture_config.snaplen = atoi(argv[i + 1]);
+            i += 2;
+            break;
+        case 'r':
+            capture_config.ring_size = atoi(argv[i + 1]);
+            i += 2;
+            break;
+        case 'b':
+            capture_config.budget = atoi(argv[i + 1]);
+            i += 2;
+            break;
+        case 'S':
+            capture_config.shared_sock_nr = atoi(argv[i + 1]);
+            i += 2;
+            break;
+        case 't':
+            capture_config.xid_capacity = atoi(argv[i + 1]);
             i += 2;
             break;
         case 'w':
             window_interval = atoi(argv[i + 1]);
             i += 2;
             break;
+        case 'p':
+            check_interval = atoi(argv[i + 1]);
+            i += 2;
+            break;
         case 'c':
             max_unhealthy_count = atoi(argv[i + 1]);
             i += 2;
@@ -154,16 +239,27 @@ int main(int argc, char **argv)
         }
     }
 
-    if (make_daemon) {
-        dhcpmon_daemonize();
-    }
+    if (replay_path != NULL) {
+        // replay runs in the foreground, its results go to stderr as well
+        closelog();
+        openlog(basename(argv[0]), LOG_CONS | LOG_PID | LOG_NDELAY | LOG_PERROR, LOG_DAEMON);
+
+        if (dhcp_devman_replay(replay_path, replay_count, &capture_config) == 0) {
+            dhcp_devman_print_status(NULL, DHCP_COUNTERS_CURRENT);
+            rv = EXIT_SUCCESS;
+        }
+    } else {
+        if (make_daemon) {
+            dhcpmon_daemonize();
+        }
 
-    if ((dhcp_mon_init(window_interval, max_unhealthy_count) == 0) &&
-        (dhcp_mon_start(snaplen) == 0)) {
+        if ((dhcp_mon_init(window_interval, check_interval, max_unhealthy_count, export_path) == 0) &&
+            (dhcp_mon_start(&capture_config) == 0)) {
 
-        rv = EXIT_SUCCESS;
+            rv = EXIT_SUCCESS;
 
-        dhcp_mon_shutdown();
+            dhcp_mon_shutdown();
+        }
     }
 
     dhcp_devman_shutdown();
@@ -4,20 +4,43 @@ CC := gcc
 C_SRCS += \
 ../src/dhcp_device.c \
 ../src/dhcp_devman.c \
+../src/dhcp_ebpf.c \
+../src/dhcp_export.c \
 ../src/dhcp_mon.c \
-../src/main.c 
+../src/dhcp_pcap.c \
+../src/dhcp_xid.c \
+../src/main.c \
+../src/dhcpmon_bench.c \
+../src/dhcpmon_counters.c 
 
 OBJS += \
 ./src/dhcp_device.o \
 ./src/dhcp_devman.o \
+./src/dhcp_ebpf.o \
+./src/dhcp_export.o \
 ./src/dhcp_mon.o \
+./src/dhcp_pcap.o \
+./src/dhcp_xid.o \
 ./src/main.o 
 
+COUNTERS_OBJS += \
+./src/dhcpmon_counters.o 
+
+BENCH_OBJS += \
+./src/dhcpmon_bench.o \
+./src/dhcp_pcap.o 
+
 C_DEPS += \
 ./src/dhcp_device.d \
 ./src/dhcp_devman.d \
+./src/dhcp_ebpf.d \
+./src/dhcp_export.d \
 ./src/dhcp_mon.d \
-./src/main.d 
+./src/dhcp_pcap.d \
+./src/dhcp_xid.d \
+./src/main.d \
+./src/dhcpmon_bench.d \
+./src/dhcpmon_counters.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
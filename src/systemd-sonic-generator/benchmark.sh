@@ -0,0 +1,106 @@
+#!/bin/bash
+#
+# Times systemd-sonic-generator end to end against a synthetic multi-ASIC tree.
+#
+# Usage: benchmark.sh <generator> <root> [<asics> [<units> [<runs>]]]
+#
+# The generator is to be built with ROOT_PREFIX set to <root>. Every run gets
+# a freshly generated tree under <root> and an empty output directory, only the
+# generator itself is timed. Each run is followed by a second one that replays
+# the cache the first one wrote.
+
+set -e
+
+GENERATOR=$1
+ROOT=$2
+NUM_ASICS=${3:-16}
+NUM_UNITS=${4:-500}
+NUM_RUNS=${5:-10}
+
+if [ -z "$GENERATOR" ] || [ -z "$ROOT" ]; then
+    echo "Usage: $0 <generator> <root> [<asics> [<units> [<runs>]]]" >&2
+    exit 1
+fi
+
+PLATFORM=x86_64-bench-r0
+UNIT_DIR=$ROOT/usr/lib/systemd/system
+OUTPUT_DIR=$ROOT/run/systemd/generator
+# one in ten units is a multi-instance service, as swss, syncd, bgp, teamd, ... are on SONiC
+NUM_MULTI=$((NUM_UNITS / 10))
+
+generate_tree() {
+    rm -rf "$ROOT"
+    mkdir -p "$UNIT_DIR" "$ROOT/var/cache" "$ROOT/etc/sonic" "$ROOT/host" "$ROOT/usr/share/sonic/device/$PLATFORM" "$OUTPUT_DIR"
+
+    echo "onie_platform=$PLATFORM" > "$ROOT/host/machine.conf"
+    echo "NUM_ASIC=$NUM_ASICS" > "$ROOT/usr/share/sonic/device/$PLATFORM/asic.conf"
+
+    for ((i = 0; i < NUM_MULTI; i++)); do
+        echo "multi$i@.service"
+        cat > "$UNIT_DIR/multi$i@.service" <<EOF
+[Unit]
+Description=Synthetic multi-instance service $i
+Requires=multi$(((i + 1) % NUM_MULTI))@%i.service
+After=multi$(((i + 1) % NUM_MULTI))@%i.service single0.service
+
+[Service]
+ExecStart=/bin/true %i
+
+[Install]
+WantedBy=sonic.target
+EOF
+    done > "$ROOT/etc/sonic/generated_services.conf"
+
+    for ((i = 0; i < NUM_UNITS - NUM_MULTI; i++)); do
+        echo "single$i.service"
+        cat > "$UNIT_DIR/single$i.service" <<EOF
+[Unit]
+Description=Synthetic service $i
+Requires=multi$((i % NUM_MULTI)).service
+After=multi$((i % NUM_MULTI)).service multi$(((i + 7) % NUM_MULTI)).service single$(((i + 1) % (NUM_UNITS - NUM_MULTI))).service
+Before=multi$(((i + 3) % NUM_MULTI)).service
+
+[Service]
+ExecStart=/bin/true
+
+[Install]
+WantedBy=sonic.target multi-user.target
+RequiredBy=multi$(((i + 5) % NUM_MULTI))@.service
+EOF
+    done >> "$ROOT/etc/sonic/generated_services.conf"
+}
+
+# Runs the generator into an empty output directory, adds the elapsed time to
+# <prefix>_total_ns and keeps the shortest one in <prefix>_min_ns
+time_run() {
+    local prefix=$1 start end elapsed min
+
+    rm -rf "$OUTPUT_DIR"
+    mkdir -p "$OUTPUT_DIR"
+    start=$(date +%s%N)
+    "$GENERATOR" "$OUTPUT_DIR"
+    end=$(date +%s%N)
+    elapsed=$((end - start))
+    eval "${prefix}_total_ns=\$((${prefix}_total_ns + elapsed))"
+    eval "min=\$${prefix}_min_ns"
+    if [ -z "$min" ] || [ "$elapsed" -lt "$min" ]; then
+        eval "${prefix}_min_ns=$elapsed"
+    fi
+}
+
+cold_total_ns=0
+cold_min_ns=
+warm_total_ns=0
+warm_min_ns=
+for ((run = 0; run < NUM_RUNS; run++)); do
+    # a fresh tree has no cache, the second run replays the cache the first one wrote
+    generate_tree
+    time_run cold
+    time_run warm
+done
+
+echo "$NUM_UNITS units, $NUM_ASICS ASICs: $(find "$OUTPUT_DIR" -type l | wc -l) links," \
+     "cold min $((cold_min_ns / 1000)) usec, avg $((cold_total_ns / NUM_RUNS / 1000)) usec," \
+     "cached min $((warm_min_ns / 1000)) usec, avg $((warm_total_ns / NUM_RUNS / 1000)) usec over $NUM_RUNS runs"
+
+rm -rf "$ROOT"
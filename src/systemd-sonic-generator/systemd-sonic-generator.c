@@ -4,22 +4,269 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <linux/limits.h>
 
-#define MAX_NUM_TARGETS 15
-#define MAX_NUM_INSTALL_LINES 15
-#define MAX_NUM_UNITS 128
 #define MAX_BUF_SIZE 512
+#define MIN_TABLE_SIZE 16
+
+/* Root all input files are read under, overridden to run against a synthetic tree */
+#ifndef ROOT_PREFIX
+#define ROOT_PREFIX ""
+#endif
+
+static const char* UNIT_FILE_PREFIX = ROOT_PREFIX "/usr/lib/systemd/system/";
+static const char* CONFIG_FILE = ROOT_PREFIX "/etc/sonic/generated_services.conf";
+static const char* MACHINE_CONF_FILE = ROOT_PREFIX "/host/machine.conf";
+static const char* ASIC_CONF_FORMAT = ROOT_PREFIX "/usr/share/sonic/device/%s/asic.conf";
+static const char* CACHE_FILE = ROOT_PREFIX "/var/cache/sonic/systemd-sonic-generator.cache";
+/* stamped along the input files, so an upgraded generator never replays the plan of the previous one */
+static const char* GENERATOR_BINARY = "/proc/self/exe";
+
+#define CACHE_MAGIC 0x43475353  /* "SSGC" */
+#define CACHE_VERSION 2
+
+/* Growable array of strings owned by the table */
+typedef struct {
+    char** items;
+    int count;
+    int capacity;
+} str_table;
+
+/* Open-addressed hash set of strings, capacity is a power of two */
+typedef struct {
+    char** slots;
+    size_t count;
+    size_t capacity;
+} str_set;
+
+/* Installation plan of a generator run, replayed from the cache on unchanged boots */
+typedef struct {
+    str_table inputs;       /* pairs of input file path and its stamp */
+    str_table overrides;    /* pairs of unit file name and its content with multi-instance dependencies replaced */
+    str_table links;        /* triples of target directory, link name and unit file the link points to */
+    bool complete;          /* false if recording ran out of memory */
+} gen_plan;
 
-static const char* UNIT_FILE_PREFIX = "/usr/lib/systemd/system/";
-static const char* CONFIG_FILE = "/etc/sonic/generated_services.conf";
-static const char* MACHINE_CONF_FILE = "/host/machine.conf";
 static int num_asics;
-static char** multi_instance_services;
-static int num_multi_inst;
+static str_set multi_instance_services;
+static gen_plan plan = {.complete = true};
+
+
+static int str_table_append(str_table* table, char* item) {
+    /***
+    Appends a string to a table, the table takes ownership of it
+
+    Returns 0 on success, -1 if the table could not grow
+    ***/
+    if (item == NULL) {
+        return -1;
+    }
+
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? 2 * table->capacity : MIN_TABLE_SIZE;
+        char** items = realloc(table->items, capacity * sizeof(char *));
+
+        if (items == NULL) {
+            fputs("Failed to grow table\n", stderr);
+            free(item);
+            return -1;
+        }
+        table->items = items;
+        table->capacity = capacity;
+    }
+
+    table->items[table->count++] = item;
+    return 0;
+}
+
+
+static void str_table_clear(str_table* table) {
+    /***
+    Frees the strings of a table, keeping its memory for reuse
+    ***/
+    for (int i = 0; i < table->count; i++) {
+        free(table->items[i]);
+    }
+    table->count = 0;
+}
+
+
+static void str_table_free(str_table* table) {
+    str_table_clear(table);
+    free(table->items);
+    table->items = NULL;
+    table->capacity = 0;
+}
+
+
+static size_t str_hash(const char* key, size_t len) {
+    /***
+    FNV-1a hash of the first len characters of key
+    ***/
+    size_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+
+static char** str_set_find(const str_set* set, const char* key, size_t len) {
+    /***
+    Returns the slot holding the first len characters of key,
+    or the empty slot it would be inserted at
+    ***/
+    size_t mask = set->capacity - 1;
+    size_t i = str_hash(key, len) & mask;
+
+    while (set->slots[i] != NULL) {
+        if ((strncmp(set->slots[i], key, len) == 0) && (set->slots[i][len] == '\0')) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return &set->slots[i];
+}
+
+
+static bool str_set_contains(const str_set* set, const char* key, size_t len) {
+    return (set->count > 0) && (*str_set_find(set, key, len) != NULL);
+}
+
+
+static int str_set_add(str_set* set, const char* key, size_t len) {
+    /***
+    Adds a copy of the first len characters of key to the set
+
+    The set is kept at most half full so probe sequences stay short
+    Returns 0 on success, -1 on allocation failure
+    ***/
+    char** slot;
+
+    if (2 * (set->count + 1) > set->capacity) {
+        str_set grown;
+
+        grown.capacity = set->capacity ? 2 * set->capacity : MIN_TABLE_SIZE;
+        grown.count = set->count;
+        grown.slots = calloc(grown.capacity, sizeof(char *));
+        if (grown.slots == NULL) {
+            fputs("Failed to grow set\n", stderr);
+            return -1;
+        }
+
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->slots[i] != NULL) {
+                *str_set_find(&grown, set->slots[i], strlen(set->slots[i])) = set->slots[i];
+            }
+        }
+        free(set->slots);
+        *set = grown;
+    }
+
+    slot = str_set_find(set, key, len);
+    if (*slot == NULL) {
+        *slot = strndup(key, len);
+        if (*slot == NULL) {
+            return -1;
+        }
+        set->count++;
+    }
+    return 0;
+}
+
+
+static void str_set_free(str_set* set) {
+    for (size_t i = 0; i < set->capacity; i++) {
+        free(set->slots[i]);
+    }
+    free(set->slots);
+    set->slots = NULL;
+    set->count = 0;
+    set->capacity = 0;
+}
+
+
+static char* read_file(const char* path) {
+    /***
+    Reads a whole text file into a string, NULL if it cannot be read
+    ***/
+    FILE *fp;
+    char* content = NULL;
+    size_t len = 0;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+
+    if (getdelim(&content, &len, '\0', fp) == -1) {
+        free(content);
+        content = strdup("");
+    }
+    fclose(fp);
+
+    return content;
+}
+
+
+static char* get_file_stamp(const char* path) {
+    /***
+    Returns a stamp of a file that changes whenever the file is
+    replaced or modified, "-" if the file does not exist
+    ***/
+    struct stat st;
+    char stamp[128];
+
+    if (stat(path, &st) == -1) {
+        return strdup("-");
+    }
+
+    snprintf(stamp, sizeof(stamp), "%llu:%llu:%lld:%lld.%09ld",
+             (unsigned long long) st.st_dev, (unsigned long long) st.st_ino, (long long) st.st_size,
+             (long long) st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+    return strdup(stamp);
+}
+
+
+static void record_strings(str_table* table, int num_strings, ...) {
+    /***
+    Appends copies of num_strings strings to a plan table as one entry
+
+    If a string is missing or its copy cannot be appended, the plan
+    is marked incomplete so it is never cached
+    ***/
+    va_list args;
+
+    va_start(args, num_strings);
+    for (int i = 0; i < num_strings; i++) {
+        const char* str = va_arg(args, const char*);
+
+        if (plan.complete && ((str == NULL) || (str_table_append(table, strdup(str)) != 0))) {
+            plan.complete = false;
+        }
+    }
+    va_end(args);
+}
+
+
+static void record_input(const char* path) {
+    /***
+    Records an input file of the plan, it is stamped before it is read
+    so changes made while it is read invalidate the cache
+    ***/
+    char* stamp = get_file_stamp(path);
+
+    record_strings(&plan.inputs, 2, path, stamp);
+    free(stamp);
+}
 
 void strip_trailing_newline(char* str) {
     /***
@@ -32,7 +279,7 @@ void strip_trailing_newline(char* str) {
 }
 
 
-static int get_target_lines(char* unit_file, char* target_lines[]) {
+static int get_target_lines(char* unit_file, str_table* target_lines) {
     /***
     Gets installation information for a given unit file
 
@@ -62,12 +309,10 @@ static int get_target_lines(char* unit_file, char* target_lines[]) {
              found_install = true;
         }
         else if (found_install) {
-            if (num_target_lines >= MAX_NUM_INSTALL_LINES) {
-                fprintf(stderr, "Number of lines in [Install] section of %s exceeds MAX_NUM_INSTALL_LINES\n", unit_file);
-                fputs("Extra [Install] lines will be ignored\n", stderr);
+            if (str_table_append(target_lines, strdup(line)) != 0) {
+                fprintf(stderr, "Failed to read [Install] section of %s\n", unit_file);
                 break;
             }
-            target_lines[num_target_lines] = strdup(line);
             num_target_lines++;
         }
     }
@@ -80,17 +325,16 @@ static int get_target_lines(char* unit_file, char* target_lines[]) {
 }
 
 static bool is_multi_instance_service(char *service_name){
-    int i;
-    for(i=0; i < num_multi_inst; i++){
-        if (strstr(service_name, multi_instance_services[i]) != NULL) {
-            return true;
-        }
-    }
-    return false;
+    /***
+    Checks if a unit or unit name belongs to a multi-instance service
 
+    The service name is the unit name up to its instance or type suffix,
+    e.g. 'swss' for 'swss.service', 'swss@.service' and 'swss@'
+    ***/
+    return str_set_contains(&multi_instance_services, service_name, strcspn(service_name, "@."));
 }
 
-static int get_install_targets_from_line(char* target_string, char* install_type, char* targets[], int existing_targets) {
+static int get_install_targets_from_line(char* target_string, char* install_type, str_table* targets) {
     /***
     Helper fuction for get_install_targets
 
@@ -103,12 +347,6 @@ static int get_install_targets_from_line(char* target_string, char* install_type
     int num_targets = 0;
 
     while ((token = strtok_r(target_string, " ", &target_string))) {
-        if (num_targets + existing_targets >= MAX_NUM_TARGETS) {
-            fputs("Number of targets found exceeds MAX_NUM_TARGETS\n", stderr);
-            fputs("Additional targets will be ignored \n", stderr);
-            return num_targets;
-        }
-
         target = strdup(token);
         strip_trailing_newline(target);
 
@@ -128,14 +366,27 @@ static int get_install_targets_from_line(char* target_string, char* install_type
         strcat(final_target, install_type);
 
         free(target);
-        
-        targets[num_targets + existing_targets] = strdup(final_target);
+
+        if (str_table_append(targets, strdup(final_target)) != 0) {
+            return num_targets;
+        }
         num_targets++;
     }
     return num_targets;
 }
 
-static void replace_multi_inst_dep(char *src) {
+static int replace_multi_inst_dep(char *src, char *dest) {
+    /***
+    Writes a copy of a unit file whose dependencies on multi-instance
+    services are replaced by dependencies on each of their instances
+
+    The copy is written into the generator output directory, where it
+    takes precedence over the unit file under /usr/lib/systemd/system,
+    so the installed unit file is never modified. Drop-ins cannot be
+    used as they can only add dependencies, not drop the replaced ones
+
+    Returns 0 on success, -1 if the copy could not be written
+    ***/
     FILE *fp_src;
     FILE *fp_tmp;
     char buf[MAX_BUF_SIZE];
@@ -151,8 +402,7 @@ static void replace_multi_inst_dep(char *src) {
     char *save_ptr2 = NULL;
     ssize_t nread;
     bool section_done = false;
-    char tmp_file_path[PATH_MAX];
-    
+
     /* Assumes that the service files has 3 sections,
      * in the order: Unit, Service and Install.
      * Assumes that the timer file has 3 sectiosn, 
@@ -162,8 +412,17 @@ static void replace_multi_inst_dep(char *src) {
      * service.
      */
     fp_src = fopen(src, "r");
-    snprintf(tmp_file_path, PATH_MAX, "%s.tmp", src);
-    fp_tmp = fopen(tmp_file_path, "w");
+    if (fp_src == NULL) {
+        fprintf(stderr, "Failed to open file %s\n", src);
+        return -1;
+    }
+
+    fp_tmp = fopen(dest, "w");
+    if (fp_tmp == NULL) {
+        fprintf(stderr, "Failed to create file %s\n", dest);
+        fclose(fp_src);
+        return -1;
+    }
 
     while ((nread = getline(&line, &len, fp_src)) != -1 ) {
         if ((strstr(line, "[Service]") != NULL) || 
@@ -206,24 +465,28 @@ static void replace_multi_inst_dep(char *src) {
         }
     }
     fclose(fp_src);
-    fclose(fp_tmp);
     free(line);
-    /* remove the .service file, rename the .service.tmp file
-     * as .service.
-     */
-    remove(src);
-    rename(tmp_file_path, src);
+    if (fclose(fp_tmp) != 0) {
+        fprintf(stderr, "Failed to write file %s\n", dest);
+        remove(dest);
+        return -1;
+    }
+    return 0;
 }
 
-static int get_install_targets(char* unit_file, char* targets[]) {
+static int get_install_targets(char* unit_file, char* install_dir, str_table* targets) {
     /***
     Returns install targets for a unit file
 
     Parses the information in the [Install] section of a given
     unit file to determine which directories to install the unit in
+
+    On multi ASIC platforms, the unit file copy with multi-instance
+    dependencies replaced is written to install_dir and parsed instead
     ***/
     char file_path[PATH_MAX];
-    char *target_lines[MAX_NUM_INSTALL_LINES];
+    char override_path[PATH_MAX];
+    str_table target_lines = {0};
     int num_target_lines;
     int num_targets;
     int found_targets;
@@ -236,17 +499,25 @@ static int get_install_targets(char* unit_file, char* targets[]) {
 
     strcpy(file_path, UNIT_FILE_PREFIX);
     strcat(file_path, unit_file);
+    record_input(file_path);
 
     instance_name = strdup(unit_file);
     dot_ptr = strchr(instance_name, '.');
     *dot_ptr = '\0';
 
     if((num_asics > 1) && (!is_multi_instance_service(instance_name))) {
-        replace_multi_inst_dep(file_path);
+        snprintf(override_path, PATH_MAX, "%s%s", install_dir, unit_file);
+        if (replace_multi_inst_dep(file_path, override_path) == 0) {
+            char* content = read_file(override_path);
+
+            record_strings(&plan.overrides, 2, unit_file, content);
+            free(content);
+            strcpy(file_path, override_path);
+        }
     }
     free(instance_name);
 
-    num_target_lines = get_target_lines(file_path, target_lines);
+    num_target_lines = get_target_lines(file_path, &target_lines);
     if (num_target_lines < 0) {
         fprintf(stderr, "Error parsing targets for %s\n", unit_file);
         return -1;
@@ -255,7 +526,7 @@ static int get_install_targets(char* unit_file, char* targets[]) {
     num_targets = 0;
 
     for (int i = 0; i < num_target_lines; i++) {
-        line = target_lines[i];
+        line = target_lines.items[i];
         first = true;
 
         while ((token = strtok_r(line, "=", &line))) {
@@ -270,17 +541,17 @@ static int get_install_targets(char* unit_file, char* targets[]) {
                 }
             }
             else {
-                found_targets = get_install_targets_from_line(token, target_suffix, targets, num_targets);
+                found_targets = get_install_targets_from_line(token, target_suffix, targets);
                 num_targets += found_targets;
             }
         }
-        free(target_lines[i]);
     }
+    str_table_free(&target_lines);
     return num_targets;
 }
 
 
-static int get_unit_files(char* unit_files[]) {
+static int get_unit_files(str_table* unit_files) {
     /***
     Reads a list of unit files to be installed from /etc/sonic/generated_services.conf
     ***/
@@ -290,6 +561,7 @@ static int get_unit_files(char* unit_files[]) {
     ssize_t read;
     char *pos;
 
+    record_input(CONFIG_FILE);
     fp = fopen(CONFIG_FILE, "r");
 
     if (fp == NULL) {
@@ -298,23 +570,15 @@ static int get_unit_files(char* unit_files[]) {
     }
 
     int num_unit_files = 0;
-    num_multi_inst = 0;
-
-    multi_instance_services = malloc(MAX_NUM_UNITS * sizeof(char *));
 
     while ((read = getline(&line, &len, fp)) != -1) {
-        if (num_unit_files >= MAX_NUM_UNITS) {
-            fprintf(stderr, "Maximum number of units exceeded, ignoring extras\n");
-            break;
-        }
         strip_trailing_newline(line);
 
         /* Get the multi-instance services */
         pos = strchr(line, '@');
-        if (pos != NULL) {
-            multi_instance_services[num_multi_inst] = malloc(strlen(line)*sizeof(char));
-            strncpy(multi_instance_services[num_multi_inst], line, pos-line);
-            num_multi_inst++;
+        if ((pos != NULL) && (str_set_add(&multi_instance_services, line, pos - line) != 0)) {
+            fprintf(stderr, "Failed to add multi-instance service %s, ignoring extras\n", line);
+            break;
         }
 
         /* topology service to be started only for multiasic VS platform */
@@ -322,7 +586,10 @@ static int get_unit_files(char* unit_files[]) {
                         (num_asics == 1)) {
             continue;
         }
-        unit_files[num_unit_files] = strdup(line);
+        if (str_table_append(unit_files, strdup(line)) != 0) {
+            fprintf(stderr, "Failed to add unit %s, ignoring extras\n", line);
+            break;
+        }
         num_unit_files++;
     }
 
@@ -338,35 +605,30 @@ static char* insert_instance_number(char* unit_file, int instance) {
     /***
     Adds an instance number to a systemd template name
 
-    E.g. given unit_file='example@.service', instance=3,
-    returns a pointer to 'example@1.service'
+    E.g. given unit_file='example@.service', instance=13,
+    returns a pointer to 'example@13.service'
     ***/
     char* prefix;
     char* suffix;
-    char* instance_string;
     char* instance_name;
     char* temp_unit_file;
+    size_t instance_len;
 
-    instance_string = malloc(2 * sizeof(char));
-    snprintf(instance_string, 2, "%d", instance);
+    temp_unit_file = strdup(unit_file);
+    prefix = strtok(temp_unit_file, "@");
+    suffix = strtok(NULL, "@");
 
-    instance_name = malloc(strlen(unit_file) + 2);
+    instance_len = snprintf(NULL, 0, "%d", instance);
+    instance_name = malloc(strlen(prefix) + 1 + instance_len + strlen(suffix) + 1);
 
     if (instance_name == NULL) {
         fprintf(stderr, "Error creating instance %d of %s\n", instance, unit_file);
+        free(temp_unit_file);
         return NULL;
     }
 
-    temp_unit_file = strdup(unit_file);
-    prefix = strtok(temp_unit_file, "@");
-    suffix = strtok(NULL, "@");
+    sprintf(instance_name, "%s@%d%s", prefix, instance, suffix);
 
-    strcpy(instance_name, prefix);
-    strcat(instance_name, "@");
-    strcat(instance_name, instance_string);
-    strcat(instance_name, suffix);
-
-    free(instance_string);
     free(temp_unit_file);
 
     return instance_name;
@@ -397,6 +659,7 @@ static int create_symlink(char* unit, char* target, char* install_dir, int insta
     strcat(dest_path, "/");
     strcat(dest_path, unit_instance);
 
+    record_strings(&plan.links, 3, target, unit_instance, unit);
     free(unit_instance);
 
     if (stat(final_install_dir, &st) == -1) {
@@ -475,6 +738,10 @@ static int install_unit_file(char* unit_file, char* target, char* install_dir) {
                 target_instance = strdup(target);
             }
 
+            if (target_instance == NULL) {
+                continue;
+            }
+
             r = create_symlink(unit_file, target_instance, install_dir, i);
             if (r < 0) 
                 fprintf(stderr, "Error installing %s for target %s\n", unit_file, target_instance);
@@ -508,6 +775,7 @@ static int get_num_of_asic() {
     char* str_num_asic;
     int num_asic = 1;
 
+    record_input(MACHINE_CONF_FILE);
     fp = fopen(MACHINE_CONF_FILE, "r");
 
     if (fp == NULL) {
@@ -527,7 +795,8 @@ static int get_num_of_asic() {
 
     fclose(fp);
     if(platform != NULL) {
-        snprintf(asic_file, 512, "/usr/share/sonic/device/%s/asic.conf", platform);
+        snprintf(asic_file, 512, ASIC_CONF_FORMAT, platform);
+        record_input(asic_file);
         fp = fopen(asic_file, "r");
         if (fp != NULL) {
             while ((nread = getline(&line, &len, fp)) != -1) {
@@ -550,32 +819,391 @@ static int get_num_of_asic() {
 }
 
 
+static void gen_plan_free(gen_plan* p) {
+    str_table_free(&p->inputs);
+    str_table_free(&p->overrides);
+    str_table_free(&p->links);
+}
+
+
+static int compare_links(const void* a, const void* b) {
+    /***
+    Orders links by target directory, keeping the order they were
+    recorded in within a directory
+    ***/
+    char** link_a = *(char***) a;
+    char** link_b = *(char***) b;
+    int r = strcmp(link_a[0], link_b[0]);
+
+    if (r != 0) {
+        return r;
+    }
+    return (link_a > link_b) - (link_a < link_b);
+}
+
+
+static int write_cache_strings(FILE* fp, char** strings, int num_strings) {
+    for (int i = 0; i < num_strings; i++) {
+        uint32_t len = strlen(strings[i]);
+
+        if ((fwrite(&len, sizeof(len), 1, fp) != 1) || (fwrite(strings[i], 1, len, fp) != len)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static void write_cache() {
+    /***
+    Writes the plan of this run to the cache file
+
+    Links are grouped by target directory so that replaying them opens
+    every directory once. The file is written under a temporary name
+    and renamed, so a crash never leaves a truncated cache behind
+    ***/
+    FILE *fp;
+    char tmp_path[PATH_MAX];
+    char cache_dir[PATH_MAX];
+    char*** links;
+    int num_links = plan.links.count / 3;
+    uint32_t header[5] = {CACHE_MAGIC, CACHE_VERSION, plan.inputs.count, plan.overrides.count, plan.links.count};
+    int r = 0;
+
+    if (!plan.complete) {
+        return;
+    }
+
+    links = malloc((num_links ? num_links : 1) * sizeof(char **));
+    if (links == NULL) {
+        return;
+    }
+    for (int i = 0; i < num_links; i++) {
+        links[i] = &plan.links.items[3 * i];
+    }
+    qsort(links, num_links, sizeof(char **), compare_links);
+
+    strcpy(cache_dir, CACHE_FILE);
+    *strrchr(cache_dir, '/') = '\0';
+    mkdir(cache_dir, 0755);
+
+    snprintf(tmp_path, PATH_MAX, "%s.tmp", CACHE_FILE);
+    fp = fopen(tmp_path, "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Failed to create cache %s\n", tmp_path);
+        free(links);
+        return;
+    }
+
+    if ((fwrite(header, sizeof(header), 1, fp) != 1) ||
+        (write_cache_strings(fp, plan.inputs.items, plan.inputs.count) != 0) ||
+        (write_cache_strings(fp, plan.overrides.items, plan.overrides.count) != 0)) {
+        r = -1;
+    }
+    for (int i = 0; (i < num_links) && (r == 0); i++) {
+        r = write_cache_strings(fp, links[i], 3);
+    }
+    free(links);
+
+    if ((fclose(fp) != 0) || (r != 0) || (rename(tmp_path, CACHE_FILE) != 0)) {
+        fprintf(stderr, "Failed to write cache %s\n", CACHE_FILE);
+        remove(tmp_path);
+    }
+}
+
+
+static int read_cache_strings(const char* buf, size_t size, size_t* offset, str_table* table, uint32_t num_strings) {
+    for (uint32_t i = 0; i < num_strings; i++) {
+        uint32_t len;
+
+        if (size - *offset < sizeof(len)) {
+            return -1;
+        }
+        memcpy(&len, buf + *offset, sizeof(len));
+        *offset += sizeof(len);
+
+        if ((size - *offset < len) || (str_table_append(table, strndup(buf + *offset, len)) != 0)) {
+            return -1;
+        }
+        *offset += len;
+    }
+    return 0;
+}
+
+
+static int load_cache(gen_plan* cached) {
+    /***
+    Loads the plan of a previous run from the cache file
+
+    Returns 0 on success, -1 if there is no valid cache
+    ***/
+    int fd;
+    struct stat st;
+    char* buf;
+    size_t offset = 0;
+    uint32_t header[5];
+    int r = -1;
+
+    fd = open(CACHE_FILE, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+
+    if ((fstat(fd, &st) == -1) || (st.st_size < (off_t) sizeof(header))) {
+        close(fd);
+        return -1;
+    }
+
+    buf = malloc(st.st_size);
+    if ((buf != NULL) && (read(fd, buf, st.st_size) == st.st_size)) {
+        memcpy(header, buf, sizeof(header));
+        offset = sizeof(header);
+
+        if ((header[0] == CACHE_MAGIC) && (header[1] == CACHE_VERSION) &&
+            (header[2] % 2 == 0) && (header[3] % 2 == 0) && (header[4] % 3 == 0) &&
+            (read_cache_strings(buf, st.st_size, &offset, &cached->inputs, header[2]) == 0) &&
+            (read_cache_strings(buf, st.st_size, &offset, &cached->overrides, header[3]) == 0) &&
+            (read_cache_strings(buf, st.st_size, &offset, &cached->links, header[4]) == 0) &&
+            (offset == (size_t) st.st_size)) {
+            r = 0;
+        }
+    }
+    free(buf);
+    close(fd);
+
+    if (r != 0) {
+        fprintf(stderr, "Ignoring invalid cache %s\n", CACHE_FILE);
+        gen_plan_free(cached);
+    }
+    return r;
+}
+
+
+static bool is_cache_fresh(const gen_plan* cached, bool verbose) {
+    /***
+    Checks if none of the inputs of a cached plan changed since it was
+    recorded, verbose prints every changed input
+    ***/
+    bool fresh = true;
+
+    for (int i = 0; i < cached->inputs.count; i += 2) {
+        char* stamp = get_file_stamp(cached->inputs.items[i]);
+
+        if ((stamp == NULL) || (strcmp(stamp, cached->inputs.items[i + 1]) != 0)) {
+            fresh = false;
+            if (verbose) {
+                printf("Input changed: %s\n", cached->inputs.items[i]);
+            }
+        }
+        free(stamp);
+
+        if (!fresh && !verbose) {
+            break;
+        }
+    }
+    return fresh;
+}
+
+
+static int replay_plan(const gen_plan* cached, char* install_dir) {
+    /***
+    Installs the units of a cached plan without parsing any unit file
+
+    Links are created with symlinkat() against the fd of their target
+    directory, which is opened once as links are grouped by directory
+    ***/
+    int out_fd;
+    int dir_fd = -1;
+    const char* dir_name = NULL;
+    char src_path[PATH_MAX];
+    int r = 0;
+
+    out_fd = open(install_dir, O_RDONLY | O_DIRECTORY);
+    if (out_fd == -1) {
+        fprintf(stderr, "Failed to open %s\n", install_dir);
+        return -1;
+    }
+
+    for (int i = 0; (i < cached->overrides.count) && (r == 0); i += 2) {
+        const char* content = cached->overrides.items[i + 1];
+        size_t len = strlen(content);
+        int fd = openat(out_fd, cached->overrides.items[i], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if ((fd == -1) || (write(fd, content, len) != (ssize_t) len)) {
+            fprintf(stderr, "Failed to write %s%s\n", install_dir, cached->overrides.items[i]);
+            r = -1;
+        }
+        if ((fd != -1) && (close(fd) != 0)) {
+            r = -1;
+        }
+    }
+
+    for (int i = 0; (i < cached->links.count) && (r == 0); i += 3) {
+        const char* target = cached->links.items[i];
+
+        if ((dir_name == NULL) || (strcmp(dir_name, target) != 0)) {
+            if (dir_fd != -1) {
+                close(dir_fd);
+            }
+            dir_name = target;
+
+            if ((mkdirat(out_fd, target, 0755) == -1) && (errno != EEXIST)) {
+                fprintf(stderr, "Unable to create target directory %s%s\n", install_dir, target);
+                r = -1;
+                break;
+            }
+            dir_fd = openat(out_fd, target, O_RDONLY | O_DIRECTORY);
+            if (dir_fd == -1) {
+                fprintf(stderr, "Unable to open target directory %s%s\n", install_dir, target);
+                r = -1;
+                break;
+            }
+        }
+
+        snprintf(src_path, PATH_MAX, "%s%s", UNIT_FILE_PREFIX, cached->links.items[i + 2]);
+        if ((symlinkat(src_path, dir_fd, cached->links.items[i + 1]) == -1) && (errno != EEXIST)) {
+            fprintf(stderr, "Error creating symlink %s%s/%s from source %s\n",
+                    install_dir, target, cached->links.items[i + 1], src_path);
+            r = -1;
+        }
+    }
+
+    if (dir_fd != -1) {
+        close(dir_fd);
+    }
+    close(out_fd);
+
+    return r;
+}
+
+
+static int diff_plan_entries(const str_table* from, const str_table* to, int entry_size, const char* sign,
+                             const char* kind) {
+    /***
+    Prints the entries of one plan table missing from another
+
+    Entries are joined into a single string per entry and looked up
+    in a hash set of the other table. Joined strings are sized to the
+    entry, so unit contents are compared in full. Returns the number
+    of missing entries, an entry that cannot be joined counts as missing
+    ***/
+    str_set entries = {0};
+    int num_missing = 0;
+
+    for (int pass = 0; pass < 2; pass++) {
+        const str_table* table = pass == 0 ? to : from;
+
+        for (int i = 0; i + entry_size <= table->count; i += entry_size) {
+            const char* format = entry_size == 3 ? "%s/%s -> %s" : "%s\n%s";
+            const char* third = entry_size == 3 ? table->items[i + 2] : NULL;
+            int len = snprintf(NULL, 0, format, table->items[i], table->items[i + 1], third);
+            char* buf = len >= 0 ? malloc(len + 1) : NULL;
+
+            if (buf == NULL) {
+                fprintf(stderr, "Failed to compare %s %s\n", kind, table->items[i]);
+                num_missing++;
+                continue;
+            }
+            snprintf(buf, len + 1, format, table->items[i], table->items[i + 1], third);
+
+            if (pass == 0) {
+                if (str_set_add(&entries, buf, len) != 0) {
+                    num_missing++;
+                }
+            } else if (!str_set_contains(&entries, buf, len)) {
+                printf("%s %s %s\n", sign, kind, entry_size == 3 ? buf : table->items[i]);
+                num_missing++;
+            }
+            free(buf);
+        }
+    }
+
+    str_set_free(&entries);
+    return num_missing;
+}
+
+
+static int verify_cache(const gen_plan* cached) {
+    /***
+    Diffs the cached plan against the plan regenerated by this run
+
+    Lines starting with '-' are only in the cache, lines starting
+    with '+' are only in the regenerated plan
+    Returns 0 if the cache matches, 1 otherwise
+    ***/
+    int num_diffs;
+
+    if (cached == NULL) {
+        printf("No valid cache at %s\n", CACHE_FILE);
+        return 1;
+    }
+
+    if (is_cache_fresh(cached, true)) {
+        printf("Cache inputs unchanged\n");
+    }
+
+    num_diffs = diff_plan_entries(&cached->overrides, &plan.overrides, 2, "-", "unit") +
+                diff_plan_entries(&plan.overrides, &cached->overrides, 2, "+", "unit") +
+                diff_plan_entries(&cached->links, &plan.links, 3, "-", "link") +
+                diff_plan_entries(&plan.links, &cached->links, 3, "+", "link");
+
+    if (num_diffs == 0) {
+        printf("Cache matches regenerated plan\n");
+        return 0;
+    }
+    printf("Cache differs from regenerated plan in %d entries\n", num_diffs);
+    return 1;
+}
+
+
 int main(int argc, char **argv) {
-    char* unit_files[MAX_NUM_UNITS];
+    str_table unit_files = {0};
     char install_dir[PATH_MAX];
-    char* targets[MAX_NUM_TARGETS];
+    str_table targets = {0};
     char* unit_instance;
     char* prefix;
     char* suffix;
     int num_unit_files;
     int num_targets;
     int r;
+    gen_plan cached = {0};
+    bool has_cache;
+    bool verify = false;
+    char* output_dir;
 
     if (argc <= 1) {
         fputs("Installation directory required as argument\n", stderr);
         return 1;
     }
 
-    num_asics = get_num_of_asic();
+    /* --verify <dir> regenerates the plan into a scratch directory and diffs it against the cache */
+    output_dir = argv[1];
+    if (strcmp(argv[1], "--verify") == 0) {
+        if (argc <= 2) {
+            fputs("Scratch installation directory required as argument to --verify\n", stderr);
+            return 1;
+        }
+        verify = true;
+        output_dir = argv[2];
+    }
 
-    strcpy(install_dir, argv[1]);
+    strcpy(install_dir, output_dir);
     strcat(install_dir, "/");
 
-    num_unit_files = get_unit_files(unit_files);
+    has_cache = load_cache(&cached) == 0;
+    if (!verify && has_cache && is_cache_fresh(&cached, false) && (replay_plan(&cached, install_dir) == 0)) {
+        gen_plan_free(&cached);
+        return 0;
+    }
+
+    record_input(GENERATOR_BINARY);
+    num_asics = get_num_of_asic();
+
+    num_unit_files = get_unit_files(&unit_files);
 
     // For each unit file, get the installation targets and install the unit
     for (int i = 0; i < num_unit_files; i++) {
-        unit_instance = strdup(unit_files[i]);
+        unit_instance = strdup(unit_files.items[i]);
         if ((num_asics == 1) && strstr(unit_instance, "@") != NULL) {
             prefix = strtok(unit_instance, "@");
             suffix = strtok(NULL, "@");
@@ -584,29 +1212,36 @@ int main(int argc, char **argv) {
             strcat(unit_instance, suffix);
         }
 
-        num_targets = get_install_targets(unit_instance, targets);
+        num_targets = get_install_targets(unit_instance, install_dir, &targets);
         if (num_targets < 0) {
             fprintf(stderr, "Error parsing %s\n", unit_instance);
             free(unit_instance);
-            free(unit_files[i]);
             continue;
         }
 
         for (int j = 0; j < num_targets; j++) {
-            if (install_unit_file(unit_instance, targets[j], install_dir) != 0)
-                fprintf(stderr, "Error installing %s to target directory %s\n", unit_instance, targets[j]);
-
-            free(targets[j]);
+            if (install_unit_file(unit_instance, targets.items[j], install_dir) != 0)
+                fprintf(stderr, "Error installing %s to target directory %s\n", unit_instance, targets.items[j]);
         }
+        str_table_clear(&targets);
 
         free(unit_instance);
-        free(unit_files[i]);
     }
 
-    for (int i = 0; i < num_multi_inst; i++) {
-        free(multi_instance_services[i]);
+    str_table_free(&targets);
+    str_table_free(&unit_files);
+    str_set_free(&multi_instance_services);
+
+    r = 0;
+    if (verify) {
+        r = verify_cache(has_cache ? &cached : NULL);
+    }
+    else {
+        write_cache();
     }
-    free(multi_instance_services);
 
-    return 0;
+    gen_plan_free(&cached);
+    gen_plan_free(&plan);
+
+    return r;
 }